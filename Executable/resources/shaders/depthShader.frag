@@ -0,0 +1,6 @@
+#version 400 core
+
+// Depth-only pass: colour writes are off, so there is nothing to shade
+void main()
+{
+}
@@ -0,0 +1,18 @@
+#version 400 core
+
+// Depth-only pass: just the position, transformed exactly as mainShader.vert does, so that the depths the main
+// pass writes over it are the same to the bit
+uniform struct Matrices
+{
+	mat4 projMatrix;
+	mat4 modelViewMatrix;
+} matrices;
+
+layout (location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = matrices.projMatrix * matrices.modelViewMatrix * vec4(inPosition, 1.0f);
+}
@@ -35,6 +35,10 @@ layout (location = 0) in vec3 inPosition;
 layout (location = 1) in vec2 inCoord;
 layout (location = 2) in vec3 inNormal;
 
+// The layer of the texture array to sample, for textureArrayShader.frag.  Set per draw, or per instance, as a
+// vertex attribute so that it needs no uniform.
+layout (location = 5) in float inMaterialLayer;
+
 uniform float t;
 
 // Vertex colour output to fragment shader -- using Gouraud (interpolated) shading
@@ -43,6 +47,11 @@ out vec3 meshColour;
 out vec2 vTexCoord;	// Texture coordinate
 
 out vec3 worldPosition;	// used for skybox
+flat out float vMaterialLayer;
+
+// Computed the same way as in depthShader.vert, so that a depth pre-pass leaves exactly the depths drawn here.
+// Nothing drawn with this shader may change it afterwards; the skybox is put on the far plane by CSkybox::Render.
+invariant gl_Position;
 
 // This function implements the Phong shading model
 // The code is based on the OpenGL 4.0 Shading Language Cookbook, Chapter 2, pp. 62 - 63, with a few tweaks. 
@@ -82,8 +91,9 @@ void main()
 	// Apply the Phong model to compute the vertex colour
 	vColour = PhongModel(vEyePosition, vEyeNorm);
 	
-	// Pass through the texture coordinate
+	// Pass through the texture coordinate and layer
 	vTexCoord = inCoord;
+	vMaterialLayer = inMaterialLayer;
 
 
 } 
@@ -0,0 +1,152 @@
+#include "AssetManifest.h"
+#include "JobSystem.h"
+#include "StartupProfiler.h"
+
+CAssetManifest::CAssetManifest()
+{
+	m_pJobs = NULL;
+	m_pProfiler = NULL;
+}
+
+CAssetManifest::~CAssetManifest()
+{}
+
+void CAssetManifest::Add(const string &name, AssetType type, const std::function<void()> &load,
+	const std::function<void()> &upload, std::initializer_list<const char*> dependsOn)
+{
+	Asset asset;
+	asset.name = name;
+	asset.type = type;
+	asset.load = load;
+	asset.upload = upload;
+	asset.dependsOn.assign(dependsOn.begin(), dependsOn.end());
+	asset.remaining = 0;
+	m_assets.push_back(asset);
+}
+
+int CAssetManifest::GetNumAssets() const
+{
+	return (int) m_assets.size();
+}
+
+bool CAssetManifest::Load(CJobSystem *jobs, CStartupProfiler *profiler, const ProgressFunction &progress)
+{
+	m_pJobs = jobs;
+	m_pProfiler = profiler;
+	m_loaded.clear();
+
+	// Link each asset to those that depend on it
+	for (unsigned int i = 0; i < m_assets.size(); i++) {
+		m_assets[i].dependents.clear();
+		m_assets[i].remaining = (int) m_assets[i].dependsOn.size();
+	}
+	for (unsigned int i = 0; i < m_assets.size(); i++) {
+		for (unsigned int d = 0; d < m_assets[i].dependsOn.size(); d++) {
+			unsigned int j = 0;
+			while (j < m_assets.size() && m_assets[j].name != m_assets[i].dependsOn[d])
+				j++;
+			if (j == m_assets.size()) {
+				char message[1024];
+				sprintf_s(message, "Asset '%s' depends on '%s', which is not in the manifest\n", m_assets[i].name.c_str(),
+					m_assets[i].dependsOn[d].c_str());
+				MessageBox(NULL, message, "Error", MB_ICONERROR);
+				return false;
+			}
+			m_assets[j].dependents.push_back(i);
+		}
+	}
+
+	int numStarted = 0;
+	for (unsigned int i = 0; i < m_assets.size(); i++) {
+		if (m_assets[i].remaining == 0) {
+			StartLoad(i);
+			numStarted++;
+		}
+	}
+
+	int numDone = 0;
+	int numAssets = (int) m_assets.size();
+	while (numDone < numStarted) {
+		int asset = -1;
+		{
+			std::lock_guard<std::mutex> lock(m_loadedMutex);
+			if (!m_loaded.empty()) {
+				asset = m_loaded.front();
+				m_loaded.erase(m_loaded.begin());
+			}
+		}
+
+		if (asset < 0) {
+			// Help with the loads rather than sit idle; once none are waiting to start, sleep until one finishes
+			if (m_pJobs->RunPendingJob())
+				continue;
+			std::unique_lock<std::mutex> lock(m_loadedMutex);
+			m_loadedChanged.wait(lock, [this] { return !m_loaded.empty(); });
+			continue;
+		}
+
+		Asset &loaded = m_assets[asset];
+		if (loaded.upload) {
+			double start = m_pProfiler->Now();
+			loaded.upload();
+			m_pProfiler->Record("upload " + loaded.name + " (" + GetTypeName(loaded.type) + ")", start, m_pProfiler->Now());
+		}
+
+		numDone++;
+		if (progress)
+			progress(numDone, numAssets, loaded.name);
+
+		for (unsigned int i = 0; i < loaded.dependents.size(); i++) {
+			if (--m_assets[loaded.dependents[i]].remaining == 0) {
+				StartLoad(loaded.dependents[i]);
+				numStarted++;
+			}
+		}
+	}
+
+	if (numDone < numAssets) {
+		MessageBox(NULL, "The asset manifest's dependencies form a loop\n", "Error", MB_ICONERROR);
+		return false;
+	}
+	return true;
+}
+
+// Load an asset on the job system, or queue it for upload straight away if it has nothing to load
+void CAssetManifest::StartLoad(int asset)
+{
+	if (!m_assets[asset].load) {
+		std::lock_guard<std::mutex> lock(m_loadedMutex);
+		m_loaded.push_back(asset);
+		return;
+	}
+
+	m_pJobs->Run(m_pJobs->CreateJob([this, asset] {
+		Asset &toLoad = m_assets[asset];
+		double start = m_pProfiler->Now();
+		toLoad.load();
+		m_pProfiler->Record("load " + toLoad.name + " (" + GetTypeName(toLoad.type) + ")", start, m_pProfiler->Now());
+
+		// Notified under the lock: once the last asset is queued, Load may return and the manifest go at any moment
+		std::lock_guard<std::mutex> lock(m_loadedMutex);
+		m_loaded.push_back(asset);
+		m_loadedChanged.notify_one();
+	}));
+}
+
+const char *CAssetManifest::GetTypeName(AssetType type)
+{
+	switch (type) {
+	case ASSET_SHADERS:
+		return "shaders";
+	case ASSET_TEXTURE:
+		return "texture";
+	case ASSET_MESH:
+		return "mesh";
+	case ASSET_FONT:
+		return "font";
+	case ASSET_TRACK:
+		return "track";
+	default:
+		return "gameplay";
+	}
+}
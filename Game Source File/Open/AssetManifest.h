@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Common.h"
+#include <condition_variable>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+
+class CJobSystem;
+class CStartupProfiler;
+
+enum AssetType {
+	ASSET_SHADERS,
+	ASSET_TEXTURE,
+	ASSET_MESH,
+	ASSET_FONT,
+	ASSET_TRACK,
+	ASSET_GAMEPLAY,		// Objects placed in the level, built from other assets
+};
+
+// Everything the game loads before its first frame, each with the assets it needs first.  An asset loads in two
+// parts: load, which may run on any thread and must not touch OpenGL, and upload, which runs on the thread that
+// owns the context.  Load runs every asset whose dependencies have finished at once, on the job system, and uploads
+// each as its load finishes, so that reading and decoding files overlaps with the uploads and with each other.
+// Either part may be empty.  Errors are reported by the parts themselves, as they are elsewhere.
+//
+//		manifest.Add("skybox", ASSET_TEXTURE, [] { CSkybox::Prefetch(); }, [this] { m_pSkybox->Create(m_pPrimitives, 2500.0f); });
+//		manifest.Add("font", ASSET_FONT, nullptr, [=] { ... }, { "shaders" });
+//		if (!manifest.Load(m_pJobSystem, m_pStartupProfiler, progress))
+//			PostQuitMessage(1);
+class CAssetManifest
+{
+public:
+	typedef std::function<void(int numDone, int numAssets, const string &name)> ProgressFunction;
+
+	CAssetManifest();
+	~CAssetManifest();
+
+	void Add(const string &name, AssetType type, const std::function<void()> &load, const std::function<void()> &upload,
+		std::initializer_list<const char*> dependsOn = std::initializer_list<const char*>());
+	int GetNumAssets() const;
+
+	// Load every asset, on the calling thread (which must own the context) and the job system's, timing each part
+	// into the profiler.  progress, which may be empty, is called on the calling thread after each upload.  Returns
+	// false if the manifest names an asset it does not have or its dependencies form a loop.
+	bool Load(CJobSystem *jobs, CStartupProfiler *profiler, const ProgressFunction &progress);
+
+	static const char *GetTypeName(AssetType type);
+
+private:
+	struct Asset {
+		string name;
+		AssetType type;
+		std::function<void()> load;
+		std::function<void()> upload;
+		vector<string> dependsOn;
+		vector<int> dependents;
+		int remaining;		// Dependencies not yet uploaded
+	};
+
+	void StartLoad(int asset);
+
+	vector<Asset> m_assets;
+	CJobSystem *m_pJobs;
+	CStartupProfiler *m_pProfiler;
+
+	// Assets whose load has finished, waiting for the context thread to upload them
+	std::mutex m_loadedMutex;
+	std::condition_variable m_loadedChanged;
+	vector<int> m_loaded;
+};
@@ -1,4 +1,5 @@
 #include "Audio.h"
+#include "ResourcePack.h"
 
 #pragma comment(lib, "lib/fmodex_vc.lib")
 
@@ -40,7 +41,15 @@ bool CAudio::LoadEventSound(char *filename)
 	if (!m_initialised)
 		return false;
 
-	result = m_pFmodSystem->createSound(filename, FMOD_HARDWARE, 0, &m_pEventSound);
+	// FMOD takes its own copy of the file, read from where it is mapped
+	CResource file;
+	if (!file.Open(filename))
+		return false;
+	FMOD_CREATESOUNDEXINFO info;
+	memset(&info, 0, sizeof(info));
+	info.cbsize = sizeof(info);
+	info.length = file.GetSize();
+	result = m_pFmodSystem->createSound((const char*) file.GetData(), FMOD_HARDWARE | FMOD_OPENMEMORY, &info, &m_pEventSound);
 	FmodErrorCheck(result);
 	if (result != FMOD_OK) 
 		return false;
@@ -70,7 +79,14 @@ bool CAudio::LoadMusicStream(char *filename)
 	if (!m_initialised)
 		return false;
 
-	result = m_pFmodSystem->createStream(filename, FMOD_SOFTWARE | FMOD_LOOP_NORMAL, 0, &m_pMusic);
+	CResource file;
+	if (!file.Open(filename))
+		return false;
+	FMOD_CREATESOUNDEXINFO info;
+	memset(&info, 0, sizeof(info));
+	info.cbsize = sizeof(info);
+	info.length = file.GetSize();
+	result = m_pFmodSystem->createStream((const char*) file.GetData(), FMOD_SOFTWARE | FMOD_LOOP_NORMAL | FMOD_OPENMEMORY, &info, &m_pMusic);
 	FmodErrorCheck(result);
 
 	if (result != FMOD_OK) 
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Common.h"
+#include <assert.h>
+#include <new>
+#include <utility>
+
+// The interleaved vertex layout used by the template's geometry: position (attribute 0), texture coordinate
+// (attribute 1) and normal (attribute 2)
+struct VertexPTN
+{
+	glm::vec3 position;
+	glm::vec2 texCoord;
+	glm::vec3 normal;
+
+	VertexPTN() {}
+	VertexPTN(const glm::vec3 &p, const glm::vec2 &t, const glm::vec3 &n) : position(p), texCoord(t), normal(n) {}
+};
+
+// Fills the buffer object currently bound to a target with elements of type T, writing them straight into mapped
+// buffer memory.  The element count must be known up front: the storage is allocated once, in the constructor,
+// so there is no staging copy, no reallocation and no second copy at upload time.  For example:
+//
+//		vbo.Bind();
+//		CBufferBuilder<VertexPTN> vertices(GL_ARRAY_BUFFER, numVertices, GL_STATIC_DRAW);
+//		for (...)
+//			vertices.Emplace(position, texCoord, normal);
+//		vertices.Finish();
+//
+// If the driver refuses to map the buffer, the elements are gathered in system memory instead and sent with a
+// single glBufferSubData in Finish.
+template <typename T>
+class CBufferBuilder
+{
+public:
+	CBufferBuilder(GLenum target, UINT capacity, GLenum usageHint)
+	{
+		m_target = target;
+		m_capacity = capacity;
+		m_size = 0;
+		m_mapped = false;
+		m_pData = NULL;
+
+		glBufferData(target, capacity * sizeof(T), NULL, usageHint);
+		if (capacity > 0) {
+			m_pData = (T*) glMapBufferRange(target, 0, capacity * sizeof(T), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			m_mapped = m_pData != NULL;
+			if (!m_mapped) {
+				m_fallback.resize(capacity * sizeof(T));
+				m_pData = (T*) &m_fallback[0];
+			}
+		}
+	}
+
+	~CBufferBuilder()
+	{
+		Finish();
+	}
+
+	// Construct the next element in place from the given arguments
+	template <typename... Args>
+	T &Emplace(Args&&... args)
+	{
+		assert(m_size < m_capacity);
+		return *new (m_pData + m_size++) T(std::forward<Args>(args)...);
+	}
+
+	void Add(const T &element)
+	{
+		assert(m_size < m_capacity);
+		m_pData[m_size++] = element;
+	}
+
+	UINT Size() const { return m_size; }
+	UINT Capacity() const { return m_capacity; }
+
+	// Unmap the buffer (or upload the fallback copy).  The buffer must still be bound to the same target.
+	// Returns false if the driver reports that the mapped contents were lost.
+	bool Finish()
+	{
+		if (m_pData == NULL)
+			return true;
+
+		bool ok = true;
+		if (m_mapped)
+			ok = glUnmapBuffer(m_target) == GL_TRUE;
+		else
+			glBufferSubData(m_target, 0, m_size * sizeof(T), m_pData);
+
+		m_pData = NULL;
+		m_fallback.clear();
+		return ok;
+	}
+
+private:
+	CBufferBuilder(const CBufferBuilder &);
+	CBufferBuilder &operator=(const CBufferBuilder &);
+
+	GLenum m_target;
+	UINT m_capacity;
+	UINT m_size;
+	bool m_mapped;
+	T *m_pData;
+	vector<BYTE> m_fallback;
+};
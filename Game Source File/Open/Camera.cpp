@@ -1,5 +1,6 @@
 	#include "camera.h"
 #include "gamewindow.h"
+#include "MatrixStack.h"
 
 // Constructor for camera -- initialise with some default values
 CCamera::CCamera()
@@ -185,3 +186,10 @@ glm::mat3 CCamera::ComputeNormalMatrix(const glm::mat4 &modelViewMatrix)
 	return glm::transpose(glm::inverse(glm::mat3(modelViewMatrix)));
 }
 
+// As above, but uses the transform type tracked by the matrix stack so that rigid and uniformly scaled transforms 
+// (everything Game::Render draws) avoid the 3x3 inverse
+glm::mat3 CCamera::ComputeNormalMatrix(const glutil::MatrixStack &modelViewMatrixStack)
+{
+	return modelViewMatrixStack.NormalMatrix();
+}
+
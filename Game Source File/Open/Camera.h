@@ -3,6 +3,8 @@
 #include "./include/glm/gtc/type_ptr.hpp"
 #include "./include/glm/gtc/matrix_transform.hpp"
 
+namespace glutil { class MatrixStack; }
+
 class CCamera {
 public:
 	CCamera();										// Constructor - sets default values for camera position, viewvector, upvector, and speed
@@ -42,6 +44,7 @@ public:
 	void SetOrthographicProjectionMatrix(int width, int height);
 
 	glm::mat3 ComputeNormalMatrix(const glm::mat4 &modelViewMatrix);
+	glm::mat3 ComputeNormalMatrix(const glutil::MatrixStack &modelViewMatrixStack);	// Skips the inverse when the stack knows its top is rigid or uniformly scaled
 
 private:
 	glm::vec3 m_position;			// The position of the camera's centre of projection
@@ -1,13 +1,37 @@
 #include "CatmullRom.h"
+#include "BufferBuilder.h"
+#include "ResourcePack.h"
+#include "HighResolutionTimer.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
-
+#include <algorithm>
+
+// The track is drawn in chunks of about this length
+static const float TRACK_CHUNK_LENGTH = 200.0f;
+// Each chunk is halved at most this many times, which bounds the number of vertices a chunk can need
+static const int TRACK_CHUNK_MAX_DEPTH = 8;
+// Most chunks that can have geometry at once
+static const int MAX_RESIDENT_TRACK_CHUNKS = 32;
+// Size of the cells of the grid used by Project, in centreline segments, and the most cells along either side
+static const float PROJECTION_CELL_SEGMENTS = 4.0f;
+static const int MAX_PROJECTION_GRID_SIZE = 256;
+// Segments either side of the hinted one searched by Project, and the most Newton steps it takes
+static const int PROJECTION_HINT_SEGMENTS = 3;
+static const int PROJECTION_ITERATIONS = 4;
 
 
 CCatmullRom::CCatmullRom()
 {
-	m_vertexCount = 0;
 	m_w = 70.0f;
+	m_sampleSpacing = 0.0f;
+	m_trackTolerance = 0.2f;
+	m_trackChunkBuffer = 0;
+	m_trackSlotSize = 0;
+	m_trackViewDistance = 1e30f;
+	m_trackFrame = 0;
+	m_numSamples = 500;
+	m_gridCellSize = 1.0f;
+	m_gridWidth = m_gridDepth = 0;
 }
 
 CCatmullRom::~CCatmullRom()
@@ -45,8 +69,302 @@ void CCatmullRom::SetControlPoints()
 	m_controlPoints.push_back(glm::vec3(-100, 20, -700));
 	m_controlPoints.push_back(glm::vec3(400, 20, -600));
 	// Optionally, set upvectors (m_controlUpVectors, one for each control point as well)
+
+	m_numSamples = 500;
+	PickupRule rules[] = {
+		{PICKUP_SPHERE, LANE_RIGHT, 50, 50},
+		{PICKUP_CUBE, LANE_LEFT, 50, 50},
+		{PICKUP_PYRAMID, LANE_CENTRE, 50, 50},
+		{PICKUP_HEALTHPACK, LANE_CENTRE, 36, 250},
+	};
+	m_pickupRules.assign(rules, rules + sizeof(rules) / sizeof(rules[0]));
+}
+
+
+
+// Names used for pickup types and lanes in track files
+static const char *PICKUP_NAMES[] = {"sphere", "cube", "pyramid", "healthpack"};
+static const char *LANE_NAMES[] = {"left", "centre", "right"};
+
+// A compiled track file is this header followed by the arrays it counts, in the order listed, each packed tightly
+struct CompiledTrackHeader {
+	char magic[4];
+	UINT version;
+	float width;
+	UINT numControlPoints;		// Control points, then one more distance than this, then the control upvectors
+	UINT numControlUpVectors;
+	UINT numSamples;			// Centreline points, frames and curvatures, then the centreline upvectors
+	UINT numSampleUpVectors;
+	UINT numPickups;
+};
+static const char COMPILED_TRACK_MAGIC[4] = {'T', 'R', 'K', 'B'};
+static const UINT COMPILED_TRACK_VERSION = 3;
+
+template <typename T>
+static void WriteArray(FILE *fp, const vector<T> &v)
+{
+	if (!v.empty())
+		fwrite(&v[0], sizeof(T), v.size(), fp);
+}
+
+// Copy count elements out of the mapped file and move past them
+template <typename T>
+static void ReadArray(const BYTE *&pData, UINT count, vector<T> &v)
+{
+	const T *p = (const T*) pData;
+	v.assign(p, p + count);
+	pData += count * sizeof(T);
+}
+
+// True if the first file exists and was written no earlier than the second (or the second does not exist)
+static bool IsUpToDate(const string &filename, const string &source)
+{
+	WIN32_FILE_ATTRIBUTE_DATA file, sourceFile;
+	if (!GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &file))
+		return false;
+	if (!GetFileAttributesEx(source.c_str(), GetFileExInfoStandard, &sourceFile))
+		return true;
+	return CompareFileTime(&file.ftLastWriteTime, &sourceFile.ftLastWriteTime) >= 0;
+}
+
+bool CCatmullRom::LoadTrack(const string &filename)
+{
+	CHighResolutionTimer timer;
+	timer.Start();
+
+	// A compiled track in the resource pack is taken as it is: the pack is built with it up to date, and is only
+	// mounted while no loose file, the track's included, is newer than it
+	string compiledFilename = filename + ".bin";
+	UINT size, packedSize;
+	CResourcePack *pack = CResourcePack::GetMounted();
+	bool packed = pack != NULL && pack->Find(compiledFilename, size, packedSize) != NULL;
+	bool compiled = (packed || IsUpToDate(compiledFilename, filename)) && LoadCompiledTrack(compiledFilename);
+	if (!compiled) {
+		if (!ParseTrack(filename))
+			return false;
+		UniformlySampleControlPoints(m_numSamples);
+		ComputeFrames();
+		PlacePickups();
+		if (!SaveCompiledTrack(compiledFilename))
+			printf("Track: could not write %s\n", compiledFilename.c_str());
+	}
+
+	printf("Track: %s, %u centreline points, %u pickups, loaded in %.2f ms from the %s\n", filename.c_str(),
+		(unsigned int) m_centrelinePoints.size(), (unsigned int) m_pickups.size(), timer.Elapsed(), compiled ? "compiled file" : "text");
+	return true;
 }
 
+const vector<TrackPickup> &CCatmullRom::GetPickups() const
+{
+	return m_pickups;
+}
+
+void CCatmullRom::ClearTrack()
+{
+	m_controlPoints.clear();
+	m_controlUpVectors.clear();
+	m_distances.clear();
+	m_centrelinePoints.clear();
+	m_centrelineUpVectors.clear();
+	m_centrelineFrames.clear();
+	m_centrelineCurvatures.clear();
+	m_pickupRules.clear();
+	m_pickups.clear();
+	m_w = 70.0f;
+	m_numSamples = 500;
+}
+
+// Read a track definition.  Each line is one of the following, and # starts a comment:
+//		width w							Width of the track
+//		samples n						Number of centreline points to sample the spline into
+//		point x y z						A control point
+//		up x y z						An upvector for the control point of the same number; give all or none
+//		pickup type lane first every	Pickups (sphere, cube, pyramid or healthpack) on a lane (left, centre or
+//										right) at centreline point first and every so many points after
+bool CCatmullRom::ParseTrack(const string &filename)
+{
+	ClearTrack();
+
+	CResource file;
+	if (!file.Open(filename)) {
+		char message[1024];
+		sprintf_s(message, "Cannot load track\n%s\n", filename.c_str());
+		MessageBox(NULL, message, "Error", MB_ICONERROR);
+		return false;
+	}
+
+	const char *pText = (const char*) file.GetData();
+	const char *pEnd = pText + file.GetSize();
+	char line[256];
+	int lineNumber = 0;
+	bool ok = true;
+	while (ok && pText < pEnd) {
+		// Copy out the next line, as much of it as fits, so that it ends in a zero
+		const char *pLineEnd = (const char*) memchr(pText, '\n', pEnd - pText);
+		pLineEnd = pLineEnd ? pLineEnd + 1 : pEnd;
+		size_t length = min((size_t) (pLineEnd - pText), sizeof(line) - 1);
+		memcpy(line, pText, length);
+		line[length] = '\0';
+		pText = pLineEnd;
+		lineNumber++;
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		char word[32];
+		if (sscanf_s(line, "%31s", word, (unsigned) sizeof(word)) != 1)
+			continue;
+
+		glm::vec3 v;
+		if (strcmp(word, "width") == 0) {
+			ok = sscanf_s(line, "%*s %f", &m_w) == 1 && m_w > 0.0f;
+		} else if (strcmp(word, "samples") == 0) {
+			ok = sscanf_s(line, "%*s %d", &m_numSamples) == 1 && m_numSamples >= 3;
+		} else if (strcmp(word, "point") == 0) {
+			ok = sscanf_s(line, "%*s %f %f %f", &v.x, &v.y, &v.z) == 3;
+			m_controlPoints.push_back(v);
+		} else if (strcmp(word, "up") == 0) {
+			ok = sscanf_s(line, "%*s %f %f %f", &v.x, &v.y, &v.z) == 3;
+			m_controlUpVectors.push_back(v);
+		} else if (strcmp(word, "pickup") == 0) {
+			char type[32], lane[32];
+			PickupRule rule = {-1, -2, 0, 0};
+			ok = sscanf_s(line, "%*s %31s %31s %d %d", type, (unsigned) sizeof(type), lane, (unsigned) sizeof(lane), &rule.first, &rule.every) == 4;
+			for (int i = 0; ok && i < sizeof(PICKUP_NAMES) / sizeof(PICKUP_NAMES[0]); i++) {
+				if (strcmp(type, PICKUP_NAMES[i]) == 0)
+					rule.type = i;
+			}
+			for (int i = 0; ok && i < sizeof(LANE_NAMES) / sizeof(LANE_NAMES[0]); i++) {
+				if (strcmp(lane, LANE_NAMES[i]) == 0)
+					rule.lane = i - 1;
+			}
+			ok = ok && rule.type >= 0 && rule.lane >= LANE_LEFT && rule.first >= 0 && rule.every > 0;
+			m_pickupRules.push_back(rule);
+		} else {
+			ok = false;
+		}
+	}
+
+	const char *error = NULL;
+	if (!ok)
+		error = "Cannot read line";
+	else if (m_controlPoints.size() < 3)
+		error = "Too few control points in";
+	else if (!m_controlUpVectors.empty() && m_controlUpVectors.size() != m_controlPoints.size())
+		error = "Wrong number of upvectors in";
+
+	if (error) {
+		char message[1024];
+		if (!ok)
+			sprintf_s(message, "%s %d of track\n%s\n", error, lineNumber, filename.c_str());
+		else
+			sprintf_s(message, "%s track\n%s\n", error, filename.c_str());
+		MessageBox(NULL, message, "Error", MB_ICONERROR);
+		ClearTrack();
+		return false;
+	}
+	return true;
+}
+
+static bool PickupBefore(const TrackPickup &a, const TrackPickup &b)
+{
+	return a.distance < b.distance;
+}
+
+// Apply the pickup rules to the centreline
+void CCatmullRom::PlacePickups()
+{
+	m_pickups.clear();
+	int n = (int) m_centrelinePoints.size();
+	for (unsigned int r = 0; r < m_pickupRules.size(); r++) {
+		const PickupRule &rule = m_pickupRules[r];
+		for (int i = rule.first; i < n; i += rule.every) {
+			// On the lane as the ship sees it, across the track's own frame, so banked track carries its pickups
+			TrackPickup pickup;
+			glm::quat orientation;
+			pickup.type = rule.type;
+			pickup.distance = i * m_sampleSpacing;
+			SampleOffset(pickup.distance, rule.lane * m_w / 3.5f, pickup.position, orientation);
+			m_pickups.push_back(pickup);
+		}
+	}
+	stable_sort(m_pickups.begin(), m_pickups.end(), PickupBefore);
+}
+
+// Write out everything LoadCompiledTrack needs, so that loading does not have to parse or sample anything
+bool CCatmullRom::SaveCompiledTrack(const string &filename)
+{
+	FILE *fp;
+	fopen_s(&fp, filename.c_str(), "wb");
+	if (!fp)
+		return false;
+
+	CompiledTrackHeader header;
+	memcpy(header.magic, COMPILED_TRACK_MAGIC, sizeof(header.magic));
+	header.version = COMPILED_TRACK_VERSION;
+	header.width = m_w;
+	header.numControlPoints = (UINT) m_controlPoints.size();
+	header.numControlUpVectors = (UINT) m_controlUpVectors.size();
+	header.numSamples = (UINT) m_centrelinePoints.size();
+	header.numSampleUpVectors = (UINT) m_centrelineUpVectors.size();
+	header.numPickups = (UINT) m_pickups.size();
+	fwrite(&header, sizeof(header), 1, fp);
+
+	WriteArray(fp, m_controlPoints);
+	WriteArray(fp, m_distances);
+	WriteArray(fp, m_controlUpVectors);
+	WriteArray(fp, m_centrelinePoints);
+	WriteArray(fp, m_centrelineFrames);
+	WriteArray(fp, m_centrelineCurvatures);
+	WriteArray(fp, m_centrelineUpVectors);
+	WriteArray(fp, m_pickups);
+
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
+
+// Map a compiled track and copy its arrays straight into place.  Returns false if the file is missing, from a
+// different version or the wrong size, in which case the text is read instead.
+bool CCatmullRom::LoadCompiledTrack(const string &filename)
+{
+	CResource file;
+	if (!file.Open(filename) || file.GetSize() < sizeof(CompiledTrackHeader))
+		return false;
+
+	CompiledTrackHeader header;
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (memcmp(header.magic, COMPILED_TRACK_MAGIC, sizeof(header.magic)) != 0 || header.version != COMPILED_TRACK_VERSION)
+		return false;
+
+	unsigned long long expectedSize = sizeof(header)
+		+ (unsigned long long) header.numControlPoints * sizeof(glm::vec3)
+		+ ((unsigned long long) header.numControlPoints + 1) * sizeof(float)
+		+ (unsigned long long) header.numControlUpVectors * sizeof(glm::vec3)
+		+ (unsigned long long) header.numSamples * (sizeof(glm::vec3) + sizeof(glm::quat) + sizeof(float))
+		+ (unsigned long long) header.numSampleUpVectors * sizeof(glm::vec3)
+		+ (unsigned long long) header.numPickups * sizeof(TrackPickup);
+	if (file.GetSize() != expectedSize || header.numControlPoints < 3 || header.numSamples < 3) {
+		printf("Track: ignoring %s, which is damaged\n", filename.c_str());
+		return false;
+	}
+
+	ClearTrack();
+	const BYTE *pData = file.GetData() + sizeof(header);
+	m_w = header.width;
+	ReadArray(pData, header.numControlPoints, m_controlPoints);
+	ReadArray(pData, header.numControlPoints + 1, m_distances);
+	ReadArray(pData, header.numControlUpVectors, m_controlUpVectors);
+	ReadArray(pData, header.numSamples, m_centrelinePoints);
+	ReadArray(pData, header.numSamples, m_centrelineFrames);
+	ReadArray(pData, header.numSamples, m_centrelineCurvatures);
+	ReadArray(pData, header.numSampleUpVectors, m_centrelineUpVectors);
+	ReadArray(pData, header.numPickups, m_pickups);
+
+	m_numSamples = (int) header.numSamples;
+	m_sampleSpacing = m_distances[m_distances.size() - 1] / m_numSamples;
+	return true;
+}
 
 
 // Determine lengths along the control points, which is the set of control points forming the closed curve
@@ -67,6 +385,16 @@ void CCatmullRom::ComputeLengthsAlongControlPoints()
 }
 
 
+// Find the segment of the control polygon containing a length along it, or -1.  The lengths are sorted, so this is
+// a binary search, which keeps sampling tracks with many thousands of points fast.
+int CCatmullRom::FindSegment(float fLength)
+{
+	int j = (int) (upper_bound(m_distances.begin(), m_distances.end(), fLength) - m_distances.begin()) - 1;
+	if (j < 0 || j >= (int) m_distances.size() - 1)
+		return -1;
+	return j;
+}
+
 // Return the point (and upvector, if control upvectors provided) based on a distance d along the control polygon
 bool CCatmullRom::Sample(float d, glm::vec3 &p, glm::vec3 &up)
 {
@@ -84,13 +412,7 @@ bool CCatmullRom::Sample(float d, glm::vec3 &p, glm::vec3 &up)
 	float fLength = d - (int) (d / fTotalLength) * fTotalLength;
 
 	// Find the current segment
-	int j = -1;
-	for (int i = 0; i < (int)m_distances.size(); i++) {
-		if (fLength >= m_distances[i] && fLength < m_distances[i + 1]) {
-			j = i; // found it!
-			break;
-		}
-	}
+	int j = FindSegment(fLength);
 
 	if (j == -1)
 		return false;
@@ -113,54 +435,377 @@ bool CCatmullRom::Sample(float d, glm::vec3 &p, glm::vec3 &up)
 	return true;
 }
 
-bool CCatmullRom::SampleSides(float d, glm::vec3 &p, vector<glm::vec3> &pointVec,glm::vec3 &up)
+// Build a rotation-minimising frame at every centreline point using the double reflection method (Wang et al., 2008).
+// Each frame is carried to the next point by reflecting it in the plane bisecting the chord between them, then in
+// the plane that brings the tangents into line; unlike building frames from a fixed world up, this never twists
+// needlessly and works on vertical sections.  The twist left over on closing the loop is spread evenly around it.
+// Where upvectors were supplied, the up direction is taken from them instead, which gives banking.
+void CCatmullRom::ComputeFrames()
 {
-	if (d < 0)
+	int n = (int) m_centrelinePoints.size();
+	m_centrelineFrames.clear();
+	m_centrelineCurvatures.clear();
+	if (n < 3)
+		return;
+
+	m_sampleSpacing = m_distances[m_distances.size() - 1] / n;
+
+	// Tangents and curvatures by central differences around the closed curve
+	vector<glm::vec3> tangents(n);
+	for (int i = 0; i < n; i++)
+		tangents[i] = glm::normalize(m_centrelinePoints[(i + 1) % n] - m_centrelinePoints[(i - 1 + n) % n]);
+	for (int i = 0; i < n; i++) {
+		float chord = glm::distance(m_centrelinePoints[(i + 1) % n], m_centrelinePoints[(i - 1 + n) % n]);
+		float turn = glm::length(tangents[(i + 1) % n] - tangents[(i - 1 + n) % n]);
+		m_centrelineCurvatures.push_back(chord > 0.0f ? turn / chord : 0.0f);
+	}
+
+	// Start with world up, made perpendicular to the first tangent
+	glm::vec3 r = glm::vec3(0, 1, 0) - tangents[0].y * tangents[0];
+	if (glm::length(r) < 1e-3f)
+		r = glm::vec3(1, 0, 0) - tangents[0].x * tangents[0];
+	r = glm::normalize(r);
+
+	// Propagate all the way round, including back to the first point
+	vector<glm::vec3> ups(n + 1);
+	ups[0] = r;
+	for (int i = 0; i < n; i++) {
+		glm::vec3 v1 = m_centrelinePoints[(i + 1) % n] - m_centrelinePoints[i];
+		float c1 = glm::dot(v1, v1);
+		if (c1 < 1e-12f) {
+			ups[i + 1] = ups[i];
+			continue;
+		}
+		glm::vec3 rL = ups[i] - (2.0f / c1) * glm::dot(v1, ups[i]) * v1;
+		glm::vec3 tL = tangents[i] - (2.0f / c1) * glm::dot(v1, tangents[i]) * v1;
+		glm::vec3 v2 = tangents[(i + 1) % n] - tL;
+		float c2 = glm::dot(v2, v2);
+		ups[i + 1] = c2 < 1e-12f ? rL : rL - (2.0f / c2) * glm::dot(v2, rL) * v2;
+	}
+
+	// Angle, about the first tangent, from where the frame ended up after the loop to where it started
+	float twist = atan2(glm::dot(glm::cross(ups[n], ups[0]), tangents[0]), glm::dot(ups[n], ups[0]));
+
+	bool useUpVectors = m_centrelineUpVectors.size() == m_centrelinePoints.size();
+	for (int i = 0; i < n; i++) {
+		glm::vec3 t = tangents[i];
+		glm::vec3 up = glm::rotate(ups[i], glm::degrees(twist * i / n), t);
+		if (useUpVectors) {
+			glm::vec3 banked = m_centrelineUpVectors[i] - glm::dot(m_centrelineUpVectors[i], t) * t;
+			if (glm::length(banked) > 1e-3f)
+				up = banked;
+		}
+		up = glm::normalize(up - glm::dot(up, t) * t);
+		glm::vec3 side = glm::cross(t, up);
+		glm::quat q = glm::quat_cast(glm::mat3(t, up, side));
+		if (i > 0 && glm::dot(q, m_centrelineFrames[i - 1]) < 0.0f)
+			q = -q;		// Keep neighbours in the same hemisphere so interpolation takes the short way round
+		m_centrelineFrames.push_back(q);
+	}
+}
+
+// Spherical interpolation along the shorter arc.  glm's quaternion mix does neither the sign check nor the
+// fallback for nearly equal rotations, where dividing by sin(angle) is unstable.
+glm::quat CCatmullRom::Slerp(const glm::quat &a, const glm::quat &b, float t)
+{
+	glm::quat c = b;
+	float cosAngle = glm::dot(a, b);
+	if (cosAngle < 0.0f) {
+		c = -b;
+		cosAngle = -cosAngle;
+	}
+
+	if (cosAngle > 0.9995f)
+		return glm::normalize(a * (1.0f - t) + c * t);
+
+	float angle = acos(cosAngle);
+	return (a * (sin((1.0f - t) * angle)) + c * sin(t * angle)) * (1.0f / sin(angle));
+}
+
+// Find the centreline point at or before distance d, and how far it is (from 0 to 1) towards the next one
+bool CCatmullRom::FindSample(float d, int &i, float &t)
+{
+	if (d < 0 || m_centrelineFrames.empty())
 		return false;
 
-	int M = (int)pointVec.size();
-	if (M == 0)
+	float fTotalLength = m_distances[m_distances.size() - 1];
+	float fLength = d - (int) (d / fTotalLength) * fTotalLength;
+
+	float s = fLength / m_sampleSpacing;
+	i = (int) s;
+	t = s - i;
+	i %= (int) m_centrelineFrames.size();
+	return true;
+}
+
+bool CCatmullRom::SampleFrame(float d, glm::vec3 &p, glm::quat &orientation)
+{
+	int i;
+	float t;
+	if (!FindSample(d, i, t))
 		return false;
 
+	int n = (int) m_centrelinePoints.size();
+	int iPrev = (i - 1 + n) % n;
+	int iNext = (i + 1) % n;
+	int iNextNext = (i + 2) % n;
 
+	p = Interpolate(m_centrelinePoints[iPrev], m_centrelinePoints[i], m_centrelinePoints[iNext], m_centrelinePoints[iNextNext], t);
+	orientation = Slerp(m_centrelineFrames[i], m_centrelineFrames[iNext], t);
+	return true;
+}
+
+bool CCatmullRom::SampleOffset(float d, float offset, glm::vec3 &p, glm::quat &orientation)
+{
+	if (!SampleFrame(d, p, orientation))
+		return false;
+	p += offset * (orientation * glm::vec3(0, 0, 1));
+	return true;
+}
+
+bool CCatmullRom::SampleOffsets(const float *d, const float *offsets, int count, glm::vec3 *p, glm::quat *orientations) const
+{
+	if (m_centrelineFrames.empty())
+		return false;
+
+	// The same as SampleOffset, with the lookups that are the same for every point taken out of the loop
+	int n = (int) m_centrelinePoints.size();
 	float fTotalLength = m_distances[m_distances.size() - 1];
+	float fInverseSpacing = 1.0f / m_sampleSpacing;
+	const glm::vec3 *points = &m_centrelinePoints[0];
+	const glm::quat *frames = &m_centrelineFrames[0];
+	for (int k = 0; k < count; k++) {
+		float fLength = d[k] - (int) (d[k] / fTotalLength) * fTotalLength;
+		float s = fLength * fInverseSpacing;
+		int i = (int) s;
+		float t = s - i;
+		i %= n;
+		int iNext = i + 1 < n ? i + 1 : 0;
+
+		// Catmull-Rom interpolation between samples i and i + 1, as in Interpolate
+		const glm::vec3 &p0 = points[i > 0 ? i - 1 : n - 1];
+		const glm::vec3 &p1 = points[i];
+		const glm::vec3 &p2 = points[iNext];
+		const glm::vec3 &p3 = points[iNext + 1 < n ? iNext + 1 : 0];
+		glm::vec3 b = 0.5f * (p2 - p0);
+		glm::vec3 c = 0.5f * (2.0f*p0 - 5.0f*p1 + 4.0f*p2 - p3);
+		glm::vec3 e = 0.5f * (-p0 + 3.0f*p1 - 3.0f*p2 + p3);
+
+		orientations[k] = Slerp(frames[i], frames[iNext], t);
+		p[k] = p1 + t * (b + t * (c + t * e)) + offsets[k] * (orientations[k] * glm::vec3(0, 0, 1));
+	}
+	return true;
+}
 
-	// The the current length along the control polygon; handle the case where we've looped around the track
-	float fLength = d - (int)(d / fTotalLength) * fTotalLength;
+float CCatmullRom::SampleCurvature(float d)
+{
+	int i;
+	float t;
+	if (!FindSample(d, i, t))
+		return 0.0f;
 
-	// Find the current segment
-	int j = -1;
-	for (int i = 0; i < (int)m_distances.size(); i++) {
-		if (fLength >= m_distances[i] && fLength < m_distances[i + 1]) {
-			j = i; // found it!
+	int iNext = (i + 1) % (int) m_centrelineCurvatures.size();
+	return m_centrelineCurvatures[i] + t * (m_centrelineCurvatures[iNext] - m_centrelineCurvatures[i]);
+}
+
+// Catmull-Rom interpolation as in Interpolate, along with the first and second derivatives with respect to t
+static void InterpolateWithDerivatives(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, float t,
+	glm::vec3 &p, glm::vec3 &dp, glm::vec3 &ddp)
+{
+	glm::vec3 b = 0.5f * (-p0 + p2);
+	glm::vec3 c = 0.5f * (2.0f*p0 - 5.0f*p1 + 4.0f*p2 - p3);
+	glm::vec3 d = 0.5f * (-p0 + 3.0f*p1 - 3.0f*p2 + p3);
+
+	p = p1 + t * (b + t * (c + t * d));
+	dp = b + t * (2.0f * c + 3.0f * t * d);
+	ddp = 2.0f * c + 6.0f * t * d;
+}
+
+// Bin each centreline segment into every grid cell its bounding box overlaps.  Cells are a few segments across,
+// so a query only has to look at a handful of segments.
+void CCatmullRom::BuildProjectionGrid()
+{
+	int n = (int) m_centrelinePoints.size();
+	m_gridCellStart.clear();
+	m_gridSegments.clear();
+	m_gridWidth = m_gridDepth = 0;
+	if (n < 3)
+		return;
+
+	glm::vec2 boundsMin(m_centrelinePoints[0].x, m_centrelinePoints[0].z), boundsMax = boundsMin;
+	for (int i = 1; i < n; i++) {
+		boundsMin = glm::min(boundsMin, glm::vec2(m_centrelinePoints[i].x, m_centrelinePoints[i].z));
+		boundsMax = glm::max(boundsMax, glm::vec2(m_centrelinePoints[i].x, m_centrelinePoints[i].z));
+	}
+	glm::vec2 size = boundsMax - boundsMin;
+	m_gridCellSize = max(PROJECTION_CELL_SEGMENTS * m_sampleSpacing, max(size.x, size.y) / MAX_PROJECTION_GRID_SIZE);
+	if (m_gridCellSize <= 0.0f)
+		m_gridCellSize = 1.0f;
+	m_gridOrigin = boundsMin;
+	m_gridWidth = (int) (size.x / m_gridCellSize) + 1;
+	m_gridDepth = (int) (size.y / m_gridCellSize) + 1;
+	int numCells = m_gridWidth * m_gridDepth;
+
+	// Count the segments in each cell, turn the counts into the end of each cell's run, then place the segments
+	// while counting each cell back down to its start
+	vector<int> cellStart(numCells + 1, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < n; i++) {
+			const glm::vec3 &a = m_centrelinePoints[i];
+			const glm::vec3 &b = m_centrelinePoints[(i + 1) % n];
+			int x0 = (int) ((min(a.x, b.x) - m_gridOrigin.x) / m_gridCellSize);
+			int x1 = (int) ((max(a.x, b.x) - m_gridOrigin.x) / m_gridCellSize);
+			int z0 = (int) ((min(a.z, b.z) - m_gridOrigin.y) / m_gridCellSize);
+			int z1 = (int) ((max(a.z, b.z) - m_gridOrigin.y) / m_gridCellSize);
+			for (int z = z0; z <= z1; z++) {
+				for (int x = x0; x <= x1; x++) {
+					int cell = z * m_gridWidth + x;
+					if (pass == 0)
+						cellStart[cell]++;
+					else
+						m_gridSegments[--cellStart[cell]] = i;
+				}
+			}
+		}
+
+		if (pass == 0) {
+			for (int c = 1; c < numCells; c++)
+				cellStart[c] += cellStart[c - 1];
+			m_gridSegments.resize(cellStart[numCells - 1]);
+		}
+	}
+	cellStart[numCells] = (int) m_gridSegments.size();
+	m_gridCellStart.swap(cellStart);
+}
+
+// The nearest of count consecutive segments, starting at first, to a position, as the segment, how far along it
+// (from 0 to 1) the nearest point is, and the squared distance to it
+float CCatmullRom::NearestSegment(const glm::vec3 &position, int first, int count, int &segment, float &t) const
+{
+	int n = (int) m_centrelinePoints.size();
+	float best = 1e30f;
+	for (int k = 0; k < count; k++) {
+		int i = ((first + k) % n + n) % n;
+		const glm::vec3 &a = m_centrelinePoints[i];
+		glm::vec3 ab = m_centrelinePoints[(i + 1) % n] - a;
+		float length2 = glm::dot(ab, ab);
+		float u = length2 > 0.0f ? glm::clamp(glm::dot(position - a, ab) / length2, 0.0f, 1.0f) : 0.0f;
+		glm::vec3 offset = a + u * ab - position;
+		float distance2 = glm::dot(offset, offset);
+		if (distance2 < best) {
+			best = distance2;
+			segment = i;
+			t = u;
+		}
+	}
+	return best;
+}
+
+// Newton's method on the derivative of the squared distance to the spline, moving on to the neighbouring segment
+// if the nearest point lies beyond either end of this one
+void CCatmullRom::RefineProjection(const glm::vec3 &position, int segment, float t, TrackProjection &result) const
+{
+	int n = (int) m_centrelinePoints.size();
+	glm::vec3 p, dp, ddp;
+	for (int iteration = 0; ; iteration++) {
+		const glm::vec3 &p0 = m_centrelinePoints[(segment - 1 + n) % n];
+		const glm::vec3 &p1 = m_centrelinePoints[segment];
+		const glm::vec3 &p2 = m_centrelinePoints[(segment + 1) % n];
+		const glm::vec3 &p3 = m_centrelinePoints[(segment + 2) % n];
+		InterpolateWithDerivatives(p0, p1, p2, p3, t, p, dp, ddp);
+		if (iteration == PROJECTION_ITERATIONS)
+			break;
+
+		glm::vec3 offset = p - position;
+		float slope = glm::dot(dp, dp) + glm::dot(offset, ddp);
+		if (slope <= 0.0f)
 			break;
+		float step = glm::dot(offset, dp) / slope;
+		if (fabs(step) < 1e-4f)
+			break;
+		t -= step;
+		if (t < 0.0f) {
+			segment = (segment - 1 + n) % n;
+			t = glm::clamp(t + 1.0f, 0.0f, 1.0f);
+		} else if (t > 1.0f) {
+			segment = (segment + 1) % n;
+			t = glm::clamp(t - 1.0f, 0.0f, 1.0f);
 		}
 	}
 
-	if (j == -1)
+	result.distance = (segment + t) * m_sampleSpacing;
+	result.point = p;
+	result.orientation = Slerp(m_centrelineFrames[segment], m_centrelineFrames[(segment + 1) % n], t);
+	glm::vec3 offset = position - p;
+	result.lateral = glm::dot(offset, result.orientation * glm::vec3(0, 0, 1));
+	result.height = glm::dot(offset, result.orientation * glm::vec3(0, 1, 0));
+}
+
+bool CCatmullRom::Project(const glm::vec3 &position, TrackProjection &result, float hint) const
+{
+	int n = (int) m_centrelinePoints.size();
+	if (m_gridWidth == 0 || (int) m_centrelineFrames.size() != n)
 		return false;
 
-	// Interpolate on current segment -- get t
-	float fSegmentLength = m_distances[j + 1] - m_distances[j];
-	float t = (fLength - m_distances[j]) / fSegmentLength;
+	int segment = 0;
+	float t = 0.0f;
+
+	// Near the hint, take the nearest segment unless it is at the edge of the window searched, which means the
+	// position has moved further than the window covers
+	if (hint >= 0.0f) {
+		float fTotalLength = m_distances[m_distances.size() - 1];
+		int hinted = (int) ((hint - (int) (hint / fTotalLength) * fTotalLength) / m_sampleSpacing);
+		int first = hinted - PROJECTION_HINT_SEGMENTS;
+		NearestSegment(position, first, 2 * PROJECTION_HINT_SEGMENTS + 1, segment, t);
+		int firstSegment = (first % n + n) % n;
+		int lastSegment = (hinted + PROJECTION_HINT_SEGMENTS) % n;
+		if ((segment != firstSegment || t > 0.0f) && (segment != lastSegment || t < 1.0f)) {
+			RefineProjection(position, segment, t, result);
+			return true;
+		}
+	}
 
-	// Get the indices of the four points along the control polygon for the current segment
-	int iPrev = ((j - 1) + M) % M;
-	int iCur = j;
-	int iNext = (j + 1) % M;
-	int iNextNext = (j + 2) % M;
+	// Search rings of cells outwards from the one holding the position, until no cell further out can hold a
+	// segment nearer than the nearest found so far
+	glm::vec2 local = glm::vec2(position.x, position.z) - m_gridOrigin;
+	int cx = glm::clamp((int) floor(local.x / m_gridCellSize), 0, m_gridWidth - 1);
+	int cz = glm::clamp((int) floor(local.y / m_gridCellSize), 0, m_gridDepth - 1);
+	float best = 1e30f;
+	int maxRing = max(m_gridWidth, m_gridDepth);
+	for (int ring = 0; ring <= maxRing; ring++) {
+		for (int z = max(cz - ring, 0); z <= min(cz + ring, m_gridDepth - 1); z++) {
+			// Inside the ring only the cells at either end of the row are new
+			bool wholeRow = z == cz - ring || z == cz + ring;
+			for (int x = cx - ring; x <= cx + ring; x += wholeRow ? 1 : 2 * ring) {
+				if (x < 0 || x >= m_gridWidth)
+					continue;
+				int cell = z * m_gridWidth + x;
+				for (int k = m_gridCellStart[cell]; k < m_gridCellStart[cell + 1]; k++) {
+					int candidate;
+					float u;
+					float distance2 = NearestSegment(position, m_gridSegments[k], 1, candidate, u);
+					if (distance2 < best) {
+						best = distance2;
+						segment = candidate;
+						t = u;
+					}
+				}
+			}
+		}
 
-	// Interpolate to get the point (and upvector)
-	p = Interpolate(pointVec[iPrev], pointVec[iCur], pointVec[iNext], pointVec[iNextNext], t);
-	if (m_controlUpVectors.size() == pointVec.size())
-		up = glm::normalize(Interpolate(m_controlUpVectors[iPrev], m_controlUpVectors[iCur], m_controlUpVectors[iNext], m_controlUpVectors[iNextNext], t));
+		// Everything outside this ring is at least this far away horizontally
+		float reach = min(min(local.x - (cx - ring) * m_gridCellSize, (cx + ring + 1) * m_gridCellSize - local.x),
+			min(local.y - (cz - ring) * m_gridCellSize, (cz + ring + 1) * m_gridCellSize - local.y));
+		if (best <= reach * reach && reach > 0.0f)
+			break;
+	}
 
+	RefineProjection(position, segment, t, result);
 	return true;
 }
 
 
 
-
 // Sample a set of control points using an open Catmull-Rom spline, to produce a set of iNumSamples that are (roughly) equally spaced
 void CCatmullRom::UniformlySampleControlPoints(int numSamples)
 {
@@ -207,10 +852,17 @@ void CCatmullRom::UniformlySampleControlPoints(int numSamples)
 void CCatmullRom::CreateCentreline()
 {
 	
-	// Call Set Control Points
-	SetControlPoints();
-	// Call UniformlySampleControlPoints with the number of samples required
-	UniformlySampleControlPoints(500);
+	// Use the built-in track unless one has been loaded
+	if (m_centrelinePoints.empty()) {
+		// Call Set Control Points
+		SetControlPoints();
+		// Call UniformlySampleControlPoints with the number of samples required
+		UniformlySampleControlPoints(m_numSamples);
+		// Precompute the orientation of the track at each sample
+		ComputeFrames();
+		PlacePickups();
+	}
+	BuildProjectionGrid();
 	// Create a VAO called m_vaoCentreline and a VBO to get the points onto the graphics card
 	CVertexBufferObject vbo;
 	vbo.Create();
@@ -219,13 +871,10 @@ void CCatmullRom::CreateCentreline()
 	glBindVertexArray(m_vaoCentreline);
 	glm::vec2 textCoord(0.0f, 0.0f);
 	glm::vec3 normal(0.0f, 1.0f, 0.0f);
-	for (unsigned int i = 0; i < m_centrelinePoints.size(); i++) {
-		glm::vec3 points = glm::vec3(m_centrelinePoints.at(i));
-		vbo.AddData(&points, sizeof(glm::vec3));
-		vbo.AddData(&textCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
-	}
-	vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	CBufferBuilder<VertexPTN> vertices(GL_ARRAY_BUFFER, m_centrelinePoints.size(), GL_STATIC_DRAW);
+	for (unsigned int i = 0; i < m_centrelinePoints.size(); i++)
+		vertices.Emplace(m_centrelinePoints[i], textCoord, normal);
+	vertices.Finish();
 	// Set the vertex attribute locations
 	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
 	// Vertex positions
@@ -240,172 +889,98 @@ void CCatmullRom::CreateCentreline()
 		+ sizeof(glm::vec2)));
 }
 
-void CCatmullRom::CreateOffsetCurves()
+void CCatmullRom::SetTrackTolerance(float tolerance)
 {
-	// Compute the offset curves, one left, and one right.  Store the points in m_leftOffsetPoints and m_rightOffsetPoints respectively
-    glm::vec3 l = glm::vec3(0.0f, 0.0f, 0.0f);
-    glm::vec3 r = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 p = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 pNext = glm::vec3(0.0f, 0.0f, 0.0f);
-	for (int i = 0; i < m_centrelinePoints.size(); i++) {
-		p = m_centrelinePoints.at(i);
-       int pIndex = (i + 1) % m_centrelinePoints.size();
-
-		pNext = m_centrelinePoints.at(pIndex);
-
-		glm::vec3 T = glm::normalize(pNext-p);
-		glm::vec3 N = glm::normalize(glm::cross(T, glm::vec3(0, 1, 0)));
-		glm::vec3 B = glm::normalize(glm::cross(N, T));
-
-		l = p - (m_w / 2)*N;
-		r = p + (m_w / 2)*N;
+	m_trackTolerance = tolerance;
+}
 
-		m_leftOffsetPoints.push_back(l);
-		m_rightOffsetPoints.push_back(r);
-	}
-	// Generate two VAOs called m_vaoLeftOffsetCurve and m_vaoRightOffsetCurve, each with a VBO, and get the offset curve points on the graphics card
+// The centre and both edges of the track a distance d along the control curve
+void CCatmullRom::SampleEdges(float d, glm::vec3 &left, glm::vec3 &centre, glm::vec3 &right)
+{
+	glm::quat orientation;
+	SampleFrame(d, centre, orientation);
+	glm::vec3 N = orientation * glm::vec3(0, 0, 1);
+	left = centre - (m_w / 2)*N;
+	right = centre + (m_w / 2)*N;
+}
 
-	CVertexBufferObject vbo;
-	vbo.Create();
-	vbo.Bind();
-	glm::vec2 textCoord(0.0f, 0.0f);
-	glm::vec3 normal(0.0f, 1.0f, 0.0f);
-	glGenVertexArrays(1, &m_vaoLeftOffsetCurve);
-	glBindVertexArray(m_vaoLeftOffsetCurve);
-	for (int i = 0; i < m_leftOffsetPoints.size(); i++) {
-		glm::vec3 lPoints = glm::vec3(m_leftOffsetPoints.at(i));
-		vbo.AddData(&lPoints, sizeof(glm::vec3));
-		vbo.AddData(&textCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
+// How far the straight edges of a piece of track from d0 to d1 would be from the curve, checked at numChecks points
+// evenly spaced between them.  The edges are checked as well as the centre since, on the outside of a bend, they
+// stray further.
+float CCatmullRom::ChordError(float d0, float d1, int numChecks)
+{
+	glm::vec3 l0, c0, r0, l1, c1, r1, l, c, r;
+	SampleEdges(d0, l0, c0, r0);
+	SampleEdges(d1, l1, c1, r1);
+
+	float error = 0.0f;
+	for (int k = 1; k <= numChecks; k++) {
+		float t = k / (float) (numChecks + 1);
+		SampleEdges(d0 + t * (d1 - d0), l, c, r);
+		error = max(error, glm::distance(c, c0 + t * (c1 - c0)));
+		error = max(error, glm::distance(l, l0 + t * (l1 - l0)));
+		error = max(error, glm::distance(r, r0 + t * (r1 - r0)));
 	}
+	return error;
+}
 
-	vbo.UploadDataToGPU(GL_STATIC_DRAW);
-	// Set the vertex attribute locations
-	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)
-		+ sizeof(glm::vec2)));
-
-
-	CVertexBufferObject sVbo;
-	sVbo.Create();
-	sVbo.Bind();
-	glGenVertexArrays(1, &m_vaoRightOffsetCurve);
-	glBindVertexArray(m_vaoRightOffsetCurve);
-	for (int i = 0; i < m_rightOffsetPoints.size(); i++) {
-		glm::vec3 rPoints = glm::vec3(m_rightOffsetPoints.at(i));
-		sVbo.AddData(&rPoints, sizeof(glm::vec3));
-		sVbo.AddData(&textCoord, sizeof(glm::vec2));
-		sVbo.AddData(&normal, sizeof(glm::vec3));
-
+// Split the piece of track from d0 to d1 in half until it is straight enough.  Since the chord error of a curve
+// grows with its curvature times the square of the length, straights end up with long pieces and bends short ones.
+void CCatmullRom::SubdivideTrack(float d0, float d1, float tolerance, int depth, int maxDepth, vector<float> &distances)
+{
+	if (depth < maxDepth && ChordError(d0, d1, 3) > tolerance) {
+		float mid = 0.5f * (d0 + d1);
+		SubdivideTrack(d0, mid, tolerance, depth + 1, maxDepth, distances);
+		SubdivideTrack(mid, d1, tolerance, depth + 1, maxDepth, distances);
+	} else {
+		distances.push_back(d0);
 	}
-
-	sVbo.UploadDataToGPU(GL_STATIC_DRAW);
-	
-	// Set the vertex attribute locations
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)
-		+ sizeof(glm::vec2)));
-
-	// Note it is possible to only use one VAO / VBO with all the points instead.
-
 }
-//vertices used to spawn objects between centreline and the two offset curves.
-void CCatmullRom::CreateOjectPath() {
-	glm::vec3 l = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 r = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 p = glm::vec3(0.0f, 0.0f, 0.0f);
-	glm::vec3 pNext = glm::vec3(0.0f, 0.0f, 0.0f);
-	for (int i = 0; i < m_centrelinePoints.size(); i++) {
-		p = m_centrelinePoints.at(i);
-		int pIndex = (i + 1) % m_centrelinePoints.size();
-
-		pNext = m_centrelinePoints.at(pIndex);
-
-		glm::vec3 T = glm::normalize(pNext - p);
-		glm::vec3 N = glm::normalize(glm::cross(T, glm::vec3(0, 1, 0)));
-		glm::vec3 B = glm::normalize(glm::cross(N, T));
 
-		l = p - (m_w / 3.5f)*N;
-		r = p + (m_w / 3.5f)*N;
-
-		m_leftObjectPoints.push_back(l);
-		m_rightObjectPoints.push_back(r);
-	}
-	// Generate two VAOs called m_vaoLeftOffsetCurve and m_vaoRightOffsetCurve, each with a VBO, and get the offset curve points on the graphics card
+// Choose the distances at which to sample the track geometry so that it is never more than tolerance from the spline.
+// The closed curve is first cut into a few even pieces so that no feature can hide inside a single piece.
+void CCatmullRom::AdaptivelySampleTrack(float tolerance, vector<float> &distances)
+{
+	distances.clear();
+	float fTotalLength = m_distances[m_distances.size() - 1];
+	const int numPieces = 32;
+	for (int i = 0; i < numPieces; i++)
+		SubdivideTrack(i * fTotalLength / numPieces, (i + 1) * fTotalLength / numPieces, tolerance, 0, 12, distances);
+}
 
-	CVertexBufferObject vbo;
-	vbo.Create();
-	vbo.Bind();
-	glm::vec2 textCoord(0.0f, 0.0f);
-	glm::vec3 normal(0.0f, 1.0f, 0.0f);
-	glGenVertexArrays(1, &m_vaoLeftOffsetCurve);
-	glBindVertexArray(m_vaoLeftObjectCurve);
-	for (int i = 0; i < m_leftObjectPoints.size(); i++) {
-		glm::vec3 lPoints = glm::vec3(m_leftObjectPoints.at(i));
-		vbo.AddData(&lPoints, sizeof(glm::vec3));
-		vbo.AddData(&textCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
+// Measure the largest distance between the track geometry and the spline more densely than the sampler does
+float CCatmullRom::MaxTrackDeviation(const vector<float> &distances)
+{
+	float fTotalLength = m_distances[m_distances.size() - 1];
+	float error = 0.0f;
+	for (unsigned int i = 0; i < distances.size(); i++) {
+		float next = i + 1 < distances.size() ? distances[i + 1] : fTotalLength;
+		error = max(error, ChordError(distances[i], next, 15));
 	}
+	return error;
+}
 
-	vbo.UploadDataToGPU(GL_STATIC_DRAW);
-	// Set the vertex attribute locations
-	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)
-		+ sizeof(glm::vec2)));
-
-	CVertexBufferObject sVbo;
-	sVbo.Create();
-	sVbo.Bind();
-	glGenVertexArrays(1, &m_vaoRightObjectCurve);
-	glBindVertexArray(m_vaoRightObjectCurve);
-	for (int i = 0; i < m_rightObjectPoints.size(); i++) {
-		glm::vec3 rPoints = glm::vec3(m_rightObjectPoints.at(i));
-		sVbo.AddData(&rPoints, sizeof(glm::vec3));
-		sVbo.AddData(&textCoord, sizeof(glm::vec2));
-		sVbo.AddData(&normal, sizeof(glm::vec3));
-
+// The uniform sampling the track used to have is reported too, for comparison
+void CCatmullRom::ReportTrackSampling()
+{
+	vector<float> distances;
+	float fTotalLength = m_distances[m_distances.size() - 1];
+	for (unsigned int i = 0; i < m_centrelinePoints.size(); i++)
+		distances.push_back(i * fTotalLength / m_centrelinePoints.size());
+	printf("Track sampling: uniform, %u vertices, max deviation %.4f\n", 2 * (unsigned int) distances.size() + 2, MaxTrackDeviation(distances));
+
+	const float tolerances[] = {0.5f, 0.2f, 0.1f, 0.05f, 0.02f, 0.01f};
+	for (int i = 0; i < sizeof(tolerances) / sizeof(tolerances[0]); i++) {
+		AdaptivelySampleTrack(tolerances[i], distances);
+		printf("Track sampling: tolerance %.3f, %u vertices, max deviation %.4f%s\n", tolerances[i],
+			2 * (unsigned int) distances.size() + 2, MaxTrackDeviation(distances), tolerances[i] == m_trackTolerance ? " (in use)" : "");
 	}
-	sVbo.UploadDataToGPU(GL_STATIC_DRAW);
-	// Set the vertex attribute locations
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)
-		+ sizeof(glm::vec2)));
 }
 
-
 void CCatmullRom::CreateTrack(string filename)
 {
-	// Generate a VAO called m_vaoTrack and a VBO to get the offset curve points and indices on the graphics card
+	// Divide the track into chunks and generate a VAO called m_vaoTrack with a VBO big enough for the chunks that can
+	// be resident at once.  The chunks' geometry is only generated once they come into view, in RenderTrack.
 
 	
 	m_texture.Load(filename);
@@ -414,49 +989,31 @@ void CCatmullRom::CreateTrack(string filename)
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
-	CVertexBufferObject vbo;
-	vbo.Bind();
-	vbo.Create();
-	glGenVertexArrays(1, &m_vaoTrack);
-	glBindVertexArray(m_vaoTrack);
-	
-	glm::vec2 textCoord(0.0f, 0.0f);
-	
-	glm::vec3 normal(0.0f, 1.0f, 0.0f);
-	
-	int i = 0;
-	//add the offsets of the path
-	for (i ; i < m_centrelinePoints.size(); i++) {
-		glm::vec3 lPoints = glm::vec3(m_leftOffsetPoints.at(i));
-		vbo.AddData(&lPoints, sizeof(glm::vec3));
-		textCoord = glm::vec2(0,i);
-		vbo.AddData(&textCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
-		m_vertexCount += 1;
-		glm::vec3 rPoints = glm::vec3(m_rightOffsetPoints.at(i));
-		vbo.AddData(&rPoints, sizeof(glm::vec3));
-		textCoord = glm::vec2(1, i);
-		vbo.AddData(&textCoord, sizeof(glm::vec2));
-		vbo.AddData(&normal, sizeof(glm::vec3));
-		m_vertexCount += 1;
+
+	float fTotalLength = m_distances[m_distances.size() - 1];
+	int numChunks = max(1, (int) (fTotalLength / TRACK_CHUNK_LENGTH + 0.5f));
+	m_trackChunks.resize(numChunks);
+	for (int i = 0; i < numChunks; i++) {
+		TrackChunk &chunk = m_trackChunks[i];
+		chunk.startDistance = i * fTotalLength / numChunks;
+		chunk.length = fTotalLength / numChunks;
+		chunk.slot = -1;
+		chunk.numVertices = 0;
+		chunk.lastDrawn = 0;
+		ComputeChunkBounds(chunk);
 	}
 
-	//add the first two points to close the path.
-	vbo.AddData(&m_leftOffsetPoints.at(0), sizeof(glm::vec3));
-	textCoord = glm::vec2(0, i);
-	vbo.AddData(&textCoord, sizeof(glm::vec2));
-	vbo.AddData(&normal, sizeof(glm::vec3));
-	m_vertexCount += 1;
-	vbo.AddData(&m_rightOffsetPoints.at(0), sizeof(glm::vec3));
-	textCoord = glm::vec2(1, i);
-	vbo.AddData(&textCoord, sizeof(glm::vec2));
-	vbo.AddData(&normal, sizeof(glm::vec3));
-	m_vertexCount += 1;
-	
+	// A chunk has at most 2^TRACK_CHUNK_MAX_DEPTH pieces, so one more pair of vertices than that
+	int numSlots = min(numChunks, MAX_RESIDENT_TRACK_CHUNKS);
+	m_trackSlotSize = 2 * ((1 << TRACK_CHUNK_MAX_DEPTH) + 1);
+	m_trackSlotOwners.assign(numSlots, -1);
 
-	
+	glGenVertexArrays(1, &m_vaoTrack);
+	glBindVertexArray(m_vaoTrack);
+	glGenBuffers(1, &m_trackChunkBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_trackChunkBuffer);
+	glBufferData(GL_ARRAY_BUFFER, numSlots * m_trackSlotSize * sizeof(VertexPTN), NULL, GL_DYNAMIC_DRAW);
 
-	vbo.UploadDataToGPU(GL_STATIC_DRAW);
 	// Set the vertex attribute locations
 	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
 	// Vertex positions
@@ -470,8 +1027,89 @@ void CCatmullRom::CreateTrack(string filename)
 	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)
 		+ sizeof(glm::vec2)));
 
-    
+	printf("Track: %d chunks of length %.1f, %d resident at most\n", numChunks, fTotalLength / numChunks, numSlots);
+}
 
+void CCatmullRom::SetTrackViewDistance(float distance)
+{
+	m_trackViewDistance = distance;
+}
+
+// Bound both edges of the chunk.  They are sampled more finely than the centreline table, and the box is grown by
+// half the longest step between samples to cover the curve between them.
+void CCatmullRom::ComputeChunkBounds(TrackChunk &chunk)
+{
+	int numSteps = max(1, (int) ceil(4.0f * chunk.length / m_sampleSpacing));
+	glm::vec3 l, p, r, lPrev, rPrev;
+	float step = 0.0f;
+	for (int i = 0; i <= numSteps; i++) {
+		SampleEdges(chunk.startDistance + chunk.length * i / numSteps, l, p, r);
+		if (i == 0) {
+			chunk.boundsMin = glm::min(l, r);
+			chunk.boundsMax = glm::max(l, r);
+		} else {
+			chunk.boundsMin = glm::min(chunk.boundsMin, glm::min(l, r));
+			chunk.boundsMax = glm::max(chunk.boundsMax, glm::max(l, r));
+			step = max(step, max(glm::distance(l, lPrev), glm::distance(r, rPrev)));
+		}
+		lPrev = l;
+		rPrev = r;
+	}
+	chunk.boundsMin -= glm::vec3(0.5f * step);
+	chunk.boundsMax += glm::vec3(0.5f * step);
+}
+
+// Use a slot that is free or, failing that, the one drawn longest ago.  A slot drawn from this frame is never
+// taken, so -1 is returned if every slot is in use.
+int CCatmullRom::FindTrackSlot()
+{
+	int best = -1;
+	unsigned int oldest = m_trackFrame;
+	for (unsigned int i = 0; i < m_trackSlotOwners.size(); i++) {
+		if (m_trackSlotOwners[i] < 0)
+			return i;
+		unsigned int lastDrawn = m_trackChunks[m_trackSlotOwners[i]].lastDrawn;
+		if (lastDrawn < oldest) {
+			oldest = lastDrawn;
+			best = i;
+		}
+	}
+	return best;
+}
+
+// Sample the chunk adaptively, more densely on bends than on straights, and write it into a slot as a strip
+bool CCatmullRom::GenerateTrackChunk(int index)
+{
+	int slot = FindTrackSlot();
+	if (slot < 0)
+		return false;
+	if (m_trackSlotOwners[slot] >= 0)
+		m_trackChunks[m_trackSlotOwners[slot]].slot = -1;
+	m_trackSlotOwners[slot] = index;
+
+	TrackChunk &chunk = m_trackChunks[index];
+	chunk.slot = slot;
+
+	float end = chunk.startDistance + chunk.length;
+	m_chunkDistances.clear();
+	SubdivideTrack(chunk.startDistance, end, m_trackTolerance, 0, TRACK_CHUNK_MAX_DEPTH, m_chunkDistances);
+	m_chunkDistances.push_back(end);
+
+	// The texture repeats once per centreline point's worth of distance, whatever the spacing of the geometry
+	glm::vec3 normal(0.0f, 1.0f, 0.0f);
+	glm::vec3 l, p, r;
+	m_chunkVertices.clear();
+	for (unsigned int i = 0; i < m_chunkDistances.size(); i++) {
+		SampleEdges(m_chunkDistances[i], l, p, r);
+		float v = m_chunkDistances[i] / m_sampleSpacing;
+		m_chunkVertices.push_back(VertexPTN(l, glm::vec2(0, v), normal));
+		m_chunkVertices.push_back(VertexPTN(r, glm::vec2(1, v), normal));
+	}
+	chunk.numVertices = (int) m_chunkVertices.size();
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_trackChunkBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, slot * m_trackSlotSize * sizeof(VertexPTN), m_chunkVertices.size() * sizeof(VertexPTN), &m_chunkVertices[0]);
+	return true;
 }
 
 
@@ -486,61 +1124,50 @@ void CCatmullRom::RenderCentreline()
 
 }
 
-void CCatmullRom::RenderOffsetCurves()
+void CCatmullRom::RenderTrack(const CFrustum &frustum)
 {
-	// Bind the VAO m_vaoLeftOffsetCurve and render it
-	glBindVertexArray(m_vaoLeftOffsetCurve);
-	//glDrawArrays(GL_LINE_STRIP, 0, m_leftOffsetPoints.size());
-	glDrawArrays(GL_POINTS, 0, m_leftOffsetPoints.size());
-	// Bind the VAO m_vaoRightOffsetCurve and render it
-	glBindVertexArray(m_vaoRightOffsetCurve);
-	//glDrawArrays(GL_LINE_STRIP, 0, m_rightOffsetPoints.size());
-	glDrawArrays(GL_POINTS, 0, m_rightOffsetPoints.size());
+	// Gather the chunks in view, generating any that have no geometry yet, and draw them all with one call
+	m_trackFrame++;
+	m_chunkFirsts.clear();
+	m_chunkCounts.clear();
+	for (unsigned int i = 0; i < m_trackChunks.size(); i++) {
+		TrackChunk &chunk = m_trackChunks[i];
+		if (!frustum.IsBoxVisible(chunk.boundsMin, chunk.boundsMax, m_trackViewDistance))
+			continue;
+		if (chunk.slot < 0 && !GenerateTrackChunk(i))
+			continue;
+		chunk.lastDrawn = m_trackFrame;
+		m_chunkFirsts.push_back(chunk.slot * m_trackSlotSize);
+		m_chunkCounts.push_back(chunk.numVertices);
+	}
+	RedrawTrack();
 }
 
-void CCatmullRom::RenderTrack()
+void CCatmullRom::RedrawTrack()
 {
+	if (m_chunkFirsts.empty())
+		return;
+
 	// Bind the VAO m_vaoTrack and render it
  //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	m_texture.Bind();
 	glBindVertexArray(m_vaoTrack);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, m_leftOffsetPoints.size()+m_rightOffsetPoints.size()+2);
+	glMultiDrawArrays(GL_TRIANGLE_STRIP, &m_chunkFirsts[0], &m_chunkCounts[0], (GLsizei) m_chunkFirsts.size());
  //glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	
 }
 
-void CCatmullRom::RenderObjectPath()
-{
-	// Bind the VAO m_vaoLeftObjectCurve and render it
-	glBindVertexArray(m_vaoLeftObjectCurve);
-	//glDrawArrays(GL_LINE_STRIP, 0, m_leftOffsetPoints.size());
-//	glDrawArrays(GL_POINTS, 0, m_leftObjectPoints.size());
-	// Bind the VAO m_vaoRightOffObjectCurve and render it
-	glBindVertexArray(m_vaoRightObjectCurve);
-	//glDrawArrays(GL_LINE_STRIP, 0, m_rightOffsetPoints.size());
-	//glDrawArrays(GL_POINTS, 0, m_rightObjectPoints.size());
-
-
-
-}
-
-int CCatmullRom::CurrentLap(float d)
+int CCatmullRom::CurrentLap(double d)
 {
 	return (int)(d / m_distances.back());
 }
 
-//Some get methods
-vector<glm::vec3> CCatmullRom::GetLeftObjectPoints() 
+float CCatmullRom::GetWidth() const
 {
-	return m_leftObjectPoints;
+	return m_w;
 }
 
-vector<glm::vec3> CCatmullRom::GetCentrelinePoints()
+float CCatmullRom::GetLapLength() const
 {
-	return m_centrelinePoints;
+	return m_distances.back();
 }
-
-vector<glm::vec3> CCatmullRom::GetRightObjectPoints()
-{
-	return m_rightObjectPoints;
-}
\ No newline at end of file
@@ -3,8 +3,32 @@
 #include "vertexBufferObject.h"
 #include "vertexBufferObjectIndexed.h"
 #include "Texture.h"
+#include "Frustum.h"
+#include "BufferBuilder.h"
+#include "./include/glm/gtc/quaternion.hpp"
 
 
+// Kinds of pickup a track can place
+enum PickupType { PICKUP_SPHERE, PICKUP_CUBE, PICKUP_PYRAMID, PICKUP_HEALTHPACK };
+
+// Paths alongside the centreline that objects can be placed on
+enum TrackLane { LANE_LEFT = -1, LANE_CENTRE = 0, LANE_RIGHT = 1 };
+
+// A pickup placed by a track: what it is and where
+struct TrackPickup {
+	int type;
+	glm::vec3 position;
+	float distance;				// Distance along the control curve, within one lap
+};
+
+// Where a point in the world is relative to the track, as found by CCatmullRom::Project
+struct TrackProjection {
+	float distance;				// Distance along the control curve of the nearest centreline point, within one lap
+	float lateral;				// How far the point is to the right of the centreline (negative to the left)
+	float height;				// How far the point is above the track surface
+	glm::vec3 point;			// The nearest centreline point
+	glm::quat orientation;		// Frame there, as returned by SampleFrame
+};
 
 class CCatmullRom
 {
@@ -12,50 +36,132 @@ public:
 	CCatmullRom();
 	~CCatmullRom();
 
+	// Load a track definition; see resources\tracks\default.track for the format.  A compiled copy is written next to
+	// it, with ".bin" appended, and is mapped instead of reading the text whenever it is the newer of the two.
+	// CreateCentreline builds the original built-in loop unless a track has been loaded.
+	bool LoadTrack(const string &filename);
+	const vector<TrackPickup> &GetPickups() const;		// In order of distance along the track
+
 	void CreateCentreline();
 	void RenderCentreline();
 
-	void CreateOffsetCurves();
-	void RenderOffsetCurves();
-	vector<glm::vec3> GetLeftObjectPoints();
-	vector<glm::vec3> GetCentrelinePoints();
-	vector<glm::vec3> GetRightObjectPoints();
+	void SetTrackTolerance(float tolerance);	// Largest distance the track geometry may stray from the spline; call before CreateTrack
+	// Print the number of track vertices against the deviation from the spline for a range of tolerances.  This
+	// samples the whole track several times over, so is for "-tracksampling" only.
+	void ReportTrackSampling();
 	void CreateTrack(string filename);
-	void RenderTrack();
-	void RenderObjectPath();
-	void CreateOjectPath();
-	int CurrentLap(float d); // Return the currvent lap (starting from 0) based on distance along the control curve.
+	void RenderTrack(const CFrustum &frustum);	// Draws the chunks of track inside the frustum and within the view distance
+	void RedrawTrack();							// Draws the chunks the last RenderTrack did again, for a second pass
+	void SetTrackViewDistance(float distance);
+	int CurrentLap(double d); // Return the currvent lap (starting from 0) based on distance along the control curve.
 
 	bool Sample(float d, glm::vec3 &p, glm::vec3 &up = glm::vec3(0, 0, 0)); // Return a point on the centreline based on a certain distance along the control curve.
-	bool SampleSides(float d, glm::vec3 &p, vector<glm::vec3> &pointVec, glm::vec3 &up = glm::vec3(0, 0, 0));
+
+	// Return the centreline point and frame a distance d along the control curve, from the table built by CreateCentreline.
+	// The orientation takes x to the tangent, y to the up vector and z to the right-hand side.  Constant time.
+	bool SampleFrame(float d, glm::vec3 &p, glm::quat &orientation);
+	// The point offset to the right (or, if negative, the left) of the centreline along the frame's side vector, and
+	// the frame there.  Any number of lanes or ships can follow the track this way without storing a curve for each.
+	bool SampleOffset(float d, float offset, glm::vec3 &p, glm::quat &orientation);
+	// SampleOffset for count points at once, for the many ships racing along the track.  Distances must not be
+	// negative.  Returns false, writing nothing, if there is no centreline yet.
+	bool SampleOffsets(const float *d, const float *offsets, int count, glm::vec3 *p, glm::quat *orientations) const;
+	float GetWidth() const;
+	float GetLapLength() const;
+	float SampleCurvature(float d);	// Curvature (1 / radius) of the centreline a distance d along the control curve
+
+	// Spherical interpolation along the shorter arc, which is safe for nearly equal rotations
+	static glm::quat Slerp(const glm::quat &a, const glm::quat &b, float t);
+
+	// Find the nearest point of the centreline to a position.  With a hint, such as the distance found for the same
+	// object last frame, only the centreline near it is searched unless the position has moved too far; without
+	// one, a grid over the centreline built by CreateCentreline narrows the search.  Either way a few Newton steps
+	// then find the nearest point on the curve itself.
+	bool Project(const glm::vec3 &position, TrackProjection &result, float hint = -1.0f) const;
 private:
 
 	void SetControlPoints();
+
+	// Places pickups of one type every few centreline points along one lane
+	struct PickupRule {
+		int type;
+		int lane;
+		int first;		// Centreline point of the first pickup
+		int every;		// Number of centreline points from one pickup to the next
+	};
+	void ClearTrack();
+	bool ParseTrack(const string &filename);
+	bool LoadCompiledTrack(const string &filename);
+	bool SaveCompiledTrack(const string &filename);
+	void PlacePickups();
+	int FindSegment(float fLength);
 	
 	void ComputeLengthsAlongControlPoints();
 	void UniformlySampleControlPoints(int numSamples);
+	void ComputeFrames();
+	bool FindSample(float d, int &i, float &t);
+	void SampleEdges(float d, glm::vec3 &left, glm::vec3 &centre, glm::vec3 &right);
+	float ChordError(float d0, float d1, int numChecks);
+	void SubdivideTrack(float d0, float d1, float tolerance, int depth, int maxDepth, vector<float> &distances);
+	void AdaptivelySampleTrack(float tolerance, vector<float> &distances);
+	float MaxTrackDeviation(const vector<float> &distances);
+
+	// A fixed length of track.  Its geometry is generated from the spline the first time it comes into view and kept
+	// in one of the slots of m_trackChunkBuffer until that slot is needed for another chunk, so the memory used for
+	// the track does not grow with its length.
+	struct TrackChunk {
+		float startDistance;		// Distance from the start of the lap to the start of the chunk
+		float length;
+		glm::vec3 boundsMin, boundsMax;
+		int slot;					// Slot holding the chunk's vertices, or -1 if it has not been generated
+		int numVertices;
+		unsigned int lastDrawn;		// Frame on which the chunk was last drawn, used to pick a slot to reuse
+	};
+	void ComputeChunkBounds(TrackChunk &chunk);
+	bool GenerateTrackChunk(int index);
+	int FindTrackSlot();
 	glm::vec3 Interpolate(glm::vec3 &p0, glm::vec3 &p1, glm::vec3 &p2, glm::vec3 &p3, float t);
+
+	void BuildProjectionGrid();
+	float NearestSegment(const glm::vec3 &position, int first, int count, int &segment, float &t) const;
+	void RefineProjection(const glm::vec3 &position, int segment, float t, TrackProjection &result) const;
 	float m_currentDistance;
 	float m_w;
 	vector<float> m_distances;
 	CTexture m_texture;
 
 	GLuint m_vaoCentreline;
-	GLuint m_vaoLeftOffsetCurve;
-	GLuint m_vaoRightOffsetCurve;
-	GLuint m_vaoLeftObjectCurve;
-	GLuint m_vaoRightObjectCurve;
 	GLuint m_vaoTrack;
 
 	vector<glm::vec3> m_controlPoints;		// Control points, which are interpolated to produce the centreline points
 	vector<glm::vec3> m_controlUpVectors;	// Control upvectors, which are interpolated to produce the centreline upvectors
 	vector<glm::vec3> m_centrelinePoints;	// Centreline points
 	vector<glm::vec3> m_centrelineUpVectors;// Centreline upvectors
+	vector<glm::quat> m_centrelineFrames;	// Rotation-minimising frame at each centreline point
+	vector<float> m_centrelineCurvatures;	// Curvature at each centreline point
+	float m_sampleSpacing;					// Distance along the control curve between consecutive centreline points
+
+	float m_trackTolerance;
+	int m_numSamples;						// Number of centreline points to sample the control points into
+	vector<PickupRule> m_pickupRules;
+	vector<TrackPickup> m_pickups;
 
-	vector<glm::vec3> m_leftOffsetPoints;	// Left offset curve points
-	vector<glm::vec3> m_rightOffsetPoints;	// Right offset curve points
-	vector<glm::vec3> m_leftObjectPoints;  //Left object points
-	vector<glm::vec3> m_rightObjectPoints; //right object points
+	vector<TrackChunk> m_trackChunks;
+	vector<int> m_trackSlotOwners;			// Chunk held in each slot, or -1
+	GLuint m_trackChunkBuffer;				// All the slots, one after another
+	int m_trackSlotSize;					// Number of vertices in a slot
+	float m_trackViewDistance;
+	unsigned int m_trackFrame;
+	vector<float> m_chunkDistances;			// Scratch space for generating chunks and gathering draws, kept to avoid
+	vector<VertexPTN> m_chunkVertices;		// allocating every time
+	vector<GLint> m_chunkFirsts;
+	vector<GLsizei> m_chunkCounts;
 
-	unsigned int m_vertexCount;				// Number of vertices in the track VBO
+	// Uniform grid over x and z of the segments between consecutive centreline points, used by Project.  The
+	// segments overlapping each cell are stored one cell after another in m_gridSegments.
+	glm::vec2 m_gridOrigin;
+	float m_gridCellSize;
+	int m_gridWidth, m_gridDepth;
+	vector<int> m_gridCellStart;			// Where each cell's segments start in m_gridSegments, plus one past the end
+	vector<int> m_gridSegments;
 };
@@ -1,111 +1,117 @@
 #include "Cube.h"
-CCube::CCube()
-{}
-CCube::~CCube()
-{
-	Release();
-}
-void CCube::Create(string filename)
-{
-	m_texture.Load(filename);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER,
-		GL_LINEAR_MIPMAP_LINEAR);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
-	m_vbo.Create();
-	m_vbo.Bind();
-	glm::vec3 cube[24]{ 
-		//front face
-		glm::vec3(-1, -1, 1),
-		glm::vec3(1, -1, 1),
-		glm::vec3(-1, 1, 1),
-		glm::vec3(1, 1, 1),
-		//right face
-		glm::vec3(1,-1,1),
-		glm::vec3(1,-1,-1),
-		glm::vec3(1,1,1),
-		glm::vec3(1,1,-1),
-		//back face
-		glm::vec3(1,-1,-1),
-		glm::vec3(-1,-1,-1),
-		glm::vec3(1,1,-1),
-		glm::vec3(-1,1,-1),
-
-		//left face
-		glm::vec3(-1,-1,-1),
-		glm::vec3(-1,-1,1),
-		glm::vec3(-1,1,-1),
-		glm::vec3(-1,1,1),
-		//top face
-		glm::vec3(-1,1,1),
-		glm::vec3(1,1,1),
-		glm::vec3(-1,1,-1),
-		glm::vec3(1,1,-1),
-		//bottom face
-		glm::vec3(-1,-1,1),
-		glm::vec3(1,-1,1),
-		glm::vec3(-1,-1,-1),
-		glm::vec3(1,-1,-1),
-	};
 
+// Each face is a triangle strip of four corners, sharing the face's normal
+static const glm::vec3 cube[24]{ 
+	//front face
+	glm::vec3(-1, -1, 1),
+	glm::vec3(1, -1, 1),
+	glm::vec3(-1, 1, 1),
+	glm::vec3(1, 1, 1),
+	//right face
+	glm::vec3(1,-1,1),
+	glm::vec3(1,-1,-1),
+	glm::vec3(1,1,1),
+	glm::vec3(1,1,-1),
+	//back face
+	glm::vec3(1,-1,-1),
+	glm::vec3(-1,-1,-1),
+	glm::vec3(1,1,-1),
+	glm::vec3(-1,1,-1),
 
-	glm::vec2 textCoords[4]{
-		glm::vec2(0.0f, 1.0f), glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 1.0f), glm::vec2(1.0f, 0.0f)
-	};
+	//left face
+	glm::vec3(-1,-1,-1),
+	glm::vec3(-1,-1,1),
+	glm::vec3(-1,1,-1),
+	glm::vec3(-1,1,1),
+	//top face
+	glm::vec3(-1,1,1),
+	glm::vec3(1,1,1),
+	glm::vec3(-1,1,-1),
+	glm::vec3(1,1,-1),
+	//bottom face
+	glm::vec3(-1,-1,1),
+	glm::vec3(1,-1,1),
+	glm::vec3(-1,-1,-1),
+	glm::vec3(1,-1,-1),
+};
 
-	glm::vec3 normal[6]{
-		glm::vec3(0.0f, 0.0f, -1.0f),
-		glm::vec3(0.0f, 0.0f, 1.0f),
-		glm::vec3(1.0f, 0.0f, 0.0f),
-		glm::vec3(-1.0f, 0.0f, 0.0f),
-		glm::vec3(0.0f, -1.0f, 0.0f),
-		glm::vec3(0.0f, 1.0f, 0.0f)	
 
-	};
+static const glm::vec2 textCoords[4]{
+	glm::vec2(0.0f, 1.0f), glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 1.0f), glm::vec2(1.0f, 0.0f)
+};
 
+static const glm::vec3 normal[6]{
+	glm::vec3(0.0f, 0.0f, -1.0f),
+	glm::vec3(0.0f, 0.0f, 1.0f),
+	glm::vec3(1.0f, 0.0f, 0.0f),
+	glm::vec3(-1.0f, 0.0f, 0.0f),
+	glm::vec3(0.0f, -1.0f, 0.0f),
+	glm::vec3(0.0f, 1.0f, 0.0f)	
 
+};
 
-
-
-	// Write the code to add interleaved vertex attributes to the VBO
-	for (int i = 0; i < 24; i++) {
-		m_vbo.AddData(&cube[i], sizeof(glm::vec3));
-		m_vbo.AddData(&textCoords[i%4], sizeof(glm::vec2));
-		m_vbo.AddData(&normal[i/4], sizeof(glm::vec3));
+CCube::CCube()
+{
+	m_pPrimitives = NULL;
+	m_primitive = -1;
+}
+CCube::~CCube()
+{
+	Release();
+}
+void CCube::Create(CPrimitiveArena *primitives, string filename)
+{
+	// An empty filename leaves the cube untextured, for a caller that binds its own
+	if (!filename.empty()) {
+		m_texture.Load(filename);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER,
+			GL_LINEAR_MIPMAP_LINEAR);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
 	}
-		
 
-	// Upload data to GPU
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
-	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride,
-		(void*)(sizeof(glm::vec3) + sizeof(glm::vec2)));
+	// All six faces as one indexed triangle list
+	vector<VertexPTN> vertices;
+	vector<unsigned int> indices;
+	GetTriangles(vertices, indices);
+	m_pPrimitives = primitives;
+	m_primitive = primitives->Add(vertices, indices);
 }
 void CCube::Render()
 {
-	glBindVertexArray(m_vao);
-	// Call glDrawArrays to render each side
+	Bind();
+	Draw();
+}
 
-	m_texture.Bind();
-	for (int i = 0; i < 6; i++) {
-		glDrawArrays(GL_TRIANGLE_STRIP, i * 4, 4);
+void CCube::Bind()
+{
+	m_pPrimitives->Bind();
+	if (m_texture.IsCreated())
+		m_texture.Bind();
+}
+
+void CCube::Draw()
+{
+	m_pPrimitives->Draw(m_primitive);
+}
+
+// Each face's strip as two triangles, wound the same way
+void CCube::GetTriangles(vector<VertexPTN> &vertices, vector<unsigned int> &indices)
+{
+	vertices.clear();
+	indices.clear();
+	for (int i = 0; i < 24; i++)
+		vertices.push_back(VertexPTN(cube[i], textCoords[i%4], normal[i/4]));
+	for (unsigned int face = 0; face < 6; face++) {
+		unsigned int strip[6] = { 0, 1, 2, 2, 1, 3 };
+		for (int j = 0; j < 6; j++)
+			indices.push_back(face * 4 + strip[j]);
 	}
 }
+
 void CCube::Release()
 {
 	m_texture.Release();
-	glDeleteVertexArrays(1, &m_vao);
-	m_vbo.Release();
 }
 
@@ -1,19 +1,24 @@
 #pragma once
 #include "Common.h"
 #include "Texture.h"
-#include "VertexBufferObject.h"
-// Class for generating a unit cube
+#include "PrimitiveArena.h"
+// Class for generating a unit cube, drawn from the shared primitive arena
 class CCube
 {
 public:
 	CCube();
 	~CCube();
-	void Create(string filename);
+	void Create(CPrimitiveArena *primitives, string filename);	// Adds the cube to primitives, which must then be created
 	void Render();
+	void Bind();		// Render split in two, so that several cubes in a row need only bind once.  Binds the texture too, if it has one.
+	void Draw();
 	void Release();
+	float GetBoundingRadius() const { return 1.7320508f; }	// Half the diagonal of the 2x2x2 cube
+	int GetPrimitive() const { return m_primitive; }		// In the arena given to Create
+	static void GetTriangles(vector<VertexPTN> &vertices, vector<unsigned int> &indices);	// As one triangle list
 private:
-	GLuint m_vao;
-	CVertexBufferObject m_vbo;
+	CPrimitiveArena *m_pPrimitives;
+	int m_primitive;
 	CTexture m_texture;
 
 };
\ No newline at end of file
@@ -9,19 +9,7 @@
 
 bool CCubemap::LoadTexture(string filename, BYTE **bmpBytes, int &iWidth, int &iHeight)
 {
-	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
-	FIBITMAP* dib(0);
-
-	fif = FreeImage_GetFileType(filename.c_str(), 0); // Check the file signature and deduce its format
-
-	if(fif == FIF_UNKNOWN) // If still unknown, try to guess the file format from the file extension
-		fif = FreeImage_GetFIFFromFilename(filename.c_str());
-	
-	if(fif == FIF_UNKNOWN) // If still unknown, return failure
-		return false;
-
-	if(FreeImage_FIFSupportsReading(fif)) // Check if the plugin has reading capabilities and load the file
-		dib = FreeImage_Load(fif, filename.c_str());
+	FIBITMAP* dib = CTexture::Decode(filename);	// Prefetched, or decoded now from the resource pack or loose file
 
 	if(!dib) {
 		char message[1024];
@@ -0,0 +1,470 @@
+#include "EndlessTrack.h"
+#include "FrameArena.h"
+
+#include <math.h>
+
+// Shape of the generated track
+static const float CONTROL_POINT_SPACING = 250.0f;
+static const float MAX_TURN = 50.0f;			// Degrees the heading can change by from one control point to the next
+static const float WANDER_RADIUS = 700.0f;		// Beyond this distance from the origin the track is steered back
+static const float MIN_HEIGHT = 20.0f;
+static const float MAX_HEIGHT = 100.0f;
+static const float MAX_CLIMB = 25.0f;			// Largest change in height from one control point to the next
+static const float TRACK_WIDTH = 70.0f;
+static const float UP_CORRECTION = 0.02f;		// How far each frame leans back towards world up
+
+// Sampling and baking
+static const float SAMPLE_SPACING = 10.0f;		// About the same as the built-in loop's centreline points
+static const int MAX_PIECE_SAMPLES = 64;		// Most samples a piece can be split into, which sizes the buffer slots
+static const int ARC_LENGTH_STEPS = 64;			// Steps used to measure the length of a segment
+
+// How much track is kept
+static const double LOOKAHEAD = 2500.0;			// Further than the track view distance
+static const double KEEP_BEHIND = 300.0;
+static const int MAX_PIECES = 32;
+static const int MAX_ADOPTED_PER_FRAME = 2;
+static const float VIEW_DISTANCE = 2000.0f;		// As the built-in track's
+
+// Pickups: spheres, cubes and pyramids side by side every PICKUP_SPACING, and health packs less often
+static const double PICKUP_SPACING = 500.0;
+static const double HEALTH_PACK_SPACING = 2500.0;
+static const double FIRST_HEALTH_PACK = 360.0;
+
+static const float LAP_LENGTH = 5000.0f;
+
+
+CEndlessTrack::CEndlessTrack()
+{
+	m_vao = 0;
+	m_buffer = 0;
+	m_slotSize = 0;
+	m_version = 0;
+	m_generatedDistance = 0.0;
+	m_nextPickup = PICKUP_SPACING;
+	m_nextHealthPack = FIRST_HEALTH_PACK;
+	m_firstPiece = true;
+	m_requestedDistance = 0.0;
+	m_queuedDistance = 0.0;
+	m_quit = false;
+	for (int i = 0; i < NUM_PICKUP_TYPES; i++)
+		m_pickupSerials[i] = 0;
+}
+
+CEndlessTrack::~CEndlessTrack()
+{
+	Release();
+}
+
+bool CEndlessTrack::Create(unsigned int seed, string textureFilename)
+{
+	m_texture.Load(textureFilename);
+	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// One slot of the vertex buffer per piece that can be held at once
+	m_slotSize = 2 * (MAX_PIECE_SAMPLES + 1);
+	m_slotUsed.assign(MAX_PIECES, false);
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX_PIECES * m_slotSize * sizeof(VertexPTN), NULL, GL_DYNAMIC_DRAW);
+
+	// Set the vertex attribute locations
+	GLsizei stride = 2 * sizeof(glm::vec3) + sizeof(glm::vec2);
+	// Vertex positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+	// Texture coordinates
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
+	// Normal vectors
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)
+		+ sizeof(glm::vec2)));
+
+	// Start where the built-in loop does, heading straight on for the first few control points
+	m_random.seed(seed);
+	m_heading = glm::vec3(0, 0, 1);
+	glm::vec3 start(100, 20, 0);
+	for (int i = 0; i < 4; i++)
+		m_controlPoints[i] = start + ((i - 1) * CONTROL_POINT_SPACING) * m_heading;
+
+	// Build enough to start with here, so there is track under the ship from the first frame
+	while (m_generatedDistance < LOOKAHEAD)
+		Adopt(GeneratePiece());
+	m_requestedDistance = m_queuedDistance = m_generatedDistance;
+
+	m_worker = std::thread(&CEndlessTrack::WorkerMain, this);
+	printf("Endless track: seed %u, %u pieces to start with\n", seed, (unsigned int) m_pieces.size());
+	return true;
+}
+
+void CEndlessTrack::Release()
+{
+	if (m_worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_one();
+		m_worker.join();
+	}
+
+	for (unsigned int i = 0; i < m_pieces.size(); i++)
+		delete m_pieces[i];
+	for (unsigned int i = 0; i < m_finished.size(); i++)
+		delete m_finished[i];
+	m_pieces.clear();
+	m_finished.clear();
+}
+
+// Make pieces whenever the render thread wants the track to reach further than it does
+void CEndlessTrack::WorkerMain()
+{
+	// Pieces are built on the heap, which is fine here, away from the frame
+	CFrameArena::IgnoreHeapAllocations();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_quit) {
+		if (m_queuedDistance >= m_requestedDistance) {
+			m_wake.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+		Piece *piece = GeneratePiece();
+		lock.lock();
+
+		m_finished.push_back(piece);
+		m_queuedDistance = piece->startDistance + piece->length;
+	}
+}
+
+// Turn by a random amount, steering back towards the middle of the world once the track has wandered too far
+// from it, and climb or fall a little without going below the ground
+glm::vec3 CEndlessTrack::NextControlPoint()
+{
+	glm::vec3 last = m_controlPoints[3];
+
+	float turn = std::uniform_real_distribution<float>(-MAX_TURN, MAX_TURN)(m_random);
+	glm::vec3 outwards(last.x, 0.0f, last.z);
+	float radius = glm::length(outwards);
+	if (radius > WANDER_RADIUS) {
+		glm::vec3 inwards = -outwards / radius;
+		float angle = glm::degrees(atan2(glm::cross(m_heading, inwards).y, glm::dot(m_heading, inwards)));
+		float weight = min(1.0f, (radius - WANDER_RADIUS) / WANDER_RADIUS);
+		turn = glm::clamp(turn + weight * angle, -MAX_TURN, MAX_TURN);
+	}
+	m_heading = glm::normalize(glm::rotate(m_heading, turn, glm::vec3(0, 1, 0)));
+
+	glm::vec3 next = last + CONTROL_POINT_SPACING * m_heading;
+	next.y = glm::clamp(last.y + std::uniform_real_distribution<float>(-MAX_CLIMB, MAX_CLIMB)(m_random), MIN_HEIGHT, MAX_HEIGHT);
+	return next;
+}
+
+// Bake the segment between the middle two control points, then move the control points on by one
+CEndlessTrack::Piece *CEndlessTrack::GeneratePiece()
+{
+	Piece *piece = new Piece;
+	piece->startDistance = m_generatedDistance;
+	piece->slot = -1;
+	for (int i = 0; i < 4; i++)
+		piece->controlPoints[i] = m_controlPoints[i];
+
+	// Measure the segment, then place samples evenly along it by inverting the measurements
+	float cumulative[ARC_LENGTH_STEPS + 1];
+	cumulative[0] = 0.0f;
+	glm::vec3 previous = Interpolate(piece->controlPoints, 0.0f);
+	for (int k = 1; k <= ARC_LENGTH_STEPS; k++) {
+		glm::vec3 q = Interpolate(piece->controlPoints, k / (float) ARC_LENGTH_STEPS);
+		cumulative[k] = cumulative[k - 1] + glm::distance(previous, q);
+		previous = q;
+	}
+	piece->length = cumulative[ARC_LENGTH_STEPS];
+
+	int numSamples = glm::clamp((int) ceil(piece->length / SAMPLE_SPACING), 1, MAX_PIECE_SAMPLES);
+	int k = 0;
+	for (int i = 0; i <= numSamples; i++) {
+		float s = piece->length * i / numSamples;
+		while (k < ARC_LENGTH_STEPS - 1 && cumulative[k + 1] < s)
+			k++;
+		float step = cumulative[k + 1] - cumulative[k];
+		float f = step > 0.0f ? glm::clamp((s - cumulative[k]) / step, 0.0f, 1.0f) : 0.0f;
+		piece->parameters.push_back((k + f) / ARC_LENGTH_STEPS);
+	}
+
+	// Frames, carried on from the previous piece by double reflection as in CCatmullRom::ComputeFrames, and the
+	// track surface from their side vectors.  The texture coordinate wraps every 1024 repeats, which the texture
+	// cannot show, to keep it small however far the track goes.
+	float vStart = (float) (fmod(piece->startDistance, 1024.0 * SAMPLE_SPACING) / SAMPLE_SPACING);
+	glm::vec3 p, pPrevious, T, up;
+	float largestStep = 0.0f;
+	glm::vec3 lPrevious, rPrevious;
+	for (int i = 0; i <= numSamples; i++) {
+		p = Interpolate(piece->controlPoints, piece->parameters[i]);
+		glm::vec3 tangent = glm::normalize(Derivative(piece->controlPoints, piece->parameters[i]));
+
+		if (i == 0) {
+			up = m_firstPiece ? glm::vec3(0, 1, 0) : m_lastUp;
+		} else {
+			glm::vec3 v1 = p - pPrevious;
+			float c1 = glm::dot(v1, v1);
+			if (c1 > 1e-12f) {
+				glm::vec3 rL = up - (2.0f / c1) * glm::dot(v1, up) * v1;
+				glm::vec3 tL = T - (2.0f / c1) * glm::dot(v1, T) * v1;
+				glm::vec3 v2 = tangent - tL;
+				float c2 = glm::dot(v2, v2);
+				up = c2 < 1e-12f ? rL : rL - (2.0f / c2) * glm::dot(v2, rL) * v2;
+			}
+		}
+		T = tangent;
+
+		// Over hills, rotation-minimising frames slowly turn away from vertical, so lean back towards it a little
+		glm::vec3 level = glm::vec3(0, 1, 0) - T.y * T;
+		if (glm::length(level) > 1e-3f)
+			up += UP_CORRECTION * (glm::normalize(level) - up);
+		up = glm::normalize(up - glm::dot(up, T) * T);
+		glm::vec3 side = glm::cross(T, up);
+
+		glm::quat frame = glm::quat_cast(glm::mat3(T, up, side));
+		if (!m_firstPiece && glm::dot(frame, m_lastFrame) < 0.0f)
+			frame = -frame;
+		m_lastFrame = frame;
+		m_firstPiece = false;
+		piece->frames.push_back(frame);
+
+		glm::vec3 l = p - (TRACK_WIDTH / 2) * side;
+		glm::vec3 r = p + (TRACK_WIDTH / 2) * side;
+		float v = vStart + (piece->length * i / numSamples) / SAMPLE_SPACING;
+		piece->vertices.push_back(VertexPTN(l, glm::vec2(0, v), up));
+		piece->vertices.push_back(VertexPTN(r, glm::vec2(1, v), up));
+
+		if (i == 0) {
+			piece->boundsMin = glm::min(l, r);
+			piece->boundsMax = glm::max(l, r);
+		} else {
+			piece->boundsMin = glm::min(piece->boundsMin, glm::min(l, r));
+			piece->boundsMax = glm::max(piece->boundsMax, glm::max(l, r));
+			largestStep = max(largestStep, max(glm::distance(l, lPrevious), glm::distance(r, rPrevious)));
+		}
+		lPrevious = l;
+		rPrevious = r;
+		pPrevious = p;
+	}
+	// Cover the curve between samples
+	piece->boundsMin -= glm::vec3(0.5f * largestStep);
+	piece->boundsMax += glm::vec3(0.5f * largestStep);
+	m_lastUp = up;
+
+	// Pickups that fall on this piece, on the lanes CCatmullRom uses for objects
+	double end = piece->startDistance + piece->length;
+	for (int type = 0; type < NUM_PICKUP_TYPES; type++)
+		piece->firstPickupSerial[type] = m_pickupSerials[type];
+	for (; m_nextPickup < end || m_nextHealthPack < end; ) {
+		bool healthPack = m_nextHealthPack < m_nextPickup;
+		double d = healthPack ? m_nextHealthPack : m_nextPickup;
+		float x = (float) ((d - piece->startDistance) / piece->length * numSamples);
+		int i = min((int) x, numSamples - 1);
+		float t = x - i;
+		glm::vec3 centre = Interpolate(piece->controlPoints, glm::mix(piece->parameters[i], piece->parameters[i + 1], t));
+		glm::vec3 side = CCatmullRom::Slerp(piece->frames[i], piece->frames[i + 1], t) * glm::vec3(0, 0, 1);
+		float lane = TRACK_WIDTH / 3.5f;
+
+		if (healthPack) {
+			piece->pickups[PICKUP_HEALTHPACK].push_back(centre);
+			m_nextHealthPack += HEALTH_PACK_SPACING;
+		} else {
+			piece->pickups[PICKUP_SPHERE].push_back(centre + lane * side);
+			piece->pickups[PICKUP_CUBE].push_back(centre - lane * side);
+			piece->pickups[PICKUP_PYRAMID].push_back(centre);
+			m_nextPickup += PICKUP_SPACING;
+		}
+		for (int type = 0; type < NUM_PICKUP_TYPES; type++) {
+			while (piece->pickupDistances[type].size() < piece->pickups[type].size()) {
+				piece->pickupDistances[type].push_back(d);
+				m_pickupSerials[type]++;
+			}
+		}
+	}
+
+	m_generatedDistance = end;
+	glm::vec3 next = NextControlPoint();
+	for (int i = 0; i < 3; i++)
+		m_controlPoints[i] = m_controlPoints[i + 1];
+	m_controlPoints[3] = next;
+
+	return piece;
+}
+
+// Give a finished piece a slot in the vertex buffer and copy its vertices there
+void CEndlessTrack::Adopt(Piece *piece)
+{
+	int slot = 0;
+	while (m_slotUsed[slot])
+		slot++;
+	m_slotUsed[slot] = true;
+	piece->slot = slot;
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, slot * m_slotSize * sizeof(VertexPTN), piece->vertices.size() * sizeof(VertexPTN), &piece->vertices[0]);
+	piece->numVertices = (int) piece->vertices.size();
+	vector<VertexPTN>().swap(piece->vertices);
+
+	m_pieces.push_back(piece);
+	m_version++;
+}
+
+void CEndlessTrack::Update(double distance)
+{
+	// Retire pieces the ship is well past
+	while (m_pieces.size() > 1 && m_pieces.front()->startDistance + m_pieces.front()->length < distance - KEEP_BEHIND) {
+		m_slotUsed[m_pieces.front()->slot] = false;
+		delete m_pieces.front();
+		m_pieces.pop_front();
+		m_version++;
+	}
+
+	// Take a few of the pieces the worker has finished, as long as there are slots for them, and ask for more.
+	// Copying the vertices happens after the lock is released.
+	Piece *adopted[MAX_ADOPTED_PER_FRAME];
+	int numAdopted = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		int freeSlots = MAX_PIECES - (int) m_pieces.size();
+		while (!m_finished.empty() && numAdopted < MAX_ADOPTED_PER_FRAME && numAdopted < freeSlots) {
+			adopted[numAdopted++] = m_finished.front();
+			m_finished.pop_front();
+		}
+		m_requestedDistance = distance + LOOKAHEAD;
+	}
+	m_wake.notify_one();
+
+	for (int i = 0; i < numAdopted; i++)
+		Adopt(adopted[i]);
+}
+
+// The piece holding distance d, counting each piece's end as its own so that the newest piece's end can be sampled
+int CEndlessTrack::FindPiece(double d) const
+{
+	if (m_pieces.empty() || d < m_pieces.front()->startDistance)
+		return -1;
+	int lo = 0, hi = (int) m_pieces.size() - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (d <= m_pieces[mid]->startDistance + m_pieces[mid]->length)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	const Piece *piece = m_pieces[lo];
+	return d <= piece->startDistance + piece->length ? lo : -1;
+}
+
+bool CEndlessTrack::SampleFrame(double d, glm::vec3 &p, glm::quat &orientation)
+{
+	int index = FindPiece(d);
+	if (index < 0)
+		return false;
+
+	const Piece *piece = m_pieces[index];
+	int numSamples = (int) piece->parameters.size() - 1;
+	float x = (float) ((d - piece->startDistance) / piece->length * numSamples);
+	int i = glm::clamp((int) x, 0, numSamples - 1);
+	float t = glm::clamp(x - i, 0.0f, 1.0f);
+
+	p = Interpolate(piece->controlPoints, glm::mix(piece->parameters[i], piece->parameters[i + 1], t));
+	orientation = CCatmullRom::Slerp(piece->frames[i], piece->frames[i + 1], t);
+	return true;
+}
+
+bool CEndlessTrack::SampleOffset(double d, float offset, glm::vec3 &p, glm::quat &orientation)
+{
+	if (!SampleFrame(d, p, orientation))
+		return false;
+	p += offset * (orientation * glm::vec3(0, 0, 1));
+	return true;
+}
+
+double CEndlessTrack::GetEndDistance() const
+{
+	if (m_pieces.empty())
+		return 0.0;
+	return m_pieces.back()->startDistance + m_pieces.back()->length;
+}
+
+float CEndlessTrack::GetWidth() const
+{
+	return TRACK_WIDTH;
+}
+
+int CEndlessTrack::CurrentLap(double d)
+{
+	return (int) (d / LAP_LENGTH);
+}
+
+void CEndlessTrack::Render(const CFrustum &frustum)
+{
+	m_drawFirsts.clear();
+	m_drawCounts.clear();
+	for (unsigned int i = 0; i < m_pieces.size(); i++) {
+		const Piece *piece = m_pieces[i];
+		if (!frustum.IsBoxVisible(piece->boundsMin, piece->boundsMax, VIEW_DISTANCE))
+			continue;
+		m_drawFirsts.push_back(piece->slot * m_slotSize);
+		m_drawCounts.push_back(piece->numVertices);
+	}
+	Redraw();
+}
+
+void CEndlessTrack::Redraw()
+{
+	if (m_drawFirsts.empty())
+		return;
+
+	m_texture.Bind();
+	glBindVertexArray(m_vao);
+	glMultiDrawArrays(GL_TRIANGLE_STRIP, &m_drawFirsts[0], &m_drawCounts[0], (GLsizei) m_drawFirsts.size());
+}
+
+void CEndlessTrack::GetPickups(int type, vector<glm::vec3> &positions, vector<double> &distances, int &firstSerial) const
+{
+	positions.clear();
+	distances.clear();
+	firstSerial = m_pieces.empty() ? 0 : m_pieces.front()->firstPickupSerial[type];
+	for (unsigned int i = 0; i < m_pieces.size(); i++) {
+		positions.insert(positions.end(), m_pieces[i]->pickups[type].begin(), m_pieces[i]->pickups[type].end());
+		distances.insert(distances.end(), m_pieces[i]->pickupDistances[type].begin(), m_pieces[i]->pickupDistances[type].end());
+	}
+}
+
+unsigned int CEndlessTrack::GetVersion() const
+{
+	return m_version;
+}
+
+// Point on the Catmull-Rom segment from p[1] to p[2], as CCatmullRom::Interpolate
+glm::vec3 CEndlessTrack::Interpolate(const glm::vec3 *p, float u)
+{
+	float u2 = u * u;
+	float u3 = u2 * u;
+
+	glm::vec3 a = p[1];
+	glm::vec3 b = 0.5f * (-p[0] + p[2]);
+	glm::vec3 c = 0.5f * (2.0f*p[0] - 5.0f*p[1] + 4.0f*p[2] - p[3]);
+	glm::vec3 d = 0.5f * (-p[0] + 3.0f*p[1] - 3.0f*p[2] + p[3]);
+
+	return a + b*u + c*u2 + d*u3;
+}
+
+glm::vec3 CEndlessTrack::Derivative(const glm::vec3 *p, float u)
+{
+	glm::vec3 b = 0.5f * (-p[0] + p[2]);
+	glm::vec3 c = 0.5f * (2.0f*p[0] - 5.0f*p[1] + 4.0f*p[2] - p[3]);
+	glm::vec3 d = 0.5f * (-p[0] + 3.0f*p[1] - 3.0f*p[2] + p[3]);
+
+	return b + 2.0f*c*u + 3.0f*d*u*u;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Common.h"
+#include "Texture.h"
+#include "Frustum.h"
+#include "BufferBuilder.h"
+#include "CatmullRom.h"
+#include "./include/glm/gtc/quaternion.hpp"
+#include <deque>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A track without end.  A worker thread keeps adding Catmull-Rom segments ahead of the ship, steered by a seeded
+// random generator, and bakes each one into a piece: evenly spaced samples with their frames, the vertices of the
+// track surface and the pickups along it.  The render thread only has to copy finished pieces into the vertex
+// buffer and retire the pieces the ship has left behind, so the memory used stays the same however far the ship
+// goes and new track appears without holding up a frame.
+class CEndlessTrack
+{
+public:
+	CEndlessTrack();
+	~CEndlessTrack();
+
+	// Build the first stretch of track, then start the worker.  The same seed always gives the same track.
+	bool Create(unsigned int seed, string textureFilename);
+	void Release();
+
+	// Call once a frame with the ship's distance along the track: retires pieces behind it, takes on pieces the
+	// worker has finished and asks for more ahead of it
+	void Update(double distance);
+
+	// Same conventions as CCatmullRom::SampleFrame.  Returns false if d is behind the oldest piece or beyond the
+	// newest, which Update prevents as long as the ship does not pass GetEndDistance.  Distances along the track
+	// are doubles, as the track has no end: a float would no longer place the ship to the nearest tenth of a unit
+	// a few hundred thousand units in.
+	bool SampleFrame(double d, glm::vec3 &p, glm::quat &orientation);
+	bool SampleOffset(double d, float offset, glm::vec3 &p, glm::quat &orientation);	// As CCatmullRom::SampleOffset
+	double GetEndDistance() const;		// Distance along the track at the end of the newest piece
+	float GetWidth() const;
+	int CurrentLap(double d);			// Laps are a fixed length, about that of the built-in loop
+
+	void Render(const CFrustum &frustum);
+	void Redraw();						// Draws the pieces the last Render did again, for a second pass
+
+	// The pickups of one type on the pieces currently held, nearest first, with their distances along the track and
+	// the serial number of the first.  Pickups are numbered in the order they are made, so as pieces come and go the
+	// list only loses entries from its start and gains them at its end.
+	void GetPickups(int type, vector<glm::vec3> &positions, vector<double> &distances, int &firstSerial) const;
+	unsigned int GetVersion() const;	// Changes whenever a piece is added or retired
+
+private:
+	static const int NUM_PICKUP_TYPES = PICKUP_HEALTHPACK + 1;
+
+	struct Piece {
+		double startDistance;
+		float length;
+		glm::vec3 controlPoints[4];			// The piece is the segment of spline from the second to the third
+		vector<float> parameters;			// Spline parameter at each sample; the samples are evenly spaced by
+		vector<glm::quat> frames;			// arc length, and the first and last are on the ends of the segment
+		vector<VertexPTN> vertices;			// Track surface as a strip, emptied once it is in the vertex buffer
+		int numVertices;
+		glm::vec3 boundsMin, boundsMax;
+		vector<glm::vec3> pickups[NUM_PICKUP_TYPES];
+		vector<double> pickupDistances[NUM_PICKUP_TYPES];
+		int firstPickupSerial[NUM_PICKUP_TYPES];
+		int slot;							// Slot of the vertex buffer holding the piece, or -1
+	};
+
+	// Run on the worker thread once it has started (and on the render thread before then)
+	Piece *GeneratePiece();
+	glm::vec3 NextControlPoint();
+	void WorkerMain();
+
+	void Adopt(Piece *piece);
+	int FindPiece(double d) const;
+	static glm::vec3 Interpolate(const glm::vec3 *p, float u);
+	static glm::vec3 Derivative(const glm::vec3 *p, float u);
+
+	CTexture m_texture;
+	GLuint m_vao;
+	GLuint m_buffer;
+	int m_slotSize;
+	vector<bool> m_slotUsed;
+
+	deque<Piece*> m_pieces;					// Pieces in use by the render thread, oldest first
+	unsigned int m_version;
+	vector<GLint> m_drawFirsts;
+	vector<GLsizei> m_drawCounts;
+
+	// Generator state, owned by the worker thread once it is running
+	std::mt19937 m_random;
+	glm::vec3 m_controlPoints[4];
+	glm::vec3 m_heading;
+	double m_generatedDistance;
+	glm::vec3 m_lastUp;						// Frame at the end of the newest piece, carried into the next
+	glm::quat m_lastFrame;
+	double m_nextPickup, m_nextHealthPack;
+	int m_pickupSerials[NUM_PICKUP_TYPES];
+	bool m_firstPiece;
+
+	// Shared between the threads, guarded by m_mutex
+	std::thread m_worker;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	deque<Piece*> m_finished;				// Pieces the worker has made that the render thread has not yet taken
+	double m_requestedDistance;				// The worker keeps going until the track reaches this far
+	double m_queuedDistance;				// How far the track reaches, counting finished pieces
+	bool m_quit;
+};
@@ -0,0 +1,120 @@
+#include "FrameArena.h"
+#include <new>
+#include <malloc.h>
+#include <stdlib.h>
+
+// Count every call to the global operator new, on every thread but those that have asked not to be counted, so that
+// GetHeapAllocations can report them.  The array forms and the nothrow forms go through this one in the Microsoft
+// runtime.  Counting is one uncontended atomic add, so it is done in every build.
+static std::atomic<int> s_heapAllocations(0);
+static thread_local bool s_ignoreHeapAllocations = false;
+
+void *operator new(size_t size)
+{
+	if (!s_ignoreHeapAllocations)
+		s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = malloc(size == 0 ? 1 : size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+CFrameArena::CFrameArena()
+{
+	m_pMemory = NULL;
+	m_frameSize = 0;
+	m_currentFrame = 0;
+	m_used = 0;
+	m_peakUsage = 0;
+	m_numOverflows = 0;
+}
+
+CFrameArena::~CFrameArena()
+{
+	Release();
+}
+
+bool CFrameArena::Create(UINT frameSize)
+{
+	Release();
+	m_pMemory = (BYTE*) _aligned_malloc(2 * frameSize, 64);
+	if (m_pMemory == NULL)
+		return false;
+	m_frameSize = frameSize;
+	m_currentFrame = 0;
+	m_used = 0;
+	m_overflow[0].reserve(64);
+	m_overflow[1].reserve(64);
+	return true;
+}
+
+void CFrameArena::Release()
+{
+	for (int frame = 0; frame < 2; frame++) {
+		for (unsigned int i = 0; i < m_overflow[frame].size(); i++)
+			_aligned_free(m_overflow[frame][i]);
+		m_overflow[frame].clear();
+	}
+	_aligned_free(m_pMemory);
+	m_pMemory = NULL;
+	m_frameSize = 0;
+}
+
+void CFrameArena::BeginFrame()
+{
+	m_peakUsage = max(m_peakUsage, (UINT) m_used);
+
+	m_currentFrame = 1 - m_currentFrame;
+	m_used = 0;
+	vector<void*> &overflow = m_overflow[m_currentFrame];
+	for (unsigned int i = 0; i < overflow.size(); i++)
+		_aligned_free(overflow[i]);
+	overflow.clear();
+}
+
+void *CFrameArena::Allocate(UINT size, UINT alignment)
+{
+	// Claim enough for the worst-case padding, so that the bump itself needs no lock
+	UINT start = m_used.fetch_add(size + alignment - 1);
+	if (start + size + alignment - 1 <= m_frameSize) {
+		BYTE *p = m_pMemory + m_currentFrame * m_frameSize + start;
+		return (void*) (((size_t) p + alignment - 1) & ~(size_t) (alignment - 1));
+	}
+
+	// Out of room: take it from the heap, to be freed when this half is next emptied
+	std::lock_guard<std::mutex> lock(m_overflowMutex);
+	m_numOverflows++;
+	void *p = _aligned_malloc(max(size, 1u), alignment);
+	m_overflow[m_currentFrame].push_back(p);
+	return p;
+}
+
+UINT CFrameArena::GetUsed() const
+{
+	return min((UINT) m_used, m_frameSize);
+}
+
+UINT CFrameArena::GetPeakUsage() const
+{
+	return max(m_peakUsage, (UINT) m_used);
+}
+
+UINT CFrameArena::GetNumOverflows() const
+{
+	return m_numOverflows;
+}
+
+int CFrameArena::GetHeapAllocations()
+{
+	return s_heapAllocations.load(std::memory_order_relaxed);
+}
+
+void CFrameArena::IgnoreHeapAllocations()
+{
+	s_ignoreHeapAllocations = true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Common.h"
+#include <atomic>
+#include <mutex>
+
+// Scratch memory for data that only lives for a frame, such as sort buffers and formatted text.  Allocating is a
+// pointer bump, there is nothing to free, and BeginFrame empties the arena for the next frame.  The arena is split
+// in two and alternates between the halves, so what one frame allocates is still valid during the next.
+//
+// Any thread may allocate.  When a frame's half is full, allocations fall back on the heap (and are counted as
+// overflows) until that half is next emptied, so a frame size that is too small costs speed, not correctness.
+class CFrameArena
+{
+public:
+	CFrameArena();
+	~CFrameArena();
+
+	bool Create(UINT frameSize);		// frameSize is the number of bytes available to each frame
+	void Release();
+
+	void BeginFrame();					// Moves to the other half and empties it
+	void *Allocate(UINT size, UINT alignment = 16);
+
+	template <typename T>
+	T *Allocate(UINT count)
+	{
+		return (T*) Allocate(count * sizeof(T), alignof(T));
+	}
+
+	// Statistics, for choosing the frame size
+	UINT GetUsed() const;				// Bytes allocated so far this frame
+	UINT GetPeakUsage() const;			// Most bytes any frame has asked for
+	UINT GetNumOverflows() const;		// Allocations that have had to fall back on the heap
+
+	// The number of calls to the global operator new made so far, by any thread, so that frames that should not
+	// touch the heap can be checked.  A thread that allocates by design, away from the frame, such as the endless
+	// track's worker, calls IgnoreHeapAllocations to leave its own allocations out.
+	static int GetHeapAllocations();
+	static void IgnoreHeapAllocations();
+
+private:
+	BYTE *m_pMemory;
+	UINT m_frameSize;
+	int m_currentFrame;
+	std::atomic<UINT> m_used;
+	UINT m_peakUsage;
+	UINT m_numOverflows;
+	std::mutex m_overflowMutex;
+	vector<void*> m_overflow[2];		// Heap blocks handed out by each half when it was full
+};
+
+// Lets standard containers take their storage from a frame arena, for example
+//
+//		vector<int, CFrameAllocator<int> > indices(pArena);
+//		indices.reserve(count);
+//
+// The storage is never given back individually, so reserve up front rather than let a container grow.
+template <typename T>
+class CFrameAllocator
+{
+public:
+	typedef T value_type;
+
+	CFrameAllocator(CFrameArena *arena) : m_pArena(arena) {}
+	template <typename U>
+	CFrameAllocator(const CFrameAllocator<U> &other) : m_pArena(other.m_pArena) {}
+
+	T *allocate(size_t count)
+	{
+		return m_pArena->Allocate<T>((UINT) count);
+	}
+
+	void deallocate(T *, size_t) {}
+
+	template <typename U>
+	bool operator==(const CFrameAllocator<U> &other) const { return m_pArena == other.m_pArena; }
+	template <typename U>
+	bool operator!=(const CFrameAllocator<U> &other) const { return m_pArena != other.m_pArena; }
+
+	CFrameArena *m_pArena;
+};
@@ -1,4 +1,5 @@
 #include "FreeTypeFont.h"
+#include "FrameArena.h"
 #include <minmax.h>
 
 #pragma comment(lib, "lib/freetype2410.lib")
@@ -6,6 +7,9 @@
 CFreeTypeFont::CFreeTypeFont()
 {
 	m_isLoaded = false;
+	m_streamVao = 0;
+	m_streamBuffer = NULL;
+	m_frameArena = NULL;
 }
 CFreeTypeFont::~CFreeTypeFont()
 {}
@@ -109,6 +113,12 @@ bool CFreeTypeFont::LoadFont(string file, int ipixelSize)
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2)*2, 0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2)*2, (void*)(sizeof(glm::vec2)));
+
+	// A second VAO for streamed text; its attribute pointers are set on each print
+	glGenVertexArrays(1, &m_streamVao);
+	glBindVertexArray(m_streamVao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
 	return true;
 }
 
@@ -125,11 +135,15 @@ bool CFreeTypeFont::LoadSystemFont(string name, int ipixelSize)
 
 
 // Prints text at the specified location (x, y) with the given pixel size (iPXSize)
-void CFreeTypeFont::Print(string text, int x, int y, int pixelSize)
+void CFreeTypeFont::Print(const char *text, int x, int y, int pixelSize)
 {
 	if(!m_isLoaded)
 		return;
 
+	int length = (int) strlen(text);
+	if (m_streamBuffer != NULL && PrintStreamed(text, length, x, y, pixelSize))
+		return;
+
 	glBindVertexArray(m_vao);
 	m_shaderProgram->SetUniform("sampler0", 0);
 	glEnable(GL_BLEND);
@@ -138,7 +152,7 @@ void CFreeTypeFont::Print(string text, int x, int y, int pixelSize)
 	if (pixelSize == -1)
 		pixelSize = m_loadedPixelSize;
 	float fScale = float(pixelSize) / float(m_loadedPixelSize);
-	for (int i = 0; i < (int) text.size(); i++) {
+	for (int i = 0; i < length; i++) {
 		if (text[i] == '\n')
 		{
 			iCurX = x;
@@ -163,12 +177,90 @@ void CFreeTypeFont::Print(string text, int x, int y, int pixelSize)
 }
 
 
+// Prints text using the stream buffer.  All the glyph quads are written, already positioned and scaled, in one
+// pass; the modelview matrix is then set once and the glyphs drawn in a second pass.  Returns false if there was
+// no room in the stream buffer, in which case the caller falls back to the static quads.
+bool CFreeTypeFont::PrintStreamed(const char *text, int length, int x, int y, int pixelSize)
+{
+	UINT offset = 0;
+	glm::vec4* vertices = (glm::vec4*) m_streamBuffer->Allocate(length * 4 * sizeof(glm::vec4), sizeof(glm::vec4), offset);
+	if (vertices == NULL)
+		return false;
+
+	// Each vertex holds a position (x, y) and a texture coordinate (z, w)
+	int iCurX = x, iCurY = y;
+	if (pixelSize == -1)
+		pixelSize = m_loadedPixelSize;
+	float fScale = float(pixelSize) / float(m_loadedPixelSize);
+	int numQuads = 0;
+	for (int i = 0; i < length; i++) {
+		if (text[i] == '\n')
+		{
+			iCurX = x;
+			iCurY -= m_newLine*pixelSize / m_loadedPixelSize;
+			continue;
+		}
+		int iIndex = int(text[i]);
+		iCurX += m_bearingX[iIndex] * pixelSize / m_loadedPixelSize;
+		if(text[i] != ' ')
+		{
+			float fX = float(iCurX), fY = float(iCurY);
+			float fW = m_charTextures[iIndex].GetWidth() * fScale;
+			float fBottom = -m_advY[iIndex] * fScale;
+			float fTop = fBottom + m_charTextures[iIndex].GetHeight() * fScale;
+			glm::vec4* quad = vertices + numQuads*4;
+			quad[0] = glm::vec4(fX, fY + fTop, 0.0f, 1.0f);
+			quad[1] = glm::vec4(fX, fY + fBottom, 0.0f, 0.0f);
+			quad[2] = glm::vec4(fX + fW, fY + fTop, 1.0f, 1.0f);
+			quad[3] = glm::vec4(fX + fW, fY + fBottom, 1.0f, 0.0f);
+			numQuads++;
+		}
+
+		iCurX += (m_advX[iIndex] - m_bearingX[iIndex])*pixelSize / m_loadedPixelSize;
+	}
+	m_streamBuffer->Commit();
+
+	glBindVertexArray(m_streamVao);
+	m_streamBuffer->Bind(GL_ARRAY_BUFFER);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)(size_t) offset);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)(size_t)(offset + sizeof(glm::vec2)));
+	m_shaderProgram->SetUniform("sampler0", 0);
+	m_shaderProgram->SetUniform("matrices.modelViewMatrix", glm::mat4(1.0f));
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	int quad = 0;
+	for (int i = 0; i < length; i++) {
+		if (text[i] == '\n' || text[i] == ' ')
+			continue;
+		m_charTextures[int(text[i])].Bind();
+		glDrawArrays(GL_TRIANGLE_STRIP, quad*4, 4);
+		quad++;
+	}
+	glDisable(GL_BLEND);
+	return true;
+}
+
+
 // Print formatted text at the location (x, y) with specified pixel size (iPXSize)
 void CFreeTypeFont::Render(int x, int y, int pixelSize, char* text, ...)
 {
-	char buf[512];
 	va_list ap;
 	va_start(ap, text);
+	if (m_frameArena != NULL) {
+		// Format into the frame's scratch memory, which is just big enough however long the text is
+		va_list lengthAp;
+		va_copy(lengthAp, ap);
+		int length = _vscprintf(text, lengthAp);
+		va_end(lengthAp);
+		char *buf = (char*) m_frameArena->Allocate(length + 1, 1);
+		vsprintf_s(buf, length + 1, text, ap);
+		va_end(ap);
+		Print(buf, x, y, pixelSize);
+		return;
+	}
+
+	char buf[512];
 	vsprintf_s(buf, text, ap);
 	va_end(ap);
 	Print(buf, x, y, pixelSize);
@@ -181,10 +273,23 @@ void CFreeTypeFont::ReleaseFont()
 		m_charTextures[i].Release();
 	m_vbo.Release();
 	glDeleteVertexArrays(1, &m_vao);
+	glDeleteVertexArrays(1, &m_streamVao);
 }
 
 // Sets shader programme that font uses
 void CFreeTypeFont::SetShaderProgram(CShaderProgram* shaderProgram)
 {
 	m_shaderProgram = shaderProgram;
+}
+
+// Sets the buffer used for per-frame text vertices
+void CFreeTypeFont::SetStreamBuffer(CStreamBuffer* streamBuffer)
+{
+	m_streamBuffer = streamBuffer;
+}
+
+// Sets the frame arena that Render formats its text into
+void CFreeTypeFont::SetFrameArena(CFrameArena* frameArena)
+{
+	m_frameArena = frameArena;
 }
\ No newline at end of file
@@ -7,6 +7,9 @@
 #include "Texture.h"
 #include "Shaders.h"
 #include "VertexBufferObject.h"
+#include "StreamBuffer.h"
+
+class CFrameArena;
 
 
 // This class is a wrapper for FreeType fonts and their usage with OpenGL
@@ -21,15 +24,18 @@ public:
 
 	int GetTextWidth(string text, int pixelSize);
 
-	void Print(string text, int x, int y, int pixelSize = -1);
+	void Print(const char *text, int x, int y, int pixelSize = -1);
 	void Render(int x, int y, int pixelSize, char* text, ...);
 
 	void ReleaseFont();
 
 	void SetShaderProgram(CShaderProgram* shaderProgram);
+	void SetStreamBuffer(CStreamBuffer* streamBuffer);	// If set, text is laid out on the CPU and streamed each frame
+	void SetFrameArena(CFrameArena* frameArena);		// If set, Render formats text of any length into it
 
 private:
 	void CreateChar(int index);
+	bool PrintStreamed(const char *text, int length, int x, int y, int pixelSize);
 
 	CTexture m_charTextures[256];
 	int m_advX[256], m_advY[256];
@@ -41,6 +47,9 @@ private:
 
 	UINT m_vao;
 	CVertexBufferObject m_vbo;
+	UINT m_streamVao;
+	CStreamBuffer* m_streamBuffer;
+	CFrameArena* m_frameArena;
 
 	FT_Library m_ftLib;
 	FT_Face m_ftFace;
@@ -0,0 +1,204 @@
+#include "Frustum.h"
+
+#include <xmmintrin.h>
+
+
+CBoundingSpheres::CBoundingSpheres()
+{
+	m_count = 0;
+}
+
+CBoundingSpheres::~CBoundingSpheres()
+{}
+
+// Add a sphere, keeping the arrays padded to a whole number of SSE registers
+void CBoundingSpheres::Add(const glm::vec3 &centre, float radius)
+{
+	if (m_count % 4 == 0) {
+		m_x.resize(m_count + 4, 0.0f);
+		m_y.resize(m_count + 4, 0.0f);
+		m_z.resize(m_count + 4, 0.0f);
+		m_r.resize(m_count + 4, -1.0f);	// A negative radius can never pass the plane tests
+	}
+	m_x[m_count] = centre.x;
+	m_y[m_count] = centre.y;
+	m_z[m_count] = centre.z;
+	m_r[m_count] = radius;
+	m_count++;
+}
+
+void CBoundingSpheres::Clear()
+{
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	m_r.clear();
+	m_count = 0;
+}
+
+int CBoundingSpheres::Size() const
+{
+	return m_count;
+}
+
+glm::vec3 CBoundingSpheres::GetCentre(int index) const
+{
+	return glm::vec3(m_x[index], m_y[index], m_z[index]);
+}
+
+float CBoundingSpheres::GetRadius(int index) const
+{
+	return m_r[index];
+}
+
+
+CFrustum::CFrustum()
+{
+	m_eye = glm::vec3(0.0f);
+	m_fadeDistance = 1e30f;
+	m_cullDistance = 1e30f;
+	for (int i = 0; i < 6; i++)
+		m_planes[i] = glm::vec4(0.0f);
+}
+
+CFrustum::~CFrustum()
+{}
+
+// Extract the planes using the Gribb-Hartmann method: each plane is the sum or difference of the fourth row
+// of the combined matrix with one of the other rows.  Since the matrix takes world coordinates to clip
+// coordinates, the planes come out in world coordinates.
+void CFrustum::Extract(const glm::mat4 &projectionMatrix, const glm::mat4 &viewMatrix)
+{
+	glm::mat4 m = projectionMatrix * viewMatrix;
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	m_planes[0] = row3 + row0;	// Left
+	m_planes[1] = row3 - row0;	// Right
+	m_planes[2] = row3 + row1;	// Bottom
+	m_planes[3] = row3 - row1;	// Top
+	m_planes[4] = row3 + row2;	// Near
+	m_planes[5] = row3 - row2;	// Far
+
+	for (int i = 0; i < 6; i++)
+		m_planes[i] /= glm::length(glm::vec3(m_planes[i]));
+
+	// The eye is the origin of eye space
+	m_eye = glm::vec3(glm::inverse(viewMatrix)[3]);
+}
+
+void CFrustum::SetDistanceThresholds(float fadeDistance, float cullDistance)
+{
+	m_cullDistance = cullDistance;
+	m_fadeDistance = min(fadeDistance, cullDistance);
+}
+
+float CFrustum::GetFadeDistance() const
+{
+	return m_fadeDistance;
+}
+
+float CFrustum::GetCullDistance() const
+{
+	return m_cullDistance;
+}
+
+const glm::vec4 *CFrustum::GetPlanes() const
+{
+	return m_planes;
+}
+
+glm::vec3 CFrustum::GetEye() const
+{
+	return m_eye;
+}
+
+bool CFrustum::IsVisible(const glm::vec3 &centre, float radius) const
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(m_planes[i]), centre) + m_planes[i].w < -radius)
+			return false;
+	}
+	// Near side strictly nearer than the cull distance, as in Cull and cullShader.comp
+	float maxDistance = m_cullDistance + radius;
+	glm::vec3 toCentre = centre - m_eye;
+	return glm::dot(toCentre, toCentre) < maxDistance * maxDistance;
+}
+
+// Test the corner of the box furthest along each plane's normal: if even that one is behind the plane, the whole
+// box is
+bool CFrustum::IsBoxVisible(const glm::vec3 &boxMin, const glm::vec3 &boxMax, float maxDistance) const
+{
+	for (int i = 0; i < 6; i++) {
+		glm::vec3 corner(m_planes[i].x >= 0.0f ? boxMax.x : boxMin.x,
+			m_planes[i].y >= 0.0f ? boxMax.y : boxMin.y,
+			m_planes[i].z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(glm::vec3(m_planes[i]), corner) + m_planes[i].w < 0.0f)
+			return false;
+	}
+	glm::vec3 toNearest = glm::clamp(m_eye, boxMin, boxMax) - m_eye;
+	return glm::dot(toNearest, toNearest) <= maxDistance * maxDistance;
+}
+
+// Test four spheres per iteration against all six planes and the cull distance
+void CFrustum::Cull(const CBoundingSpheres &spheres, vector<int> &visible, vector<float> &fade) const
+{
+	visible.clear();
+	fade.clear();
+
+	__m128 eyeX = _mm_set1_ps(m_eye.x);
+	__m128 eyeY = _mm_set1_ps(m_eye.y);
+	__m128 eyeZ = _mm_set1_ps(m_eye.z);
+	__m128 cullDistance = _mm_set1_ps(m_cullDistance);
+	__m128 zero = _mm_setzero_ps();
+
+	float fadeRange = m_cullDistance - m_fadeDistance;
+	float invFadeRange = fadeRange > 0.0f ? 1.0f / fadeRange : 0.0f;
+
+	int paddedCount = (int) spheres.m_x.size();
+	for (int i = 0; i < paddedCount; i += 4) {
+		__m128 x = _mm_loadu_ps(&spheres.m_x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.m_y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.m_z[i]);
+		__m128 r = _mm_loadu_ps(&spheres.m_r[i]);
+		__m128 negR = _mm_sub_ps(zero, r);
+
+		// Inside (or straddling) a plane if the signed distance is at least -r
+		__m128 inside = _mm_cmpge_ps(r, zero);
+		for (int p = 0; p < 6; p++) {
+			__m128 d = _mm_mul_ps(x, _mm_set1_ps(m_planes[p].x));
+			d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(m_planes[p].y)));
+			d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(m_planes[p].z)));
+			d = _mm_add_ps(d, _mm_set1_ps(m_planes[p].w));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+		}
+
+		// Distance from the eye to the near side of the sphere
+		__m128 dx = _mm_sub_ps(x, eyeX);
+		__m128 dy = _mm_sub_ps(y, eyeY);
+		__m128 dz = _mm_sub_ps(z, eyeZ);
+		__m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		dist = _mm_max_ps(_mm_sub_ps(dist, r), zero);
+		// Strictly nearer than the cull distance, so that nothing is kept only to be drawn with a fade, and so a
+		// scale, of zero
+		inside = _mm_and_ps(inside, _mm_cmplt_ps(dist, cullDistance));
+
+		int mask = _mm_movemask_ps(inside);
+		if (mask == 0)
+			continue;
+
+		float distances[4];
+		_mm_storeu_ps(distances, dist);
+		for (int k = 0; k < 4; k++) {
+			if (mask & (1 << k)) {
+				visible.push_back(i + k);
+				float f = (m_cullDistance - distances[k]) * invFadeRange;
+				if (fadeRange <= 0.0f || f > 1.0f)
+					f = 1.0f;
+				fade.push_back(max(f, 0.0f));
+			}
+		}
+	}
+}
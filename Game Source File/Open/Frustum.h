@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Common.h"
+
+// A set of bounding spheres stored as separate x, y, z, radius arrays so that they can be culled four at a time
+class CBoundingSpheres
+{
+public:
+	CBoundingSpheres();
+	~CBoundingSpheres();
+
+	void Add(const glm::vec3 &centre, float radius);	// Appends a sphere; its index is the order of insertion
+	void Clear();
+	int Size() const;
+
+	glm::vec3 GetCentre(int index) const;
+	float GetRadius(int index) const;
+
+private:
+	friend class CFrustum;
+
+	// Padded to a multiple of four with negative-radius spheres, which the culling pass always discards
+	vector<float> m_x, m_y, m_z, m_r;
+	int m_count;
+};
+
+// A view frustum, extracted from a combined projection * view matrix, used to decide which objects need drawing
+class CFrustum
+{
+public:
+	CFrustum();
+	~CFrustum();
+
+	// Extract the six clipping planes (in world coordinates) and the eye position from the camera
+	void Extract(const glm::mat4 &projectionMatrix, const glm::mat4 &viewMatrix);
+
+	// Objects start fading at fadeDistance from the eye and are culled entirely beyond cullDistance
+	void SetDistanceThresholds(float fadeDistance, float cullDistance);
+	float GetFadeDistance() const;
+	float GetCullDistance() const;
+
+	// For culling elsewhere, such as on the GPU, by the same rules
+	const glm::vec4 *GetPlanes() const;		// The six planes, as described below
+	glm::vec3 GetEye() const;
+
+	// Returns true if the sphere intersects the frustum and its near side is nearer than the cull distance, as Cull
+	bool IsVisible(const glm::vec3 &centre, float radius) const;
+
+	// Returns true if the axis-aligned box intersects the frustum and its nearest point is within maxDistance
+	bool IsBoxVisible(const glm::vec3 &boxMin, const glm::vec3 &boxMax, float maxDistance) const;
+
+	// Culls every sphere in the set, writing the indices of the visible ones into visible and, for each of those,
+	// a fade factor into fade (1 inside the fade distance, falling to 0 at the cull distance).  Both vectors are
+	// cleared first but keep their capacity, so reusing them each frame does not allocate.
+	void Cull(const CBoundingSpheres &spheres, vector<int> &visible, vector<float> &fade) const;
+
+private:
+	glm::vec4 m_planes[6];		// Plane equations (a, b, c, d), normalised so that a*x + b*y + c*z + d is a signed distance
+	glm::vec3 m_eye;			// Eye position in world coordinates
+	float m_fadeDistance;
+	float m_cullDistance;
+};
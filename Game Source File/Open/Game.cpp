@@ -19,6 +19,7 @@ Source code drawn from a number of sources and examples, including contributions
 
 #include "game.h"
 #include <iostream>
+#include <algorithm>
 using namespace std;
 
 
@@ -39,6 +40,90 @@ using namespace std;
 #include "CatmullRom.h"
 #include "Cube.h"
 #include "Pyramid.h"
+#include "Frustum.h"
+#include "LevelOfDetail.h"
+#include "StreamBuffer.h"
+#include "EndlessTrack.h"
+#include "Racers.h"
+#include "JobSystem.h"
+#include "RenderQueue.h"
+#include "FrameArena.h"
+#include "ResourcePack.h"
+#include "AssetManifest.h"
+#include "StartupProfiler.h"
+#include "Texture.h"
+#include "TextureArray.h"
+#include "GpuCuller.h"
+#include "PrimitiveArena.h"
+#include "GpuTimer.h"
+
+// Sort key fields for the draws Game::Render records.  The programs are numbered as in m_pShaderPrograms.  Each
+// mesh owns its texture, so the mesh number serves as the material number too, except for the pickups that share
+// the pickup texture array.
+enum RenderPass { RENDER_PASS_OPAQUE };
+enum RenderProgram { RENDER_PROGRAM_MAIN, RENDER_PROGRAM_TEXT, RENDER_PROGRAM_INSTANCED, RENDER_PROGRAM_TEXTURE_ARRAY,
+	RENDER_PROGRAM_INSTANCED_TEXTURE_ARRAY, RENDER_PROGRAM_DEPTH, RENDER_PROGRAM_CULL };
+enum RenderMesh { RENDER_MESH_SHIP, RENDER_MESH_SPHERE, RENDER_MESH_CUBE, RENDER_MESH_PYRAMID, RENDER_MESH_HEALTHPACK };
+static const int RENDER_MATERIAL_PICKUP_TEXTURES = RENDER_MESH_HEALTHPACK + 1;
+static const float RENDER_MAX_DEPTH = 5000.0f;	// The far plane
+
+static const UINT FRAME_ARENA_SIZE = 256 * 1024;	// Bytes of scratch memory for each frame
+static const int WARM_UP_FRAMES = 120;				// Frames to let reused buffers reach their working size
+static const int GPU_TIMING_FRAMES = 120;			// Frames each GPU timing report averages over
+
+static const char *RESOURCE_PACK_FILE = "resources.pak";
+static const char *TRACK_FILE = "resources\\tracks\\default.track";
+// Texture downloaded from http://thumbs.dreamstime.com/t/texture-silver-metal-platform-floor-background-close-up-54526246.jpg 17 March 2016
+static const char *TRACK_TEXTURE = "resources\\textures\\space_floor.jpg";
+
+static const double LOADING_SCREEN_INTERVAL = 50.0;	// Milliseconds between redraws of the loading screen
+static const char *STARTUP_TRACE_FILE = "startup_trace.json";	// Open in chrome://tracing
+
+static const int ATTRIBUTE_MATERIAL_LAYER = 5;		// The vertex attribute that picks a texture array layer
+
+static const float PICKUP_HEIGHTS[4] = { 3.5f, 3.5f, 3.5f, 5.5f };	// Above the track, along its up
+// The sphere, cube and pyramid pickups spin and bob, each a little behind the one before it along the track.  The
+// instanced shader animates them itself; only without the GPU culler are they animated here.
+static const glm::vec3 PICKUP_SPIN_AXES[4] = { glm::vec3(1, 1, 0), glm::vec3(1, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0) };
+static const float PICKUP_SPIN_SPEED = 3.4906585f;	// Radians per second (200 degrees)
+static const float PICKUP_BOB_HEIGHT = 0.5f;
+static const float PICKUP_BOB_SPEED = 3.1415927f;	// Radians per second, so a bob takes two seconds
+static const float PICKUP_PHASE_PER_UNIT = 0.05f;	// Radians of phase for each unit along the track
+static const int PICKUP_TEXTURE_UNIT = 2;			// Where the pickup texture array stays bound
+
+// Draw functions for the render queue
+static void DrawMesh(void *object, int lod, bool bindState)
+{
+	// A mesh binds each of its parts as it draws them, so there is nothing to skip
+	((COpenAssetImportMesh*) object)->Render(lod);
+}
+
+static void DrawSphere(void *object, int lod, bool bindState)
+{
+	CSphere *pSphere = (CSphere*) object;
+	if (bindState)
+		pSphere->Bind();
+	glVertexAttrib1f(ATTRIBUTE_MATERIAL_LAYER, (float) PICKUP_SPHERE);
+	pSphere->Draw(lod);
+}
+
+static void DrawCube(void *object, int lod, bool bindState)
+{
+	CCube *pCube = (CCube*) object;
+	if (bindState)
+		pCube->Bind();
+	glVertexAttrib1f(ATTRIBUTE_MATERIAL_LAYER, (float) PICKUP_CUBE);
+	pCube->Draw();
+}
+
+static void DrawPyramid(void *object, int lod, bool bindState)
+{
+	PPyramid *pPyramid = (PPyramid*) object;
+	if (bindState)
+		pPyramid->Bind();
+	glVertexAttrib1f(ATTRIBUTE_MATERIAL_LAYER, (float) PICKUP_PYRAMID);
+	pPyramid->Draw();
+}
 
 
 // Constructor
@@ -56,23 +141,69 @@ Game::Game()
 	m_pHighResolutionTimer = NULL;
 	m_pAudio = NULL;
 	m_pCatmullRom = NULL;
+	m_pEndlessTrack = NULL;
 	m_pFighterMesh = NULL;
 	m_pCube = NULL;
 	m_pPyramid = NULL;
+	m_pPrimitives = NULL;
+	m_pSkyboxTimer = NULL;
+	m_pPrePassTimer = NULL;
+	m_pOpaqueTimer = NULL;
 	m_pHealthPack = NULL;
+	m_pModelViewMatrixStack = NULL;
+	m_pFrustum = NULL;
+	m_pSphereBounds = NULL;
+	m_pCubeBounds = NULL;
+	m_pPyramidBounds = NULL;
+	m_pHealthPackBounds = NULL;
+	m_pLodSelector = NULL;
+	m_pStreamBuffer = NULL;
+	m_pRacers = NULL;
+	m_pJobSystem = NULL;
+	m_pRenderQueue = NULL;
+	m_pFrameArena = NULL;
+	m_pResourcePack = NULL;
+	m_pStartupProfiler = NULL;
+	m_pPickupTextures = NULL;
+	m_pGpuCuller = NULL;
 
 	m_dt = 0.0;
 	m_framesPerSecond = 0;
 	m_frameCount = 0;
 	m_elapsedTime = 0.0f;
-	m_currentDistance = 0.0f;
-	m_rotateObject = 0.0;
+	m_frameNumber = 0;
+	m_frameArenaOverflows = 0;
+	m_matrixStackErrors = 0;
+	m_pickupsReplaced = false;
+	m_allocCheckFrames = 0;
+	m_allocCheckFailures = 0;
+	m_currentDistance = 0.0;
+	m_animationTime = 0.0f;
 	m_spaceShipPosition = glm::vec3(0, 0, 0);
 	m_spaceShipOrientation = glm::mat4(0);
 	m_health = 100;
 	m_points = 0;
 	m_currentLap = 0;
 	m_isGameOver = false;
+	m_lateralOffset = 0.0f;
+	m_endless = false;
+	m_endlessSeed = 0;
+	m_numRacers = 0;
+	m_numJobThreads = 0;
+	m_benchmarkJobs = false;
+	m_benchmarkTrack = false;
+	m_pickupVersion = 0;
+	for (int i = 0; i < 4; i++)
+		m_firstPickupSerial[i] = 0;
+	m_gpuCulling = false;
+	for (int i = 0; i < 3; i++)
+		m_firstGpuPickup[i] = 0;
+	m_cullCheckFrames = 0;
+	m_cullCheckFailures = 0;
+	m_gpuTiming = false;
+	m_skyboxFirst = false;
+	m_depthMode = DEPTH_MODE_SORTED;
+	m_reportTrackSampling = false;
 }
 
 // Destructor
@@ -88,11 +219,32 @@ Game::~Game()
 	delete m_pSphere;
 	delete m_pAudio;
 	delete m_pCatmullRom;
+	delete m_pEndlessTrack;
 	delete m_pFighterMesh;
 	delete m_pCube;
 	delete m_pPyramid;
 	delete m_pHealthPack;
 	delete m_pShaderProgram;
+	delete m_pModelViewMatrixStack;
+	delete m_pFrustum;
+	delete m_pSphereBounds;
+	delete m_pCubeBounds;
+	delete m_pPyramidBounds;
+	delete m_pHealthPackBounds;
+	delete m_pLodSelector;
+	delete m_pStreamBuffer;
+	delete m_pRacers;
+	delete m_pJobSystem;
+	delete m_pRenderQueue;
+	delete m_pFrameArena;
+	delete m_pPickupTextures;
+	delete m_pGpuCuller;
+	delete m_pPrimitives;
+	delete m_pSkyboxTimer;
+	delete m_pPrePassTimer;
+	delete m_pOpaqueTimer;
+	CResourcePack::Mount(NULL);
+	delete m_pResourcePack;
 
 	if (m_pShaderPrograms != NULL) {
 		for (unsigned int i = 0; i < m_pShaderPrograms->size(); i++)
@@ -102,6 +254,7 @@ Game::~Game()
 
 	//setup objects
 	delete m_pHighResolutionTimer;
+	delete m_pStartupProfiler;
 }
 
 // Initialisation:  This method only runs once at startup
@@ -125,13 +278,55 @@ void Game::Initialise()
 	m_pSphere = new CSphere;
 	m_pAudio = new CAudio;
 	m_pCatmullRom = new CCatmullRom;
+	m_pEndlessTrack = new CEndlessTrack;
 	m_pCube = new CCube;
 	m_pPyramid = new PPyramid;
+	m_pPrimitives = new CPrimitiveArena;
+	m_pSkyboxTimer = new CGpuTimer;
+	m_pPrePassTimer = new CGpuTimer;
+	m_pOpaqueTimer = new CGpuTimer;
 	m_pModelMatrix = new glm::mat4(1);
 	m_pViewMatrix = new glm::mat4(1);
 	m_pProjectionMatrix = new glm::mat4(1);
+	m_pModelViewMatrixStack = new glutil::MatrixStack;
+	m_pFrustum = new CFrustum;
+	m_pSphereBounds = new CBoundingSpheres;
+	m_pCubeBounds = new CBoundingSpheres;
+	m_pPyramidBounds = new CBoundingSpheres;
+	m_pHealthPackBounds = new CBoundingSpheres;
+	m_pLodSelector = new CLodSelector;
+	m_pStreamBuffer = new CStreamBuffer;
+	m_pRacers = new CRacers;
+	m_updateRacers = [this] { m_pRacers->Update(m_dt); };
+	m_pJobSystem = new CJobSystem;
+	m_pRenderQueue = new CRenderQueue;
+	m_pFrameArena = new CFrameArena;
+	m_pResourcePack = new CResourcePack;
+	m_pPickupTextures = new CTextureArray;
+	m_pGpuCuller = new CGpuCuller;
 	
 	
+	// Read every resource from the pack, if one has been built with "-pack", rather than from the loose files.  If a
+	// loose file has changed since, the pack is out of date, and the loose files are read instead.
+	if (m_pResourcePack->Open(RESOURCE_PACK_FILE)) {
+		string newer = CResourcePack::FindNewerFile(RESOURCE_PACK_FILE, "resources");
+		if (newer.empty()) {
+			CResourcePack::Mount(m_pResourcePack);
+			printf("Pack: reading %d files from %s\n", m_pResourcePack->GetNumFiles(), RESOURCE_PACK_FILE);
+		} else {
+			printf("Pack: %s is newer than %s, so reading the loose files instead; run with -pack to rebuild it\n",
+				newer.c_str(), RESOURCE_PACK_FILE);
+			m_pResourcePack->Close();
+		}
+	}
+
+	// Start the worker threads, which load the assets alongside this thread
+	double stageStart = m_pStartupProfiler->Now();
+	m_pJobSystem->Create(m_numJobThreads);
+	m_pFrameArena->Create(FRAME_ARENA_SIZE);
+	m_pRenderQueue->Create(m_pJobSystem->GetNumThreads(), m_pFrameArena);
+	m_pStartupProfiler->Record("start jobs", stageStart, m_pStartupProfiler->Now());
+
 	RECT dimensions = m_gameWindow.GetDimensions();
 
 	int width = dimensions.right - dimensions.left;
@@ -141,6 +336,181 @@ void Game::Initialise()
 	m_pCamera->SetOrthographicProjectionMatrix(width, height); 
 	m_pCamera->SetPerspectiveProjectionMatrix(45.0f, (float) width / (float) height, 0.5f, 5000.0f);
 
+	// Pickups shrink away between these distances from the camera and are not drawn at all beyond the second
+	m_pFrustum->SetDistanceThresholds(600.0f, 900.0f);
+
+	// Drop to a coarser level of detail once an object is less than 120, then 40, pixels across
+	m_pLodSelector->SetProjection(45.0f, height);
+	m_pLodSelector->SetThresholds(120.0f, 40.0f);
+	m_pLodSelector->SetHysteresis(0.15f);
+
+	// 64 KB a frame, with three frames in flight, is plenty for the HUD text, which cannot be drawn without it
+	if (!m_pStreamBuffer->Create(64 * 1024, 3)) {
+		MessageBox(NULL, "Unable to create the streaming buffer", "Error", MB_ICONERROR);
+		PostQuitMessage(1);
+		return;
+	}
+
+	if (m_gpuTiming) {
+		m_pSkyboxTimer->Create();
+		m_pPrePassTimer->Create();
+		m_pOpaqueTimer->Create();
+	}
+
+	// Everything the first frame needs, each with what it needs first.  Files are read, and images and models
+	// decoded, on the workers; only this thread has the GL context, so each asset's buffers, textures and shaders
+	// are made here as its files come in.
+	CAssetManifest manifest;
+	manifest.Add("shaders", ASSET_SHADERS, nullptr, [this] { CreateShaderPrograms(); });
+
+	// Skybox downloaded from   http://www.custommapmakers.org/skyboxes.php
+	manifest.Add("skybox", ASSET_TEXTURE, [] { CSkybox::Prefetch(); }, [this] { m_pSkybox->Create(m_pPrimitives, 2500.0f); });
+
+	// Texture downloaded from http://www.psionicgames.com/?page_id=26 on 24 Jan 2013
+	manifest.Add("terrain", ASSET_TEXTURE, [] { CTexture::Prefetch("resources\\textures\\mars_texture.jpg"); },
+		[this] { m_pPlanarTerrain->Create(m_pPrimitives, "resources\\textures\\", "mars_texture.jpg", 2000.0f, 2000.0f, 100.0f); });
+
+	manifest.Add("font", ASSET_FONT, nullptr, [this] {
+		m_pFtFont->LoadSystemFont("arial.ttf", 32);
+		m_pFtFont->SetShaderProgram((*m_pShaderPrograms)[1]);
+		m_pFtFont->SetStreamBuffer(m_pStreamBuffer);
+		m_pFtFont->SetFrameArena(m_pFrameArena);
+	}, { "shaders" });
+
+	// Load some meshes in OBJ format
+	// Downloaded from http://www.psionicgames.com/?page_id=24 on 24 Jan 2013
+	manifest.Add("barrel", ASSET_MESH, [this] { m_pBarrelMesh->Prepare("resources\\models\\Barrel\\Barrel02.obj"); },
+		[this] { m_pBarrelMesh->Upload(); });
+	// Downloaded from http://opengameart.org/content/horse-lowpoly on 24 Jan 2013
+	manifest.Add("horse", ASSET_MESH, [this] { m_pHorseMesh->Prepare("resources\\models\\Horse\\Horse2.obj"); },
+		[this] { m_pHorseMesh->Upload(); });
+	// Downloaded from http://www.psionicgames.com/?page_id=24 on March 15th 2016
+	manifest.Add("fighter", ASSET_MESH, [this] { m_pFighterMesh->Prepare("resources\\models\\Fighter\\fighter1.obj"); },
+		[this] { m_pFighterMesh->Upload(); });
+	// Downloaded from http://www.turbosquid.com/3d-models/free-health-pack-3d-model/514293 on 23th March 2016
+	manifest.Add("healthpack", ASSET_MESH, [this] { m_pHealthPack->Prepare("resources\\models\\Healthpack\\healthpack.3ds"); },
+		[this] { m_pHealthPack->Upload(); });
+
+	// The sphere, cube and pyramid pickups take their textures from one texture array, a layer for each in
+	// PickupType order, so that they are drawn with a single texture bound
+	static const char *pickupTextures[3] = {
+		"resources\\textures\\green_texture.jpg",	// Texture downloaded from http://www.pageresource.com/wallpapers/3974/texture-green-wall-hd-wallpaper.html on 19 March 2016
+		"resources\\textures\\red_texture.jpg",		//texture downloaded from http://www.pageresource.com/wallpapers/4190/muffet-red-texture-textures-geprek-hd-wallpaper.htmlon 15 March 2016
+		"resources\\textures\\yellow_texture.jpg",	//texture downloaded from http://muffet1.deviantart.com/art/Smoky-Glow-161302234 on 19 March 2016
+	};
+	manifest.Add("pickup textures", ASSET_TEXTURE, [] {
+		for (int i = 0; i < 3; i++)
+			CTexture::Prefetch(pickupTextures[i]);
+	}, [this] { m_pPickupTextures->Create(vector<string>(pickupTextures, pickupTextures + 3)); });
+	manifest.Add("sphere", ASSET_MESH, nullptr, [this] { m_pSphere->Create(m_pPrimitives, "", "", 25, 25); });
+	manifest.Add("cube", ASSET_MESH, nullptr, [this] { m_pCube->Create(m_pPrimitives, ""); });
+	manifest.Add("pyramid", ASSET_MESH, nullptr, [this] { m_pPyramid->Create(m_pPrimitives, ""); });
+
+	// The skybox, terrain and pickups share one vertex and index buffer, uploaded once they have all been added
+	manifest.Add("primitives", ASSET_MESH, nullptr, [this] { m_pPrimitives->Create(); },
+		{ "skybox", "terrain", "sphere", "cube", "pyramid" });
+
+	// With OpenGL 4.3 the same three are culled on the GPU and drawn from the arena with one multi-draw.  Otherwise
+	// they are culled on the CPU and drawn through the render queue.
+	manifest.Add("gpu culler", ASSET_MESH, nullptr, [this] {
+		if (!CGpuCuller::IsSupported()) {
+			printf("Culling: OpenGL 4.3 is not available, so pickups are culled on the CPU\n");
+			return;
+		}
+		m_pGpuCuller->AddMesh(m_pPrimitives, m_pSphere->GetFirstPrimitive(), m_pSphere->GetNumLods(), m_pSphere->GetBoundingRadius() + PICKUP_BOB_HEIGHT / 2.0f);
+		m_pGpuCuller->AddMesh(m_pPrimitives, m_pCube->GetPrimitive(), 1, m_pCube->GetBoundingRadius() + PICKUP_BOB_HEIGHT / 2.0f);
+		m_pGpuCuller->AddMesh(m_pPrimitives, m_pPyramid->GetPrimitive(), 1, m_pPyramid->GetBoundingRadius() + PICKUP_BOB_HEIGHT / 2.0f);
+		m_gpuCulling = m_pGpuCuller->Create((*m_pShaderPrograms)[RENDER_PROGRAM_CULL]);
+		if (m_gpuCulling)
+			printf("Culling: pickups are culled on the GPU\n");
+		else
+			printf("Culling: the GPU culler could not be created, so pickups are culled on the CPU\n");
+	}, { "shaders", "primitives" });
+
+	if (m_endless) {
+		// Generate the track as the ship goes; the pickups come and go with it
+		manifest.Add("track", ASSET_TRACK, [] { CTexture::Prefetch(TRACK_TEXTURE); },
+			[this] { m_pEndlessTrack->Create(m_endlessSeed, TRACK_TEXTURE); });
+	} else {
+		// Read the track, which falls back on the built-in loop if the file cannot be read, and build it
+		manifest.Add("track", ASSET_TRACK, [this] {
+			m_pCatmullRom->LoadTrack(TRACK_FILE);
+			CTexture::Prefetch(TRACK_TEXTURE);
+		}, [this] {
+			m_pCatmullRom->CreateCentreline();
+			if (m_reportTrackSampling)
+				m_pCatmullRom->ReportTrackSampling();
+			m_pCatmullRom->CreateTrack(TRACK_TEXTURE);
+			m_pCatmullRom->SetTrackViewDistance(2000.0f);
+		});
+
+		// The computer-controlled racers, if any were asked for, start spread round the loop.  Placing them needs no
+		// context, but their instance buffer does.
+		if (m_numRacers > 0)
+			manifest.Add("racers", ASSET_GAMEPLAY, [this] {
+				m_pRacers->Create(m_numRacers, (unsigned int) time(0), m_pCatmullRom, m_pJobSystem);
+			}, [this] {
+				if (m_pRacers->GetCount() > 0 && !m_pRacers->CreateInstanceBuffer())
+					printf("Racers: cannot create the instance buffer, so racing without them\n");
+			}, { "track" });
+	}
+
+	// The pickups' bounds are sized by their meshes
+	manifest.Add("pickups", ASSET_GAMEPLAY, nullptr, [this] {
+		if (m_endless)
+			SyncEndlessPickups();
+		else
+			PlaceTrackPickups();
+	}, { "track", "sphere", "cube", "pyramid", "healthpack", "gpu culler" });
+
+	// Show how far the loading has got, no more often than a swap could keep up with
+	double lastDrawn = m_pStartupProfiler->Now();
+	DrawLoadingScreen(0, manifest.GetNumAssets());
+	bool loaded = manifest.Load(m_pJobSystem, m_pStartupProfiler, [this, &lastDrawn](int numDone, int numAssets, const string &name) {
+		if (numDone < numAssets && m_pStartupProfiler->Now() - lastDrawn >= LOADING_SCREEN_INTERVAL) {
+			DrawLoadingScreen(numDone, numAssets);
+			lastDrawn = m_pStartupProfiler->Now();
+		}
+	});
+	CTexture::ReleasePrefetched();
+
+	// Load has already said what is wrong; the assets after the fault were never loaded, so there is no game to run
+	if (!loaded) {
+		PostQuitMessage(1);
+		return;
+	}
+
+	// There is nothing for "-cullcheck" to check without the GPU culler
+	if (m_cullCheckFrames > 0 && !m_gpuCulling) {
+		printf("Cull check: the GPU culler is not in use\n");
+		PostQuitMessage(1);
+	}
+
+    //glEnable(GL_CULL_FACE);
+
+	// Initialise audio and play background music
+	//m_pAudio->Initialise();
+	//m_pAudio->LoadEventSound("Resources\\Audio\\Boing.wav");					// Royalty free sound from freesound.org
+	//m_pAudio->LoadMusicStream("Resources\\Audio\\DST-Garote.mp3");	// Royalty free music from http://www.nosoapradio.us/
+	//m_pAudio->PlayMusicStream();
+
+	if (!m_endless && m_benchmarkJobs)
+		BenchmarkJobSystem();
+	if (!m_endless && m_benchmarkTrack)
+		BenchmarkTrackProjection();
+
+		
+	m_objectNames.push_back("Pyramid");
+	m_objectNames.push_back("Cube");
+	m_objectNames.push_back("Sphere");
+	srand(time(0));
+	m_currentObjects = m_objectNames[(rand() % 3)];
+	
+}
+
+// Load the shaders and link them into the programs the game draws with
+void Game::CreateShaderPrograms()
+{
 	// Load shaders
 	vector<CShader> shShaders;
 	vector<string> sShaderFileNames;
@@ -148,7 +518,12 @@ void Game::Initialise()
 	sShaderFileNames.push_back("mainShader.frag");
 	sShaderFileNames.push_back("textShader.vert");
 	sShaderFileNames.push_back("textShader.frag");
-	
+	sShaderFileNames.push_back("instancedShader.vert");
+	sShaderFileNames.push_back("textureArrayShader.frag");
+	sShaderFileNames.push_back("depthShader.vert");
+	sShaderFileNames.push_back("depthShader.frag");
+	if (CGpuCuller::IsSupported())
+		sShaderFileNames.push_back("cullShader.comp");
 
 	for (int i = 0; i < (int) sShaderFileNames.size(); i++) {
 		string sExt = sShaderFileNames[i].substr((int) sShaderFileNames[i].size()-4, 4);
@@ -157,6 +532,7 @@ void Game::Initialise()
 		else if (sExt == "frag") iShaderType = GL_FRAGMENT_SHADER;
 		else if (sExt == "geom") iShaderType = GL_GEOMETRY_SHADER;
 		else if (sExt == "tcnl") iShaderType = GL_TESS_CONTROL_SHADER;
+		else if (sExt == "comp") iShaderType = GL_COMPUTE_SHADER;
 		else iShaderType = GL_TESS_EVALUATION_SHADER;
 		CShader shader;
 		shader.LoadShader("resources\\shaders\\"+sShaderFileNames[i], iShaderType);
@@ -179,97 +555,118 @@ void Game::Initialise()
 	pFontProgram->LinkProgram();
 	m_pShaderPrograms->push_back(pFontProgram);
 
+	// Create a shader program for instanced meshes, lit and textured as by the main program
+	CShaderProgram *pInstancedProgram = new CShaderProgram;
+	pInstancedProgram->CreateProgram();
+	pInstancedProgram->AddShaderToProgram(&shShaders[4]);
+	pInstancedProgram->AddShaderToProgram(&shShaders[1]);
+	pInstancedProgram->LinkProgram();
+	m_pShaderPrograms->push_back(pInstancedProgram);
+
+	// Create a shader program for objects whose texture is a layer of a texture array
+	CShaderProgram *pTextureArrayProgram = new CShaderProgram;
+	pTextureArrayProgram->CreateProgram();
+	pTextureArrayProgram->AddShaderToProgram(&shShaders[0]);
+	pTextureArrayProgram->AddShaderToProgram(&shShaders[5]);
+	pTextureArrayProgram->LinkProgram();
+	m_pShaderPrograms->push_back(pTextureArrayProgram);
+
+	// Create a shader program for instanced objects whose texture is a layer of a texture array
+	CShaderProgram *pInstancedTextureArrayProgram = new CShaderProgram;
+	pInstancedTextureArrayProgram->CreateProgram();
+	pInstancedTextureArrayProgram->AddShaderToProgram(&shShaders[4]);
+	pInstancedTextureArrayProgram->AddShaderToProgram(&shShaders[5]);
+	pInstancedTextureArrayProgram->LinkProgram();
+	m_pShaderPrograms->push_back(pInstancedTextureArrayProgram);
+
+	// Its objects spin and bob the same way for as long as they are drawn, so only the time changes each frame
+	pInstancedTextureArrayProgram->UseProgram();
+	pInstancedTextureArrayProgram->SetUniform("spinSpeed", PICKUP_SPIN_SPEED);
+	pInstancedTextureArrayProgram->SetUniform("bobHeight", PICKUP_BOB_HEIGHT);
+	pInstancedTextureArrayProgram->SetUniform("bobSpeed", PICKUP_BOB_SPEED);
+
+	// Create a shader program that only writes depth, for the depth pre-pass
+	CShaderProgram *pDepthProgram = new CShaderProgram;
+	pDepthProgram->CreateProgram();
+	pDepthProgram->AddShaderToProgram(&shShaders[6]);
+	pDepthProgram->AddShaderToProgram(&shShaders[7]);
+	pDepthProgram->LinkProgram();
+	m_pShaderPrograms->push_back(pDepthProgram);
+
+	// Create the compute program that culls objects for the GPU culler, where there are compute shaders
+	if (CGpuCuller::IsSupported()) {
+		CShaderProgram *pCullProgram = new CShaderProgram;
+		pCullProgram->CreateProgram();
+		pCullProgram->AddShaderToProgram(&shShaders[8]);
+		pCullProgram->LinkProgram();
+		m_pShaderPrograms->push_back(pCullProgram);
+	}
 
 	// You can follow this pattern to load additional shaders
+}
 
-
-
-
-	// Create the skybox
-	// Skybox downloaded from   http://www.custommapmakers.org/skyboxes.php
-	m_pSkybox->Create(2500.0f);
-	
-	// Create the planar terrain
-	m_pPlanarTerrain->Create("resources\\textures\\", "mars_texture.jpg", 2000.0f, 2000.0f, 100.0f); // Texture downloaded from http://www.psionicgames.com/?page_id=26 on 24 Jan 2013
-
-	m_pFtFont->LoadSystemFont("arial.ttf", 32);
-	m_pFtFont->SetShaderProgram(pFontProgram);
-
-	// Load some meshes in OBJ format
-	m_pBarrelMesh->Load("resources\\models\\Barrel\\Barrel02.obj");  // Downloaded from http://www.psionicgames.com/?page_id=24 on 24 Jan 2013
-	m_pHorseMesh->Load("resources\\models\\Horse\\Horse2.obj");  // Downloaded from http://opengameart.org/content/horse-lowpoly on 24 Jan 2013
-	m_pFighterMesh->Load("resources\\models\\Fighter\\fighter1.obj"); // Downloaded from http://www.psionicgames.com/?page_id=24 on March 15th 2016
-	m_pHealthPack->Load("resources\\models\\Healthpack\\healthpack.3ds");// Downloaded from http://www.turbosquid.com/3d-models/free-health-pack-3d-model/514293 on 23th March 2016
-	
-																		   
-	// Create a sphere
-	m_pSphere->Create("resources\\textures\\", "green_texture.jpg", 25, 25);  // Texture downloaded from http://www.pageresource.com/wallpapers/3974/texture-green-wall-hd-wallpaper.html on 19 March 2016
-	//create cube
-	m_pCube->Create("resources\\textures\\red_texture.jpg"); //texture downloaded from http://www.pageresource.com/wallpapers/4190/muffet-red-texture-textures-geprek-hd-wallpaper.htmlon 15 March 2016
-	//create pyramid
-	m_pPyramid->Create("resources\\textures\\yellow_texture.jpg"); //texture downloaded from http://muffet1.deviantart.com/art/Smoky-Glow-161302234 on 19 March 2016
-	
-																   
-    //glEnable(GL_CULL_FACE);
-
-	// Initialise audio and play background music
-	//m_pAudio->Initialise();
-	//m_pAudio->LoadEventSound("Resources\\Audio\\Boing.wav");					// Royalty free sound from freesound.org
-	//m_pAudio->LoadMusicStream("Resources\\Audio\\DST-Garote.mp3");	// Royalty free music from http://www.nosoapradio.us/
-	//m_pAudio->PlayMusicStream();
-
-	m_pCatmullRom->CreateCentreline();
-	m_pCatmullRom->CreateOffsetCurves();
-	m_pCatmullRom->CreateOjectPath();
-	m_pCatmullRom->CreateTrack("resources\\textures\\space_floor.jpg"); ////texture downloaded from http://thumbs.dreamstime.com/t/texture-silver-metal-platform-floor-background-close-up-54526246.jpg 17 March 2016
-
-																		//store the location of each object.
-	vector<glm::vec3> spherePoints = m_pCatmullRom->GetRightObjectPoints();
-	vector<glm::vec3> cubePoints = m_pCatmullRom->GetLeftObjectPoints();
-	vector<glm::vec3> centrePoints = m_pCatmullRom->GetCentrelinePoints();
-
-	//store locations for spheres
-	for (int i = 1; i < spherePoints.size(); i++) {
-		if (i % 50 == 0) {
-
-			m_spherePointLocation.push_back(spherePoints.at(i));
+// Store the location of each pickup, as placed by the loop track
+void Game::PlaceTrackPickups()
+{
+	const vector<TrackPickup> &pickups = m_pCatmullRom->GetPickups();
+	for (unsigned int i = 0; i < pickups.size(); i++) {
+		switch (pickups[i].type) {
+		case PICKUP_SPHERE:
+			m_spherePointLocation.push_back(pickups[i].position);
+			m_spherePointDistance.push_back(pickups[i].distance);
 			m_activeSphere.push_back(true);
-		}
-	}
-
-	//store locations for cube
-	for (int i = 1; i < cubePoints.size(); i++) {
-		if (i % 50 == 0) {
-			m_cubePointLocation.push_back(cubePoints.at(i));
+			break;
+		case PICKUP_CUBE:
+			m_cubePointLocation.push_back(pickups[i].position);
+			m_cubePointDistance.push_back(pickups[i].distance);
 			m_activeCube.push_back(true);
-		}
-	}
-
-	//store locations for pyramid
-	for (int i = 1; i < centrePoints.size(); i++) {
-		if (i % 50 == 0) {
-			m_pyramidPointLocation.push_back(centrePoints.at(i));
+			break;
+		case PICKUP_PYRAMID:
+			m_pyramidPointLocation.push_back(pickups[i].position);
+			m_pyramidPointDistance.push_back(pickups[i].distance);
 			m_activePyramid.push_back(true);
-		}
-	}
-
-	//store locations for health pack.
-	for (int i = 0; i < centrePoints.size(); i++) {
-		if (i % 250 == 0) {
-			m_healthpackPointLocation.push_back(centrePoints.at(i + 36));
+			break;
+		case PICKUP_HEALTHPACK:
+			m_healthpackPointLocation.push_back(pickups[i].position);
+			m_healthpackPointDistance.push_back(pickups[i].distance);
 			m_activeHealthPack.push_back(true);
+			break;
 		}
-	
 	}
+	FindPickupFrames();
+	UpdatePickupBounds();
+	m_sphereLod.assign(m_spherePointLocation.size(), 0);
+	m_healthPackLod.assign(m_healthpackPointLocation.size(), 0);
+}
 
+// A progress bar for while the assets load, drawn with clears alone so that it needs nothing loaded
+void Game::DrawLoadingScreen(int numDone, int numAssets)
+{
+	RECT dimensions = m_gameWindow.GetDimensions();
+	int width = dimensions.right - dimensions.left;
+	int height = dimensions.bottom - dimensions.top;
+	int barWidth = width / 2;
+	int barHeight = 16;
+	int x = (width - barWidth) / 2;
+	int y = (height - barHeight) / 2;
 
-		
-	m_objectNames.push_back("Pyramid");
-	m_objectNames.push_back("Cube");
-	m_objectNames.push_back("Sphere");
-	srand(time(0));
-	m_currentObjects = m_objectNames[(rand() % 3)];
-	
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x - 2, y - 2, barWidth + 4, barHeight + 4);
+	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(x, y, barWidth, barHeight);
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(x, y, numAssets > 0 ? barWidth * numDone / numAssets : 0, barHeight);
+	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+
+	// Back to the game's clear colour
+	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+	SwapBuffers(m_gameWindow.Hdc());
 }
 
 // Render method runs repeatedly in a loop
@@ -280,9 +677,12 @@ void Game::Render()
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
 
-	// Set up a matrix stack
-	glutil::MatrixStack modelViewMatrixStack;
-	modelViewMatrixStack.SetIdentity();
+	// Start this frame's part of the stream buffer, waiting if the GPU is still using it from an earlier frame
+	m_pStreamBuffer->BeginFrame();
+
+	// Set up the matrix stack -- it persists across frames, so just empty it
+	glutil::MatrixStack &modelViewMatrixStack = *m_pModelViewMatrixStack;
+	modelViewMatrixStack.Clear();
 
 	// Use the main shader program 
 	CShaderProgram *pMainProgram = (*m_pShaderPrograms)[0];
@@ -299,7 +699,10 @@ void Game::Render()
 	// Store the view matrix and the normal matrix associated with the view matrix for later (they're useful for lighting -- since lighting is done in eye coordinates)
 	modelViewMatrixStack.LookAt(m_pCamera->GetPosition(), m_pCamera->GetView(), m_pCamera->GetUpVector());
 	glm::mat4 viewMatrix = modelViewMatrixStack.Top();
-	glm::mat3 viewNormalMatrix = m_pCamera->ComputeNormalMatrix(viewMatrix);
+	glm::mat3 viewNormalMatrix = m_pCamera->ComputeNormalMatrix(modelViewMatrixStack);
+
+	// Update the view frustum so that objects outside it can be skipped
+	m_pFrustum->Extract(*m_pCamera->GetPerspectiveProjectionMatrix(), viewMatrix);
 
 
 	// Set light and materials in main shader program
@@ -314,197 +717,520 @@ void Game::Render()
 	pMainProgram->SetUniform("material1.shininess", 15.0f);		// Shininess material property
 
 
-	// Render the skybox and terrain with full ambient reflectance 
-	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("renderSkybox", true);
-	// Translate the modelview matrix to the camera eye point so skybox stays centred around camera
+	// The skybox is drawn last, so that only the pixels nothing else covers shade it.  "-skyfirst" draws it here
+	// instead, under everything, as it used to be, to compare the two.
 	glm::vec3 vEye = m_pCamera->GetPosition();
-	modelViewMatrixStack.Translate(vEye);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pSkybox->Render();
-	pMainProgram->SetUniform("renderSkybox", false);
-	modelViewMatrixStack.Pop();
-
-	// Render the planar terrain
-	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pPlanarTerrain->Render();
-	modelViewMatrixStack.Pop();
-
-
-
+	if (m_skyboxFirst)
+		RenderSkybox(vEye);
 
 	// Turn on diffuse + specular materials
 	pMainProgram->SetUniform("material1.Ma", glm::vec3(0.5f));	// Ambient material reflectance
 	pMainProgram->SetUniform("material1.Md", glm::vec3(0.5f));	// Diffuse material reflectance
 	pMainProgram->SetUniform("material1.Ms", glm::vec3(1.0f));	// Specular material reflectance	
 
+	// The spaceship and the pickups are recorded as draw packets first, then sorted and drawn together below
+	m_pRenderQueue->BeginFrame();
 
-
-	
-
-	//Render spaceship
+	//Render spaceship, raised off the track along the track's own up
 	modelViewMatrixStack.Push();
-	modelViewMatrixStack.Translate(glm::vec3(0, 5, 0));
 	modelViewMatrixStack.Translate(m_spaceShipPosition.x, m_spaceShipPosition.y, m_spaceShipPosition.z);
-	modelViewMatrixStack *= m_spaceShipOrientation;
+	modelViewMatrixStack.Rotate(glm::mat3(m_spaceShipOrientation));
+	modelViewMatrixStack.Translate(glm::vec3(0, 5, 0));
 	modelViewMatrixStack.Scale(0.3);
-	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pFighterMesh->Render();
+	m_pRenderQueue->GetCommandBuffer(m_pJobSystem->GetThreadIndex()).Draw(
+		CRenderQueue::MakeKey(RENDER_PASS_OPAQUE, RENDER_PROGRAM_MAIN, RENDER_MESH_SHIP, RENDER_MESH_SHIP, glm::distance(m_spaceShipPosition, vEye), RENDER_MAX_DEPTH),
+		DrawMesh, m_pFighterMesh, 0, modelViewMatrixStack.Top(), m_pCamera->ComputeNormalMatrix(modelViewMatrixStack));
 	modelViewMatrixStack.Pop();
 
+	// Record the pickups, a kind at a time on as many threads as there are.  The GPU culler, if there is one, culls
+	// the sphere, cube and pyramid pickups itself, all at once.
+	int firstRecorded = m_gpuCulling ? PICKUP_HEALTHPACK : PICKUP_SPHERE;
+	m_pJobSystem->ParallelFor(PICKUP_HEALTHPACK + 1 - firstRecorded, 1, [&](int first, int last) {
+		for (int type = firstRecorded + first; type < firstRecorded + last; type++)
+			RecordPickups(type, modelViewMatrixStack, vEye);
+	});
+	if (m_gpuCulling)
+		m_pGpuCuller->Cull(*m_pFrustum, *m_pLodSelector);
+
+	// The sphere, cube and pyramid pickups are lit as by the main program, and share the one texture array.  Drawn
+	// through the render queue they have the texture array program; drawn by the GPU culler, the instanced one, which
+	// takes just the view transform.
+	int pickupPrograms[2] = { RENDER_PROGRAM_TEXTURE_ARRAY, RENDER_PROGRAM_INSTANCED_TEXTURE_ARRAY };
+	for (int i = 0; i < 2; i++) {
+		CShaderProgram *pTextureArrayProgram = (*m_pShaderPrograms)[pickupPrograms[i]];
+		pTextureArrayProgram->UseProgram();
+		pTextureArrayProgram->SetUniform("bUseTexture", true);
+		pTextureArrayProgram->SetUniform("samplerArray", PICKUP_TEXTURE_UNIT);
+		pTextureArrayProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pTextureArrayProgram->SetUniform("matrices.modelViewMatrix", viewMatrix);
+		pTextureArrayProgram->SetUniform("matrices.normalMatrix", viewNormalMatrix);
+		pTextureArrayProgram->SetUniform("light1.position", viewMatrix*lightPosition1);
+		pTextureArrayProgram->SetUniform("light1.La", glm::vec3(1.0f));
+		pTextureArrayProgram->SetUniform("light1.Ld", glm::vec3(1.0f));
+		pTextureArrayProgram->SetUniform("light1.Ls", glm::vec3(1.0f));
+		pTextureArrayProgram->SetUniform("material1.Ma", glm::vec3(0.5f));
+		pTextureArrayProgram->SetUniform("material1.Md", glm::vec3(0.5f));
+		pTextureArrayProgram->SetUniform("material1.Ms", glm::vec3(1.0f));
+		pTextureArrayProgram->SetUniform("material1.shininess", 15.0f);
+	}
+
+	// The planar terrain, with full ambient reflectance
+	auto renderTerrain = [&] {
+		pMainProgram->SetUniform("material1.Ma", glm::vec3(1.0f));
+		pMainProgram->SetUniform("material1.Md", glm::vec3(0.0f));
+		pMainProgram->SetUniform("material1.Ms", glm::vec3(0.0f));
+		modelViewMatrixStack.Push();
+		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
+		pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack));
+		m_pPlanarTerrain->Render();
+		modelViewMatrixStack.Pop();
+		pMainProgram->SetUniform("material1.Ma", glm::vec3(0.5f));
+		pMainProgram->SetUniform("material1.Md", glm::vec3(0.5f));
+		pMainProgram->SetUniform("material1.Ms", glm::vec3(1.0f));
+	};
+
+	// The racers, with the instanced program, which takes each ship's placement from its instance data and so only
+	// needs the view transform
+	auto renderRacers = [&] {
+		if (m_pRacers->GetCount() == 0)
+			return;
+		CShaderProgram *pInstancedProgram = (*m_pShaderPrograms)[2];
+		pInstancedProgram->UseProgram();
+		pInstancedProgram->SetUniform("bUseTexture", true);
+		pInstancedProgram->SetUniform("renderSkybox", false);
+		pInstancedProgram->SetUniform("sampler0", 0);
+		pInstancedProgram->SetUniform("CubeMapTex", 1);
+		pInstancedProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+		pInstancedProgram->SetUniform("matrices.modelViewMatrix", viewMatrix);
+		pInstancedProgram->SetUniform("matrices.normalMatrix", viewNormalMatrix);
+		pInstancedProgram->SetUniform("light1.position", viewMatrix*lightPosition1);
+		pInstancedProgram->SetUniform("light1.La", glm::vec3(1.0f));
+		pInstancedProgram->SetUniform("light1.Ld", glm::vec3(1.0f));
+		pInstancedProgram->SetUniform("light1.Ls", glm::vec3(1.0f));
+		pInstancedProgram->SetUniform("material1.Ma", glm::vec3(0.5f));
+		pInstancedProgram->SetUniform("material1.Md", glm::vec3(0.5f));
+		pInstancedProgram->SetUniform("material1.Ms", glm::vec3(1.0f));
+		pInstancedProgram->SetUniform("material1.shininess", 15.0f);
+		m_pRacers->Render(m_pFighterMesh, *m_pFrustum, *m_pLodSelector, vEye);
+		pMainProgram->UseProgram();
+	};
+
+	// The track, only the chunks of it in view.  After the depth pre-pass the track draws again
+	// just the pieces the pre-pass streamed and culled.
+	bool trackInDepth = m_depthMode == DEPTH_MODE_PREPASS;
+	auto renderTrack = [&] {
+		modelViewMatrixStack.Push();
+		pMainProgram->SetUniform("bUseTexture",true); // turn on texturing
+		pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
+		pMainProgram->SetUniform("matrices.normalMatrix",
+			m_pCamera->ComputeNormalMatrix(modelViewMatrixStack));
+		if (m_endless) {
+			if (trackInDepth)
+				m_pEndlessTrack->Redraw();
+			else
+				m_pEndlessTrack->Render(*m_pFrustum);
+		} else {
+			m_pCatmullRom->RenderCentreline();
+			if (trackInDepth)
+				m_pCatmullRom->RedrawTrack();
+			else
+				m_pCatmullRom->RenderTrack(*m_pFrustum);
+		}
+		modelViewMatrixStack.Pop();
+	};
+
+	// Everything recorded: the spaceship and the pickups, sorted, and the pickups the GPU culler kept
+	auto renderObjects = [&] {
+		m_pPickupTextures->Bind(PICKUP_TEXTURE_UNIT);
+		if (m_gpuCulling) {
+			CShaderProgram *pInstancedTextureArrayProgram = (*m_pShaderPrograms)[RENDER_PROGRAM_INSTANCED_TEXTURE_ARRAY];
+			pInstancedTextureArrayProgram->UseProgram();
+			pInstancedTextureArrayProgram->SetUniform("t", m_animationTime);
+			m_pGpuCuller->Draw();
+			if (m_cullCheckFrames > 0)
+				CheckGpuCulling();
+		}
+		m_pRenderQueue->Submit(*m_pShaderPrograms);
+		pMainProgram->UseProgram();
+	};
+
+	// Draw the opaque geometry; see DepthMode.  Sorted, it goes front to back a layer at a time, so that the depth
+	// test rejects what is hidden before it is shaded: the ship, racers and pickups, which fly above the track, then
+	// the track, which lies above the terrain, then the terrain under them all.  The terrain and the track surround
+	// the camera and have no one depth, so they are ordered as layers rather than sorted by distance.
+	if (m_depthMode == DEPTH_MODE_PREPASS)
+		RenderDepthPrePass(viewMatrix);
+	if (m_gpuTiming)
+		m_pOpaqueTimer->Begin();
+	pMainProgram->UseProgram();
+	if (m_depthMode == DEPTH_MODE_UNSORTED) {
+		renderTerrain();
+		renderRacers();
+		renderTrack();
+		renderObjects();
+	} else {
+		renderObjects();
+		renderRacers();
+		renderTrack();
+		renderTerrain();
+	}
+	glDepthFunc(GL_LESS);
+	if (m_gpuTiming)
+		m_pOpaqueTimer->End();
+	if (!m_skyboxFirst)
+		RenderSkybox(vEye);
+
+	// Draw the 2D graphics after the 3D graphics
+	DisplayFrameRate();
+	DisplayHUD();
+
+	// Everything that reads this frame's stream data has been submitted
+	m_pStreamBuffer->EndFrame();
+
+	// The matrix stack keeps going if it is pushed too deep or popped too often, so say when that happens
+	if (modelViewMatrixStack.GetNumErrors() > m_matrixStackErrors) {
+		m_matrixStackErrors = modelViewMatrixStack.GetNumErrors();
+		printf("Matrix stack: %d pushes past the limit or pops of an empty stack so far\n", m_matrixStackErrors);
+	}
 
+	// Swap buffers to show the rendered image
+	SwapBuffers(m_gameWindow.Hdc());		
 
+}
+
+
+
+
+// Draw the skybox centred on the camera, so that it stays put as the camera moves, with the main program, which
+// must be in use.  With "-gputime" it is timed.
+void Game::RenderSkybox(const glm::vec3 &eye)
+{
+	CShaderProgram *pMainProgram = (*m_pShaderPrograms)[RENDER_PROGRAM_MAIN];
+	glutil::MatrixStack &modelViewMatrixStack = *m_pModelViewMatrixStack;
+	if (m_gpuTiming)
+		m_pSkyboxTimer->Begin();
 
-	//render centreline and the two offsets.
 	modelViewMatrixStack.Push();
-	pMainProgram->SetUniform("bUseTexture",true); // turn on texturing
+	pMainProgram->SetUniform("renderSkybox", true);
+	modelViewMatrixStack.Translate(eye);
 	pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-	pMainProgram->SetUniform("matrices.normalMatrix",
-		m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-	m_pCatmullRom->RenderCentreline();
-	m_pCatmullRom->RenderOffsetCurves();
-	m_pCatmullRom->RenderTrack();
-	m_pCatmullRom->RenderObjectPath();
+	pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack));
+	m_pSkybox->Render();
+	pMainProgram->SetUniform("renderSkybox", false);
 	modelViewMatrixStack.Pop();
 
-	//Render Health pack
-	
-	for (int i = 0; i < m_healthpackPointLocation.size(); i++) {
-		if (m_activeHealthPack[i] != false) {
-			modelViewMatrixStack.Push();
-			//put it at a random place.
-			modelViewMatrixStack.Translate(m_healthpackPointLocation.at(i).x, m_healthpackPointLocation.at(i).y + 5.5f, m_healthpackPointLocation.at(i).z);
-			modelViewMatrixStack.Scale(0.5f);
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-			m_pHealthPack->Render();
-			modelViewMatrixStack.Pop();
-		}
-
-	}
+	if (m_gpuTiming)
+		m_pSkyboxTimer->End();
+}
 
+// Draw the terrain and the track into the depth buffer alone, with the depth program, which transforms positions
+// and shades nothing, so that the colour pass shades each of their pixels once, and only where nothing is in front.
+// The terrain draws from the primitive arena's position-only vertices.  The track streams in as it is needed, so it
+// draws from its own vertices, of which the depth program reads just the positions, and the colour pass then draws
+// again what this streamed and culled.  Leaves the depth test at GL_LEQUAL, so that the same surfaces pass it again.
+void Game::RenderDepthPrePass(const glm::mat4 &viewMatrix)
+{
+	if (m_gpuTiming)
+		m_pPrePassTimer->Begin();
+
+	CShaderProgram *pDepthProgram = (*m_pShaderPrograms)[RENDER_PROGRAM_DEPTH];
+	pDepthProgram->UseProgram();
+	pDepthProgram->SetUniform("matrices.projMatrix", m_pCamera->GetPerspectiveProjectionMatrix());
+	pDepthProgram->SetUniform("matrices.modelViewMatrix", viewMatrix);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	m_pPlanarTerrain->RenderDepth();
+	if (m_endless)
+		m_pEndlessTrack->Render(*m_pFrustum);
+	else
+		m_pCatmullRom->RenderTrack(*m_pFrustum);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthFunc(GL_LEQUAL);
+
+	if (m_gpuTiming)
+		m_pPrePassTimer->End();
+}
 
-	
-	//Render the sphere
-	for (int i = 0; i < m_spherePointLocation.size(); i++){
-		//if there is no collision.
-			if (m_activeSphere[i] != false) {
-				modelViewMatrixStack.Push();
-				modelViewMatrixStack.Translate(m_spherePointLocation.at(i).x, m_spherePointLocation.at(i).y + 3.5f, m_spherePointLocation.at(i).z);
-				modelViewMatrixStack.Rotate(glm::vec3(1, 1, 0), m_rotateObject);
-				modelViewMatrixStack.Scale(2.0f);
-				pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-				pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-				pMainProgram->SetUniform("bUseTexture", true);
-				m_pSphere->Render();
-				modelViewMatrixStack.Pop();
-			}
+// The frame of the track at each pickup, so that pickups stand on banked and steep track as the ship flies over it:
+// raised along the track's up rather than the world's, and turned with it
+void Game::FindPickupFrames()
+{
+	const vector<double> *distances[4] = { &m_spherePointDistance, &m_cubePointDistance, &m_pyramidPointDistance, &m_healthpackPointDistance };
+	vector<glm::quat> *frames[4] = { &m_spherePointFrame, &m_cubePointFrame, &m_pyramidPointFrame, &m_healthpackPointFrame };
+	for (int type = PICKUP_SPHERE; type <= PICKUP_HEALTHPACK; type++) {
+		frames[type]->resize(distances[type]->size());
+		for (unsigned int i = 0; i < distances[type]->size(); i++) {
+			glm::vec3 p;
+			double d = (*distances[type])[i];
+			bool sampled = m_endless ? m_pEndlessTrack->SampleFrame(d, p, (*frames[type])[i])
+				: m_pCatmullRom->SampleFrame((float) d, p, (*frames[type])[i]);
+			if (!sampled)
+				(*frames[type])[i] = glm::quat();
 		}
+	}
+}
 
-	
+// Where a pickup of one type is drawn from, before its bob: raised off the track along the track's up
+glm::vec3 Game::PickupOrigin(int type, int i) const
+{
+	const vector<glm::vec3> *locations[4] = { &m_spherePointLocation, &m_cubePointLocation, &m_pyramidPointLocation, &m_healthpackPointLocation };
+	const vector<glm::quat> *frames[4] = { &m_spherePointFrame, &m_cubePointFrame, &m_pyramidPointFrame, &m_healthpackPointFrame };
+	return (*locations[type])[i] + (*frames[type])[i] * glm::vec3(0, PICKUP_HEIGHTS[type], 0);
+}
 
+// Bounding spheres for culling, placed and sized to match the transforms used in Render.  The pickups spin about
+// their origin, so a sphere centred there covers every orientation, and grow by the height they bob.
+void Game::UpdatePickupBounds()
+{
+	m_pSphereBounds->Clear();
+	m_pCubeBounds->Clear();
+	m_pPyramidBounds->Clear();
+	m_pHealthPackBounds->Clear();
+	for (int i = 0; i < m_spherePointLocation.size(); i++)
+		m_pSphereBounds->Add(PickupOrigin(PICKUP_SPHERE, i), 2.0f * m_pSphere->GetBoundingRadius() + PICKUP_BOB_HEIGHT);
+	for (int i = 0; i < m_cubePointLocation.size(); i++)
+		m_pCubeBounds->Add(PickupOrigin(PICKUP_CUBE, i), 2.0f * m_pCube->GetBoundingRadius() + PICKUP_BOB_HEIGHT);
+	for (int i = 0; i < m_pyramidPointLocation.size(); i++)
+		m_pPyramidBounds->Add(PickupOrigin(PICKUP_PYRAMID, i), 2.0f * m_pPyramid->GetBoundingRadius() + PICKUP_BOB_HEIGHT);
+	for (int i = 0; i < m_healthpackPointLocation.size(); i++)
+		m_pHealthPackBounds->Add(PickupOrigin(PICKUP_HEALTHPACK, i) + m_healthpackPointFrame[i] * (0.5f * m_pHealthPack->GetBoundingCentre()),
+			0.5f * m_pHealthPack->GetBoundingRadius());
+	UploadGpuPickups();
+}
 
-	//render cube;
-	for (int i = 0; i < m_cubePointLocation.size(); i++) {
-		//if collision is not detected.
-		if (m_activeCube[i] != false) {
-			modelViewMatrixStack.Push();
-			modelViewMatrixStack.Translate(m_cubePointLocation.at(i).x, m_cubePointLocation.at(i).y + 3.5f, m_cubePointLocation.at(i).z);
-			modelViewMatrixStack.Rotate(glm::vec3(1, 1, 0), m_rotateObject);
-			modelViewMatrixStack.Scale(2.0f);
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix", m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-			pMainProgram->SetUniform("bUseTexture", true);
-			m_pCube->Render();
-			modelViewMatrixStack.Pop();
+// Give the GPU culler every sphere, cube and pyramid pickup, placed as in RecordPickups, in that order.  Only
+// needed when pickups are placed or respawned; collecting one changes just its own flag, in SetGpuPickupActive.
+void Game::UploadGpuPickups()
+{
+	if (!m_gpuCulling)
+		return;
+
+	const vector<glm::vec3> *locations[3] = { &m_spherePointLocation, &m_cubePointLocation, &m_pyramidPointLocation };
+	const vector<double> *distances[3] = { &m_spherePointDistance, &m_cubePointDistance, &m_pyramidPointDistance };
+	const vector<glm::quat> *frames[3] = { &m_spherePointFrame, &m_cubePointFrame, &m_pyramidPointFrame };
+	const vector<bool> *active[3] = { &m_activeSphere, &m_activeCube, &m_activePyramid };
+
+	vector<GpuCullInstance> instances;
+	instances.reserve(locations[0]->size() + locations[1]->size() + locations[2]->size());
+	for (int type = PICKUP_SPHERE; type <= PICKUP_PYRAMID; type++) {
+		m_firstGpuPickup[type] = (int) instances.size();
+		for (unsigned int i = 0; i < locations[type]->size(); i++) {
+			GpuCullInstance instance;
+			instance.position = PickupOrigin(type, i);
+			instance.scale = 2.0f;
+			instance.rotation = (*frames[type])[i];
+			instance.spinAxis = PICKUP_SPIN_AXES[type];
+			instance.phase = (float) ((*distances[type])[i] * PICKUP_PHASE_PER_UNIT);
+			instance.mesh = type;
+			instance.layer = type;
+			instance.active = (*active[type])[i];
+			instances.push_back(instance);
 		}
-	
-
 	}
+	m_pGpuCuller->SetInstances(instances);
+}
 
-	//render the pyramid.
-	for (int i = 0; i < m_pyramidPointLocation.size(); i++) {
-		if(m_activePyramid[i] != false){
-			modelViewMatrixStack.Push();
-			modelViewMatrixStack.Translate(m_pyramidPointLocation.at(i).x, m_pyramidPointLocation.at(i).y + 3.5f, m_pyramidPointLocation.at(i).z);
-			modelViewMatrixStack.Rotate(glm::vec3(0, 1, 0), m_rotateObject);
-			modelViewMatrixStack.Scale(2.0f);
-			pMainProgram->SetUniform("bUseTexture", true); // turn on texturing
-			pMainProgram->SetUniform("matrices.modelViewMatrix", modelViewMatrixStack.Top());
-			pMainProgram->SetUniform("matrices.normalMatrix",
-				m_pCamera->ComputeNormalMatrix(modelViewMatrixStack.Top()));
-			m_pPyramid->Render();
-			modelViewMatrixStack.Pop();
-			}
-		
+void Game::SetGpuPickupActive(int type, int index, bool active)
+{
+	if (m_gpuCulling && type <= PICKUP_PYRAMID)
+		m_pGpuCuller->SetActive(m_firstGpuPickup[type] + index, active);
+}
+
+// With "-cullcheck", compare the number of pickups the GPU culler kept with the number the CPU keeps by the same
+// rules, and once enough frames have been checked, quit with the number of frames that disagreed.  Reading the
+// counts back stalls until the GPU has culled, so this is for testing only.
+void Game::CheckGpuCulling()
+{
+	const CBoundingSpheres *bounds[3] = { m_pSphereBounds, m_pCubeBounds, m_pPyramidBounds };
+	const vector<bool> *active[3] = { &m_activeSphere, &m_activeCube, &m_activePyramid };
+	int cpuCount = 0;
+	for (int type = PICKUP_SPHERE; type <= PICKUP_PYRAMID; type++) {
+		m_pFrustum->Cull(*bounds[type], m_visibleObjects[type], m_visibleFade[type]);
+		for (unsigned int j = 0; j < m_visibleObjects[type].size(); j++) {
+			if ((*active[type])[m_visibleObjects[type][j]])
+				cpuCount++;
+		}
+	}
+	int gpuCount = m_pGpuCuller->ReadVisibleCount();
+	if (gpuCount != cpuCount) {
+		printf("Cull check: frame %d, the GPU kept %d pickups and the CPU %d\n", m_frameNumber, gpuCount, cpuCount);
+		m_cullCheckFailures++;
 	}
-	
-	
 
-	// Draw the 2D graphics after the 3D graphics
-	DisplayFrameRate();
-	DisplayHUD();
+	if (--m_cullCheckFrames == 0) {
+		printf("Cull check: %d frames disagreed\n", m_cullCheckFailures);
+		PostQuitMessage(m_cullCheckFailures);
+	}
+}
 
-	// Swap buffers to show the rendered image
-	SwapBuffers(m_gameWindow.Hdc());		
+// Record a draw packet for each pickup of one kind that is still to be collected and survives culling, placed as
+// in Game::Render and shrunk by its fade factor as it recedes.  Safe to run for different kinds at once: each
+// kind has its own culling output and levels of detail, and packets go into the calling thread's command buffer.
+void Game::RecordPickups(int type, const glutil::MatrixStack &viewMatrixStack, const glm::vec3 &eye)
+{
+	const vector<double> *distances[4] = { &m_spherePointDistance, &m_cubePointDistance, &m_pyramidPointDistance, &m_healthpackPointDistance };
+	const vector<glm::quat> *frames[4] = { &m_spherePointFrame, &m_cubePointFrame, &m_pyramidPointFrame, &m_healthpackPointFrame };
+	const vector<bool> *active[4] = { &m_activeSphere, &m_activeCube, &m_activePyramid, &m_activeHealthPack };
+	const CBoundingSpheres *bounds[4] = { m_pSphereBounds, m_pCubeBounds, m_pPyramidBounds, m_pHealthPackBounds };
+	vector<int> *lods[4] = { &m_sphereLod, NULL, NULL, &m_healthPackLod };
+	int numLods[4] = { m_pSphere->GetNumLods(), 1, 1, m_pHealthPack->GetNumLods() };
+	DrawFunction draw[4] = { DrawSphere, DrawCube, DrawPyramid, DrawMesh };
+	void *object[4] = { m_pSphere, m_pCube, m_pPyramid, m_pHealthPack };
+	int program[4] = { RENDER_PROGRAM_TEXTURE_ARRAY, RENDER_PROGRAM_TEXTURE_ARRAY, RENDER_PROGRAM_TEXTURE_ARRAY, RENDER_PROGRAM_MAIN };
+	int material[4] = { RENDER_MATERIAL_PICKUP_TEXTURES, RENDER_MATERIAL_PICKUP_TEXTURES, RENDER_MATERIAL_PICKUP_TEXTURES, RENDER_MESH_HEALTHPACK };
+	int mesh[4] = { RENDER_MESH_SPHERE, RENDER_MESH_CUBE, RENDER_MESH_PYRAMID, RENDER_MESH_HEALTHPACK };
+	static const float scale[4] = { 2.0f, 2.0f, 2.0f, 0.5f };
+
+	CCommandBuffer &commands = m_pRenderQueue->GetCommandBuffer(m_pJobSystem->GetThreadIndex());
+	vector<int> &visible = m_visibleObjects[type];
+	vector<float> &fade = m_visibleFade[type];
+	m_pFrustum->Cull(*bounds[type], visible, fade);
+	glutil::MatrixStack modelViewMatrixStack(viewMatrixStack);
+	for (unsigned int j = 0; j < visible.size(); j++) {
+		int i = visible[j];
+		if (!(*active[type])[i])
+			continue;
+
+		// Stand in the track's frame, and spin and bob in it as instancedShader.vert does
+		modelViewMatrixStack.Push();
+		modelViewMatrixStack.Translate(PickupOrigin(type, i));
+		modelViewMatrixStack.Rotate(glm::mat3_cast((*frames[type])[i]));
+		if (type != PICKUP_HEALTHPACK) {
+			float phase = (float) ((*distances[type])[i] * PICKUP_PHASE_PER_UNIT);
+			modelViewMatrixStack.Translate(glm::vec3(0, PICKUP_BOB_HEIGHT * sin(PICKUP_BOB_SPEED * m_animationTime + phase), 0));
+			modelViewMatrixStack.Rotate(PICKUP_SPIN_AXES[type], glm::degrees(PICKUP_SPIN_SPEED * m_animationTime + phase));
+		}
+		modelViewMatrixStack.Scale(scale[type] * fade[j]);
 
+		float distance = glm::distance(bounds[type]->GetCentre(i), eye);
+		int lod = 0;
+		if (lods[type] != NULL) {
+			lod = m_pLodSelector->Select(bounds[type]->GetRadius(i), distance, (*lods[type])[i], numLods[type]);
+			(*lods[type])[i] = lod;
+		}
+		commands.Draw(CRenderQueue::MakeKey(RENDER_PASS_OPAQUE, program[type], material[type], mesh[type], distance, RENDER_MAX_DEPTH),
+			draw[type], object[type], lod, modelViewMatrixStack.Top(), m_pCamera->ComputeNormalMatrix(modelViewMatrixStack));
+		modelViewMatrixStack.Pop();
+	}
 }
 
+// Bring the pickup vectors into line with the pieces of endless track now held.  Entries for pickups on retired
+// pieces are dropped from the front, keeping the state of the rest, and pickups on new pieces are added at the end.
+void Game::SyncEndlessPickups()
+{
+	if (m_pEndlessTrack->GetVersion() == m_pickupVersion)
+		return;
+	m_pickupVersion = m_pEndlessTrack->GetVersion();
+	m_pickupsReplaced = true;
+
+	vector<glm::vec3> *locations[4] = { &m_spherePointLocation, &m_cubePointLocation, &m_pyramidPointLocation, &m_healthpackPointLocation };
+	vector<double> *distances[4] = { &m_spherePointDistance, &m_cubePointDistance, &m_pyramidPointDistance, &m_healthpackPointDistance };
+	vector<bool> *active[4] = { &m_activeSphere, &m_activeCube, &m_activePyramid, &m_activeHealthPack };
+	vector<int> *lods[4] = { &m_sphereLod, NULL, NULL, &m_healthPackLod };
+	for (int type = PICKUP_SPHERE; type <= PICKUP_HEALTHPACK; type++) {
+		int firstSerial;
+		m_pEndlessTrack->GetPickups(type, *locations[type], *distances[type], firstSerial);
+
+		int retired = min(firstSerial - m_firstPickupSerial[type], (int) active[type]->size());
+		active[type]->erase(active[type]->begin(), active[type]->begin() + retired);
+		active[type]->resize(locations[type]->size(), true);
+		if (lods[type] != NULL) {
+			lods[type]->erase(lods[type]->begin(), lods[type]->begin() + retired);
+			lods[type]->resize(locations[type]->size(), 0);
+		}
+		m_firstPickupSerial[type] = firstSerial;
+	}
+	FindPickupFrames();
+	UpdatePickupBounds();
+}
 
+// Find the pickups in a list that the ship came within reach of while moving from distance d0 along the track,
+// offset0 across it, to d1 and offset1.  Only pickups whose own distance is within that stretch, give or take the
+// reach, are looked at, and each is tested against where the ship was as it passed it, so the ship cannot pass
+// through a pickup however far it goes in a frame.  The distances must be in order, and on the loop within a lap.
+void Game::FindPickupsPassed(const vector<glm::vec3> &locations, const vector<double> &distances, double d0, float offset0,
+	double d1, float offset1, float reach, vector<int> &passed)
+{
+	passed.clear();
+
+	// On the loop the stretch may run over the end of one lap into the next
+	double lapLength = m_endless ? 0.0 : m_pCatmullRom->GetLapLength();
+	int firstLap = 0, lastLap = 0;
+	if (lapLength > 0.0) {
+		firstLap = (int) floor((d0 - reach) / lapLength);
+		lastLap = (int) floor((d1 + reach) / lapLength);
+	}
 
+	for (int lap = firstLap; lap <= lastLap; lap++) {
+		double lapStart = lap * lapLength;
+		vector<double>::const_iterator it = lower_bound(distances.begin(), distances.end(), d0 - reach - lapStart);
+		for (; it != distances.end() && *it <= d1 + reach - lapStart; ++it) {
+			double d = glm::clamp(*it + lapStart, d0, d1);
+			float offset = d1 > d0 ? glm::mix(offset0, offset1, (float) ((d - d0) / (d1 - d0))) : offset1;
+			glm::vec3 p;
+			glm::quat orientation;
+			bool sampled = m_endless ? m_pEndlessTrack->SampleOffset(d, offset, p, orientation)
+				: m_pCatmullRom->SampleOffset((float) (d - lapStart), offset, p, orientation);
+			int i = (int) (it - distances.begin());
+			if (sampled && glm::length(locations[i] - p) < reach)
+				passed.push_back(i);
+		}
+	}
+}
 
 // Update method runs repeatedly with the Render method
 void Game::Update()
 {
-	m_currentDistance += m_dt * 0.1f;
+	double previousDistance = m_currentDistance;
+	m_currentDistance += m_dt * 0.1;
 	m_pCamera->Update(m_dt);
 
+	// The racers share nothing with the player's ship, so they update on the workers while the ship updates here
+	CJob *pRacersJob = m_pJobSystem->CreateJob(m_updateRacers);
+	m_pJobSystem->Run(pRacersJob);
+
 	//m_pAudio->Update();
 
 	glm::vec3 p;
-	glm::vec3 pNext;
-	glm::vec3 pLeft;
+	glm::quat orientation;
 
 	bool isSphereCollected = false;
 
-	//Get the left points, right and centreline points and store it in local vector variable
-	vector<glm::vec3> leftPoints = m_pCatmullRom->GetLeftObjectPoints();
-	vector<glm::vec3> rightPoints = m_pCatmullRom->GetRightObjectPoints();
-	vector<glm::vec3> centrelinePoints = m_pCatmullRom->GetCentrelinePoints();
-	////default position
-	
-	m_pCatmullRom->Sample(m_currentDistance, p);
-	m_pCatmullRom->Sample(m_currentDistance + 1, pNext);
+	if (m_endless) {
+		// Keep the track ahead of the ship and the pickups in step with it.  Should the worker ever fall behind, the
+		// ship waits at the end of the track rather than running off it.
+		m_pEndlessTrack->Update(m_currentDistance);
+		m_currentDistance = min(m_currentDistance, m_pEndlessTrack->GetEndDistance());
+		SyncEndlessPickups();
+	}
 
+	// Steer across the track with the left and right keys.  The ship stays where it is steered to, anywhere it fits
+	// on the track, rather than snapping between lanes.
+	float previousOffset = m_lateralOffset;
+	float trackWidth = m_endless ? m_pEndlessTrack->GetWidth() : m_pCatmullRom->GetWidth();
 	if (!m_isGameOver) {
-		//move spaceship left when left key is pressed
-		if (GetKeyState(VK_LEFT) & 0x80) {
-			m_pCatmullRom->SampleSides(m_currentDistance, p, leftPoints);
-			m_pCatmullRom->SampleSides(m_currentDistance + 1, pNext, leftPoints);
-		}
-		//move spaceship right when right key is pressed.
-		else if (GetKeyState(VK_RIGHT) & 0x80) {
-			m_pCatmullRom->SampleSides(m_currentDistance, p, rightPoints);
-			m_pCatmullRom->SampleSides(m_currentDistance + 1, pNext, rightPoints);
-		}
-
-		else {
-			//default position in the middle.
-			m_pCatmullRom->Sample(m_currentDistance, p);
-			m_pCatmullRom->Sample(m_currentDistance + 1, pNext);
-		}
-
-
+		const float steerSpeed = 0.05f;		// Across the track, in units per millisecond
+		const float shipClearance = 10.0f;	// Closest the ship gets to the edge
+		float steer = 0.0f;
+		if (GetKeyState(VK_LEFT) & 0x80)
+			steer -= 1.0f;
+		if (GetKeyState(VK_RIGHT) & 0x80)
+			steer += 1.0f;
+		float limit = 0.5f * trackWidth - shipClearance;
+		m_lateralOffset = glm::clamp(m_lateralOffset + steer * steerSpeed * (float) m_dt, -limit, limit);
 	}
 
+	// Position from the centreline and the right-hand side of its frame, and the orientation of the track there
+	if (m_endless)
+		m_pEndlessTrack->SampleOffset(m_currentDistance, m_lateralOffset, p, orientation);
+	else
+		m_pCatmullRom->SampleOffset((float) fmod(m_currentDistance, (double) m_pCatmullRom->GetLapLength()), m_lateralOffset, p, orientation);
+
 
-	glm::vec3 T = glm::normalize(pNext - p);
-	glm::vec3 N = glm::normalize(glm::cross(T, glm::vec3(0, 1, 0)));
-	glm::vec3 B = glm::normalize(glm::cross(N, T));
+	// Tangent, up (binormal) and right-hand side (normal) of the track
+	glm::mat3 frame = glm::mat3_cast(orientation);
+	glm::vec3 T = frame[0];
+	glm::vec3 B = frame[1];
+	glm::vec3 N = frame[2];
 
 
 	glm::vec3 pathX;
@@ -514,15 +1240,15 @@ void Game::Update()
 	//default third person view
 	pathX = glm::vec3((p - 30.0f*T + (20.0f*B)));
 	pathY = glm::vec3(p + 40.0f*T);
-	pathZ = glm::vec3(0, 1, 0);
+	pathZ = B;
 
 	if (!m_isGameOver) {
 		//change to first person when button is pressed.
 		if (GetKeyState('C') & 1) {
 			//set the camera along the path -- FIRST PERSON
-			pathX = glm::vec3(p + glm::vec3(0, 10, 0));
+			pathX = glm::vec3(p + 10.0f*B);
 			pathY = glm::vec3(p + 30.0f*T);
-			pathZ = glm::vec3(0, 1, 0);
+			pathZ = B;
 		}
 	}
 
@@ -554,42 +1280,28 @@ void Game::Update()
 
 
 	//set the spaceship orientation and make it travel along the path
-	m_spaceShipOrientation = glm::mat4(glm::mat3(T, B, N));
+	m_spaceShipOrientation = glm::mat4_cast(orientation);
 
 	//set the location of the spaceship
 	m_spaceShipPosition = p;
 
 
-	//rotate primtive objects
-	m_rotateObject += 0.2f * m_dt;
+	// Advance the pickups' spin and bob
+	m_animationTime += (float) (m_dt / 1000.0);
 
 
 
 	//keep track of lap
-	m_currentLap = m_pCatmullRom->CurrentLap(m_currentDistance);
+	m_currentLap = m_endless ? m_pEndlessTrack->CurrentLap(m_currentDistance) : m_pCatmullRom->CurrentLap(m_currentDistance);
 	int speed = 0.12f;
 
-
-
-	//last point of each line on the path
-	int centreIndex = m_pCatmullRom->GetCentrelinePoints().size() - 1;
-	int leftIndex = m_pCatmullRom->GetLeftObjectPoints().size() - 1;
-	int rightIndex = m_pCatmullRom->GetRightObjectPoints().size() - 1;
-
-	glm::vec3 centreLastPoint = m_pCatmullRom->GetCentrelinePoints()[centreIndex];
-	glm::vec3 leftLastPoint = m_pCatmullRom->GetLeftObjectPoints()[leftIndex];
-	glm::vec3 rightLastPoint = m_pCatmullRom->GetRightObjectPoints()[rightIndex];
-
-	//respawn objects at new lap and make spaceship go faster
-	if (glm::length( centreLastPoint - p) < 5.0f || (glm::length(leftLastPoint - p)   < 5.0f || (glm::length(leftLastPoint - p) < 5.0f)))
-	{
+	//respawn objects on starting a new lap.  The endless track needs none, as fresh pickups keep arriving.
+	if (!m_endless && m_pCatmullRom->CurrentLap(previousDistance) != m_currentLap)
 		RespawnObjects();
 	
-	}
-	
 	for (int i = 1; i < 100; i++) {
 		if (m_currentLap == i) {
-			m_currentDistance += m_dt * 0.06f;
+			m_currentDistance += m_dt * 0.06;
 	}
 	}
 		
@@ -600,20 +1312,24 @@ void Game::Update()
 	
 
 
+	// Collisions are tested along the whole of the path the ship took since the last frame, not just where it is now
+	const float pickupReach = 5.0f;
+
 		//check collision detection for sphere 
-	for (int i = 0; i < m_spherePointLocation.size(); i++) {
-		if (glm::length(m_spherePointLocation.at(i) - p) < 5.0f) {
-			if (m_activeSphere[i] && m_currentObjects == "Sphere") {
-				m_activeSphere[i] = false;  //do not render object
-				m_points++; //increase points
-				//select random object name from vector
-				m_currentObjects = m_objectNames[(rand() % 3)];
-			}
-			//take away health if wrong object is collected.
-			if (m_activeSphere[i] && m_currentObjects != "Sphere") 
-			{
-				m_health--;
-			}
+	FindPickupsPassed(m_spherePointLocation, m_spherePointDistance, previousDistance, previousOffset, m_currentDistance, m_lateralOffset, pickupReach, m_passedPickups);
+	for (unsigned int k = 0; k < m_passedPickups.size(); k++) {
+		int i = m_passedPickups[k];
+		if (m_activeSphere[i] && m_currentObjects == "Sphere") {
+			m_activeSphere[i] = false;  //do not render object
+			SetGpuPickupActive(PICKUP_SPHERE, i, false);
+			m_points++; //increase points
+			//select random object name from vector
+			m_currentObjects = m_objectNames[(rand() % 3)];
+		}
+		//take away health if wrong object is collected.
+		if (m_activeSphere[i] && m_currentObjects != "Sphere") 
+		{
+			m_health--;
 		}
 
 	}
@@ -621,20 +1337,21 @@ void Game::Update()
 
 	
 		//check collision for cube
-		for (int i = 0; i < m_cubePointLocation.size(); i++) {
-			if (glm::length(m_cubePointLocation.at(i) - p) < 5.0f) {
-				//check if object has been rendered and matches name with shape
-				if(m_activeCube[i] && m_currentObjects == "Cube") {
-					m_activeCube[i] = false;  //do not render object
-					m_points++; //increase points
-					//select random object name from vector
-					m_currentObjects = m_objectNames[(rand() % 3)];
-				}
-				//take away health if wrong object is collected.
-				if (m_activeCube[i] && m_currentObjects != "Cube")
-				{
-					m_health--;
-				}
+		FindPickupsPassed(m_cubePointLocation, m_cubePointDistance, previousDistance, previousOffset, m_currentDistance, m_lateralOffset, pickupReach, m_passedPickups);
+		for (unsigned int k = 0; k < m_passedPickups.size(); k++) {
+			int i = m_passedPickups[k];
+			//check if object has been rendered and matches name with shape
+			if(m_activeCube[i] && m_currentObjects == "Cube") {
+				m_activeCube[i] = false;  //do not render object
+				SetGpuPickupActive(PICKUP_CUBE, i, false);
+				m_points++; //increase points
+				//select random object name from vector
+				m_currentObjects = m_objectNames[(rand() % 3)];
+			}
+			//take away health if wrong object is collected.
+			if (m_activeCube[i] && m_currentObjects != "Cube")
+			{
+				m_health--;
 			}
 		}
 
@@ -642,34 +1359,35 @@ void Game::Update()
 
 		//check if object has been rendered and matches name with shape
 
-		for (int i = 0; i < m_pyramidPointLocation.size(); i++) {
-			if (glm::length(m_pyramidPointLocation.at(i) - p) < 5.0f) {
-				if (m_activePyramid[i] && m_currentObjects == "Pyramid") {
-					m_activePyramid[i] = false; //do not render object
-					m_points++; 
-					//select random object name from vector
-					m_currentObjects = m_objectNames[(rand() % 3)];
-				}
-				//take away health if wrong object is collected.
-				if (m_activePyramid[i] && m_currentObjects != "Pyramid")
-				{
-					m_health--;
-				}
+		FindPickupsPassed(m_pyramidPointLocation, m_pyramidPointDistance, previousDistance, previousOffset, m_currentDistance, m_lateralOffset, pickupReach, m_passedPickups);
+		for (unsigned int k = 0; k < m_passedPickups.size(); k++) {
+			int i = m_passedPickups[k];
+			if (m_activePyramid[i] && m_currentObjects == "Pyramid") {
+				m_activePyramid[i] = false; //do not render object
+				SetGpuPickupActive(PICKUP_PYRAMID, i, false);
+				m_points++; 
+				//select random object name from vector
+				m_currentObjects = m_objectNames[(rand() % 3)];
+			}
+			//take away health if wrong object is collected.
+			if (m_activePyramid[i] && m_currentObjects != "Pyramid")
+			{
+				m_health--;
 			}
 		}
 
 		
 		//collision detection and interactions with healthpack
-		for (int i = 0; i < m_healthpackPointLocation.size(); i++) {
-			if (glm::length(m_healthpackPointLocation.at(i) - p) < 5.0f) {
-				if (m_activeHealthPack[i] && m_health < 100) {
-					m_activeHealthPack[i] = false;
-					if (m_health > 100) {
-						m_health = 100;
-					}
-					else {
-						m_health+=10;
-					}
+		FindPickupsPassed(m_healthpackPointLocation, m_healthpackPointDistance, previousDistance, previousOffset, m_currentDistance, m_lateralOffset, pickupReach, m_passedPickups);
+		for (unsigned int k = 0; k < m_passedPickups.size(); k++) {
+			int i = m_passedPickups[k];
+			if (m_activeHealthPack[i] && m_health < 100) {
+				m_activeHealthPack[i] = false;
+				if (m_health > 100) {
+					m_health = 100;
+				}
+				else {
+					m_health+=10;
 				}
 			}
 		}
@@ -686,7 +1404,7 @@ void Game::Update()
 		
 		
 		
-		
+	m_pJobSystem->Wait(pRacersJob);
 }
 
 
@@ -703,6 +1421,8 @@ void Game::RespawnObjects() {
 	for (int i = 0; i < m_pyramidPointLocation.size(); i++) {
 		m_activePyramid[i] = true;
 	}
+	UploadGpuPickups();
+	m_pickupsReplaced = true;
 }
 
 
@@ -715,10 +1435,6 @@ void Game::DisplayHUD(){
 
 	RECT dimensions = m_gameWindow.GetDimensions();
 	int height = dimensions.bottom - dimensions.top;
-	char * message;
-	//convert string to char *
-	message = new char[m_currentObjects.size() + 1];
-	memcpy(message,m_currentObjects.c_str(), m_currentObjects.size()+1);
 
 	//render the texts
 	fontProgram->UseProgram();
@@ -728,10 +1444,12 @@ void Game::DisplayHUD(){
 	fontProgram->SetUniform("vColour", glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
 	m_pFtFont->Render(10, 5, 15, "Use C to change camera views");
 	m_pFtFont->Render(600, height - 20, 15, "Pick up: " );
-	m_pFtFont->Render(650, height - 20, 15, message);
+	m_pFtFont->Render(650, height - 20, 15, "%s", m_currentObjects.c_str());
 	m_pFtFont->Render(600, height - 40, 15, "Health: %d", m_health);
 	m_pFtFont->Render(600, height - 60, 15, "Points: %d", m_points);
 	m_pFtFont->Render(600, height - 80, 15, "Lap: %d", m_currentLap);
+	if (m_pRacers->GetCount() > 0)
+		m_pFtFont->Render(600, height - 100, 15, "Racers: %d, %.3f ms per 1000", m_pRacers->GetCount(), m_pRacers->GetUpdateTime());
 	INPUT ip;
 	ip.type = INPUT_KEYBOARD;
 	ip.ki.wVk = 0x09;
@@ -743,8 +1461,6 @@ void Game::DisplayHUD(){
 		m_isGameOver = true;
 
 	}
-	//release resources
-	delete[] message;
 }
 
 
@@ -805,24 +1521,104 @@ void Game::GameLoop()
 	
 	// Variable timer
 	m_pHighResolutionTimer->Start();
+	m_pFrameArena->BeginFrame();
+	int heapAllocations = CFrameArena::GetHeapAllocations();
 	Update();
 	Render();
 	m_dt = m_pHighResolutionTimer->Elapsed();
-	
+	if (m_frameNumber == 0)
+		ReportStartup();
+	ReportFrameAllocations(CFrameArena::GetHeapAllocations() - heapAllocations);
+	ReportGpuTimings();
+	m_frameNumber++;
 
 }
 
+// Once the game is under way a frame should not need the heap: everything it keeps is in buffers that are reused,
+// and its scratch data goes in the frame arena.  In debug builds, report any frame after the warm-up that made heap
+// allocations on any thread, and any time the frame arena has run out of room.  Picking up the last pickup of a
+// stretch of endless track can legitimately grow the pickup lists, as can respawning the pickups on a new lap.
+// With "-alloccheck", every other frame that allocates or overflows the arena counts as a failure, and once enough
+// frames have been checked the game quits with the number that failed.
+void Game::ReportFrameAllocations(int heapAllocations)
+{
+	bool pickupsReplaced = m_pickupsReplaced;
+	m_pickupsReplaced = false;
+	if (m_frameNumber < WARM_UP_FRAMES)
+		return;
+
+	bool overflowed = m_pFrameArena->GetNumOverflows() > m_frameArenaOverflows;
+	m_frameArenaOverflows = m_pFrameArena->GetNumOverflows();
+#ifdef _DEBUG
+	if (heapAllocations > 0)
+		printf("Frame %d made %d heap allocations\n", m_frameNumber, heapAllocations);
+	if (overflowed)
+		printf("Frame arena full: peak usage %u of %u bytes, %u overflows\n", m_pFrameArena->GetPeakUsage(),
+			FRAME_ARENA_SIZE, m_frameArenaOverflows);
+	if (m_frameNumber == WARM_UP_FRAMES)
+		printf("Frame arena peak usage after warm-up: %u of %u bytes\n", m_pFrameArena->GetPeakUsage(), FRAME_ARENA_SIZE);
+#endif
+
+	if (m_allocCheckFrames > 0) {
+		if ((heapAllocations > 0 && !pickupsReplaced) || overflowed) {
+			printf("Allocation check: frame %d made %d heap allocations%s\n", m_frameNumber, heapAllocations,
+				overflowed ? " and overflowed the frame arena" : "");
+			m_allocCheckFailures++;
+		}
+		if (--m_allocCheckFrames == 0) {
+			if (m_allocCheckFailures > 0)
+				printf("Allocation check FAILED: %d frames allocated\n", m_allocCheckFailures);
+			else
+				printf("Allocation check passed\n");
+			PostQuitMessage(m_allocCheckFailures);
+		}
+	}
+}
+
+// With "-gputime", the GPU time and samples passed of the depth pre-pass, the opaque geometry and the skybox,
+// averaged over GPU_TIMING_FRAMES frames at a time.  The opaque geometry's samples are the fragments it shaded.
+void Game::ReportGpuTimings()
+{
+	if (!m_gpuTiming || m_frameNumber % GPU_TIMING_FRAMES != GPU_TIMING_FRAMES - 1)
+		return;
+	static const char *depthModes[] = { "unsorted", "sorted", "after a depth pre-pass" };
+	double milliseconds, samples;
+	if (m_depthMode == DEPTH_MODE_PREPASS && m_pPrePassTimer->TakeAverages(milliseconds, samples))
+		printf("GPU: depth pre-pass, %.3f ms and %.0f samples a frame\n", milliseconds, samples);
+	if (m_pOpaqueTimer->TakeAverages(milliseconds, samples))
+		printf("GPU: opaque geometry drawn %s, %.3f ms and %.0f samples a frame\n", depthModes[m_depthMode], milliseconds, samples);
+	if (m_pSkyboxTimer->TakeAverages(milliseconds, samples))
+		printf("GPU: skybox drawn %s, %.3f ms and %.0f samples a frame\n", m_skyboxFirst ? "first" : "last", milliseconds, samples);
+}
+
+// Time to first frame, and the stages that led up to it, on the console and as a trace
+void Game::ReportStartup()
+{
+	m_pStartupProfiler->Mark("first frame");
+	printf("Startup: first frame after %.1f ms\n", m_pStartupProfiler->Now());
+	m_pStartupProfiler->PrintSummary();
+	if (m_pStartupProfiler->Write(STARTUP_TRACE_FILE))
+		printf("Startup: trace written to %s\n", STARTUP_TRACE_FILE);
+}
+
 
 WPARAM Game::Execute() 
 {
 	m_pHighResolutionTimer = new CHighResolutionTimer;
+	m_pStartupProfiler = new CStartupProfiler;
+	m_pStartupProfiler->Start();
+
+	double stageStart = m_pStartupProfiler->Now();
 	m_gameWindow.Init(m_hInstance);
+	m_pStartupProfiler->Record("create window", stageStart, m_pStartupProfiler->Now());
 
 	if(!m_gameWindow.Hdc()) {
 		return 1;
 	}
 
+	stageStart = m_pStartupProfiler->Now();
 	Initialise();
+	m_pStartupProfiler->Record("initialise", stageStart, m_pStartupProfiler->Now());
 
 	m_pHighResolutionTimer->Start();
 
@@ -925,15 +1721,340 @@ void Game::SetHinstance(HINSTANCE hinstance)
 	m_hInstance = hinstance;
 }
 
+void Game::SetEndlessMode(bool endless, unsigned int seed)
+{
+	m_endless = endless;
+	m_endlessSeed = seed;
+}
+
+void Game::SetRacerCount(int count)
+{
+	m_numRacers = count;
+}
+
+void Game::SetJobThreads(int count, bool benchmark)
+{
+	m_numJobThreads = count;
+	m_benchmarkJobs = benchmark;
+}
+
+void Game::SetTrackBenchmark(bool benchmark)
+{
+	m_benchmarkTrack = benchmark;
+}
+
+void Game::SetCullCheck(int frames)
+{
+	m_cullCheckFrames = frames;
+}
+
+void Game::SetAllocCheck(int frames)
+{
+	m_allocCheckFrames = frames;
+}
+
+void Game::SetGpuTiming(bool timing, bool skyboxFirst)
+{
+	m_gpuTiming = timing;
+	m_skyboxFirst = skyboxFirst;
+}
+
+void Game::SetDepthMode(DepthMode mode)
+{
+	m_depthMode = mode;
+}
+
+void Game::SetTrackSamplingReport(bool report)
+{
+	m_reportTrackSampling = report;
+}
+
+// Time the racer update, the heaviest work shared across threads, with from one thread up to one per core
+void Game::BenchmarkJobSystem()
+{
+	const int numRacers = 100000;
+	const int numFrames = 100;
+	int maxThreads = max((int) std::thread::hardware_concurrency(), 1);
+	double oneThread = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		CJobSystem jobs;
+		jobs.Create(threads);
+		CRacers racers;
+		racers.Create(numRacers, 1, m_pCatmullRom, &jobs);
+
+		CHighResolutionTimer timer;
+		timer.Start();
+		for (int frame = 0; frame < numFrames; frame++)
+			racers.Update(1000.0 / FPS);
+		double frameTime = timer.Elapsed() / numFrames;
+		if (threads == 1)
+			oneThread = frameTime;
+		printf("Jobs: %d threads update %d racers in %.3f ms, %.2f times as fast as one thread\n", threads, numRacers,
+			frameTime, oneThread / frameTime);
+	}
+}
+
+// Time CCatmullRom::Project on points scattered over and around the loop, both searching the grid from nothing and
+// starting from a hint a frame's travel away, as for a ship followed from one frame to the next.  Each point is
+// placed a known distance along and across the track, so the answers are checked as well as timed.
+void Game::BenchmarkTrackProjection()
+{
+	const int numQueries = 100000;
+	float lapLength = m_pCatmullRom->GetLapLength();
+	float width = m_pCatmullRom->GetWidth();
+	if (lapLength <= 0.0f)
+		return;
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> along(0.0f, lapLength);
+	std::uniform_real_distribution<float> across(-0.5f * width, 0.5f * width);
+	std::uniform_real_distribution<float> travel(-20.0f, 20.0f);
+	vector<glm::vec3> positions(numQueries);
+	vector<float> distances(numQueries), laterals(numQueries), hints(numQueries);
+	for (int i = 0; i < numQueries; i++) {
+		glm::quat orientation;
+		distances[i] = along(random);
+		laterals[i] = across(random);
+		m_pCatmullRom->SampleOffset(distances[i], laterals[i], positions[i], orientation);
+		hints[i] = fmod(distances[i] + travel(random) + lapLength, lapLength);
+	}
+
+	for (int hinted = 0; hinted < 2; hinted++) {
+		float maxAlongError = 0.0f, maxAcrossError = 0.0f;
+		int offTrack = 0;
+		CHighResolutionTimer timer;
+		timer.Start();
+		for (int i = 0; i < numQueries; i++) {
+			TrackProjection projection;
+			m_pCatmullRom->Project(positions[i], projection, hinted ? hints[i] : -1.0f);
+			float alongError = fabs(projection.distance - distances[i]);
+			maxAlongError = max(maxAlongError, min(alongError, lapLength - alongError));
+			maxAcrossError = max(maxAcrossError, fabs(projection.lateral - laterals[i]));
+			if (fabs(projection.lateral) > 0.5f * width + 0.1f)
+				offTrack++;
+		}
+		double time = timer.Elapsed();
+		printf("Track: %d projections %s in %.2f ms, %.3f us each; error at most %.3f along and %.3f across, "
+			"%d found off the track\n", numQueries, hinted ? "from a hint" : "through the grid", time,
+			1000.0 * time / numQueries, maxAlongError, maxAcrossError, offTrack);
+	}
+}
+
+// Time the transform Render gives each pickup -- pushed, placed, spun and scaled, with its normal matrix taken --
+// through the matrix stack and its SSE kernels, and through plain glm as the stack used to do it.  The sums of the
+// results are compared, to check the two agree.  Then check the stack's normal matrices against the full inverse
+// transpose on rigid, uniformly scaled and generally scaled transforms.  Returns false if any check fails.
+bool Game::BenchmarkMatrixStack()
+{
+	const int numTransforms = 1000000;
+	glutil::MatrixStack stack;
+	stack.LookAt(glm::vec3(0, 50, 100), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	glm::mat4 viewMatrix = stack.Top();
+
+	glm::mat4 stackSum(0.0f), glmSum(0.0f);
+	glm::mat3 stackNormalSum(0.0f), glmNormalSum(0.0f);
+	CHighResolutionTimer timer;
+	timer.Start();
+	for (int i = 0; i < numTransforms; i++) {
+		stack.Push();
+		stack.Translate(glm::vec3(0.001f * i, 5.0f, 0.0f));
+		stack.Rotate(glm::vec3(0, 1, 0), 0.01f * i);
+		stack.Scale(2.0f);
+		stackSum += stack.Top();
+		stackNormalSum += stack.NormalMatrix();
+		stack.Pop();
+	}
+	double stackTime = timer.Elapsed();
+
+	timer.Start();
+	for (int i = 0; i < numTransforms; i++) {
+		glm::mat4 m = glm::translate(viewMatrix, glm::vec3(0.001f * i, 5.0f, 0.0f));
+		m = glm::rotate(m, 0.01f * i, glm::vec3(0, 1, 0));
+		m = glm::scale(m, glm::vec3(2.0f));
+		glmSum += m;
+		glmNormalSum += glm::transpose(glm::inverse(glm::mat3(m)));
+	}
+	double glmTime = timer.Elapsed();
+
+	float difference = 0.0f;
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			difference = max(difference, fabs(stackSum[c][r] - glmSum[c][r]) / numTransforms);
+			if (c < 3 && r < 3)
+				difference = max(difference, fabs(stackNormalSum[c][r] - glmNormalSum[c][r]) / numTransforms);
+		}
+	}
+	printf("Matrices: %d pickup transforms in %.2f ms with the matrix stack and %.2f ms with glm, %.2f times as fast; "
+		"mean difference at most %g\n", numTransforms, stackTime, glmTime, glmTime / stackTime, difference);
+
+	// Each kind of transform must be classified as expected, so that the shortcut under test is the one taken, and
+	// its normal matrix must match transpose(inverse(mat3(m))) to within a small part of the matrix's size
+	const int numChecks = 1000;
+	const char *kindNames[3] = { "rigid", "uniform scale", "general" };
+	const glutil::TransformType kindTypes[3] = { glutil::TRANSFORM_RIGID, glutil::TRANSFORM_UNIFORM_SCALE, glutil::TRANSFORM_GENERAL };
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	bool passed = true;
+	for (int kind = 0; kind < 3; kind++) {
+		int failures = 0;
+		float largestError = 0.0f;
+		for (int i = 0; i < numChecks; i++) {
+			glutil::MatrixStack check;
+			check.LookAt(glm::vec3(100.0f * unit(random), 50.0f + 40.0f * unit(random), 100.0f * unit(random)),
+				glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+			check.Translate(glm::vec3(50.0f * unit(random), 10.0f * unit(random), 50.0f * unit(random)));
+			glm::vec3 axis(unit(random), unit(random), unit(random));
+			check.Rotate(glm::length(axis) > 0.01f ? glm::normalize(axis) : glm::vec3(0, 1, 0), 180.0f * unit(random));
+			if (kind >= 1)
+				check.Scale(2.5f + 2.4f * unit(random));
+			if (kind == 2)
+				check.Scale(glm::vec3(1.5f + unit(random), 1.0f, 3.0f + 2.0f * unit(random)));
+
+			glm::mat3 expected = glm::transpose(glm::inverse(glm::mat3(check.Top())));
+			glm::mat3 actual = check.NormalMatrix();
+			float size = 1.0f, error = 0.0f;
+			for (int c = 0; c < 3; c++) {
+				for (int r = 0; r < 3; r++) {
+					size = max(size, fabs(expected[c][r]));
+					error = max(error, fabs(actual[c][r] - expected[c][r]));
+				}
+			}
+			largestError = max(largestError, error / size);
+			if (check.GetTransformType() != kindTypes[kind] || error > 1e-4f * size)
+				failures++;
+		}
+		printf("Normal matrices: %s, %d of %d wrong, largest relative error %g: %s\n", kindNames[kind], failures,
+			numChecks, largestError, failures == 0 ? "pass" : "FAIL");
+		passed = passed && failures == 0;
+	}
+	return passed;
+}
+
+// Write everything under resources into the resource pack.  The track is loaded first, so that its compiled form
+// is up to date when it goes in.
+bool Game::BuildResourcePack()
+{
+	CCatmullRom track;
+	track.LoadTrack(TRACK_FILE);
+	return CResourcePack::Build("resources", RESOURCE_PACK_FILE);
+}
+
 LRESULT CALLBACK WinProc(HWND window, UINT message, WPARAM w_param, LPARAM l_param)
 {
 	return Game::GetInstance().ProcessEvents(window, message, w_param, l_param);
 }
 
-int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, PSTR, int) 
+// The game is a Windows application, so what it prints goes nowhere unless it has a console.  Take over the console
+// of whatever started it, such as a command prompt, or, if there is none and a flag that only reports on the console
+// was given, open one of its own.  Returns true if it opened one, which then closes with the game.
+static bool OpenConsole(const char *cmdLine)
 {
+	static const char *reportFlags[] = { "-console", "-jobbench", "-matbench", "-tracksampling", "-trackbench",
+		"-alloccheck", "-pack", "-cullcheck", "-gputime" };
+	bool opened = false;
+	if (!AttachConsole(ATTACH_PARENT_PROCESS)) {
+		for (int i = 0; i < sizeof(reportFlags) / sizeof(reportFlags[0]) && !opened; i++) {
+			if (strstr(cmdLine, reportFlags[i]) != NULL)
+				opened = AllocConsole() != FALSE;
+		}
+		if (!opened)
+			return false;
+	}
+	FILE *fp;
+	freopen_s(&fp, "CONOUT$", "w", stdout);
+	freopen_s(&fp, "CONOUT$", "w", stderr);
+	freopen_s(&fp, "CONIN$", "r", stdin);
+	return opened;
+}
+
+// Keep a console the game opened until its results have been read
+static int CloseConsole(bool opened, int result)
+{
+	if (opened) {
+		printf("Press Enter to close\n");
+		getchar();
+	}
+	return result;
+}
+
+int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, PSTR cmdLine, int) 
+{
+	// "-console" shows what the game prints, as do the flags that report on it; see OpenConsole
+	bool consoleOpened = OpenConsole(cmdLine);
+
+	// "-pack" builds the resource pack, which the game then reads instead of the loose files, and quits
+	if (strstr(cmdLine, "-pack") != NULL)
+		return CloseConsole(consoleOpened, Game::BuildResourcePack() ? 0 : 1);
+
+	// "-matbench" times the matrix stack against plain glm, checks its normal matrices, and quits, with 1 if a check
+	// failed
+	if (strstr(cmdLine, "-matbench") != NULL)
+		return CloseConsole(consoleOpened, Game::BenchmarkMatrixStack() ? 0 : 1);
+
 	Game &game = Game::GetInstance();
 	game.SetHinstance(hinstance);
 
-	return game.Execute();
+	// "-endless [seed]" races on a generated track without end instead of the loop
+	const char *endless = strstr(cmdLine, "-endless");
+	if (endless != NULL) {
+		unsigned int seed;
+		if (sscanf_s(endless + strlen("-endless"), "%u", &seed) != 1)
+			seed = (unsigned int) time(0);
+		game.SetEndlessMode(true, seed);
+	}
+
+	// "-threads N" sets how many threads the job system uses, one per core by default; "-jobbench" times the
+	// racer update with every number of threads from one up to one per core
+	int threads = 0;
+	const char *threadsOption = strstr(cmdLine, "-threads");
+	if (threadsOption != NULL)
+		sscanf_s(threadsOption + strlen("-threads"), "%d", &threads);
+	game.SetJobThreads(threads, strstr(cmdLine, "-jobbench") != NULL);
+
+	// "-trackbench" times finding where points are relative to the loop track
+	game.SetTrackBenchmark(strstr(cmdLine, "-trackbench") != NULL);
+
+	// "-racers N" adds N computer-controlled ships to the race on the loop track
+	const char *racers = strstr(cmdLine, "-racers");
+	if (racers != NULL) {
+		int count;
+		if (sscanf_s(racers + strlen("-racers"), "%d", &count) == 1)
+			game.SetRacerCount(count);
+	}
+
+	// "-gputime" reports how long the GPU takes to draw the opaque geometry and the skybox, and how many samples
+	// each shades; "-skyfirst" draws the skybox before everything else rather than after, to compare
+	game.SetGpuTiming(strstr(cmdLine, "-gputime") != NULL, strstr(cmdLine, "-skyfirst") != NULL);
+
+	// "-depth unsorted" draws the opaque geometry in its old order, and "-depth prepass" lays down the terrain's
+	// and the track's depth before shading anything; by default it is drawn front to back.  See Game::DepthMode.
+	if (strstr(cmdLine, "-depth unsorted") != NULL)
+		game.SetDepthMode(Game::DEPTH_MODE_UNSORTED);
+	else if (strstr(cmdLine, "-depth prepass") != NULL)
+		game.SetDepthMode(Game::DEPTH_MODE_PREPASS);
+
+	// "-tracksampling" reports how closely the loop track's geometry follows the spline at a range of tolerances
+	game.SetTrackSamplingReport(strstr(cmdLine, "-tracksampling") != NULL);
+
+	// "-cullcheck [frames]" checks the GPU culling against the CPU's for that many frames, 300 by default, then
+	// quits with the number of frames that disagreed
+	const char *cullCheck = strstr(cmdLine, "-cullcheck");
+	if (cullCheck != NULL) {
+		int frames;
+		if (sscanf_s(cullCheck + strlen("-cullcheck"), "%d", &frames) != 1 || frames <= 0)
+			frames = 300;
+		game.SetCullCheck(frames);
+	}
+
+	// "-alloccheck [frames]" checks that that many frames after the warm-up, 300 by default, make no heap
+	// allocations, then quits with the number that did, so that a failure is a non-zero exit code
+	const char *allocCheck = strstr(cmdLine, "-alloccheck");
+	if (allocCheck != NULL) {
+		int frames;
+		if (sscanf_s(allocCheck + strlen("-alloccheck"), "%d", &frames) != 1 || frames <= 0)
+			frames = 300;
+		game.SetAllocCheck(frames);
+	}
+
+	return CloseConsole(consoleOpened, (int) game.Execute());
 }
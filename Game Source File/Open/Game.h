@@ -2,6 +2,7 @@
 
 #include "Common.h"
 #include "GameWindow.h"
+#include <functional>
 
 // Classes used in game.  For a new class, declare it here and provide a pointer to an object of this class below.  Then, in Game.cpp, 
 // include the header.  In the Game constructor, set the pointer to NULL and in Game::Initialise, create a new object.  Don't forget to 
@@ -17,10 +18,32 @@ class CSphere;
 class COpenAssetImportMesh;
 class CAudio;
 class CCatmullRom;
+class CEndlessTrack;
 class CCube;
 class PPyramid;
+class CFrustum;
+class CBoundingSpheres;
+class CLodSelector;
+class CStreamBuffer;
+class CRacers;
+class CJobSystem;
+class CRenderQueue;
+class CFrameArena;
+class CResourcePack;
+class CStartupProfiler;
+class CTextureArray;
+class CGpuCuller;
+class CPrimitiveArena;
+class CGpuTimer;
+namespace glutil { class MatrixStack; }
 
 class Game {
+public:
+	// How Render draws the opaque geometry.  Unsorted is the order it was written in, terrain first; sorted is front
+	// to back, the objects, then the track, then the terrain, so that the depth test rejects hidden fragments before
+	// they are shaded; the pre-pass first draws the terrain's and the track's depth alone, then shades as sorted.
+	enum DepthMode { DEPTH_MODE_UNSORTED, DEPTH_MODE_SORTED, DEPTH_MODE_PREPASS };
+
 private:
 	// Three main methods used in the game.  Initialise runs once, while Update and Render run repeatedly in the game loop.
 	void Initialise();
@@ -43,11 +66,33 @@ private:
 	CHighResolutionTimer *m_pHighResolutionTimer;
 	CAudio *m_pAudio;
 	CCatmullRom *m_pCatmullRom;
+	CEndlessTrack *m_pEndlessTrack;		// Used in place of m_pCatmullRom in endless mode
 	CCube *m_pCube;
 	PPyramid *m_pPyramid;
+	CPrimitiveArena *m_pPrimitives;		// Geometry of the skybox, terrain, sphere, cube and pyramid
+	CGpuTimer *m_pSkyboxTimer;
+	CGpuTimer *m_pPrePassTimer;
+	CGpuTimer *m_pOpaqueTimer;
 	glm::mat4 *m_pModelMatrix;
 	glm::mat4 *m_pViewMatrix;
 	glm::mat4 *m_pProjectionMatrix;
+	glutil::MatrixStack *m_pModelViewMatrixStack;	// Reused every frame so pushes never reallocate
+	CFrustum *m_pFrustum;
+	CBoundingSpheres *m_pSphereBounds;		// World-space bounding spheres, one per pickup, in the same order as the location vectors
+	CBoundingSpheres *m_pCubeBounds;
+	CBoundingSpheres *m_pPyramidBounds;
+	CBoundingSpheres *m_pHealthPackBounds;
+	CLodSelector *m_pLodSelector;
+	CStreamBuffer *m_pStreamBuffer;		// Ring buffer for data written every frame
+	CRacers *m_pRacers;					// Computer-controlled ships, on the loop track only
+	std::function<void()> m_updateRacers;	// Their update job, made once rather than every frame
+	CJobSystem *m_pJobSystem;			// Worker threads for loading and for the racers, the only part of the update they run
+	CRenderQueue *m_pRenderQueue;		// Draws recorded on any thread, sorted and submitted on this one
+	CFrameArena *m_pFrameArena;			// Scratch memory that is emptied at the start of every frame
+	CResourcePack *m_pResourcePack;		// Every resource file in one, if it has been built
+	CStartupProfiler *m_pStartupProfiler;	// Times each stage from Execute to the first frame
+	CTextureArray *m_pPickupTextures;		// The sphere, cube and pyramid textures, a layer each in PickupType order
+	CGpuCuller *m_pGpuCuller;				// Culls and draws the sphere, cube and pyramid pickups on the GPU, where it can
 
 
 	// Some other member variables
@@ -56,13 +101,30 @@ private:
 	bool m_appActive;
 	bool m_hasRespawned;
 	bool m_isGameOver;
-	float m_currentDistance;
-	float m_rotateObject;
+	double m_currentDistance;	// Double, as the endless track goes on far past where a float can place the ship
+	float m_lateralOffset;		// How far right of the centreline the ship is (negative to the left)
+	float m_animationTime;		// Seconds of pickup animation so far
 	float m_strafeX;
 	float m_strafeZ;
 	int m_health;
 	int m_points;
 	int m_currentLap;
+	bool m_endless;
+	unsigned int m_endlessSeed;
+	int m_numRacers;
+	int m_numJobThreads;				// 0 for one per core
+	bool m_benchmarkJobs;
+	bool m_benchmarkTrack;
+	unsigned int m_pickupVersion;		// Version of the endless track the pickup vectors were last filled from
+	int m_firstPickupSerial[4];			// Serial number of the first entry of each pickup vector, in endless mode
+	bool m_gpuCulling;					// Whether m_pGpuCuller draws the sphere, cube and pyramid pickups
+	int m_firstGpuPickup[3];			// The GPU culler's number for the first of each of those kinds
+	int m_cullCheckFrames;				// Frames left to check the GPU culling against the CPU's, if asked to
+	int m_cullCheckFailures;
+	bool m_gpuTiming;					// Whether to measure and report GPU work
+	bool m_skyboxFirst;					// Draw the skybox before everything else, as it used to be
+	DepthMode m_depthMode;
+	bool m_reportTrackSampling;
 
 	string m_currentObjects;
 
@@ -70,7 +132,24 @@ private:
 	vector<glm::vec3> m_cubePointLocation;
 	vector<glm::vec3> m_pyramidPointLocation;
 	vector<glm::vec3> m_healthpackPointLocation;
+	vector<double> m_spherePointDistance;		// Distance along the track of each pickup, in order, for collisions
+	vector<double> m_cubePointDistance;
+	vector<double> m_pyramidPointDistance;
+	vector<double> m_healthpackPointDistance;
+	vector<glm::quat> m_spherePointFrame;		// Frame of the track at each pickup, which they stand up in
+	vector<glm::quat> m_cubePointFrame;
+	vector<glm::quat> m_pyramidPointFrame;
+	vector<glm::quat> m_healthpackPointFrame;
+	vector<int> m_passedPickups;				// Output of FindPickupsPassed, reused every frame
 	vector<string> m_objectNames;
+
+	// Output of the culling pass for each kind of pickup, refilled every frame
+	vector<int> m_visibleObjects[4];
+	vector<float> m_visibleFade[4];
+
+	// Level of detail each sphere and health pack was last drawn with, needed for hysteresis
+	vector<int> m_sphereLod;
+	vector<int> m_healthPackLod;
 	
 
 	//list of bool vectors that store collisions
@@ -91,17 +170,54 @@ public:
 	void SetHinstance(HINSTANCE hinstance);
 	WPARAM Execute();
 	void DisplayHUD();
+	void ReportFrameAllocations(int heapAllocations);
 	void RespawnObjects();
 	void ShakeCam();
+	void SetEndlessMode(bool endless, unsigned int seed);	// Call before Execute
+	void SetRacerCount(int count);							// Call before Execute
+	void SetJobThreads(int count, bool benchmark);			// Call before Execute
+	void SetTrackBenchmark(bool benchmark);					// Call before Execute
+	void SetCullCheck(int frames);							// Call before Execute
+	void SetAllocCheck(int frames);							// Call before Execute
+	void SetGpuTiming(bool timing, bool skyboxFirst);		// Call before Execute
+	void SetDepthMode(DepthMode mode);						// Call before Execute
+	void SetTrackSamplingReport(bool report);				// Call before Execute
+	static bool BuildResourcePack();
+	static bool BenchmarkMatrixStack();
 
 private:
 	static const int FPS = 60;
 	void DisplayFrameRate();
 	void GameLoop();
+	void FindPickupFrames();
+	glm::vec3 PickupOrigin(int type, int i) const;
+	void UpdatePickupBounds();
+	void SyncEndlessPickups();
+	void UploadGpuPickups();
+	void SetGpuPickupActive(int type, int index, bool active);
+	void CheckGpuCulling();
+	void PlaceTrackPickups();
+	void CreateShaderPrograms();
+	void DrawLoadingScreen(int numDone, int numAssets);
+	void ReportStartup();
+	void ReportGpuTimings();
+	void RenderSkybox(const glm::vec3 &eye);
+	void RenderDepthPrePass(const glm::mat4 &viewMatrix);
+	void BenchmarkJobSystem();
+	void BenchmarkTrackProjection();
+	void RecordPickups(int type, const glutil::MatrixStack &viewMatrixStack, const glm::vec3 &eye);
+	void FindPickupsPassed(const vector<glm::vec3> &locations, const vector<double> &distances, double d0, float offset0,
+		double d1, float offset1, float reach, vector<int> &passed);
 	GameWindow m_gameWindow;
 	HINSTANCE m_hInstance;
 	int m_frameCount;
 	double m_elapsedTime;
+	int m_frameNumber;					// Frames run since the game started
+	unsigned int m_frameArenaOverflows;	// As last reported
+	int m_matrixStackErrors;			// As last reported
+	bool m_pickupsReplaced;				// Whether this frame respawned the pickups or took them from new endless track
+	int m_allocCheckFrames;				// Frames left to check for heap allocations after the warm-up, if asked to
+	int m_allocCheckFailures;
 
 
 };
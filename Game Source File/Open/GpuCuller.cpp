@@ -0,0 +1,232 @@
+#include "GpuCuller.h"
+#include "Frustum.h"
+#include "Shaders.h"
+
+#include <stddef.h>
+
+CGpuCuller::CGpuCuller()
+{
+	m_pCullProgram = NULL;
+	m_pPrimitives = NULL;
+	m_vao = 0;
+	m_instanceBuffer = 0;
+	m_meshBuffer = 0;
+	m_commandBuffer = 0;
+	m_visibleBuffer = 0;
+	m_visibleCapacity = 0;
+	m_numInstances = 0;
+}
+
+CGpuCuller::~CGpuCuller()
+{
+	Release();
+}
+
+bool CGpuCuller::IsSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+int CGpuCuller::AddMesh(const CPrimitiveArena *primitives, int firstPrimitive, int numLods, float boundingRadius)
+{
+	m_pPrimitives = primitives;
+
+	Mesh mesh;
+	mesh.firstCommand = m_meshes.empty() ? 0 : m_meshes.back().firstCommand + m_meshes.back().numLods;
+	mesh.numLods = min(numLods, MAX_LOD_LEVELS);
+	mesh.boundingRadius = boundingRadius;
+	mesh.padding = 0;
+	m_meshes.push_back(mesh);
+
+	for (int lod = 0; lod < MAX_LOD_LEVELS; lod++)
+		m_lodPrimitives.push_back(lod < numLods ? firstPrimitive + lod : -1);
+	return (int) m_meshes.size() - 1;
+}
+
+// Set up the vertex array: the arena's vertices and indices for attributes 0 to 2, and what Cull writes
+// for the per-instance attributes 3 to 6 of instancedShader.vert
+bool CGpuCuller::Create(CShaderProgram *cullProgram)
+{
+	if (m_meshes.empty())
+		return false;
+	m_pCullProgram = cullProgram;
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+
+	m_pPrimitives->SetVertexAttributes();
+
+	// Sized by SetInstances
+	glGenBuffers(1, &m_visibleBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, VISIBLE_INSTANCE_SIZE, 0);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, VISIBLE_INSTANCE_SIZE, (void*) 16);
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, VISIBLE_INSTANCE_SIZE, (void*) 32);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, VISIBLE_INSTANCE_SIZE, (void*) 48);
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+	glVertexAttribDivisor(5, 1);
+	glVertexAttribDivisor(6, 1);
+	glBindVertexArray(0);
+
+	glGenBuffers(1, &m_meshBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_meshBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_meshes.size() * sizeof(Mesh), &m_meshes[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &m_instanceBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(1, &m_commandBuffer);
+
+	SetInstances(vector<GpuCullInstance>());
+	return true;
+}
+
+void CGpuCuller::Release()
+{
+	if (m_vao == 0)
+		return;
+	glDeleteVertexArrays(1, &m_vao);
+	GLuint buffers[4] = { m_instanceBuffer, m_meshBuffer, m_commandBuffer, m_visibleBuffer };
+	glDeleteBuffers(4, buffers);
+	m_vao = 0;
+	m_instanceBuffer = m_meshBuffer = m_commandBuffer = m_visibleBuffer = 0;
+	m_visibleCapacity = 0;
+	m_numInstances = 0;
+	m_meshes.clear();
+	m_lodPrimitives.clear();
+	m_commands.clear();
+}
+
+// Write every object, and lay out the draw commands so that each has room for every object of its mesh, which
+// could all be drawn with the same level of detail
+void CGpuCuller::SetInstances(const vector<GpuCullInstance> &instances)
+{
+	vector<Instance> data(instances.size());
+	vector<UINT> meshCount(m_meshes.size(), 0);
+	for (unsigned int i = 0; i < instances.size(); i++) {
+		const GpuCullInstance &instance = instances[i];
+		data[i].positionScale = glm::vec4(instance.position, instance.scale);
+		data[i].rotation = instance.rotation;
+		data[i].spin = glm::vec4(instance.spinAxis, instance.phase);
+		data[i].mesh = instance.mesh;
+		data[i].layer = instance.layer;
+		data[i].isActive = instance.active ? 1 : 0;
+		data[i].lod = 0;
+		meshCount[instance.mesh]++;
+	}
+	m_numInstances = (int) instances.size();
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, max(data.size(), (size_t) 1) * sizeof(Instance), data.empty() ? NULL : &data[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	m_commands.clear();
+	UINT visibleCount = 0;
+	for (unsigned int mesh = 0; mesh < m_meshes.size(); mesh++) {
+		for (unsigned int lod = 0; lod < m_meshes[mesh].numLods; lod++) {
+			const CPrimitiveArena::Primitive &primitive = m_pPrimitives->GetPrimitive(m_lodPrimitives[mesh * MAX_LOD_LEVELS + lod]);
+			DrawCommand command;
+			command.count = primitive.numIndices;
+			command.instanceCount = 0;
+			command.firstIndex = primitive.firstIndex;
+			command.baseVertex = primitive.baseVertex;
+			command.baseInstance = visibleCount;
+			m_commands.push_back(command);
+			visibleCount += meshCount[mesh];
+		}
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawCommand), &m_commands[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	if (visibleCount > m_visibleCapacity || m_visibleCapacity == 0) {
+		m_visibleCapacity = max(visibleCount, 1u);
+		glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+		glBufferData(GL_ARRAY_BUFFER, m_visibleCapacity * VISIBLE_INSTANCE_SIZE, NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+// Rewrite just the one flag, so that collecting a pickup costs the same however many there are
+void CGpuCuller::SetActive(int instance, bool active)
+{
+	if (instance < 0 || instance >= m_numInstances)
+		return;
+	GLuint value = active ? 1 : 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, instance * sizeof(Instance) + offsetof(Instance, isActive), sizeof(value), &value);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+int CGpuCuller::GetNumInstances() const
+{
+	return m_numInstances;
+}
+
+void CGpuCuller::Cull(const CFrustum &frustum, const CLodSelector &lodSelector)
+{
+	if (m_commands.empty())
+		return;
+
+	// Start every command with no instances
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_commands.size() * sizeof(DrawCommand), &m_commands[0]);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (m_numInstances == 0)
+		return;
+
+	float thresholds[MAX_LOD_LEVELS - 1];
+	for (int lod = 0; lod < MAX_LOD_LEVELS - 1; lod++)
+		thresholds[lod] = lodSelector.GetThreshold(lod);
+
+	m_pCullProgram->UseProgram();
+	m_pCullProgram->SetUniform("numInstances", m_numInstances);
+	m_pCullProgram->SetUniform("planes", const_cast<glm::vec4*>(frustum.GetPlanes()), 6);
+	m_pCullProgram->SetUniform("eye", frustum.GetEye());
+	m_pCullProgram->SetUniform("fadeDistance", frustum.GetFadeDistance());
+	m_pCullProgram->SetUniform("cullDistance", frustum.GetCullDistance());
+	m_pCullProgram->SetUniform("pixelsPerUnit", lodSelector.GetPixelsPerUnit());
+	m_pCullProgram->SetUniform("lodThresholds", thresholds, MAX_LOD_LEVELS - 1);
+	m_pCullProgram->SetUniform("lodHysteresis", lodSelector.GetHysteresis());
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_meshBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_visibleBuffer);
+	glDispatchCompute((m_numInstances + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// The draw reads what the shader wrote as draw commands and as vertex attributes
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+// Every mesh and level of detail in the one call; commands Cull left empty draw nothing
+void CGpuCuller::Draw()
+{
+	if (m_commands.empty() || m_numInstances == 0)
+		return;
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, NULL, (GLsizei) m_commands.size(), 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+int CGpuCuller::ReadVisibleCount()
+{
+	if (m_commands.empty())
+		return 0;
+
+	vector<DrawCommand> commands(m_commands.size());
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawCommand), &commands[0]);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	int count = 0;
+	for (unsigned int i = 0; i < commands.size(); i++)
+		count += commands[i].instanceCount;
+	return count;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Common.h"
+#include "PrimitiveArena.h"
+#include "LevelOfDetail.h"
+
+class CFrustum;
+class CShaderProgram;
+
+// An object drawn by CGpuCuller
+struct GpuCullInstance
+{
+	glm::vec3 position;
+	float scale;
+	glm::quat rotation;		// Before its spin, such as the frame of the track it stands on
+	glm::vec3 spinAxis;		// Axis the object spins about, in its own frame, or zero if it does not spin
+	float phase;			// Of its spin and bob, in radians; see instancedShader.vert
+	int mesh;				// As returned by CGpuCuller::AddMesh
+	int layer;				// Texture array layer of its material
+	bool active;			// Drawn only while active
+};
+
+// Culls a set of objects on the GPU and draws the survivors with glMultiDrawElementsIndirect, so that drawing them
+// costs the CPU the same whatever their number.  The objects live in a shader storage buffer, written only when
+// they are placed or change state.  Each frame a compute shader (cullShader.comp) tests them all against the
+// frustum and the cull distance, as CFrustum does, picks each one's level of detail, as CLodSelector does, and
+// appends the placement of each one that survives to the draw command for its mesh and level.  A single multi-draw
+// then draws every command, with the instanced shader taking each object's placement from its instance data and
+// animating it from there, so an object's data only changes when the object itself does.
+//
+// Only objects drawn from the primitive arena with the texture array can go this way, which in the game is the
+// sphere, cube and pyramid pickups.  The health packs and the ships are imported meshes with materials of their
+// own, and are still culled by CFrustum and drawn through the render queue (the racers by CRacers).
+//
+// Needs OpenGL 4.3, for compute shaders, storage buffers and indirect multi-draws; see IsSupported.
+class CGpuCuller
+{
+public:
+	CGpuCuller();
+	~CGpuCuller();
+
+	static bool IsSupported();
+
+	// Add a mesh, whose levels of detail are consecutive primitives of the arena, and whose bounding sphere at unit
+	// scale is centred on its origin.  Returns the mesh number for GpuCullInstance::mesh.  Every mesh must be added,
+	// and from the same arena, before Create, and the arena must be created first.
+	int AddMesh(const CPrimitiveArena *primitives, int firstPrimitive, int numLods, float boundingRadius);
+	bool Create(CShaderProgram *cullProgram);
+	void Release();
+
+	// Replace every object.  Objects keep these numbers for SetActive.
+	void SetInstances(const vector<GpuCullInstance> &instances);
+	void SetActive(int instance, bool active);
+	int GetNumInstances() const;
+
+	// Cull the objects and build this frame's draw commands
+	void Cull(const CFrustum &frustum, const CLodSelector &lodSelector);
+
+	// Draw what Cull left, with the instanced texture array program, which must be in use with its view matrices and
+	// animation uniforms set
+	void Draw();
+
+	// Number of objects the last Cull kept, read back from the GPU.  This waits for the GPU, so is for checking only.
+	int ReadVisibleCount();
+
+private:
+	// As the structs in cullShader.comp, laid out by std430 rules
+	struct Instance {
+		glm::vec4 positionScale;
+		glm::quat rotation;
+		glm::vec4 spin;			// Axis and phase
+		GLuint mesh;
+		GLuint layer;
+		GLuint isActive;
+		GLuint lod;				// Level of detail last drawn with, for the hysteresis
+	};
+
+	struct Mesh {
+		GLuint firstCommand;	// Its commands, one per level of detail
+		GLuint numLods;
+		float boundingRadius;
+		GLuint padding;
+	};
+
+	// As glMultiDrawElementsIndirect reads them
+	struct DrawCommand {
+		GLuint count;
+		GLuint instanceCount;	// Zeroed before each Cull, which counts the objects it keeps
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;	// Start of the command's share of the visible instance buffer
+	};
+
+	// What Cull writes for each object kept; see instancedShader.vert
+	static const int VISIBLE_INSTANCE_SIZE = 64;
+	static const int CULL_GROUP_SIZE = 64;		// local_size_x in cullShader.comp
+
+	CShaderProgram *m_pCullProgram;
+	const CPrimitiveArena *m_pPrimitives;	// Whose buffers the meshes are drawn from
+	GLuint m_vao;
+	GLuint m_instanceBuffer;			// Every object
+	GLuint m_meshBuffer;
+	GLuint m_commandBuffer;
+	GLuint m_visibleBuffer;				// Placement of every object kept, grouped by command
+	UINT m_visibleCapacity;				// In instances
+
+	vector<Mesh> m_meshes;
+	vector<int> m_lodPrimitives;		// MAX_LOD_LEVELS for each mesh
+
+	vector<DrawCommand> m_commands;		// With the instance counts zeroed, ready to reset the command buffer
+	int m_numInstances;
+};
@@ -0,0 +1,84 @@
+#include "GpuTimer.h"
+
+CGpuTimer::CGpuTimer()
+{
+	m_currentFrame = 0;
+	m_created = false;
+	m_totalNanoseconds = 0;
+	m_totalSamples = 0;
+	m_numResults = 0;
+	for (int i = 0; i < NUM_FRAMES; i++) {
+		m_timeQueries[i] = m_sampleQueries[i] = 0;
+		m_pending[i] = false;
+	}
+}
+
+CGpuTimer::~CGpuTimer()
+{
+	Release();
+}
+
+void CGpuTimer::Create()
+{
+	if (m_created)
+		return;
+	glGenQueries(NUM_FRAMES, m_timeQueries);
+	glGenQueries(NUM_FRAMES, m_sampleQueries);
+	m_created = true;
+}
+
+void CGpuTimer::Release()
+{
+	if (!m_created)
+		return;
+	glDeleteQueries(NUM_FRAMES, m_timeQueries);
+	glDeleteQueries(NUM_FRAMES, m_sampleQueries);
+	for (int i = 0; i < NUM_FRAMES; i++)
+		m_pending[i] = false;
+	m_created = false;
+}
+
+// Read the results of the frame NUM_FRAMES ago before its queries are used again
+void CGpuTimer::Begin()
+{
+	if (!m_created)
+		return;
+	if (m_pending[m_currentFrame])
+		Collect(m_currentFrame);
+	glBeginQuery(GL_TIME_ELAPSED, m_timeQueries[m_currentFrame]);
+	glBeginQuery(GL_SAMPLES_PASSED, m_sampleQueries[m_currentFrame]);
+}
+
+void CGpuTimer::End()
+{
+	if (!m_created)
+		return;
+	glEndQuery(GL_SAMPLES_PASSED);
+	glEndQuery(GL_TIME_ELAPSED);
+	m_pending[m_currentFrame] = true;
+	m_currentFrame = (m_currentFrame + 1) % NUM_FRAMES;
+}
+
+// Waits for the results if the GPU has somehow not finished them yet
+void CGpuTimer::Collect(int frame)
+{
+	GLuint64 nanoseconds, samples;
+	glGetQueryObjectui64v(m_timeQueries[frame], GL_QUERY_RESULT, &nanoseconds);
+	glGetQueryObjectui64v(m_sampleQueries[frame], GL_QUERY_RESULT, &samples);
+	m_totalNanoseconds += nanoseconds;
+	m_totalSamples += samples;
+	m_numResults++;
+	m_pending[frame] = false;
+}
+
+bool CGpuTimer::TakeAverages(double &milliseconds, double &samples)
+{
+	if (m_numResults == 0)
+		return false;
+	milliseconds = m_totalNanoseconds / 1e6 / m_numResults;
+	samples = (double) m_totalSamples / m_numResults;
+	m_totalNanoseconds = 0;
+	m_totalSamples = 0;
+	m_numResults = 0;
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Common.h"
+
+// Measures a stretch of GPU work, once a frame, with query objects: the time the GPU spends on it and the number of
+// samples that pass the depth test in it.  The GPU finishes a frame's work well after the CPU has submitted it, so
+// each frame's queries are kept and read NUM_FRAMES frames later, by when the results are almost always ready, so
+// that measuring does not make the CPU wait.  The results are averaged until they are taken.
+//
+//		timer.Begin();
+//		... draw ...
+//		timer.End();
+//		...
+//		if (timer.TakeAverages(milliseconds, samples)) ...
+//
+// Queries of the same kind cannot overlap, so timers must not be nested.
+class CGpuTimer
+{
+public:
+	CGpuTimer();
+	~CGpuTimer();
+
+	void Create();
+	void Release();
+
+	void Begin();
+	void End();
+
+	// Average milliseconds and samples passed per Begin and End, over the results read since the last call.
+	// Returns false if there are none yet.
+	bool TakeAverages(double &milliseconds, double &samples);
+
+private:
+	static const int NUM_FRAMES = 4;
+
+	void Collect(int frame);
+
+	GLuint m_timeQueries[NUM_FRAMES];
+	GLuint m_sampleQueries[NUM_FRAMES];
+	bool m_pending[NUM_FRAMES];		// Whether the frame's queries hold results not yet read
+	int m_currentFrame;
+	bool m_created;
+
+	GLuint64 m_totalNanoseconds;
+	GLuint64 m_totalSamples;
+	int m_numResults;
+};
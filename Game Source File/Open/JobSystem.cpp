@@ -0,0 +1,207 @@
+#include "JobSystem.h"
+#include <assert.h>
+
+// The pool a worker thread belongs to and its index there.  Any other thread is taken to be the one that created
+// the pool, which uses the first queue.
+static thread_local const CJobSystem *s_pThreadSystem = NULL;
+static thread_local int s_threadIndex = 0;
+
+CJobSystem::CJobSystem()
+{
+	m_queuedJobs = 0;
+	m_quit = false;
+}
+
+CJobSystem::~CJobSystem()
+{
+	Release();
+}
+
+bool CJobSystem::Create(int numThreads)
+{
+	Release();
+
+	if (numThreads <= 0)
+		numThreads = max((int) std::thread::hardware_concurrency(), 1);
+
+	m_quit = false;
+	m_queuedJobs = 0;
+	m_ownerThread = std::this_thread::get_id();
+	for (int i = 0; i < numThreads; i++) {
+		Queue *queue = new Queue;
+		queue->ring = new CJob[MAX_JOBS_PER_THREAD];
+		queue->nextJob = 0;
+		m_queues.push_back(queue);
+	}
+	for (int i = 1; i < numThreads; i++)
+		m_workers.push_back(std::thread(&CJobSystem::WorkerMain, this, i));
+
+	printf("Jobs: %d threads\n", numThreads);
+	return true;
+}
+
+void CJobSystem::Release()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (unsigned int i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+	m_workers.clear();
+
+	for (unsigned int i = 0; i < m_queues.size(); i++) {
+		delete[] m_queues[i]->ring;
+		delete m_queues[i];
+	}
+	m_queues.clear();
+}
+
+int CJobSystem::GetNumThreads() const
+{
+	return (int) m_queues.size();
+}
+
+int CJobSystem::GetThreadIndex() const
+{
+	return s_pThreadSystem == this ? s_threadIndex : 0;
+}
+
+int CJobSystem::GetCallerIndex() const
+{
+	assert(s_pThreadSystem == this || std::this_thread::get_id() == m_ownerThread);
+	return GetThreadIndex();
+}
+
+CJob *CJobSystem::CreateJob(const std::function<void()> &function, CJob *parent)
+{
+	// Only this thread takes jobs from its ring, so no lock is needed
+	Queue *queue = m_queues[GetCallerIndex()];
+	CJob *job = &queue->ring[queue->nextJob++ % MAX_JOBS_PER_THREAD];
+	job->function = function;
+	job->parent = parent;
+	job->unfinished = 1;
+	if (parent != NULL)
+		parent->unfinished++;
+	return job;
+}
+
+void CJobSystem::Run(CJob *job)
+{
+	Queue *queue = m_queues[GetCallerIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->jobs.push_back(job);
+	}
+
+	// Counted under the sleep lock so that a worker about to sleep cannot miss the job
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queuedJobs++;
+	}
+	m_wake.notify_one();
+}
+
+void CJobSystem::Wait(CJob *job)
+{
+	int threadIndex = GetCallerIndex();
+	while (job->unfinished > 0) {
+		CJob *next = GetJob(threadIndex);
+		if (next != NULL)
+			Execute(next);
+		else
+			std::this_thread::yield();
+	}
+}
+
+bool CJobSystem::RunPendingJob()
+{
+	CJob *job = GetJob(GetCallerIndex());
+	if (job == NULL)
+		return false;
+	Execute(job);
+	return true;
+}
+
+void CJobSystem::ParallelFor(int count, int grainSize, const std::function<void(int first, int last)> &function)
+{
+	if (count <= 0)
+		return;
+	grainSize = max(grainSize, 1);
+
+	// One piece needs no other thread
+	if (count <= grainSize || GetNumThreads() == 1) {
+		function(0, count);
+		return;
+	}
+
+	CJob *parent = CreateJob(std::function<void()>());
+	for (int first = 0; first < count; first += grainSize) {
+		int last = min(first + grainSize, count);
+		Run(CreateJob([&function, first, last] { function(first, last); }, parent));
+	}
+	Run(parent);
+	Wait(parent);
+}
+
+// The newest job in this thread's own queue or, failing that, the oldest in another's
+CJob *CJobSystem::GetJob(int threadIndex)
+{
+	if (m_queuedJobs <= 0)
+		return NULL;
+
+	int numQueues = (int) m_queues.size();
+	for (int k = 0; k < numQueues; k++) {
+		Queue *queue = m_queues[(threadIndex + k) % numQueues];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (queue->jobs.empty())
+			continue;
+
+		CJob *job;
+		if (k == 0) {
+			job = queue->jobs.back();
+			queue->jobs.pop_back();
+		} else {
+			job = queue->jobs.front();
+			queue->jobs.pop_front();
+		}
+		m_queuedJobs--;
+		return job;
+	}
+	return NULL;
+}
+
+void CJobSystem::Execute(CJob *job)
+{
+	if (job->function)
+		job->function();
+	Finish(job);
+}
+
+void CJobSystem::Finish(CJob *job)
+{
+	// Once the count reaches zero the job's slot can be reused at any moment, so its parent is read first
+	CJob *parent = job->parent;
+	if (--job->unfinished == 0 && parent != NULL)
+		Finish(parent);
+}
+
+void CJobSystem::WorkerMain(int threadIndex)
+{
+	s_pThreadSystem = this;
+	s_threadIndex = threadIndex;
+
+	for (;;) {
+		CJob *job = GetJob(threadIndex);
+		if (job != NULL) {
+			Execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this] { return m_quit || m_queuedJobs > 0; });
+		if (m_quit)
+			return;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Common.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// A unit of work for CJobSystem.  A job is not finished until its function has run and every job created as its
+// child has finished too, so waiting on a parent waits for a whole tree of work.
+struct CJob
+{
+	std::function<void()> function;
+	CJob *parent;
+	std::atomic<int> unfinished;		// This job plus its unfinished children
+};
+
+// Runs jobs on a pool of worker threads, one per core by default, with the thread that creates the pool as one of
+// them.  Each thread keeps its own queue: it adds and takes jobs at the back, so it works on what it made most
+// recently while the data is still in its cache, and a thread that runs out of work steals from the front of
+// another's queue.  Waiting threads run jobs rather than block, so jobs can themselves wait on the jobs they make.
+//
+// Jobs are taken from a ring kept for each thread and reused once it wraps round, so no more than
+// MAX_JOBS_PER_THREAD jobs made by one thread may be waited on or still running at once.  Only the thread that
+// created the pool and the pool's own workers may make, run or wait on jobs; any other thread would share the first
+// thread's ring without a lock.  For example:
+//
+//		CJob *parent = jobs.CreateJob(NULL);
+//		for (...)
+//			jobs.Run(jobs.CreateJob([=] { ... }, parent));
+//		jobs.Run(parent);
+//		jobs.Wait(parent);
+class CJobSystem
+{
+public:
+	CJobSystem();
+	~CJobSystem();
+
+	// numThreads counts the calling thread; 0 means one thread per core.  With one thread every job runs inside
+	// Wait on the calling thread.
+	bool Create(int numThreads = 0);
+	void Release();
+	int GetNumThreads() const;
+	int GetThreadIndex() const;		// Of the calling thread, from 0 (the thread that created the pool) up
+
+	CJob *CreateJob(const std::function<void()> &function, CJob *parent = NULL);	// Call Run on parent after its children
+	void Run(CJob *job);
+	void Wait(CJob *job);		// Runs other jobs until this one has finished
+	bool RunPendingJob();		// Runs one queued job on the calling thread, if there is one, for threads that wait on other things
+
+	// Call function(first, last) over [0, count) in pieces of about grainSize, spread across the threads, and
+	// return once every piece is done
+	void ParallelFor(int count, int grainSize, const std::function<void(int first, int last)> &function);
+
+private:
+	static const int MAX_JOBS_PER_THREAD = 4096;
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<CJob*> jobs;
+		CJob *ring;
+		unsigned int nextJob;
+	};
+
+	int GetCallerIndex() const;		// GetThreadIndex, checking that the caller may use the pool
+	CJob *GetJob(int threadIndex);
+	void Execute(CJob *job);
+	void Finish(CJob *job);
+	void WorkerMain(int threadIndex);
+
+	vector<Queue*> m_queues;			// One per thread; the calling thread's is the first
+	vector<std::thread> m_workers;
+	std::atomic<int> m_queuedJobs;		// Jobs in any queue, so that idle workers know whether to look
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+	bool m_quit;
+	std::thread::id m_ownerThread;		// The thread that created the pool
+};
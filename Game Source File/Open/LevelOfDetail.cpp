@@ -0,0 +1,74 @@
+#include "LevelOfDetail.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+CLodSelector::CLodSelector()
+{
+	m_pixelsPerUnit = 1.0f;
+	m_thresholds[0] = 100.0f;
+	m_thresholds[1] = 30.0f;
+	m_hysteresis = 0.1f;
+}
+
+CLodSelector::~CLodSelector()
+{}
+
+void CLodSelector::SetProjection(float fovY, int viewportHeight)
+{
+	float halfAngle = fovY * 0.5f * (float) M_PI / 180.0f;
+	m_pixelsPerUnit = viewportHeight / (2.0f * tan(halfAngle));
+}
+
+void CLodSelector::SetThresholds(float threshold0, float threshold1)
+{
+	m_thresholds[0] = threshold0;
+	m_thresholds[1] = threshold1;
+}
+
+void CLodSelector::SetHysteresis(float fraction)
+{
+	m_hysteresis = fraction;
+}
+
+float CLodSelector::ProjectedSize(float radius, float distance) const
+{
+	if (distance <= radius)
+		return 1e30f;	// The eye is inside the sphere
+	return 2.0f * radius * m_pixelsPerUnit / distance;
+}
+
+float CLodSelector::GetPixelsPerUnit() const
+{
+	return m_pixelsPerUnit;
+}
+
+float CLodSelector::GetThreshold(int lod) const
+{
+	return m_thresholds[lod];
+}
+
+float CLodSelector::GetHysteresis() const
+{
+	return m_hysteresis;
+}
+
+// Step coarser while the object is clearly below the current level's threshold, then finer while it is clearly
+// above the next finer level's threshold.  Starting from the current level is what gives the hysteresis.
+int CLodSelector::Select(float radius, float distance, int currentLod, int numLods) const
+{
+	float size = ProjectedSize(radius, distance);
+
+	int lod = currentLod;
+	if (lod > numLods - 1)
+		lod = numLods - 1;
+	if (lod < 0)
+		lod = 0;
+
+	while (lod < numLods - 1 && size < m_thresholds[lod] * (1.0f - m_hysteresis))
+		lod++;
+	while (lod > 0 && size > m_thresholds[lod - 1] * (1.0f + m_hysteresis))
+		lod--;
+
+	return lod;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Common.h"
+
+// Most levels of detail any object keeps.  Level 0 is always the full resolution geometry.
+const int MAX_LOD_LEVELS = 3;
+
+// Chooses a level of detail from the size an object's bounding sphere projects to on screen
+class CLodSelector
+{
+public:
+	CLodSelector();
+	~CLodSelector();
+
+	// Must match the camera's vertical field of view (in degrees) and the viewport height (in pixels)
+	void SetProjection(float fovY, int viewportHeight);
+
+	// threshold0 is the projected diameter (in pixels) below which level 1 is used instead of level 0, and
+	// threshold1 the diameter below which level 2 is used instead of level 1
+	void SetThresholds(float threshold0, float threshold1);
+
+	// An object only changes level once its size is this fraction past the threshold, so that objects hovering
+	// around a threshold do not flicker between levels
+	void SetHysteresis(float fraction);
+
+	// Projected diameter, in pixels, of a sphere at the given distance from the eye
+	float ProjectedSize(float radius, float distance) const;
+
+	// Returns the level to draw with, given the level used last frame and the number of levels the object has
+	int Select(float radius, float distance, int currentLod, int numLods) const;
+
+	// For selecting elsewhere, such as on the GPU, by the same rule
+	float GetPixelsPerUnit() const;
+	float GetThreshold(int lod) const;		// Below which level lod + 1 is used instead of lod
+	float GetHysteresis() const;
+
+private:
+	float m_pixelsPerUnit;		// Viewport height divided by the height of the view volume at unit distance
+	float m_thresholds[MAX_LOD_LEVELS - 1];
+	float m_hysteresis;
+};
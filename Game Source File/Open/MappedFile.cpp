@@ -0,0 +1,66 @@
+#include "MappedFile.h"
+
+CMappedFile::CMappedFile()
+{
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+	m_pData = NULL;
+	m_size = 0;
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+// Map the file.  Returns false, without reporting an error, if it does not exist or cannot be mapped; an empty
+// file cannot be mapped either.
+bool CMappedFile::Open(const string &filename)
+{
+	Close();
+
+	m_file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0 || size.HighPart != 0) {
+		Close();
+		return false;
+	}
+	m_size = size.LowPart;
+
+	m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping != NULL)
+		m_pData = (const BYTE*) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_pData == NULL) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if (m_pData != NULL)
+		UnmapViewOfFile(m_pData);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+	m_pData = NULL;
+	m_size = 0;
+}
+
+const BYTE *CMappedFile::GetData() const
+{
+	return m_pData;
+}
+
+UINT CMappedFile::GetSize() const
+{
+	return m_size;
+}
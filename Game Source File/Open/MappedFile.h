@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Common.h"
+
+// A read-only view of a whole file, mapped into memory by the operating system.  Nothing is read until the pages
+// are touched, and the data is never copied into a buffer of our own.
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	bool Open(const string &filename);
+	void Close();
+
+	const BYTE *GetData() const;
+	UINT GetSize() const;
+
+private:
+	CMappedFile(const CMappedFile &);
+	CMappedFile &operator=(const CMappedFile &);
+
+	HANDLE m_file;
+	HANDLE m_mapping;
+	const BYTE *m_pData;
+	UINT m_size;
+};
@@ -0,0 +1,246 @@
+//This file is licensed by the MIT License.
+
+
+
+#include "MatrixSimd.h"
+#include <math.h>
+#include <assert.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define MATRIX_SIMD_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(MATRIX_SIMD_SSE) && defined(__AVX__)
+#define MATRIX_SIMD_AVX
+#include <immintrin.h>
+#endif
+
+namespace glutil
+{
+#ifdef MATRIX_SIMD_SSE
+	// Splat one lane of v across all four lanes
+	#define SPLAT(v, i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i, i, i, i))
+
+	// a * (x, y, z, w) for a column vector b, with a given as its four columns
+	static inline __m128 MulColumn(__m128 a0, __m128 a1, __m128 a2, __m128 a3, __m128 b)
+	{
+		__m128 r = _mm_mul_ps(a0, SPLAT(b, 0));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, SPLAT(b, 1)));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, SPLAT(b, 2)));
+		return _mm_add_ps(r, _mm_mul_ps(a3, SPLAT(b, 3)));
+	}
+
+	// a * (x, y, z, 0) -- the w component of b is ignored
+	static inline __m128 MulDirection(__m128 a0, __m128 a1, __m128 a2, __m128 b)
+	{
+		__m128 r = _mm_mul_ps(a0, SPLAT(b, 0));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, SPLAT(b, 1)));
+		return _mm_add_ps(r, _mm_mul_ps(a2, SPLAT(b, 2)));
+	}
+#endif
+
+	void MultiplyMat4( const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result )
+	{
+#if defined(MATRIX_SIMD_AVX)
+		const float *pa = &a[0][0];
+		const float *pb = &b[0][0];
+		// Every 256-bit register holds two columns, so two result columns are produced per pass
+		__m256 a0 = _mm256_broadcast_ps((const __m128 *)(pa + 0));
+		__m256 a1 = _mm256_broadcast_ps((const __m128 *)(pa + 4));
+		__m256 a2 = _mm256_broadcast_ps((const __m128 *)(pa + 8));
+		__m256 a3 = _mm256_broadcast_ps((const __m128 *)(pa + 12));
+		__m256 b01 = _mm256_loadu_ps(pb + 0);
+		__m256 b23 = _mm256_loadu_ps(pb + 8);
+
+		__m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(a1, _mm256_shuffle_ps(b01, b01, 0x55)));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(a2, _mm256_shuffle_ps(b01, b01, 0xAA)));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(a3, _mm256_shuffle_ps(b01, b01, 0xFF)));
+
+		__m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(a1, _mm256_shuffle_ps(b23, b23, 0x55)));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(a2, _mm256_shuffle_ps(b23, b23, 0xAA)));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(a3, _mm256_shuffle_ps(b23, b23, 0xFF)));
+
+		float *pr = &result[0][0];
+		_mm256_storeu_ps(pr + 0, r01);
+		_mm256_storeu_ps(pr + 8, r23);
+#elif defined(MATRIX_SIMD_SSE)
+		const float *pa = &a[0][0];
+		const float *pb = &b[0][0];
+		__m128 a0 = _mm_loadu_ps(pa + 0);
+		__m128 a1 = _mm_loadu_ps(pa + 4);
+		__m128 a2 = _mm_loadu_ps(pa + 8);
+		__m128 a3 = _mm_loadu_ps(pa + 12);
+
+		__m128 r0 = MulColumn(a0, a1, a2, a3, _mm_loadu_ps(pb + 0));
+		__m128 r1 = MulColumn(a0, a1, a2, a3, _mm_loadu_ps(pb + 4));
+		__m128 r2 = MulColumn(a0, a1, a2, a3, _mm_loadu_ps(pb + 8));
+		__m128 r3 = MulColumn(a0, a1, a2, a3, _mm_loadu_ps(pb + 12));
+
+		float *pr = &result[0][0];
+		_mm_storeu_ps(pr + 0, r0);
+		_mm_storeu_ps(pr + 4, r1);
+		_mm_storeu_ps(pr + 8, r2);
+		_mm_storeu_ps(pr + 12, r3);
+#else
+		result = a * b;
+#endif
+	}
+
+	void MultiplyAffineMat4( const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result )
+	{
+#ifdef MATRIX_SIMD_SSE
+		const float *pa = &a[0][0];
+		const float *pb = &b[0][0];
+		__m128 a0 = _mm_loadu_ps(pa + 0);
+		__m128 a1 = _mm_loadu_ps(pa + 4);
+		__m128 a2 = _mm_loadu_ps(pa + 8);
+		__m128 a3 = _mm_loadu_ps(pa + 12);
+
+		// Columns 0-2 of b have w == 0, so a3 never contributes to them; column 3 has w == 1
+		__m128 r0 = MulDirection(a0, a1, a2, _mm_loadu_ps(pb + 0));
+		__m128 r1 = MulDirection(a0, a1, a2, _mm_loadu_ps(pb + 4));
+		__m128 r2 = MulDirection(a0, a1, a2, _mm_loadu_ps(pb + 8));
+		__m128 r3 = _mm_add_ps(MulDirection(a0, a1, a2, _mm_loadu_ps(pb + 12)), a3);
+
+		float *pr = &result[0][0];
+		_mm_storeu_ps(pr + 0, r0);
+		_mm_storeu_ps(pr + 4, r1);
+		_mm_storeu_ps(pr + 8, r2);
+		_mm_storeu_ps(pr + 12, r3);
+#else
+		glm::mat4 r;
+		for (int j = 0; j < 3; j++)
+			r[j] = a[0] * b[j].x + a[1] * b[j].y + a[2] * b[j].z;
+		r[3] = a[0] * b[3].x + a[1] * b[3].y + a[2] * b[3].z + a[3];
+		result = r;
+#endif
+	}
+
+	void ApplyTranslation( glm::mat4 &m, const glm::vec3 &offset )
+	{
+#ifdef MATRIX_SIMD_SSE
+		float *pm = &m[0][0];
+		__m128 r = _mm_mul_ps(_mm_loadu_ps(pm + 0), _mm_set1_ps(offset.x));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(pm + 4), _mm_set1_ps(offset.y)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(pm + 8), _mm_set1_ps(offset.z)));
+		r = _mm_add_ps(r, _mm_loadu_ps(pm + 12));
+		_mm_storeu_ps(pm + 12, r);
+#else
+		m[3] = m[0] * offset.x + m[1] * offset.y + m[2] * offset.z + m[3];
+#endif
+	}
+
+	void ApplyScale( glm::mat4 &m, const glm::vec3 &scale )
+	{
+#ifdef MATRIX_SIMD_SSE
+		float *pm = &m[0][0];
+		_mm_storeu_ps(pm + 0, _mm_mul_ps(_mm_loadu_ps(pm + 0), _mm_set1_ps(scale.x)));
+		_mm_storeu_ps(pm + 4, _mm_mul_ps(_mm_loadu_ps(pm + 4), _mm_set1_ps(scale.y)));
+		_mm_storeu_ps(pm + 8, _mm_mul_ps(_mm_loadu_ps(pm + 8), _mm_set1_ps(scale.z)));
+#else
+		m[0] *= scale.x;
+		m[1] *= scale.y;
+		m[2] *= scale.z;
+#endif
+	}
+
+	void ApplyRotation( glm::mat4 &m, const glm::mat3 &rotation )
+	{
+#ifdef MATRIX_SIMD_SSE
+		float *pm = &m[0][0];
+		__m128 m0 = _mm_loadu_ps(pm + 0);
+		__m128 m1 = _mm_loadu_ps(pm + 4);
+		__m128 m2 = _mm_loadu_ps(pm + 8);
+
+		__m128 r0 = _mm_mul_ps(m0, _mm_set1_ps(rotation[0].x));
+		r0 = _mm_add_ps(r0, _mm_mul_ps(m1, _mm_set1_ps(rotation[0].y)));
+		r0 = _mm_add_ps(r0, _mm_mul_ps(m2, _mm_set1_ps(rotation[0].z)));
+
+		__m128 r1 = _mm_mul_ps(m0, _mm_set1_ps(rotation[1].x));
+		r1 = _mm_add_ps(r1, _mm_mul_ps(m1, _mm_set1_ps(rotation[1].y)));
+		r1 = _mm_add_ps(r1, _mm_mul_ps(m2, _mm_set1_ps(rotation[1].z)));
+
+		__m128 r2 = _mm_mul_ps(m0, _mm_set1_ps(rotation[2].x));
+		r2 = _mm_add_ps(r2, _mm_mul_ps(m1, _mm_set1_ps(rotation[2].y)));
+		r2 = _mm_add_ps(r2, _mm_mul_ps(m2, _mm_set1_ps(rotation[2].z)));
+
+		_mm_storeu_ps(pm + 0, r0);
+		_mm_storeu_ps(pm + 4, r1);
+		_mm_storeu_ps(pm + 8, r2);
+#else
+		glm::vec4 c0 = m[0], c1 = m[1], c2 = m[2];
+		for (int j = 0; j < 3; j++)
+			m[j] = c0 * rotation[j].x + c1 * rotation[j].y + c2 * rotation[j].z;
+#endif
+	}
+
+	glm::mat3 RotationMatrix( const glm::vec3 &axisOfRotation, float angRadCCW )
+	{
+		float fCos = cosf(angRadCCW);
+		float fInvCos = 1.0f - fCos;
+		float fSin = sinf(angRadCCW);
+
+		glm::vec3 axis = glm::normalize(axisOfRotation);
+
+		glm::mat3 theMat;
+		theMat[0].x = (axis.x * axis.x) + ((1 - axis.x * axis.x) * fCos);
+		theMat[1].x = axis.x * axis.y * (fInvCos) - (axis.z * fSin);
+		theMat[2].x = axis.x * axis.z * (fInvCos) + (axis.y * fSin);
+
+		theMat[0].y = axis.x * axis.y * (fInvCos) + (axis.z * fSin);
+		theMat[1].y = (axis.y * axis.y) + ((1 - axis.y * axis.y) * fCos);
+		theMat[2].y = axis.y * axis.z * (fInvCos) - (axis.x * fSin);
+
+		theMat[0].z = axis.x * axis.z * (fInvCos) - (axis.y * fSin);
+		theMat[1].z = axis.y * axis.z * (fInvCos) + (axis.x * fSin);
+		theMat[2].z = (axis.z * axis.z) + ((1 - axis.z * axis.z) * fCos);
+		return theMat;
+	}
+
+	bool IsAffine( const glm::mat4 &m )
+	{
+		return m[0].w == 0.0f && m[1].w == 0.0f && m[2].w == 0.0f && m[3].w == 1.0f;
+	}
+
+#ifdef _DEBUG
+	// Whether a shortcut normal matrix matches the general one, to within rounding relative to its size
+	static bool NormalMatricesAgree(const glm::mat3 &a, const glm::mat3 &b)
+	{
+		float size = 1.0f, difference = 0.0f;
+		for (int c = 0; c < 3; c++)
+			for (int r = 0; r < 3; r++)
+			{
+				size = fmaxf(size, fabsf(b[c][r]));
+				difference = fmaxf(difference, fabsf(a[c][r] - b[c][r]));
+			}
+		return difference <= 1e-3f * size;
+	}
+#endif
+
+	glm::mat3 NormalMatrix( const glm::mat4 &m, TransformType type, float uniformScale )
+	{
+		glm::mat3 normalMatrix;
+		switch (type)
+		{
+		case TRANSFORM_RIGID:
+			normalMatrix = glm::mat3(m);
+			break;
+		case TRANSFORM_UNIFORM_SCALE:
+			normalMatrix = glm::mat3(m) * (1.0f / (uniformScale * uniformScale));
+			break;
+		default:
+			return glm::transpose(glm::inverse(glm::mat3(m)));
+		}
+
+#ifdef _DEBUG
+		// The shortcuts are only as good as the type the caller tracked, so debug builds check them
+		assert(NormalMatricesAgree(normalMatrix, glm::transpose(glm::inverse(glm::mat3(m)))));
+#endif
+		return normalMatrix;
+	}
+}
+
+
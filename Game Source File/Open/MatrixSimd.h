@@ -0,0 +1,79 @@
+/** This file is licensed by the MIT License. **/
+
+
+
+#ifndef MATRIX_SIMD_UTIL_H
+#define MATRIX_SIMD_UTIL_H
+
+/**
+\file
+\brief SSE kernels for the glm::mat4 operations used by the \ref module_glutil_matrixstack "matrix stack".
+**/
+
+#include "include\glm\glm.hpp"
+
+namespace glutil
+{
+	///\addtogroup module_glutil_matrixstack
+	///@{
+
+	/**
+	\name SIMD Matrix Kernels
+
+	These functions operate on column-major glm::mat4 values using SSE. They are written so that
+	\a result may alias either input. When SSE is not available they fall back to plain glm arithmetic.
+
+	The Apply* functions right-multiply \a m by a transform that is known to be affine (its bottom row is
+	0, 0, 0, 1), which means they never need to build that transform as a full 4x4 matrix nor multiply by
+	its projective row. Translation only touches column 3; rotation and scale only touch columns 0 to 2.
+	**/
+	///@{
+
+	///General 4x4 product: result = a * b.
+	void MultiplyMat4(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result);
+
+	///Product of two affine matrices: result = a * b. The projective row of both inputs is assumed to be 0, 0, 0, 1.
+	void MultiplyAffineMat4(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result);
+
+	///m = m * translate(offset)
+	void ApplyTranslation(glm::mat4 &m, const glm::vec3 &offset);
+
+	///m = m * scale(scale)
+	void ApplyScale(glm::mat4 &m, const glm::vec3 &scale);
+
+	///m = m * rotation, where \a rotation is a 3x3 rotation (or any linear) matrix.
+	void ApplyRotation(glm::mat4 &m, const glm::mat3 &rotation);
+
+	///Builds the 3x3 rotation about \a axis (need not be normalised) by \a angRadCCW radians.
+	glm::mat3 RotationMatrix(const glm::vec3 &axis, float angRadCCW);
+
+	///Returns true if the projective row of \a m is exactly 0, 0, 0, 1.
+	bool IsAffine(const glm::mat4 &m);
+	///@}
+
+	/**
+	\brief Describes what the upper 3x3 of a transform is known to contain.
+
+	RIGID means a pure rotation (plus any translation), UNIFORM_SCALE a rotation times a single scale factor,
+	and GENERAL anything else, including non-uniform scale, shear and projection.
+	**/
+	enum TransformType
+	{
+		TRANSFORM_RIGID,
+		TRANSFORM_UNIFORM_SCALE,
+		TRANSFORM_GENERAL,
+	};
+
+	/**
+	\brief Computes the normal matrix, transpose(inverse(mat3(m))), using the cheapest path \a type allows.
+
+	For a rigid transform the normal matrix is just mat3(m). With a uniform scale s, mat3(m) = s*R and
+	the normal matrix is R/s = mat3(m)/(s*s). Only TRANSFORM_GENERAL pays for the full 3x3 inverse.
+	**/
+	glm::mat3 NormalMatrix(const glm::mat4 &m, TransformType type, float uniformScale = 1.0f);
+	///@}
+}
+
+
+
+#endif //MATRIX_SIMD_UTIL_H
@@ -4,37 +4,60 @@
 
 
 #include "MatrixStack.h"
+#include "MatrixSimd.h"
 #include "include\glm\gtc\matrix_transform.hpp"
+#include <math.h>
 
 namespace glutil
 {
-	void MatrixStack::Rotate( const glm::vec3 axis, float angDegCCW )
+	void MatrixStack::Overflow()
 	{
-		m_currMatrix = glm::rotate(m_currMatrix, angDegCCW, axis);
+		m_lost++;
+		m_numErrors++;
 	}
 
-	void MatrixStack::RotateRadians( const glm::vec3 axisOfRotation, float angRadCCW )
+	//A pop matching a dropped push restores the deepest matrix kept, which is the nearest there is
+	void MatrixStack::Underflow()
 	{
-		float fCos = cosf(angRadCCW);
-		float fInvCos = 1.0f - fCos;
-		float fSin = sinf(angRadCCW);
-		float fInvSin = 1.0f - fSin;
+		if (m_lost > 0)
+		{
+			m_lost--;
+			m_curr = m_stack[m_depth - 1];
+			return;
+		}
+		m_numErrors++;
+		SetIdentity();
+	}
 
-		glm::vec3 axis = glm::normalize(axisOfRotation);
+	void MatrixStack::Rotate( const glm::vec3 axis, float angDegCCW )
+	{
+		ApplyRotation(m_curr.matrix, RotationMatrix(axis, glm::radians(angDegCCW)));
+	}
 
-		glm::mat4 theMat(1.0f);
-		theMat[0].x = (axis.x * axis.x) + ((1 - axis.x * axis.x) * fCos);
-		theMat[1].x = axis.x * axis.y * (fInvCos) - (axis.z * fSin);
-		theMat[2].x = axis.x * axis.z * (fInvCos) + (axis.y * fSin);
+	void MatrixStack::RotateRadians( const glm::vec3 axisOfRotation, float angRadCCW )
+	{
+		ApplyRotation(m_curr.matrix, RotationMatrix(axisOfRotation, angRadCCW));
+	}
 
-		theMat[0].y = axis.x * axis.y * (fInvCos) + (axis.z * fSin);
-		theMat[1].y = (axis.y * axis.y) + ((1 - axis.y * axis.y) * fCos);
-		theMat[2].y = axis.y * axis.z * (fInvCos) - (axis.x * fSin);
+	//Whether the columns of a matrix are of unit length and at right angles, to within rounding
+	static bool IsOrthonormal( const glm::mat3 &m )
+	{
+		const float tolerance = 1e-3f;
+		for (int i = 0; i < 3; i++)
+		{
+			if (fabs(glm::dot(m[i], m[i]) - 1.0f) > tolerance || fabs(glm::dot(m[i], m[(i + 1) % 3])) > tolerance)
+				return false;
+		}
+		return true;
+	}
 
-		theMat[0].z = axis.x * axis.z * (fInvCos) - (axis.y * fSin);
-		theMat[1].z = axis.y * axis.z * (fInvCos) + (axis.x * fSin);
-		theMat[2].z = (axis.z * axis.z) + ((1 - axis.z * axis.z) * fCos);
-		m_currMatrix *= theMat;
+	//A matrix that is not a rotation would give the wrong normals through the rigid shortcut, so it makes the
+	//transform general
+	void MatrixStack::Rotate( const glm::mat3 &rotation )
+	{
+		ApplyRotation(m_curr.matrix, rotation);
+		if (!IsOrthonormal(rotation))
+			MakeGeneral();
 	}
 
 	void MatrixStack::RotateX( float angDegCCW )
@@ -54,23 +77,33 @@ namespace glutil
 
 	void MatrixStack::Scale( const glm::vec3 &scaleVec )
 	{
-		m_currMatrix = glm::scale(m_currMatrix, scaleVec);
+		ApplyScale(m_curr.matrix, scaleVec);
+
+		if (scaleVec.x != scaleVec.y || scaleVec.x != scaleVec.z || scaleVec.x == 0.0f)
+			MakeGeneral();
+		else if (m_curr.type != TRANSFORM_GENERAL && scaleVec.x != 1.0f)
+		{
+			m_curr.type = TRANSFORM_UNIFORM_SCALE;
+			m_curr.scale *= scaleVec.x;
+		}
 	}
 
 	void MatrixStack::Translate( const glm::vec3 &offsetVec )
 	{
-		m_currMatrix = glm::translate(m_currMatrix, offsetVec);
+		ApplyTranslation(m_curr.matrix, offsetVec);
 	}
 
 	void MatrixStack::Perspective( float degFOV, float aspectRatio, float zNear, float zFar )
 	{
-		m_currMatrix *= glm::perspective(degFOV, aspectRatio, zNear, zFar);
+		m_curr.matrix *= glm::perspective(degFOV, aspectRatio, zNear, zFar);
+		MakeGeneral();
 	}
 
 	void MatrixStack::Orthographic( float left, float right, float bottom, float top,
 		float zNear, float zFar )
 	{
-		m_currMatrix *= glm::ortho(left, right, bottom, top, zNear, zFar);
+		m_curr.matrix *= glm::ortho(left, right, bottom, top, zNear, zFar);
+		MakeGeneral();
 	}
 
 	void MatrixStack::PixelPerfectOrtho( glm::ivec2 size, glm::vec2 depthRange, bool isTopLeft /*= true*/ )
@@ -89,22 +122,29 @@ namespace glutil
 
 	void MatrixStack::LookAt( const glm::vec3 &cameraPos, const glm::vec3 &lookatPos, const glm::vec3 &upDir )
 	{
-		m_currMatrix *= glm::lookAt(cameraPos, lookatPos, upDir);
+		MultiplyMat4(m_curr.matrix, glm::lookAt(cameraPos, lookatPos, upDir), m_curr.matrix);
 	}
 
 	void MatrixStack::ApplyMatrix( const glm::mat4 &theMatrix )
 	{
-		m_currMatrix *= theMatrix;
+		if (IsAffine(m_curr.matrix) && IsAffine(theMatrix))
+			MultiplyAffineMat4(m_curr.matrix, theMatrix, m_curr.matrix);
+		else
+			MultiplyMat4(m_curr.matrix, theMatrix, m_curr.matrix);
+		MakeGeneral();
 	}
 
 	void MatrixStack::SetMatrix( const glm::mat4 &theMatrix )
 	{
-		m_currMatrix = theMatrix;
+		m_curr.matrix = theMatrix;
+		MakeGeneral();
 	}
 
 	void MatrixStack::SetIdentity()
 	{
-		m_currMatrix = glm::mat4(1.0f);
+		m_curr.matrix = glm::mat4(1.0f);
+		m_curr.type = TRANSFORM_RIGID;
+		m_curr.scale = 1.0f;
 	}
 }
 
@@ -11,10 +11,10 @@
 \brief Contains a \ref module_glutil_matrixstack "matrix stack and associated classes".
 **/
 
-#include <stack>
-#include <vector>
+#include <assert.h>
 #include "include\glm\glm.hpp"
 #include "include\glm\gtc\type_ptr.hpp"
+#include "MatrixSimd.h"
 
 namespace glutil
 {
@@ -35,9 +35,21 @@ namespace glutil
 
 	The main power of the matrix stack is the ability to preserve and restore matrices in a stack fashion.
 	The current matrix can be preserved on the stack with Push() and the most recently preserved matrix
-	can be restored with Pop(). You must ensure that you do not Pop() more times than you Push(). Also,
-	while this matrix stack does not have an explicit size limit, if you Push() more times than you Pop(),
-	then you can eventually run out of memory (unless you create and destroy the MatrixStack every frame).
+	can be restored with Pop(). You must ensure that you do not Pop() more times than you Push(). The
+	stack has a fixed capacity of MAX_DEPTH preserved matrices, held inline in the object, so pushing and
+	popping never touches the heap. Pushing past MAX_DEPTH or popping an empty stack asserts in debug builds; in
+	release builds the push is dropped and its pop restores the deepest matrix kept, an empty pop restores the
+	identity, and either is counted for GetNumErrors(). This lets a single MatrixStack be kept alive and reused every frame:
+	call Clear() (or SetIdentity() on an empty stack) at the start of the frame instead of constructing a new one.
+
+	Translation, rotation, scale and matrix application are right-multiplied using the SSE kernels in
+	MatrixSimd.h. Since translation, rotation and scale matrices are affine, only the affected columns of
+	the current matrix are recomputed.
+
+	The stack also tracks the TransformType of the current matrix: LookAt, translation and rotation keep a
+	rigid transform rigid (Rotate(glm::mat3) only if the matrix is orthonormal), a uniform Scale() makes it TRANSFORM_UNIFORM_SCALE, and anything else (non-uniform
+	scale, projections, ApplyMatrix or SetMatrix) makes it TRANSFORM_GENERAL. NormalMatrix() uses this to avoid
+	a matrix inverse whenever it can.
 
 	The best way to manage the stack is to never use the Push() and Pop() methods directly.
 	Instead, use the PushStack object to do all pushing and popping. That will ensure that
@@ -46,15 +58,30 @@ namespace glutil
 	class MatrixStack
 	{
 	public:
+		///The number of matrices that can be preserved on the stack at once.
+		enum { MAX_DEPTH = 32 };
+
 		///Initializes the matrix stack with the identity matrix.
 		MatrixStack()
-			: m_currMatrix(1)
-		{}
+			: m_depth(0)
+			, m_lost(0)
+			, m_numErrors(0)
+		{
+			m_curr.matrix = glm::mat4(1.0f);
+			m_curr.type = TRANSFORM_RIGID;
+			m_curr.scale = 1.0f;
+		}
 
 		///Initializes the matrix stack with the given matrix.
 		explicit MatrixStack(const glm::mat4 &initialMatrix)
-			: m_currMatrix(initialMatrix)
-		{}
+			: m_depth(0)
+			, m_lost(0)
+			, m_numErrors(0)
+		{
+			m_curr.matrix = initialMatrix;
+			m_curr.type = TRANSFORM_GENERAL;
+			m_curr.scale = 1.0f;
+		}
 
 		/**
 		\name Stack Maintanence Functions
@@ -66,14 +93,21 @@ namespace glutil
 		///Preserves the current matrix on the stack.
 		void Push()
 		{
-			m_stack.push(m_currMatrix);
+			assert(m_depth < MAX_DEPTH);
+			if (m_depth < MAX_DEPTH)
+				m_stack[m_depth++] = m_curr;
+			else
+				Overflow();
 		}
 
 		///Restores the most recently preserved matrix.
 		void Pop()
 		{
-			m_currMatrix = m_stack.top();
-			m_stack.pop();
+			assert(m_depth > 0 && m_lost == 0);
+			if (m_depth > 0 && m_lost == 0)
+				m_curr = m_stack[--m_depth];
+			else
+				Underflow();
 		}
 
 		/**
@@ -81,13 +115,38 @@ namespace glutil
 		
 		This function does not affect the depth of the matrix stack.
 		**/
-		void Reset() { m_currMatrix = m_stack.top(); }
+		void Reset()
+		{
+			assert(m_depth > 0);
+			if (m_depth > 0)
+				m_curr = m_stack[m_depth - 1];
+			else
+				SetIdentity();
+		}
+
+		///Discards all preserved matrices and sets the current matrix to the identity matrix.
+		void Clear() { m_depth = 0; m_lost = 0; SetIdentity(); }
+
+		///Returns the number of matrices currently preserved on the stack.
+		int Depth() const { return m_depth; }
+
+		///Returns the number of pushes past MAX_DEPTH and pops of an empty stack so far. Clear() does not reset it.
+		int GetNumErrors() const { return m_numErrors; }
 
 		///Retrieve the current matrix.
 		const glm::mat4 &Top() const
 		{
-			return m_currMatrix;
+			return m_curr.matrix;
 		}
+
+		///Retrieve what kind of transform the current matrix is known to be.
+		TransformType GetTransformType() const { return m_curr.type; }
+
+		///Retrieve the accumulated scale factor; only meaningful when GetTransformType() is TRANSFORM_UNIFORM_SCALE.
+		float GetUniformScale() const { return m_curr.scale; }
+
+		///Retrieve the normal matrix, transpose(inverse(mat3(Top()))), computed as cheaply as the transform type allows.
+		glm::mat3 NormalMatrix() const { return glutil::NormalMatrix(m_curr.matrix, m_curr.type, m_curr.scale); }
 		///@}
 
 		/**
@@ -112,6 +171,9 @@ namespace glutil
 		void RotateY(float angDegCCW);
 		///Applies a rotation matrix about the +Z axis, with the given angle in degrees.
 		void RotateZ(float angDegCCW);
+
+		///Applies the given 3x3 matrix, normally a pure rotation. One that is not orthonormal makes the transform general.
+		void Rotate(const glm::mat3 &rotation);
 		///@}
 
 		/**
@@ -245,8 +307,24 @@ namespace glutil
 		///@}
 
 	private:
-		std::stack<glm::mat4, std::vector<glm::mat4> > m_stack;
-		glm::mat4 m_currMatrix;
+		struct Entry
+		{
+			glm::mat4 matrix;
+			TransformType type;
+			float scale;
+		};
+
+		void MakeGeneral() { m_curr.type = TRANSFORM_GENERAL; }
+
+		//Out of line, to keep Push() and Pop() small.
+		void Overflow();
+		void Underflow();
+
+		Entry m_stack[MAX_DEPTH];
+		Entry m_curr;
+		int m_depth;
+		int m_lost;			//Pushes dropped because the stack was full, still to be popped
+		int m_numErrors;
 	};
 
 	/**
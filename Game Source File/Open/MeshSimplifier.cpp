@@ -0,0 +1,304 @@
+#include "MeshSimplifier.h"
+
+#include <functional>
+#include <map>
+
+// Weight of the planes added along open edges, relative to the area weighting of ordinary faces, so that holes
+// and silhouettes of open meshes are not eaten away
+static const double BOUNDARY_WEIGHT = 1000.0;
+
+
+CMeshSimplifier::Quadric::Quadric()
+{
+	a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0.0;
+}
+
+void CMeshSimplifier::Quadric::AddPlane(const glm::dvec3 &n, double d, double w)
+{
+	a2 += w * n.x * n.x;	ab += w * n.x * n.y;	ac += w * n.x * n.z;	ad += w * n.x * d;
+	b2 += w * n.y * n.y;	bc += w * n.y * n.z;	bd += w * n.y * d;
+	c2 += w * n.z * n.z;	cd += w * n.z * d;
+	d2 += w * d * d;
+}
+
+void CMeshSimplifier::Quadric::Add(const Quadric &q)
+{
+	a2 += q.a2;	ab += q.ab;	ac += q.ac;	ad += q.ad;
+	b2 += q.b2;	bc += q.bc;	bd += q.bd;
+	c2 += q.c2;	cd += q.cd;
+	d2 += q.d2;
+}
+
+// p^T Q p with p = (x, y, z, 1)
+double CMeshSimplifier::Quadric::Error(const glm::dvec3 &p) const
+{
+	return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+		+ b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+		+ c2 * p.z * p.z + 2 * cd * p.z
+		+ d2;
+}
+
+
+// Orders positions so that identical ones can be found with a map
+struct PositionLess {
+	bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+		if (a.x != b.x) return a.x < b.x;
+		if (a.y != b.y) return a.y < b.y;
+		return a.z < b.z;
+	}
+};
+
+CMeshSimplifier::CMeshSimplifier()
+{
+	m_numTriangles = 0;
+}
+
+CMeshSimplifier::~CMeshSimplifier()
+{}
+
+void CMeshSimplifier::SetMesh(const vector<glm::vec3> &positions, const vector<glm::vec2> &texCoords, const vector<unsigned int> &indices)
+{
+	m_positions = positions;
+	m_texCoords = texCoords;
+
+	// Weld vertices that share a position
+	m_weld.resize(positions.size());
+	m_wedges.clear();
+	m_weldedPositions.clear();
+	map<glm::vec3, int, PositionLess> lookup;
+	for (unsigned int i = 0; i < positions.size(); i++) {
+		map<glm::vec3, int, PositionLess>::iterator it = lookup.find(positions[i]);
+		if (it == lookup.end()) {
+			it = lookup.insert(make_pair(positions[i], (int) m_weldedPositions.size())).first;
+			m_weldedPositions.push_back(positions[i]);
+			m_wedges.push_back(vector<int>());
+		}
+		m_weld[i] = it->second;
+		m_wedges[it->second].push_back(i);
+	}
+
+	int numWelded = (int) m_weldedPositions.size();
+	m_quadrics.assign(numWelded, Quadric());
+	m_version.assign(numWelded, 0);
+	m_removedVertex.assign(numWelded, false);
+	m_vertexTriangles.assign(numWelded, vector<int>());
+
+	// Keep the non-degenerate triangles and accumulate their area-weighted planes
+	m_triangles.clear();
+	map<pair<int, int>, int> edgeUse;
+	for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+		int w0 = m_weld[indices[i]], w1 = m_weld[indices[i + 1]], w2 = m_weld[indices[i + 2]];
+		if (w0 == w1 || w1 == w2 || w2 == w0)
+			continue;
+
+		glm::dvec3 p0(m_weldedPositions[w0]), p1(m_weldedPositions[w1]), p2(m_weldedPositions[w2]);
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(n);
+		if (length <= 0.0)
+			continue;
+		n /= length;
+
+		Quadric q;
+		q.AddPlane(n, -glm::dot(n, p0), length * 0.5);
+		m_quadrics[w0].Add(q);
+		m_quadrics[w1].Add(q);
+		m_quadrics[w2].Add(q);
+
+		int t = (int) m_triangles.size() / 3;
+		m_triangles.push_back(indices[i]);
+		m_triangles.push_back(indices[i + 1]);
+		m_triangles.push_back(indices[i + 2]);
+		m_vertexTriangles[w0].push_back(t);
+		m_vertexTriangles[w1].push_back(t);
+		m_vertexTriangles[w2].push_back(t);
+
+		int w[3] = {w0, w1, w2};
+		for (int e = 0; e < 3; e++) {
+			int a = w[e], b = w[(e + 1) % 3];
+			edgeUse[make_pair(min(a, b), max(a, b))]++;
+		}
+	}
+	m_numTriangles = (unsigned int) m_triangles.size() / 3;
+	m_removedTriangle.assign(m_numTriangles, false);
+
+	// Constrain open edges with a plane through the edge, perpendicular to the face it belongs to
+	for (unsigned int t = 0; t < m_numTriangles; t++) {
+		int w[3] = {WeldOf(t, 0), WeldOf(t, 1), WeldOf(t, 2)};
+		glm::dvec3 p[3] = {glm::dvec3(m_weldedPositions[w[0]]), glm::dvec3(m_weldedPositions[w[1]]), glm::dvec3(m_weldedPositions[w[2]])};
+		glm::dvec3 faceNormal = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+		for (int e = 0; e < 3; e++) {
+			int a = w[e], b = w[(e + 1) % 3];
+			if (edgeUse[make_pair(min(a, b), max(a, b))] != 1)
+				continue;
+			glm::dvec3 edge = p[(e + 1) % 3] - p[e];
+			glm::dvec3 n = glm::cross(edge, faceNormal);
+			double length = glm::length(n);
+			if (length <= 0.0)
+				continue;
+			n /= length;
+			Quadric q;
+			q.AddPlane(n, -glm::dot(n, p[e]), BOUNDARY_WEIGHT * glm::dot(edge, edge));
+			m_quadrics[a].Add(q);
+			m_quadrics[b].Add(q);
+		}
+	}
+
+	// Queue every edge once
+	m_heap = priority_queue<Collapse, vector<Collapse>, greater<Collapse> >();
+	for (map<pair<int, int>, int>::iterator it = edgeUse.begin(); it != edgeUse.end(); ++it)
+		PushEdge(it->first.first, it->first.second);
+}
+
+int CMeshSimplifier::WeldOf(int triangle, int corner) const
+{
+	return m_weld[m_triangles[triangle * 3 + corner]];
+}
+
+// Queue the cheaper direction of collapsing the edge between two welded vertices
+void CMeshSimplifier::PushEdge(int u, int v)
+{
+	Quadric q = m_quadrics[u];
+	q.Add(m_quadrics[v]);
+
+	double costUV = q.Error(glm::dvec3(m_weldedPositions[v]));
+	double costVU = q.Error(glm::dvec3(m_weldedPositions[u]));
+
+	Collapse c;
+	if (costUV <= costVU) {
+		c.from = u;
+		c.to = v;
+		c.cost = costUV;
+	} else {
+		c.from = v;
+		c.to = u;
+		c.cost = costVU;
+	}
+	c.fromVersion = m_version[c.from];
+	c.toVersion = m_version[c.to];
+	m_heap.push(c);
+}
+
+// Moving from onto to must not turn any surviving triangle around
+bool CMeshSimplifier::FlipsTriangle(int from, int to) const
+{
+	const vector<int> &triangles = m_vertexTriangles[from];
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+		int t = triangles[i];
+		if (m_removedTriangle[t])
+			continue;
+
+		glm::vec3 p[3];
+		bool containsTo = false;
+		for (int c = 0; c < 3; c++) {
+			int w = WeldOf(t, c);
+			if (w == to)
+				containsTo = true;
+			p[c] = m_weldedPositions[w];
+		}
+		if (containsTo)
+			continue;	// This triangle collapses away
+
+		glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+		for (int c = 0; c < 3; c++) {
+			if (WeldOf(t, c) == from)
+				p[c] = m_weldedPositions[to];
+		}
+		glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+		if (glm::dot(before, after) <= 0.0f)
+			return true;
+	}
+	return false;
+}
+
+void CMeshSimplifier::DoCollapse(int from, int to)
+{
+	m_quadrics[to].Add(m_quadrics[from]);
+	m_removedVertex[from] = true;
+	m_version[from]++;
+	m_version[to]++;
+
+	const vector<int> &toWedges = m_wedges[to];
+	const vector<int> &triangles = m_vertexTriangles[from];
+	for (unsigned int i = 0; i < triangles.size(); i++) {
+		int t = triangles[i];
+		if (m_removedTriangle[t])
+			continue;
+
+		bool containsTo = false;
+		for (int c = 0; c < 3; c++) {
+			if (WeldOf(t, c) == to)
+				containsTo = true;
+		}
+		if (containsTo) {
+			m_removedTriangle[t] = true;
+			m_numTriangles--;
+			continue;
+		}
+
+		// Repoint the corner at whichever vertex at the new position has the closest texture coordinates,
+		// so that texture seams survive the collapse
+		for (int c = 0; c < 3; c++) {
+			unsigned int &corner = m_triangles[t * 3 + c];
+			if (m_weld[corner] != from)
+				continue;
+			int best = toWedges[0];
+			float bestDistance = 1e30f;
+			for (unsigned int k = 0; k < toWedges.size(); k++) {
+				glm::vec2 d = m_texCoords[toWedges[k]] - m_texCoords[corner];
+				float distance = glm::dot(d, d);
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = toWedges[k];
+				}
+			}
+			corner = best;
+		}
+		m_vertexTriangles[to].push_back(t);
+	}
+	m_vertexTriangles[from].clear();
+
+	// Compact the surviving vertex's list and requeue its edges with the merged quadric
+	vector<int> &toTriangles = m_vertexTriangles[to];
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < toTriangles.size(); i++) {
+		if (!m_removedTriangle[toTriangles[i]])
+			toTriangles[kept++] = toTriangles[i];
+	}
+	toTriangles.resize(kept);
+
+	for (unsigned int i = 0; i < toTriangles.size(); i++) {
+		for (int c = 0; c < 3; c++) {
+			int w = WeldOf(toTriangles[i], c);
+			if (w != to)
+				PushEdge(to, w);
+		}
+	}
+}
+
+unsigned int CMeshSimplifier::Simplify(unsigned int targetTriangles, vector<unsigned int> &indices)
+{
+	while (m_numTriangles > targetTriangles && !m_heap.empty()) {
+		Collapse c = m_heap.top();
+		m_heap.pop();
+
+		if (m_removedVertex[c.from] || m_removedVertex[c.to])
+			continue;
+		if (c.fromVersion != m_version[c.from] || c.toVersion != m_version[c.to])
+			continue;
+		if (FlipsTriangle(c.from, c.to))
+			continue;
+
+		DoCollapse(c.from, c.to);
+	}
+
+	indices.clear();
+	indices.reserve(m_numTriangles * 3);
+	for (unsigned int t = 0; t < m_removedTriangle.size(); t++) {
+		if (m_removedTriangle[t])
+			continue;
+		indices.push_back(m_triangles[t * 3]);
+		indices.push_back(m_triangles[t * 3 + 1]);
+		indices.push_back(m_triangles[t * 3 + 2]);
+	}
+	return m_numTriangles;
+}
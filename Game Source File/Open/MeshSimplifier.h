@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Common.h"
+#include <queue>
+
+// Reduces the triangle count of an indexed mesh using the quadric error metric of Garland and Heckbert.
+// Edges are collapsed onto one of their endpoints (never a new position), so every simplified level indexes
+// the original vertex buffer and only needs a new index list.  Vertices that share a position but differ in
+// texture coordinates or normals are welded for the purpose of collapsing, so seams stay closed.
+// Simplify can be called repeatedly with decreasing targets to build a chain of levels of detail.
+class CMeshSimplifier
+{
+public:
+	CMeshSimplifier();
+	~CMeshSimplifier();
+
+	void SetMesh(const vector<glm::vec3> &positions, const vector<glm::vec2> &texCoords, const vector<unsigned int> &indices);
+
+	// Collapse edges until no more than targetTriangles remain, or no collapse is possible without folding a
+	// triangle over.  Writes the remaining triangles to indices and returns how many there are.
+	unsigned int Simplify(unsigned int targetTriangles, vector<unsigned int> &indices);
+
+private:
+	// Symmetric 4x4 matrix representing a sum of squared distances to planes
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+		Quadric();
+		void AddPlane(const glm::dvec3 &normal, double d, double weight);
+		void Add(const Quadric &q);
+		double Error(const glm::dvec3 &p) const;
+	};
+
+	struct Collapse {
+		double cost;
+		int from, to;				// Welded vertex ids; from is merged into to
+		int fromVersion, toVersion;	// Used to discard entries made stale by later collapses
+		bool operator>(const Collapse &c) const { return cost > c.cost; }
+	};
+
+	void PushEdge(int u, int v);
+	bool FlipsTriangle(int from, int to) const;
+	void DoCollapse(int from, int to);
+	int WeldOf(int triangle, int corner) const;
+
+	vector<glm::vec3> m_positions;
+	vector<glm::vec2> m_texCoords;
+	vector<int> m_weld;					// Original vertex -> welded vertex
+	vector< vector<int> > m_wedges;		// Welded vertex -> original vertices at that position
+	vector<glm::vec3> m_weldedPositions;
+	vector<Quadric> m_quadrics;
+	vector<int> m_version;
+	vector<bool> m_removedVertex;
+
+	vector<unsigned int> m_triangles;	// Three original vertex indices per triangle
+	vector<bool> m_removedTriangle;
+	vector< vector<int> > m_vertexTriangles;	// Welded vertex -> incident triangles (may include removed ones)
+	unsigned int m_numTriangles;
+
+	priority_queue<Collapse, vector<Collapse>, greater<Collapse> > m_heap;
+};
@@ -17,16 +17,107 @@
 */
 
 #include <assert.h>
+#include <float.h>
 #include "OpenAssetImportMesh.h"
+#include "MeshSimplifier.h"
+#include "ResourcePack.h"
+#include <IOStream.hpp>
+#include <IOSystem.hpp>
 
 #pragma comment(lib, "lib/assimp.lib")
 
+// Lets Assimp read a model, and the material files it names, through CResource, so that they come from the
+// resource pack when there is one
+class CResourceStream : public Assimp::IOStream
+{
+public:
+	CResourceStream() : m_position(0) {}
+
+	bool Open(const char* path)
+	{
+		return m_resource.Open(path);
+	}
+
+	size_t Read(void* buffer, size_t size, size_t count)
+	{
+		if (size == 0)
+			return 0;
+		count = min(count, (m_resource.GetSize() - m_position) / size);
+		memcpy(buffer, m_resource.GetData() + m_position, size * count);
+		m_position += size * count;
+		return count;
+	}
+
+	size_t Write(const void* buffer, size_t size, size_t count)
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t offset, aiOrigin origin)
+	{
+		size_t base = origin == aiOrigin_CUR ? m_position : (origin == aiOrigin_END ? m_resource.GetSize() : 0);
+		if (base + offset > m_resource.GetSize())
+			return aiReturn_FAILURE;
+		m_position = base + offset;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const
+	{
+		return m_position;
+	}
+
+	size_t FileSize() const
+	{
+		return m_resource.GetSize();
+	}
+
+	void Flush()
+	{}
+
+private:
+	CResource m_resource;
+	size_t m_position;
+};
+
+class CResourceIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* path) const
+	{
+		return CResource::Exists(path);
+	}
+
+	char getOsSeparator() const
+	{
+		return '\\';
+	}
+
+	Assimp::IOStream* Open(const char* path, const char* mode)
+	{
+		if (strchr(mode, 'w') != NULL)
+			return NULL;
+		CResourceStream* stream = new CResourceStream;
+		if (!stream->Open(path)) {
+			delete stream;
+			return NULL;
+		}
+		return stream;
+	}
+
+	void Close(Assimp::IOStream* stream)
+	{
+		delete stream;
+	}
+};
+
 COpenAssetImportMesh::MeshEntry::MeshEntry()
 {
     vbo = INVALID_OGL_VALUE;
     ibo = INVALID_OGL_VALUE;
     NumIndices  = 0;
     MaterialIndex = INVALID_MATERIAL;
+    NumLods = 0;
 };
 
 COpenAssetImportMesh::MeshEntry::~MeshEntry()
@@ -54,6 +145,9 @@ void COpenAssetImportMesh::MeshEntry::Init(const std::vector<Vertex>& Vertices,
 
 COpenAssetImportMesh::COpenAssetImportMesh()
 {
+	m_vao = 0;
+	m_boundsMin = glm::vec3(0.0f);
+	m_boundsMax = glm::vec3(0.0f);
 }
 
 
@@ -68,7 +162,9 @@ void COpenAssetImportMesh::Clear()
     for (unsigned int i = 0 ; i < m_Textures.size() ; i++) {
         SAFE_DELETE(m_Textures[i]);
     }
+	m_Textures.clear();
 	glDeleteVertexArrays(1, &m_vao);
+	m_vao = 0;
 }
 
 
@@ -76,9 +172,15 @@ bool COpenAssetImportMesh::Load(const std::string& Filename)
 {
     // Release the previously loaded mesh (if it exists)
     Clear();
-    
+
+    return Prepare(Filename) && Upload();
+}
+
+bool COpenAssetImportMesh::Prepare(const std::string& Filename)
+{
     bool Ret = false;
     Assimp::Importer Importer;
+    Importer.SetIOHandler(new CResourceIOSystem);	// The importer deletes it
 
     const aiScene* pScene = Importer.ReadFile(Filename.c_str(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs);
     
@@ -95,22 +197,24 @@ bool COpenAssetImportMesh::Load(const std::string& Filename)
 bool COpenAssetImportMesh::InitFromScene(const aiScene* pScene, const std::string& Filename)
 {  
     m_Entries.resize(pScene->mNumMeshes);
-    m_Textures.resize(pScene->mNumMaterials);
+    m_TexturePaths.assign(pScene->mNumMaterials, std::string());
+    m_DiffuseColours.assign(pScene->mNumMaterials, glm::vec3(0.0f));
 
-	glGenVertexArrays(1, &m_vao); 
-	glBindVertexArray(m_vao);
+	// Start with empty bounds; InitMesh grows them to cover every vertex
+	m_boundsMin = glm::vec3(FLT_MAX);
+	m_boundsMax = glm::vec3(-FLT_MAX);
 
 
     // Initialize the meshes in the scene one by one
     for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
         const aiMesh* paiMesh = pScene->mMeshes[i];
-        InitMesh(i, paiMesh);
+        InitMesh(i, paiMesh, Filename);
     }
 
     return InitMaterials(pScene, Filename);
 }
 
-void COpenAssetImportMesh::InitMesh(unsigned int Index, const aiMesh* paiMesh)
+void COpenAssetImportMesh::InitMesh(unsigned int Index, const aiMesh* paiMesh, const std::string& Filename)
 {
     m_Entries[Index].MaterialIndex = paiMesh->mMaterialIndex;
     
@@ -129,6 +233,8 @@ void COpenAssetImportMesh::InitMesh(unsigned int Index, const aiMesh* paiMesh)
                  glm::vec3(pNormal->x, pNormal->y, pNormal->z));
 
         Vertices.push_back(v);
+		m_boundsMin = glm::min(m_boundsMin, v.m_pos);
+		m_boundsMax = glm::max(m_boundsMax, v.m_pos);
     }
 
     for (unsigned int i = 0 ; i < paiMesh->mNumFaces ; i++) {
@@ -139,7 +245,92 @@ void COpenAssetImportMesh::InitMesh(unsigned int Index, const aiMesh* paiMesh)
         Indices.push_back(Face.mIndices[2]);
     }
 
-    m_Entries[Index].Init(Vertices, Indices);
+    // Build the simplified levels of detail, each aiming for half the triangles of the one before.  Small meshes
+    // gain nothing from this, and a level is only kept if the simplifier made real progress.
+    MeshEntry& Entry = m_Entries[Index];
+    Entry.NumLods = 1;
+    Entry.LodFirstIndex[0] = 0;
+    Entry.LodNumIndices[0] = Indices.size();
+
+    unsigned int NumTriangles = Indices.size() / 3;
+    if (NumTriangles >= 64) {
+        std::vector<glm::vec3> Positions(Vertices.size());
+        std::vector<glm::vec2> TexCoords(Vertices.size());
+        for (unsigned int i = 0 ; i < Vertices.size() ; i++) {
+            Positions[i] = Vertices[i].m_pos;
+            TexCoords[i] = Vertices[i].m_tex;
+        }
+
+        CMeshSimplifier Simplifier;
+        Simplifier.SetMesh(Positions, TexCoords, Indices);
+
+        std::vector<unsigned int> LodIndices;
+        unsigned int PrevTriangles = NumTriangles;
+        for (int Lod = 1 ; Lod < MAX_LOD_LEVELS ; Lod++) {
+            unsigned int Triangles = Simplifier.Simplify(PrevTriangles / 2, LodIndices);
+            if (Triangles == 0 || Triangles > PrevTriangles * 3 / 4)
+                break;
+            Entry.LodFirstIndex[Lod] = Indices.size();
+            Entry.LodNumIndices[Lod] = LodIndices.size();
+            Indices.insert(Indices.end(), LodIndices.begin(), LodIndices.end());
+            Entry.NumLods++;
+            PrevTriangles = Triangles;
+        }
+    }
+
+    for (int Lod = 0 ; Lod < Entry.NumLods ; Lod++)
+        printf("Mesh '%s' part %u LOD %d: %u triangles\n", Filename.c_str(), Index, Lod, Entry.LodNumIndices[Lod] / 3);
+
+    Entry.Vertices.swap(Vertices);
+    Entry.Indices.swap(Indices);
+}
+
+bool COpenAssetImportMesh::Upload()
+{
+	glGenVertexArrays(1, &m_vao); 
+	glBindVertexArray(m_vao);
+
+    for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
+        MeshEntry& Entry = m_Entries[i];
+        Entry.Init(Entry.Vertices, Entry.Indices);
+        std::vector<Vertex>().swap(Entry.Vertices);
+        std::vector<unsigned int>().swap(Entry.Indices);
+    }
+
+    bool Ret = true;
+
+    m_Textures.resize(m_TexturePaths.size());
+    for (unsigned int i = 0 ; i < m_TexturePaths.size() ; i++) {
+        m_Textures[i] = NULL;
+
+        if (!m_TexturePaths[i].empty()) {
+            const std::string& FullPath = m_TexturePaths[i];
+            m_Textures[i] = new CTexture();
+            if (!m_Textures[i]->Load(FullPath, true)) {
+                MessageBox(NULL, FullPath.c_str(), "Error loading mesh texture", MB_ICONHAND);
+                delete m_Textures[i];
+                m_Textures[i] = NULL;
+                Ret = false;
+            }
+            else {
+                printf("Loaded texture '%s'\n", FullPath.c_str());
+            }
+        }
+
+        // Load a single colour texture matching the diffuse colour if no texture added
+        if (!m_Textures[i]) {
+			const glm::vec3& color = m_DiffuseColours[i];
+
+			m_Textures[i] = new CTexture();
+			BYTE data[3];
+			data[0] = (BYTE) (color[2]*255);
+			data[1] = (BYTE) (color[1]*255);
+			data[2] = (BYTE) (color[0]*255);
+			m_Textures[i]->CreateFromData(data, 1, 1, 24, GL_BGR, false);
+        }
+    }
+
+    return Ret;
 }
 
 bool COpenAssetImportMesh::InitMaterials(const aiScene* pScene, const std::string& Filename)
@@ -158,52 +349,29 @@ bool COpenAssetImportMesh::InitMaterials(const aiScene* pScene, const std::strin
         Dir = Filename.substr(0, SlashIndex);
     }
 
-    bool Ret = true;
-
-    // Initialize the materials
+    // Note each material's texture, decoding it now so that Upload only has to hand it to OpenGL, and its diffuse
+    // colour for materials without one
     for (unsigned int i = 0 ; i < pScene->mNumMaterials ; i++) {
         const aiMaterial* pMaterial = pScene->mMaterials[i];
 
-        m_Textures[i] = NULL;
-
         if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
             aiString Path;
 
 			if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) {
-                std::string FullPath = Dir + "\\" + Path.data;
-                m_Textures[i] = new CTexture();
-                if (!m_Textures[i]->Load(FullPath, true)) {
- 					MessageBox(NULL, FullPath.c_str(), "Error loading mesh texture", MB_ICONHAND);
-                    delete m_Textures[i];
-                    m_Textures[i] = NULL;
-                    Ret = false;
-                }
-                else {
-                    printf("Loaded texture '%s'\n", FullPath.c_str());
-                }
+                m_TexturePaths[i] = Dir + "\\" + Path.data;
+                CTexture::Prefetch(m_TexturePaths[i]);
             }
         }
 
-        // Load a single colour texture matching the diffuse colour if no texture added
-        if (!m_Textures[i]) {
-		
-			aiColor3D color (0.f,0.f,0.f);
-			pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE,color);
-
-			m_Textures[i] = new CTexture();
-			BYTE data[3];
-			data[0] = (BYTE) (color[2]*255);
-			data[1] = (BYTE) (color[1]*255);
-			data[2] = (BYTE) (color[0]*255);
-			m_Textures[i]->CreateFromData(data, 1, 1, 24, GL_BGR, false);
-
-        }
+		aiColor3D color (0.f,0.f,0.f);
+		pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE,color);
+		m_DiffuseColours[i] = glm::vec3(color[0], color[1], color[2]);
     }
 
-    return Ret;
+    return true;
 }
 
-void COpenAssetImportMesh::Render()
+void COpenAssetImportMesh::Render(int lod)
 {
 	glBindVertexArray(m_vao);
 
@@ -227,7 +395,10 @@ void COpenAssetImportMesh::Render()
         }
 
 
-        glDrawElements(GL_TRIANGLES, m_Entries[i].NumIndices, GL_UNSIGNED_INT, 0);
+        // Parts with fewer levels than requested fall back to their coarsest one
+        int Lod = min(lod, m_Entries[i].NumLods - 1);
+        glDrawElements(GL_TRIANGLES, m_Entries[i].LodNumIndices[Lod], GL_UNSIGNED_INT,
+                       (const GLvoid*)(m_Entries[i].LodFirstIndex[Lod] * sizeof(unsigned int)));
 		glDisableVertexAttribArray(0);
 		glDisableVertexAttribArray(1);
 		glDisableVertexAttribArray(2);
@@ -236,3 +407,68 @@ void COpenAssetImportMesh::Render()
 
 
 }
+
+void COpenAssetImportMesh::RenderInstanced(int numInstances, GLuint instanceBuffer, UINT offset, int lod)
+{
+	if (numInstances <= 0)
+		return;
+
+	glBindVertexArray(m_vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 32, (const GLvoid*)(size_t)offset);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 32, (const GLvoid*)(size_t)(offset + 16));
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+
+	for (unsigned int i = 0 ; i < m_Entries.size() ; i++) {
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, m_Entries[i].vbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)12);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)20);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Entries[i].ibo);
+
+		const unsigned int MaterialIndex = m_Entries[i].MaterialIndex;
+		if (MaterialIndex < m_Textures.size() && m_Textures[MaterialIndex]) {
+			m_Textures[MaterialIndex]->Bind(0);
+		}
+
+		int Lod = min(lod, m_Entries[i].NumLods - 1);
+		glDrawElementsInstanced(GL_TRIANGLES, m_Entries[i].LodNumIndices[Lod], GL_UNSIGNED_INT,
+			(const GLvoid*)(m_Entries[i].LodFirstIndex[Lod] * sizeof(unsigned int)), numInstances);
+		glDisableVertexAttribArray(0);
+		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(2);
+	}
+
+	// Leave the instance attributes as ordinary per-vertex ones for other users of the vertex array
+	glVertexAttribDivisor(3, 0);
+	glVertexAttribDivisor(4, 0);
+	glDisableVertexAttribArray(3);
+	glDisableVertexAttribArray(4);
+}
+
+int COpenAssetImportMesh::GetNumLods() const
+{
+    int NumLods = 1;
+    for (unsigned int i = 0 ; i < m_Entries.size() ; i++)
+        NumLods = max(NumLods, m_Entries[i].NumLods);
+    return NumLods;
+}
+
+glm::vec3 COpenAssetImportMesh::GetBoundingCentre() const
+{
+	return (m_boundsMin + m_boundsMax) * 0.5f;
+}
+
+// Half the diagonal of the bounding box -- a little loose, but cheap and always encloses the mesh
+float COpenAssetImportMesh::GetBoundingRadius() const
+{
+	return glm::length(m_boundsMax - m_boundsMin) * 0.5f;
+}
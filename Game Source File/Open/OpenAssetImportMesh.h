@@ -29,6 +29,7 @@
 
 #include "Common.h"
 #include "Texture.h"
+#include "LevelOfDetail.h"
 
 #define INVALID_OGL_VALUE 0xFFFFFFFF
 #define SAFE_DELETE(p) if (p) { delete p; p = NULL; }
@@ -56,12 +57,27 @@ class COpenAssetImportMesh
 public:
     COpenAssetImportMesh();
     ~COpenAssetImportMesh();
-    bool Load(const std::string& Filename);
-    void Render();
+    bool Load(const std::string& Filename);		// Prepare then Upload
+
+	// Loading in two steps, so that the slow part can run on any thread: Prepare reads the file, builds the vertex
+	// and index data and decodes the textures without touching OpenGL, then Upload, on the thread that owns the
+	// context, creates the buffers and textures from them
+	bool Prepare(const std::string& Filename);
+	bool Upload();
+
+    void Render(int lod = 0);	// Level 0 is full resolution; higher levels are progressively simplified
+	// Draw numInstances copies at one level of detail.  Each instance is 32 bytes of instanceBuffer from offset
+	// on: a vec4 on attribute 3 and a vec4 on attribute 4, whose meaning is up to the vertex shader.
+	void RenderInstanced(int numInstances, GLuint instanceBuffer, UINT offset, int lod = 0);
+	int GetNumLods() const;
+
+	// Bounding sphere of the mesh in model coordinates, computed from its axis-aligned bounds at load time
+	glm::vec3 GetBoundingCentre() const;
+	float GetBoundingRadius() const;
 
 private:
     bool InitFromScene(const aiScene* pScene, const std::string& Filename);
-    void InitMesh(unsigned int Index, const aiMesh* paiMesh);
+    void InitMesh(unsigned int Index, const aiMesh* paiMesh, const std::string& Filename);
     bool InitMaterials(const aiScene* pScene, const std::string& Filename);
     void Clear();
 	
@@ -79,11 +95,24 @@ private:
         GLuint ibo;
         unsigned int NumIndices;
         unsigned int MaterialIndex;
+
+        // The index buffer holds every level of detail back to back
+        int NumLods;
+        unsigned int LodFirstIndex[MAX_LOD_LEVELS];
+        unsigned int LodNumIndices[MAX_LOD_LEVELS];
+
+        // Kept from Prepare until Upload
+        std::vector<Vertex> Vertices;
+        std::vector<unsigned int> Indices;
     };
 
     std::vector<MeshEntry> m_Entries;
     std::vector<CTexture*> m_Textures;
+    std::vector<std::string> m_TexturePaths;		// Per material, from Prepare; empty if it has a diffuse colour only
+    std::vector<glm::vec3> m_DiffuseColours;
 	GLuint m_vao;
+	glm::vec3 m_boundsMin;
+	glm::vec3 m_boundsMax;
 };
 
 
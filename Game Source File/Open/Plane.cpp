@@ -1,17 +1,19 @@
 #include "Common.h"
 #include "Plane.h"
-#define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 
 CPlane::CPlane()
-{}
+{
+	m_pPrimitives = NULL;
+	m_primitive = -1;
+}
 
 CPlane::~CPlane()
 {}
 
 
 // Create the plane, including its geometry, texture mapping, normal, and colour
-void CPlane::Create(string directory, string filename, float width, float height, float textureRepeat)
+void CPlane::Create(CPrimitiveArena *primitives, string directory, string filename, float width, float height, float textureRepeat)
 {
 	
 	m_width = width;
@@ -28,18 +30,19 @@ void CPlane::Create(string directory, string filename, float width, float height
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
 	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
-	
-
-	// Use VAO to store state associated with vertices
-	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
 
-	// Create a VBO
-	m_vbo.Create();
-	m_vbo.Bind();
+	vector<VertexPTN> vertices;
+	vector<unsigned int> indices;
+	GetTriangles(width, height, textureRepeat, vertices, indices);
+	m_pPrimitives = primitives;
+	m_primitive = primitives->Add(vertices, indices);
+}
 
-	float halfWidth = m_width / 2.0f;
-	float halfHeight = m_height / 2.0f;
+// The plane's strip of four corners as two triangles
+void CPlane::GetTriangles(float width, float height, float textureRepeat, vector<VertexPTN> &vertices, vector<unsigned int> &indices)
+{
+	float halfWidth = width / 2.0f;
+	float halfHeight = height / 2.0f;
 
 	// Vertex positions
 	glm::vec3 planeVertices[4] = 
@@ -62,46 +65,30 @@ void CPlane::Create(string directory, string filename, float width, float height
 	// Plane normal
 	glm::vec3 planeNormal = glm::vec3(0.0f, 1.0f, 0.0f);
 
-	// Put the vertex attributes in the VBO
-	for (unsigned int i = 0; i < 4; i++) {
-		m_vbo.AddData(&planeVertices[i], sizeof(glm::vec3));		
-		m_vbo.AddData(&planeTexCoords[i], sizeof(glm::vec2));
-		m_vbo.AddData(&planeNormal, sizeof(glm::vec3));
-	}
-
-
-	// Upload the VBO to the GPU
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
-
-	// Set the vertex attribute locations
-	GLsizei istride = 2*sizeof(glm::vec3)+sizeof(glm::vec2);
-
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, istride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, istride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, istride, (void*)(sizeof(glm::vec3)+sizeof(glm::vec2)));
-	
+	vertices.clear();
+	indices.clear();
+	for (unsigned int i = 0; i < 4; i++)
+		vertices.push_back(VertexPTN(planeVertices[i], planeTexCoords[i], planeNormal));
+	unsigned int strip[6] = { 0, 1, 2, 2, 1, 3 };
+	indices.assign(strip, strip + 6);
 }
 
-// Render the plane as a triangle strip
+// Render the plane as two triangles
 void CPlane::Render()
 {
-	glBindVertexArray(m_vao);
+	m_pPrimitives->Bind();
 	m_texture.Bind();
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	m_pPrimitives->Draw(m_primitive);
+}
 
-	
+void CPlane::RenderDepth()
+{
+	m_pPrimitives->BindPositions();
+	m_pPrimitives->Draw(m_primitive);
 }
 
-// Release resources
+// Release resources; the geometry belongs to the arena
 void CPlane::Release()
 {
 	m_texture.Release();
-	glDeleteVertexArrays(1, &m_vao);
-	m_vbo.Release();
 }
\ No newline at end of file
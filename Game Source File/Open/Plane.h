@@ -1,20 +1,23 @@
 #pragma once
 
 #include "Texture.h"
-#include "VertexBufferObject.h"
+#include "PrimitiveArena.h"
 
-// Class for generating a xz plane of a given size
+// Class for generating a xz plane of a given size, drawn from the shared primitive arena
 class CPlane
 {
 public:
 	CPlane();
 	~CPlane();
-	void Create(string sDirectory, string sFilename, float fWidth, float fHeight, float fTextureRepeat);
+	// Adds the plane to primitives, which must then be created
+	void Create(CPrimitiveArena *primitives, string sDirectory, string sFilename, float fWidth, float fHeight, float fTextureRepeat);
 	void Render();
+	void RenderDepth();		// Just the positions, for a depth-only pass
 	void Release();
+	static void GetTriangles(float width, float height, float textureRepeat, vector<VertexPTN> &vertices, vector<unsigned int> &indices);
 private:
-	UINT m_vao;
-	CVertexBufferObject m_vbo;
+	CPrimitiveArena *m_pPrimitives;
+	int m_primitive;
 	CTexture m_texture;
 	string m_directory;
 	string m_filename;
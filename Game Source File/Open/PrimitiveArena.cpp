@@ -0,0 +1,289 @@
+#include "PrimitiveArena.h"
+
+#include <stddef.h>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+// Tuning for the vertex cache optimisation, as Forsyth gives them.  The cache is modelled as least recently used,
+// which suits the FIFO caches of real hardware well enough when it is a little larger than they are.
+static const int CACHE_SIZE = 32;
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;	// For the three vertices of the triangle just added
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+// How much it is worth drawing a triangle that uses a vertex: more the more recently the vertex was used, and more
+// the fewer triangles it has left, so that no vertex is left with a lone triangle to be fetched again for later
+static float VertexScore(int cachePosition, UINT remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 3)
+		score = pow(1.0f - (cachePosition - 3) / (float) (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+	else if (cachePosition >= 0)
+		score = LAST_TRIANGLE_SCORE;
+	return score + VALENCE_BOOST_SCALE * pow((float) remainingTriangles, -VALENCE_BOOST_POWER);
+}
+
+// Reorder a triangle list, in place, so that each triangle reuses as many as possible of the vertices the ones
+// before it used.  Triangles are added greedily, best score first; only the triangles of vertices in the cache
+// change score when one is added, so only they are searched, unless none is left.
+static void OptimizeVertexCache(unsigned int *indices, UINT numIndices, UINT numVertices)
+{
+	UINT numTriangles = numIndices / 3;
+	if (numTriangles < 2)
+		return;
+
+	// The triangles of each vertex, as one list.  The live ones are kept at the front of each vertex's range.
+	vector<UINT> remaining(numVertices, 0);
+	for (UINT i = 0; i < numTriangles * 3; i++)
+		remaining[indices[i]]++;
+	vector<UINT> firstTriangle(numVertices + 1, 0);
+	for (UINT v = 0; v < numVertices; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+	vector<UINT> vertexTriangles(numTriangles * 3);
+	vector<UINT> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (UINT i = 0; i < numTriangles * 3; i++)
+		vertexTriangles[filled[indices[i]]++] = i / 3;
+
+	vector<int> cachePosition(numVertices, -1);
+	vector<float> vertexScore(numVertices);
+	for (UINT v = 0; v < numVertices; v++)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+	vector<float> triangleScore(numTriangles);
+	vector<bool> added(numTriangles, false);
+	for (UINT t = 0; t < numTriangles; t++)
+		triangleScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+
+	vector<unsigned int> ordered;
+	ordered.reserve(numTriangles * 3);
+	UINT cache[CACHE_SIZE + 3];
+	int cacheSize = 0;
+	int best = -1;
+	while (ordered.size() < numTriangles * 3) {
+		if (best < 0) {
+			float bestScore = -1.0f;
+			for (UINT t = 0; t < numTriangles; t++) {
+				if (!added[t] && triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = (int) t;
+				}
+			}
+		}
+
+		// Add it, and take it off its vertices' lists of live triangles
+		added[best] = true;
+		const unsigned int *corners = indices + 3 * best;
+		for (int k = 0; k < 3; k++) {
+			UINT v = corners[k];
+			ordered.push_back(v);
+			UINT *live = &vertexTriangles[firstTriangle[v]];
+			for (UINT j = 0; j < remaining[v]; j++) {
+				if (live[j] == (UINT) best) {
+					live[j] = live[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// Move its vertices to the front of the cache; what falls off the end leaves the cache
+		UINT newCache[CACHE_SIZE + 3];
+		int newSize = 0;
+		for (int k = 0; k < 3; k++)
+			newCache[newSize++] = corners[k];
+		for (int c = 0; c < cacheSize; c++) {
+			if (cache[c] != corners[0] && cache[c] != corners[1] && cache[c] != corners[2])
+				newCache[newSize++] = cache[c];
+		}
+		for (int c = 0; c < newSize; c++) {
+			UINT v = newCache[c];
+			cachePosition[v] = c < CACHE_SIZE ? c : -1;
+			vertexScore[v] = VertexScore(cachePosition[v], remaining[v]);
+		}
+
+		// Rescore the triangles of everything that moved, and go on with the best of those still in the cache
+		best = -1;
+		float bestScore = -1.0f;
+		for (int c = 0; c < newSize; c++) {
+			UINT v = newCache[c];
+			const UINT *live = &vertexTriangles[firstTriangle[v]];
+			for (UINT j = 0; j < remaining[v]; j++) {
+				UINT t = live[j];
+				triangleScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+				if (c < CACHE_SIZE && triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = (int) t;
+				}
+			}
+		}
+		cacheSize = min(newSize, CACHE_SIZE);
+		memcpy(cache, newCache, cacheSize * sizeof(UINT));
+	}
+
+	memcpy(indices, &ordered[0], numTriangles * 3 * sizeof(unsigned int));
+}
+
+CPrimitiveArena::CPrimitiveArena()
+{
+	m_vao = 0;
+	m_vertexBuffer = 0;
+	m_indexBuffer = 0;
+	m_positionVao = 0;
+	m_positionBuffer = 0;
+	m_created = false;
+}
+
+CPrimitiveArena::~CPrimitiveArena()
+{
+	Release();
+}
+
+int CPrimitiveArena::Add(const vector<VertexPTN> &vertices, const vector<unsigned int> &indices)
+{
+	unsigned int first = 0, count = (unsigned int) indices.size();
+	return Add(vertices, indices, &first, &count, 1);
+}
+
+int CPrimitiveArena::Add(const vector<VertexPTN> &vertices, const vector<unsigned int> &indices,
+	const unsigned int *rangeFirstIndex, const unsigned int *rangeNumIndices, int numRanges)
+{
+	if (m_created) {
+		printf("Primitives: cannot add a primitive once the arena is created\n");
+		return -1;
+	}
+
+	vector<unsigned int> ordered(indices);
+	for (int r = 0; r < numRanges; r++)
+		OptimizeVertexCache(&ordered[rangeFirstIndex[r]], rangeNumIndices[r], (UINT) vertices.size());
+
+	// Number the vertices in the order the triangles first use them, leaving out any that none uses
+	vector<int> remap(vertices.size(), -1);
+	UINT numUsed = 0;
+	for (int r = 0; r < numRanges; r++) {
+		for (unsigned int i = 0; i < rangeNumIndices[r]; i++) {
+			unsigned int v = ordered[rangeFirstIndex[r] + i];
+			if (remap[v] < 0)
+				remap[v] = (int) numUsed++;
+		}
+	}
+	if (numUsed > MAX_PRIMITIVE_VERTICES) {
+		printf("Primitives: %u vertices are too many for 16-bit indices\n", numUsed);
+		return -1;
+	}
+
+	int baseVertex = (int) m_vertices.size();
+	m_vertices.resize(baseVertex + numUsed);
+	for (unsigned int v = 0; v < vertices.size(); v++) {
+		if (remap[v] >= 0)
+			m_vertices[baseVertex + remap[v]] = vertices[v];
+	}
+
+	int firstPrimitive = (int) m_primitives.size();
+	for (int r = 0; r < numRanges; r++) {
+		Primitive primitive;
+		primitive.firstIndex = (UINT) m_indices.size();
+		primitive.numIndices = rangeNumIndices[r];
+		primitive.baseVertex = baseVertex;
+		for (unsigned int i = 0; i < rangeNumIndices[r]; i++)
+			m_indices.push_back((GLushort) remap[ordered[rangeFirstIndex[r] + i]]);
+		m_primitives.push_back(primitive);
+	}
+	return firstPrimitive;
+}
+
+bool CPrimitiveArena::Create()
+{
+	if (m_created || m_primitives.empty())
+		return false;
+
+	glGenBuffers(1, &m_vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(VertexPTN), &m_vertices[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &m_indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLushort), &m_indices[0], GL_STATIC_DRAW);
+
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	SetVertexAttributes();
+
+	vector<glm::vec3> positions(m_vertices.size());
+	for (unsigned int i = 0; i < m_vertices.size(); i++)
+		positions[i] = m_vertices[i].position;
+	glGenVertexArrays(1, &m_positionVao);
+	glBindVertexArray(m_positionVao);
+	glGenBuffers(1, &m_positionBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_positionBuffer);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+	glBindVertexArray(0);
+
+	printf("Primitives: %d in %d vertices and %d indices\n", (int) m_primitives.size(), (int) m_vertices.size(), (int) m_indices.size());
+
+	// They are on the GPU now
+	vector<VertexPTN>().swap(m_vertices);
+	vector<GLushort>().swap(m_indices);
+	m_created = true;
+	return true;
+}
+
+void CPrimitiveArena::Release()
+{
+	if (m_vao != 0) {
+		GLuint vaos[2] = { m_vao, m_positionVao };
+		glDeleteVertexArrays(2, vaos);
+	}
+	if (m_vertexBuffer != 0) {
+		GLuint buffers[3] = { m_vertexBuffer, m_indexBuffer, m_positionBuffer };
+		glDeleteBuffers(3, buffers);
+	}
+	m_vao = m_positionVao = 0;
+	m_vertexBuffer = m_indexBuffer = m_positionBuffer = 0;
+	m_created = false;
+	m_primitives.clear();
+	m_vertices.clear();
+	m_indices.clear();
+}
+
+void CPrimitiveArena::SetVertexAttributes() const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (void*) offsetof(VertexPTN, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (void*) offsetof(VertexPTN, texCoord));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VertexPTN), (void*) offsetof(VertexPTN, normal));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+}
+
+void CPrimitiveArena::Bind()
+{
+	glBindVertexArray(m_vao);
+}
+
+void CPrimitiveArena::BindPositions()
+{
+	glBindVertexArray(m_positionVao);
+}
+
+void CPrimitiveArena::Draw(int primitive)
+{
+	const Primitive &p = m_primitives[primitive];
+	glDrawElementsBaseVertex(GL_TRIANGLES, p.numIndices, GL_UNSIGNED_SHORT, BUFFER_OFFSET(p.firstIndex * sizeof(GLushort)), p.baseVertex);
+}
+
+const CPrimitiveArena::Primitive &CPrimitiveArena::GetPrimitive(int primitive) const
+{
+	return m_primitives[primitive];
+}
+
+int CPrimitiveArena::GetNumPrimitives() const
+{
+	return (int) m_primitives.size();
+}
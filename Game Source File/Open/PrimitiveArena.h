@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.h"
+#include "BufferBuilder.h"
+
+// One vertex buffer and one index buffer shared by the procedural primitives (sphere, cube, pyramid, plane and
+// skybox), so that they all draw from the same vertex array and each is a single indexed draw.  Primitives are
+// added as indexed triangle lists in system memory, then Create uploads them all at once.
+//
+// The positions are also kept on their own, in a second vertex buffer with a vertex array of its own that shares the
+// index buffer, so that a depth-only pass fetches 12 bytes a vertex rather than the full 32.
+//
+// Add reorders each primitive's triangles for the post-transform vertex cache, using Tom Forsyth's linear-speed
+// vertex cache optimisation, then its vertices into the order the triangles first use them, so that vertex fetches
+// walk forwards through memory.  Indices are 16-bit and relative to the primitive's first vertex, which the draw
+// passes as its base vertex, so each primitive may have up to 65536 vertices however large the arena grows.
+//
+//		int cube = primitives.Add(vertices, indices);
+//		...
+//		primitives.Create();
+//		primitives.Bind();
+//		primitives.Draw(cube);
+class CPrimitiveArena
+{
+public:
+	// A range of the index buffer, drawn with one call
+	struct Primitive {
+		UINT firstIndex;
+		UINT numIndices;
+		int baseVertex;
+	};
+
+	CPrimitiveArena();
+	~CPrimitiveArena();
+
+	// Add an indexed triangle list as one primitive.  Returns its number, or -1 if it cannot be added.
+	int Add(const vector<VertexPTN> &vertices, const vector<unsigned int> &indices);
+
+	// Add several ranges of the same indices, such as levels of detail, as consecutive primitives that share the
+	// vertices.  Returns the number of the first.
+	int Add(const vector<VertexPTN> &vertices, const vector<unsigned int> &indices,
+		const unsigned int *rangeFirstIndex, const unsigned int *rangeNumIndices, int numRanges);
+
+	bool Create();		// Uploads everything added; nothing may be added after
+	void Release();
+
+	// Binds the buffers and sets vertex attributes 0 to 2 (position, texture coordinate and normal) in the vertex
+	// array currently bound, for a caller that draws the primitives from a vertex array of its own
+	void SetVertexAttributes() const;
+
+	void Bind();					// Binds the shared vertex array; every primitive can then be drawn in turn
+	void BindPositions();			// Binds the position-only vertex array instead, for attribute 0 alone
+	void Draw(int primitive);
+	const Primitive &GetPrimitive(int primitive) const;
+	int GetNumPrimitives() const;
+
+private:
+	static const UINT MAX_PRIMITIVE_VERTICES = 65536;
+
+	GLuint m_vao;
+	GLuint m_vertexBuffer;
+	GLuint m_indexBuffer;
+	GLuint m_positionVao;
+	GLuint m_positionBuffer;
+	bool m_created;
+
+	vector<Primitive> m_primitives;
+
+	// Gathered in system memory until Create
+	vector<VertexPTN> m_vertices;
+	vector<GLushort> m_indices;
+};
@@ -1,19 +1,25 @@
 #pragma once
 #include "Common.h"
 #include "Texture.h"
-#include "VertexBufferObject.h"
+#include "PrimitiveArena.h"
 
+// Class for generating a square based pyramid, drawn from the shared primitive arena
 class PPyramid
 {
 public:
 	PPyramid();
 	~PPyramid();
-	void Create(string name);
+	void Create(CPrimitiveArena *primitives, string name);	// Adds the pyramid to primitives, which must then be created
 	void Render();
+	void Bind();		// Render split in two, so that several pyramids in a row need only bind once.  Binds the texture too, if it has one.
+	void Draw();
 	void Release();
+	float GetBoundingRadius() const { return 2.0f; }	// The apex, at height 2, is the furthest point from the origin
+	int GetPrimitive() const { return m_primitive; }	// In the arena given to Create
+	static void GetTriangles(vector<VertexPTN> &vertices, vector<unsigned int> &indices);	// As one triangle list
 private:
-	GLuint m_vao;
-	CVertexBufferObject m_vbo;
+	CPrimitiveArena *m_pPrimitives;
+	int m_primitive;
 	CTexture m_texture;
 
 };
\ No newline at end of file
@@ -0,0 +1,319 @@
+#include "Racers.h"
+#include "CatmullRom.h"
+#include "OpenAssetImportMesh.h"
+#include "LevelOfDetail.h"
+#include "JobSystem.h"
+#include <algorithm>
+
+// Ships travel between these speeds, in units per millisecond; the player flies at 0.1
+static const float MIN_SPEED = 0.08f;
+static const float MAX_SPEED = 0.12f;
+
+// How fast ships move across the track (units per millisecond), and how long they hold a lane before picking another
+static const float STEER_SPEED = 0.02f;
+static const float MIN_LANE_TIME = 2000.0f;
+static const float MAX_LANE_TIME = 6000.0f;
+
+// Ships keep this far inside the edges of the track, the same clearance the player has
+static const float SHIP_CLEARANCE = 10.0f;
+
+// A pickup is collected by a ship passing within this distance of it across the track
+static const float PICKUP_REACH = 5.0f;
+
+// Ships are drawn as the player's ship is: raised above the track and scaled down
+static const float SHIP_HEIGHT = 5.0f;
+static const float SHIP_SCALE = 0.3f;
+
+// Ships are updated in batches of this many, each batch a job
+static const int UPDATE_BATCH_SIZE = 1024;
+
+// The update time is averaged over this many frames before it is reported
+static const int TIMING_FRAMES = 300;
+
+CRacers::CRacers()
+{
+	m_pTrack = NULL;
+	m_pJobs = NULL;
+	m_lapLength = 0.0f;
+	m_laneLimit = 0.0f;
+	m_updateTime = 0.0;
+	m_updateFrames = 0;
+	m_averageUpdateTime = 0.0;
+}
+
+CRacers::~CRacers()
+{
+	Release();
+}
+
+bool CRacers::Create(int count, unsigned int seed, CCatmullRom *track, CJobSystem *jobs)
+{
+	Release();
+	if (count <= 0 || track->GetLapLength() <= 0.0f)
+		return false;
+
+	m_pTrack = track;
+	m_pJobs = jobs;
+	m_random.seed(seed);
+	m_lapLength = track->GetLapLength();
+	m_laneLimit = track->GetWidth() / 2 - SHIP_CLEARANCE;
+
+	// The ships only need to know how far along and across the track each pickup is
+	const vector<TrackPickup> &pickups = track->GetPickups();
+	m_pickups.resize(pickups.size());
+	for (unsigned int i = 0; i < pickups.size(); i++) {
+		TrackProjection projection;
+		track->Project(pickups[i].position, projection, pickups[i].distance);
+		m_pickups[i].distance = pickups[i].distance;
+		m_pickups[i].lateral = projection.lateral;
+		m_pickups[i].type = pickups[i].type;
+	}
+
+	m_distance.resize(count);
+	m_offset.resize(count);
+	m_targetOffset.resize(count);
+	m_steerTimer.resize(count);
+	m_speed.resize(count);
+	m_health.assign(count, 100.0f);
+	m_score.assign(count, 0);
+	m_wanted.resize(count);
+	m_laps.assign(count, 0);
+	m_nextPickup.resize(count);
+	m_lod.assign(count, 0);
+	m_positions.resize(count);
+	m_orientations.resize(count);
+
+	// Spread the field evenly round the lap, each ship in a random lane
+	std::uniform_real_distribution<float> speed(MIN_SPEED, MAX_SPEED);
+	std::uniform_real_distribution<float> lane(-m_laneLimit, m_laneLimit);
+	std::uniform_real_distribution<float> laneTime(MIN_LANE_TIME, MAX_LANE_TIME);
+	std::uniform_int_distribution<int> shape(PICKUP_SPHERE, PICKUP_PYRAMID);
+	for (int i = 0; i < count; i++) {
+		m_distance[i] = m_lapLength * i / count;
+		m_wanted[i] = shape(m_random);
+		m_offset[i] = m_targetOffset[i] = lane(m_random);
+		m_steerTimer[i] = laneTime(m_random);
+		m_speed[i] = speed(m_random);
+
+		Pickup key = { m_distance[i], 0.0f, 0 };
+		m_nextPickup[i] = (int) (std::lower_bound(m_pickups.begin(), m_pickups.end(), key,
+			[](const Pickup &a, const Pickup &b) { return a.distance < b.distance; }) - m_pickups.begin());
+	}
+	m_pTrack->SampleOffsets(&m_distance[0], &m_offset[0], count, &m_positions[0], &m_orientations[0]);
+	return true;
+}
+
+// Room for every ship to be drawn each frame.  If there is none, the ships are released, as they could not be drawn.
+bool CRacers::CreateInstanceBuffer()
+{
+	if (GetCount() == 0)
+		return false;
+	if (!m_instanceBuffer.Create(GetCount() * sizeof(Instance), 3)) {
+		Release();
+		return false;
+	}
+	return true;
+}
+
+void CRacers::Release()
+{
+	m_pTrack = NULL;
+	m_distance.clear();
+	m_offset.clear();
+	m_targetOffset.clear();
+	m_steerTimer.clear();
+	m_speed.clear();
+	m_health.clear();
+	m_score.clear();
+	m_wanted.clear();
+	m_laps.clear();
+	m_nextPickup.clear();
+	m_lod.clear();
+	m_positions.clear();
+	m_orientations.clear();
+	m_pickups.clear();
+	m_bounds.Clear();
+	m_instanceBuffer.Release();
+}
+
+void CRacers::Update(double dt)
+{
+	int count = GetCount();
+	if (count == 0)
+		return;
+
+	m_timer.Start();
+
+	// The random number generator is shared, so lanes are chosen before the ships are split up
+	float step = (float) dt;
+	ChooseLanes(step);
+	if (m_pJobs != NULL)
+		m_pJobs->ParallelFor(count, UPDATE_BATCH_SIZE, [this, step](int first, int last) { UpdateBatch(first, last, step); });
+	else
+		UpdateBatch(0, count, step);
+
+	// Report the average cost every so often, as the cost for every 1000 ships so that different sized fields compare
+	m_updateTime += m_timer.Elapsed();
+	if (++m_updateFrames == TIMING_FRAMES) {
+		m_averageUpdateTime = m_updateTime / m_updateFrames * 1000.0 / count;
+		printf("Racers: %d ships updated in %.3f ms per 1000\n", count, m_averageUpdateTime);
+		m_updateTime = 0.0;
+		m_updateFrames = 0;
+	}
+}
+
+// Choose a new lane for the ships that have held theirs long enough.  Only a few do in any frame.
+void CRacers::ChooseLanes(float dt)
+{
+	int count = GetCount();
+	float *timer = &m_steerTimer[0];
+	std::uniform_real_distribution<float> lane(-m_laneLimit, m_laneLimit);
+	std::uniform_real_distribution<float> laneTime(MIN_LANE_TIME, MAX_LANE_TIME);
+	for (int i = 0; i < count; i++) {
+		timer[i] -= dt;
+		if (timer[i] <= 0.0f) {
+			m_targetOffset[i] = lane(m_random);
+			timer[i] += laneTime(m_random);
+		}
+	}
+}
+
+// Everything else about updating ships first to last, which touches no other ship's state and so can run
+// alongside other batches
+void CRacers::UpdateBatch(int first, int last, float dt)
+{
+	// Ease each ship towards its chosen lane and move it on along the track
+	float maxMove = STEER_SPEED * dt;
+	float *offset = &m_offset[0];
+	const float *target = &m_targetOffset[0];
+	float *distance = &m_distance[0];
+	const float *speed = &m_speed[0];
+	for (int i = first; i < last; i++) {
+		offset[i] += glm::clamp(target[i] - offset[i], -maxMove, maxMove);
+		distance[i] += speed[i] * dt;
+	}
+
+	CollectPickups(first, last);
+
+	m_pTrack->SampleOffsets(&m_distance[first], &m_offset[first], last - first, &m_positions[first], &m_orientations[first]);
+}
+
+// Check each ship against the pickups it has passed since the last frame, wrapping round to the first pickup and
+// the next lap when it crosses the start line.  As for the player, the shape a ship is hunting scores a point and
+// sets it hunting another, any other shape costs health, and healthpacks restore it.  A ship that runs out of
+// health starts its race again.  Ships have their own copy of every pickup, so they never take one away from the
+// player or from each other.
+void CRacers::CollectPickups(int first, int last)
+{
+	int numPickups = (int) m_pickups.size();
+	for (int i = first; i < last; i++) {
+		float d = m_distance[i];
+		int next = m_nextPickup[i];
+		for (;;) {
+			if (next == numPickups) {
+				if (d < m_lapLength)
+					break;
+				d -= m_lapLength;
+				next = 0;
+				m_laps[i]++;
+				continue;
+			}
+
+			const Pickup &pickup = m_pickups[next];
+			if (pickup.distance > d)
+				break;
+			if (fabs(pickup.lateral - m_offset[i]) < PICKUP_REACH) {
+				if (pickup.type == PICKUP_HEALTHPACK) {
+					m_health[i] = min(100.0f, m_health[i] + 10.0f);
+				} else if (pickup.type == m_wanted[i]) {
+					// The next shape is hashed from the ship and its score rather than drawn from m_random, which
+					// other batches may be using at the same time
+					m_score[i]++;
+					m_wanted[i] = PICKUP_SPHERE + (int) (((unsigned int) i * 2654435761u + (unsigned int) m_score[i] * 40503u) >> 16) % 3;
+				} else {
+					m_health[i] -= 1.0f;
+				}
+			}
+			next++;
+		}
+		if (m_health[i] <= 0.0f) {
+			m_health[i] = 100.0f;
+			m_score[i] = 0;
+			m_laps[i] = 0;
+		}
+		m_distance[i] = d;
+		m_nextPickup[i] = next;
+	}
+}
+
+void CRacers::Render(COpenAssetImportMesh *mesh, const CFrustum &frustum, const CLodSelector &lodSelector, const glm::vec3 &eye)
+{
+	int count = GetCount();
+	if (count == 0)
+		return;
+
+	m_instanceBuffer.BeginFrame();
+
+	// The ship is placed as in Game::Render: raised along the track's up, rotated into its frame and scaled.  A sphere about the
+	// ship's origin that holds its bounding sphere covers it however it is turned.
+	float radius = SHIP_SCALE * (glm::length(mesh->GetBoundingCentre()) + mesh->GetBoundingRadius());
+	m_bounds.Clear();
+	for (int i = 0; i < count; i++)
+		m_bounds.Add(m_positions[i] + m_orientations[i] * glm::vec3(0, SHIP_HEIGHT, 0), radius);
+	frustum.Cull(m_bounds, m_visible, m_fade);
+	int numVisible = (int) m_visible.size();
+	if (numVisible == 0) {
+		m_instanceBuffer.EndFrame();
+		return;
+	}
+
+	// Choose each visible ship's level of detail and count the ships at each level, so that the instances can be
+	// written grouped by level and drawn with one call per level
+	int numLods = mesh->GetNumLods();
+	int lodCount[MAX_LOD_LEVELS] = { 0 };
+	m_visibleLod.resize(numVisible);
+	for (int j = 0; j < numVisible; j++) {
+		int i = m_visible[j];
+		float distance = glm::distance(m_bounds.GetCentre(i), eye);
+		m_lod[i] = lodSelector.Select(radius, distance, m_lod[i], numLods);
+		m_visibleLod[j] = m_lod[i];
+		lodCount[m_lod[i]]++;
+	}
+	int lodFirst[MAX_LOD_LEVELS];
+	int first = 0;
+	for (int lod = 0; lod < MAX_LOD_LEVELS; lod++) {
+		lodFirst[lod] = first;
+		first += lodCount[lod];
+	}
+
+	UINT offset;
+	Instance *instances = (Instance*) m_instanceBuffer.Allocate(numVisible * sizeof(Instance), 16, offset);
+	if (instances == NULL) {
+		m_instanceBuffer.EndFrame();
+		return;
+	}
+	int lodNext[MAX_LOD_LEVELS];
+	memcpy(lodNext, lodFirst, sizeof(lodNext));
+	for (int j = 0; j < numVisible; j++) {
+		int i = m_visible[j];
+		Instance &instance = instances[lodNext[m_visibleLod[j]]++];
+		instance.positionScale = glm::vec4(m_positions[i] + m_orientations[i] * glm::vec3(0, SHIP_HEIGHT, 0), SHIP_SCALE * m_fade[j]);
+		instance.rotation = m_orientations[i];
+	}
+	m_instanceBuffer.Commit();
+
+	for (int lod = 0; lod < MAX_LOD_LEVELS; lod++)
+		mesh->RenderInstanced(lodCount[lod], m_instanceBuffer.GetBuffer(), offset + lodFirst[lod] * sizeof(Instance), lod);
+
+	m_instanceBuffer.EndFrame();
+}
+
+int CRacers::GetCount() const
+{
+	return (int) m_distance.size();
+}
+
+double CRacers::GetUpdateTime() const
+{
+	return m_averageUpdateTime;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Common.h"
+#include "StreamBuffer.h"
+#include "Frustum.h"
+#include "HighResolutionTimer.h"
+#include "./include/glm/gtc/quaternion.hpp"
+#include <random>
+
+class CCatmullRom;
+class COpenAssetImportMesh;
+class CLodSelector;
+class CJobSystem;
+
+// A field of computer-controlled ships racing round the track.  Each ship is just a distance along the track and an
+// offset across it, so its state is kept as a set of parallel arrays, one per quantity, which the update walks
+// straight through: advancing thousands of ships is a few tight loops rather than a call per ship, and the ships
+// can be split into batches updated on different threads.  Ships weave between lanes and play by the player's
+// rules, each hunting for one shape of pickup at a time, and are drawn with one instanced draw per level of detail.
+class CRacers
+{
+public:
+	CRacers();
+	~CRacers();
+
+	// Place count ships along the track, spread out and at random speeds.  The same seed always gives the same race.
+	// With a job system, Update shares the ships out across its threads.  Touches no OpenGL, so it may run on any
+	// thread; CreateInstanceBuffer then makes what Render draws from, on the thread that owns the context.
+	bool Create(int count, unsigned int seed, CCatmullRom *track, CJobSystem *jobs = NULL);
+	bool CreateInstanceBuffer();
+	void Release();
+
+	void Update(double dt);		// dt in milliseconds, as Game::m_dt
+
+	// Draw every ship inside the frustum with mesh, using the instanced shader, which must be in use with its view
+	// matrices set.  eye is the camera position, used to choose the levels of detail.
+	void Render(COpenAssetImportMesh *mesh, const CFrustum &frustum, const CLodSelector &lodSelector, const glm::vec3 &eye);
+
+	int GetCount() const;
+	double GetUpdateTime() const;	// Average time Update takes for every 1000 ships, in milliseconds
+
+private:
+	// A pickup as the ships see it: where it is along and across the track
+	struct Pickup {
+		float distance;
+		float lateral;
+		int type;
+	};
+
+	// What is written to the instance buffer for each ship drawn; see instancedShader.vert
+	struct Instance {
+		glm::vec4 positionScale;
+		glm::quat rotation;
+	};
+
+	void ChooseLanes(float dt);
+	void UpdateBatch(int first, int last, float dt);
+	void CollectPickups(int first, int last);
+
+	CCatmullRom *m_pTrack;
+	CJobSystem *m_pJobs;
+	std::mt19937 m_random;
+	float m_lapLength;
+	float m_laneLimit;			// Furthest a ship's centre may be from the centreline
+
+	// One entry per ship
+	vector<float> m_distance;		// Within the current lap
+	vector<float> m_offset;
+	vector<float> m_targetOffset;	// Lane the ship is moving over to
+	vector<float> m_steerTimer;		// Milliseconds until the ship picks another lane
+	vector<float> m_speed;			// Units per millisecond
+	vector<float> m_health;
+	vector<int> m_score;
+	vector<int> m_wanted;			// Type of pickup the ship is hunting for
+	vector<int> m_laps;
+	vector<int> m_nextPickup;		// Index of the next pickup ahead of the ship in m_pickups
+	vector<int> m_lod;
+	vector<glm::vec3> m_positions;
+	vector<glm::quat> m_orientations;
+
+	vector<Pickup> m_pickups;		// In order of distance along the track
+
+	// Per-frame scratch space for Render, kept to avoid allocating
+	CStreamBuffer m_instanceBuffer;
+	CBoundingSpheres m_bounds;
+	vector<int> m_visible;
+	vector<float> m_fade;
+	vector<int> m_visibleLod;
+
+	CHighResolutionTimer m_timer;
+	double m_updateTime;			// Time spent in Update over the last m_updateFrames frames
+	int m_updateFrames;
+	double m_averageUpdateTime;		// For every 1000 ships, as last reported
+};
@@ -0,0 +1,150 @@
+#include "RenderQueue.h"
+#include "Shaders.h"
+
+void CCommandBuffer::Clear()
+{
+	m_packets.clear();
+	m_modelViewMatrices.clear();
+	m_normalMatrices.clear();
+}
+
+void CCommandBuffer::Draw(UINT64 key, DrawFunction draw, void *object, int lod, const glm::mat4 &modelViewMatrix, const glm::mat3 &normalMatrix)
+{
+	CDrawPacket packet;
+	packet.key = key;
+	packet.draw = draw;
+	packet.object = object;
+	packet.lod = lod;
+	packet.transform = (int) m_modelViewMatrices.size();
+	m_packets.push_back(packet);
+	m_modelViewMatrices.push_back(modelViewMatrix);
+	m_normalMatrices.push_back(normalMatrix);
+}
+
+CRenderQueue::CRenderQueue()
+{
+	m_pFrameArena = NULL;
+}
+
+CRenderQueue::~CRenderQueue()
+{}
+
+void CRenderQueue::Create(int numCommandBuffers, CFrameArena *frameArena)
+{
+	m_commandBuffers.resize(max(numCommandBuffers, 1));
+	m_pFrameArena = frameArena;
+}
+
+void CRenderQueue::BeginFrame()
+{
+	for (unsigned int i = 0; i < m_commandBuffers.size(); i++)
+		m_commandBuffers[i].Clear();
+}
+
+CCommandBuffer &CRenderQueue::GetCommandBuffer(int index)
+{
+	return m_commandBuffers[index];
+}
+
+UINT64 CRenderQueue::MakeKey(int pass, int program, int material, int mesh, float depth, float maxDepth)
+{
+	const UINT64 maxDepthValue = (1ull << DEPTH_BITS) - 1;
+	UINT64 depthValue = (UINT64) (glm::clamp(depth / maxDepth, 0.0f, 1.0f) * maxDepthValue);
+
+	UINT64 key = (UINT64) pass & ((1 << PASS_BITS) - 1);
+	key = (key << PROGRAM_BITS) | ((UINT64) program & ((1 << PROGRAM_BITS) - 1));
+	key = (key << MATERIAL_BITS) | ((UINT64) material & ((1 << MATERIAL_BITS) - 1));
+	key = (key << MESH_BITS) | ((UINT64) mesh & ((1 << MESH_BITS) - 1));
+	key = (key << DEPTH_BITS) | depthValue;
+	return key;
+}
+
+// Least significant digit radix sort on the keys, a byte at a time.  The histograms for every byte are gathered
+// in one pass first, and bytes that are the same in every key are skipped, which with few passes, programs and
+// materials in use is most of them.  The sort is stable, so equal keys replay in the order they were recorded.
+// Both lists live in the frame arena and are simply abandoned once the frame is drawn.
+CRenderQueue::SortList CRenderQueue::Sort()
+{
+	unsigned int total = 0;
+	for (unsigned int b = 0; b < m_commandBuffers.size(); b++)
+		total += (unsigned int) m_commandBuffers[b].m_packets.size();
+
+	SortList sorted = SortList(CFrameAllocator<SortEntry>(m_pFrameArena));
+	sorted.reserve(total);
+	for (unsigned int b = 0; b < m_commandBuffers.size(); b++) {
+		const vector<CDrawPacket> &packets = m_commandBuffers[b].m_packets;
+		for (unsigned int p = 0; p < packets.size(); p++) {
+			SortEntry entry = { packets[p].key, (int) b, (int) p };
+			sorted.push_back(entry);
+		}
+	}
+
+	int count = (int) sorted.size();
+	if (count < 2)
+		return sorted;
+	SortList scratch = SortList(count, SortEntry(), CFrameAllocator<SortEntry>(m_pFrameArena));
+
+	UINT counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for (int i = 0; i < count; i++) {
+		UINT64 key = sorted[i].key;
+		for (int digit = 0; digit < 8; digit++)
+			counts[digit][(key >> (8 * digit)) & 0xFF]++;
+	}
+
+	for (int digit = 0; digit < 8; digit++) {
+		UINT *digitCounts = counts[digit];
+		if (digitCounts[(sorted[0].key >> (8 * digit)) & 0xFF] == (UINT) count)
+			continue;
+
+		UINT offsets[256];
+		UINT total = 0;
+		for (int value = 0; value < 256; value++) {
+			offsets[value] = total;
+			total += digitCounts[value];
+		}
+		for (int i = 0; i < count; i++)
+			scratch[offsets[(sorted[i].key >> (8 * digit)) & 0xFF]++] = sorted[i];
+		sorted.swap(scratch);
+	}
+	return sorted;
+}
+
+void CRenderQueue::Submit(const vector<CShaderProgram*> &programs)
+{
+	SortList sorted = Sort();
+
+	// Only switch programs, and only have the draw functions bind their state, when the key says it has changed
+	const UINT64 stateMask = ~((1ull << DEPTH_BITS) - 1);
+	const int programShift = DEPTH_BITS + MESH_BITS + MATERIAL_BITS;
+	int currentProgram = -1;
+	UINT64 currentState = 0;
+
+	// Look the per-draw uniforms up once per program, not once per draw
+	GLint modelViewLocations[1 << PROGRAM_BITS], normalLocations[1 << PROGRAM_BITS];
+	for (unsigned int p = 0; p < programs.size() && p < (1u << PROGRAM_BITS); p++) {
+		modelViewLocations[p] = normalLocations[p] = -1;
+		if (programs[p] != NULL) {
+			modelViewLocations[p] = glGetUniformLocation(programs[p]->GetProgramID(), "matrices.modelViewMatrix");
+			normalLocations[p] = glGetUniformLocation(programs[p]->GetProgramID(), "matrices.normalMatrix");
+		}
+	}
+
+	for (unsigned int i = 0; i < sorted.size(); i++) {
+		const SortEntry &entry = sorted[i];
+		const CCommandBuffer &buffer = m_commandBuffers[entry.buffer];
+		const CDrawPacket &packet = buffer.m_packets[entry.packet];
+
+		int program = (int) (packet.key >> programShift) & ((1 << PROGRAM_BITS) - 1);
+		if (program != currentProgram) {
+			programs[program]->UseProgram();
+			currentProgram = program;
+		}
+		glUniformMatrix4fv(modelViewLocations[program], 1, GL_FALSE, &buffer.m_modelViewMatrices[packet.transform][0][0]);
+		glUniformMatrix3fv(normalLocations[program], 1, GL_FALSE, &buffer.m_normalMatrices[packet.transform][0][0]);
+
+		bool bindState = i == 0 || (packet.key & stateMask) != currentState;
+		currentState = packet.key & stateMask;
+		packet.draw(packet.object, packet.lod, bindState);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Common.h"
+#include "FrameArena.h"
+
+class CShaderProgram;
+
+// Draws something recorded in a packet.  bindState is true when the packet before was for a different mesh or
+// material (or there was none), so the function must bind its vertex array and textures; otherwise they are still
+// bound and it need only draw.
+typedef void (*DrawFunction)(void *object, int lod, bool bindState);
+
+// A draw recorded for later: what to call, on what, and the sort key that decides when
+struct CDrawPacket
+{
+	UINT64 key;
+	DrawFunction draw;
+	void *object;
+	int lod;
+	int transform;				// Index of the packet's matrices in the command buffer it was recorded into
+};
+
+// Draw packets recorded by one thread.  Only the thread using a buffer may write to it, so recording needs no locks.
+class CCommandBuffer
+{
+public:
+	void Clear();
+	void Draw(UINT64 key, DrawFunction draw, void *object, int lod, const glm::mat4 &modelViewMatrix, const glm::mat3 &normalMatrix);
+
+private:
+	friend class CRenderQueue;
+
+	vector<CDrawPacket> m_packets;
+	vector<glm::mat4> m_modelViewMatrices;
+	vector<glm::mat3> m_normalMatrices;
+};
+
+// Collects draws from any number of threads, each into its own command buffer, then sorts them all by key and
+// replays them on the thread with the GL context.  The key puts the pass in the top bits, then the shader program,
+// material and mesh, then the depth, so draws come out a pass at a time, grouped to change as little state as
+// possible and front to back within each group.
+class CRenderQueue
+{
+public:
+	CRenderQueue();
+	~CRenderQueue();
+
+	// One command buffer for each thread that may record draws.  The sort's working space comes from frameArena.
+	void Create(int numCommandBuffers, CFrameArena *frameArena);
+	void BeginFrame();						// Empties every command buffer
+	CCommandBuffer &GetCommandBuffer(int index);
+
+	// Passes are drawn in order.  depth is the distance from the eye, of which up to maxDepth is kept.
+	static UINT64 MakeKey(int pass, int program, int material, int mesh, float depth, float maxDepth);
+
+	// Sort everything recorded and draw it.  programs are indexed by the keys' program numbers; each must have its
+	// per-frame uniforms set already, and the packets set matrices.modelViewMatrix and matrices.normalMatrix.
+	void Submit(const vector<CShaderProgram*> &programs);
+
+private:
+	static const int PASS_BITS = 2;
+	static const int PROGRAM_BITS = 6;
+	static const int MATERIAL_BITS = 16;
+	static const int MESH_BITS = 16;
+	static const int DEPTH_BITS = 24;
+
+	struct SortEntry {
+		UINT64 key;
+		int buffer;
+		int packet;
+	};
+
+	typedef vector<SortEntry, CFrameAllocator<SortEntry> > SortList;
+
+	SortList Sort();
+
+	vector<CCommandBuffer> m_commandBuffers;
+	CFrameArena *m_pFrameArena;
+};
@@ -0,0 +1,488 @@
+#include "ResourcePack.h"
+#include <algorithm>
+
+// Layout of a pack: the header, each file's data on a PACK_ALIGNMENT boundary, then the entries sorted by hash and
+// the normalised paths, each ending in a zero byte
+static const char PACK_MAGIC[4] = { 'R', 'P', 'A', 'K' };
+static const UINT PACK_VERSION = 1;
+static const UINT PACK_ALIGNMENT = 64;
+
+struct PackHeader {
+	char magic[4];
+	UINT version;
+	UINT numEntries;
+	UINT entriesOffset;
+	UINT namesOffset;
+	UINT namesSize;
+};
+
+static CResourcePack *s_pMountedPack = NULL;
+
+// LZ4 block format.  A block is a run of sequences, each a token byte, whose top four bits count the literals and
+// bottom four the match length less four, then any more of the literal count, the literals, the offset back to the
+// match in two bytes and any more of the match length.  A count of 15 carries on in following bytes, which are
+// added on until one is not 255.  The last sequence is literals only, and covers at least the last five bytes.
+static const int LZ4_MIN_MATCH = 4;
+static const UINT LZ4_MAX_OFFSET = 65535;
+static const UINT LZ4_LAST_LITERALS = 5;
+static const UINT LZ4_MATCH_MARGIN = 12;		// No match may start this close to the end
+static const int LZ4_HASH_BITS = 14;
+
+static UINT Read32(const BYTE *p)
+{
+	UINT v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+// Write the rest of a count of 15 or more
+static bool WriteLength(UINT length, BYTE *dst, UINT capacity, UINT &out)
+{
+	for (length -= 15; length >= 255; length -= 255) {
+		if (out >= capacity)
+			return false;
+		dst[out++] = 255;
+	}
+	if (out >= capacity)
+		return false;
+	dst[out++] = (BYTE) length;
+	return true;
+}
+
+static bool WriteSequence(const BYTE *literals, UINT numLiterals, UINT offset, UINT matchLength, BYTE *dst, UINT capacity, UINT &out)
+{
+	if (out >= capacity)
+		return false;
+	UINT matchCode = matchLength > 0 ? matchLength - LZ4_MIN_MATCH : 0;
+	dst[out++] = (BYTE) ((min(numLiterals, 15u) << 4) | min(matchCode, 15u));
+	if (numLiterals >= 15 && !WriteLength(numLiterals, dst, capacity, out))
+		return false;
+	if (numLiterals > capacity - out)
+		return false;
+	memcpy(dst + out, literals, numLiterals);
+	out += numLiterals;
+	if (matchLength == 0)
+		return true;
+
+	if (capacity - out < 2)
+		return false;
+	dst[out++] = (BYTE) offset;
+	dst[out++] = (BYTE) (offset >> 8);
+	return matchCode < 15 || WriteLength(matchCode, dst, capacity, out);
+}
+
+// Greedy compression with a table of where each four bytes were last seen.  Returns the compressed size, or 0 if it
+// would not fit in capacity bytes.
+static UINT Lz4Compress(const BYTE *src, UINT size, BYTE *dst, UINT capacity)
+{
+	vector<int> lastSeen(1 << LZ4_HASH_BITS, -1);
+	UINT out = 0;
+	UINT anchor = 0;
+	UINT i = 0;
+	UINT matchStartLimit = size > LZ4_MATCH_MARGIN ? size - LZ4_MATCH_MARGIN : 0;
+	while (i < matchStartLimit) {
+		UINT sequence = Read32(src + i);
+		UINT hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+		int candidate = lastSeen[hash];
+		lastSeen[hash] = (int) i;
+		if (candidate < 0 || i - candidate > LZ4_MAX_OFFSET || Read32(src + candidate) != sequence) {
+			i++;
+			continue;
+		}
+
+		UINT matchEnd = i + LZ4_MIN_MATCH;
+		while (matchEnd < size - LZ4_LAST_LITERALS && src[matchEnd] == src[candidate + matchEnd - i])
+			matchEnd++;
+		if (!WriteSequence(src + anchor, i - anchor, i - candidate, matchEnd - i, dst, capacity, out))
+			return 0;
+		i = anchor = matchEnd;
+	}
+	if (!WriteSequence(src + anchor, size - anchor, 0, 0, dst, capacity, out))
+		return 0;
+	return out;
+}
+
+// Read the rest of a count of 15 or more
+static bool ReadLength(const BYTE *src, UINT srcSize, UINT &in, UINT &length)
+{
+	BYTE b;
+	do {
+		if (in >= srcSize)
+			return false;
+		b = src[in++];
+		length += b;
+	} while (b == 255);
+	return true;
+}
+
+// Unpack an LZ4 block of exactly size bytes.  Returns false, rather than read or write out of bounds, if the block
+// is damaged.
+bool CResourcePack::Decompress(const BYTE *src, UINT srcSize, BYTE *dst, UINT size)
+{
+	UINT in = 0, out = 0;
+	while (in < srcSize) {
+		BYTE token = src[in++];
+		UINT numLiterals = token >> 4;
+		if (numLiterals == 15 && !ReadLength(src, srcSize, in, numLiterals))
+			return false;
+		if (numLiterals > srcSize - in || numLiterals > size - out)
+			return false;
+		memcpy(dst + out, src + in, numLiterals);
+		in += numLiterals;
+		out += numLiterals;
+		if (in == srcSize)
+			break;
+
+		if (srcSize - in < 2)
+			return false;
+		UINT offset = src[in] | (src[in + 1] << 8);
+		in += 2;
+		UINT matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(src, srcSize, in, matchLength))
+			return false;
+		matchLength += LZ4_MIN_MATCH;
+		if (offset == 0 || offset > out || matchLength > size - out)
+			return false;
+
+		// The match may overlap what it is copied to, so copy forwards a byte at a time
+		const BYTE *match = dst + out - offset;
+		for (UINT k = 0; k < matchLength; k++)
+			dst[out + k] = match[k];
+		out += matchLength;
+	}
+	return out == size;
+}
+
+CResourcePack::CResourcePack()
+{
+	m_pEntries = NULL;
+	m_numEntries = 0;
+	m_pNames = NULL;
+	m_namesSize = 0;
+}
+
+CResourcePack::~CResourcePack()
+{
+	Close();
+}
+
+bool CResourcePack::Open(const string &filename)
+{
+	Close();
+	if (!m_file.Open(filename) || m_file.GetSize() < sizeof(PackHeader)) {
+		m_file.Close();
+		return false;
+	}
+
+	PackHeader header;
+	memcpy(&header, m_file.GetData(), sizeof(header));
+	if (memcmp(header.magic, PACK_MAGIC, sizeof(header.magic)) != 0 || header.version != PACK_VERSION) {
+		printf("Pack: ignoring %s, which is from a different version\n", filename.c_str());
+		m_file.Close();
+		return false;
+	}
+
+	unsigned long long entriesEnd = header.entriesOffset + (unsigned long long) header.numEntries * sizeof(Entry);
+	unsigned long long namesEnd = header.namesOffset + (unsigned long long) header.namesSize;
+	const char *pNames = (const char*) m_file.GetData() + header.namesOffset;
+	if (entriesEnd > m_file.GetSize() || header.entriesOffset % PACK_ALIGNMENT != 0 || namesEnd > m_file.GetSize()
+		|| (header.namesSize > 0 && pNames[header.namesSize - 1] != '\0')) {
+		printf("Pack: ignoring %s, which is damaged\n", filename.c_str());
+		m_file.Close();
+		return false;
+	}
+
+	m_pEntries = (const Entry*) (m_file.GetData() + header.entriesOffset);
+	m_numEntries = header.numEntries;
+	m_pNames = pNames;
+	m_namesSize = header.namesSize;
+	return true;
+}
+
+void CResourcePack::Close()
+{
+	m_file.Close();
+	m_pEntries = NULL;
+	m_numEntries = 0;
+	m_pNames = NULL;
+	m_namesSize = 0;
+}
+
+int CResourcePack::GetNumFiles() const
+{
+	return (int) m_numEntries;
+}
+
+const BYTE *CResourcePack::Find(const string &path, UINT &size, UINT &packedSize) const
+{
+	if (m_pEntries == NULL)
+		return NULL;
+
+	string name = NormalisePath(path);
+	UINT64 hash = HashPath(name);
+	const Entry *pEnd = m_pEntries + m_numEntries;
+	const Entry *pEntry = lower_bound(m_pEntries, pEnd, hash, [](const Entry &entry, UINT64 hash) { return entry.hash < hash; });
+	if (pEntry == pEnd || pEntry->hash != hash)
+		return NULL;
+
+	// The hash is all but certain to be the file's own, but check the path, and that the data is in the pack
+	if (pEntry->name >= m_namesSize || strcmp(m_pNames + pEntry->name, name.c_str()) != 0)
+		return NULL;
+	if (pEntry->offset + (unsigned long long) pEntry->packedSize > m_file.GetSize() || pEntry->packedSize > pEntry->size)
+		return NULL;
+
+	size = pEntry->size;
+	packedSize = pEntry->packedSize;
+	return m_file.GetData() + pEntry->offset;
+}
+
+// Lower case, with forward slashes and without . and .. parts, so that every way of writing a path matches
+string CResourcePack::NormalisePath(const string &path)
+{
+	vector<string> parts;
+	string part;
+	for (size_t i = 0; i <= path.size(); i++) {
+		char c = i < path.size() ? path[i] : '/';
+		if (c != '/' && c != '\\') {
+			part += (char) tolower((unsigned char) c);
+			continue;
+		}
+		if (part == "..") {
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else
+				parts.push_back(part);
+		} else if (!part.empty() && part != ".") {
+			parts.push_back(part);
+		}
+		part.clear();
+	}
+
+	string normalised;
+	for (unsigned int i = 0; i < parts.size(); i++) {
+		if (i > 0)
+			normalised += '/';
+		normalised += parts[i];
+	}
+	return normalised;
+}
+
+// 64-bit FNV-1a
+UINT64 CResourcePack::HashPath(const string &normalisedPath)
+{
+	UINT64 hash = 14695981039346656037ull;
+	for (size_t i = 0; i < normalisedPath.size(); i++) {
+		hash ^= (BYTE) normalisedPath[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Add the path of every file under directory
+static void FindFiles(const string &directory, vector<string> &paths)
+{
+	WIN32_FIND_DATA found;
+	HANDLE search = FindFirstFile((directory + "\\*").c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		string name = found.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			FindFiles(directory + "\\" + name, paths);
+		else
+			paths.push_back(directory + "\\" + name);
+	} while (FindNextFile(search, &found));
+	FindClose(search);
+}
+
+static bool WritePadding(FILE *fp, UINT &offset)
+{
+	static const BYTE zeros[PACK_ALIGNMENT] = { 0 };
+	UINT padding = (PACK_ALIGNMENT - offset % PACK_ALIGNMENT) % PACK_ALIGNMENT;
+	offset += padding;
+	return fwrite(zeros, 1, padding, fp) == padding;
+}
+
+string CResourcePack::FindNewerFile(const string &filename, const string &directory)
+{
+	WIN32_FILE_ATTRIBUTE_DATA pack, file;
+	if (!GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &pack))
+		return string();
+
+	vector<string> paths;
+	FindFiles(directory, paths);
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		if (GetFileAttributesEx(paths[i].c_str(), GetFileExInfoStandard, &file) &&
+			CompareFileTime(&file.ftLastWriteTime, &pack.ftLastWriteTime) > 0)
+			return paths[i];
+	}
+	return string();
+}
+
+bool CResourcePack::Build(const string &directory, const string &filename)
+{
+	vector<string> paths;
+	FindFiles(directory, paths);
+	string packName = NormalisePath(filename);
+
+	FILE *fp;
+	fopen_s(&fp, filename.c_str(), "wb");
+	if (!fp) {
+		printf("Pack: cannot write %s\n", filename.c_str());
+		return false;
+	}
+
+	PackHeader header;
+	memset(&header, 0, sizeof(header));
+	fwrite(&header, sizeof(header), 1, fp);
+	UINT offset = sizeof(header);
+
+	vector<Entry> entries;
+	string names;
+	vector<BYTE> packed;
+	unsigned long long totalSize = 0, totalPacked = 0;
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		string name = NormalisePath(paths[i]);
+		if (name == packName)
+			continue;
+		CMappedFile file;
+		if (!file.Open(paths[i])) {
+			printf("Pack: skipping %s, which cannot be read\n", paths[i].c_str());
+			continue;
+		}
+
+		Entry entry;
+		entry.hash = HashPath(name);
+		entry.name = (UINT) names.size();
+		entry.offset = 0;
+		entry.size = file.GetSize();
+		names += name;
+		names += '\0';
+
+		// Keep the compressed data only if it saves at least an eighth, as otherwise it is not worth unpacking
+		packed.resize(entry.size);
+		entry.packedSize = Lz4Compress(file.GetData(), entry.size, &packed[0], entry.size - entry.size / 8);
+		const BYTE *pData = &packed[0];
+		if (entry.packedSize == 0) {
+			entry.packedSize = entry.size;
+			pData = file.GetData();
+		}
+
+		WritePadding(fp, offset);
+		entry.offset = offset;
+		fwrite(pData, 1, entry.packedSize, fp);
+		offset += entry.packedSize;
+		entries.push_back(entry);
+		totalSize += entry.size;
+		totalPacked += entry.packedSize;
+	}
+
+	sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.hash < b.hash; });
+	for (unsigned int i = 1; i < entries.size(); i++) {
+		if (entries[i].hash == entries[i - 1].hash) {
+			printf("Pack: %s and %s have the same hash; rename one\n", names.c_str() + entries[i - 1].name, names.c_str() + entries[i].name);
+			fclose(fp);
+			return false;
+		}
+	}
+
+	WritePadding(fp, offset);
+	memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+	header.version = PACK_VERSION;
+	header.numEntries = (UINT) entries.size();
+	header.entriesOffset = offset;
+	if (!entries.empty())
+		fwrite(&entries[0], sizeof(Entry), entries.size(), fp);
+	offset += (UINT) (entries.size() * sizeof(Entry));
+	header.namesOffset = offset;
+	header.namesSize = (UINT) names.size();
+	fwrite(names.data(), 1, names.size(), fp);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fp);
+
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	if (ok)
+		printf("Pack: %u files from %s, %llu bytes (%llu before compression), written to %s\n", header.numEntries,
+			directory.c_str(), totalPacked, totalSize, filename.c_str());
+	else
+		printf("Pack: could not write %s\n", filename.c_str());
+	return ok;
+}
+
+void CResourcePack::Mount(CResourcePack *pack)
+{
+	s_pMountedPack = pack;
+}
+
+CResourcePack *CResourcePack::GetMounted()
+{
+	return s_pMountedPack;
+}
+
+CResource::CResource()
+{
+	m_pData = NULL;
+	m_size = 0;
+}
+
+bool CResource::Open(const string &path)
+{
+	Close();
+
+	CResourcePack *pack = CResourcePack::GetMounted();
+	UINT packedSize;
+	const BYTE *pData = pack != NULL ? pack->Find(path, m_size, packedSize) : NULL;
+	if (pData != NULL) {
+		if (packedSize == m_size) {
+			m_pData = pData;
+			return true;
+		}
+		m_unpacked.resize(m_size);
+		if (CResourcePack::Decompress(pData, packedSize, &m_unpacked[0], m_size)) {
+			m_pData = &m_unpacked[0];
+			return true;
+		}
+		printf("Pack: %s is damaged\n", path.c_str());
+		Close();
+		return false;
+	}
+
+	if (!m_file.Open(path)) {
+		m_size = 0;
+		return false;
+	}
+	m_pData = m_file.GetData();
+	m_size = m_file.GetSize();
+	return true;
+}
+
+void CResource::Close()
+{
+	m_file.Close();
+	vector<BYTE>().swap(m_unpacked);
+	m_pData = NULL;
+	m_size = 0;
+}
+
+const BYTE *CResource::GetData() const
+{
+	return m_pData;
+}
+
+UINT CResource::GetSize() const
+{
+	return m_size;
+}
+
+bool CResource::Exists(const string &path)
+{
+	CResourcePack *pack = CResourcePack::GetMounted();
+	UINT size, packedSize;
+	if (pack != NULL && pack->Find(path, size, packedSize) != NULL)
+		return true;
+	DWORD attributes = GetFileAttributes(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
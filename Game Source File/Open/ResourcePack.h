@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Common.h"
+#include "MappedFile.h"
+
+// Everything under resources/ in one file, so that loading the game maps one file rather than opening dozens.
+// A table of contents, sorted by a hash of each file's path, finds files by binary search.  Each file's data starts
+// on a PACK_ALIGNMENT boundary and is used in place where the file is mapped.  Files that shrink enough are LZ4
+// compressed, and are unpacked into memory of their own when opened.
+//
+// Paths are looked up as the game names them: case and the kind of slash do not matter, and . and .. are resolved,
+// so "resources\\models\\Barrel\\Barrel02.obj" finds resources/models/barrel/barrel02.obj.  Build writes a pack;
+// the game runs it with "-pack".
+class CResourcePack
+{
+public:
+	CResourcePack();
+	~CResourcePack();
+
+	bool Open(const string &filename);		// Returns false, without reporting an error, if there is no pack
+	void Close();
+	int GetNumFiles() const;
+
+	// Find a file.  Returns its data in the pack, or NULL if the pack has no such file; packedSize is less than size
+	// if the data is compressed.
+	const BYTE *Find(const string &path, UINT &size, UINT &packedSize) const;
+
+	// Pack every file under directory, compressing those that LZ4 shrinks by at least an eighth
+	static bool Build(const string &directory, const string &filename);
+
+	// A file under directory written since the pack was, or an empty string if there is none, so that a pack left
+	// behind by edits to the loose files is not used in their place
+	static string FindNewerFile(const string &filename, const string &directory);
+
+	// The pack CResource looks in.  Mount before any thread loads anything, and keep the pack open while it is mounted.
+	static void Mount(CResourcePack *pack);
+	static CResourcePack *GetMounted();
+
+	static string NormalisePath(const string &path);
+	static bool Decompress(const BYTE *packed, UINT packedSize, BYTE *data, UINT size);
+
+private:
+	struct Entry {
+		UINT64 hash;
+		UINT name;			// Offset of the normalised path in the names
+		UINT offset;		// Of the data, from the start of the pack
+		UINT size;
+		UINT packedSize;	// The same as size if the data is not compressed
+	};
+
+	static UINT64 HashPath(const string &normalisedPath);
+
+	CMappedFile m_file;
+	const Entry *m_pEntries;
+	UINT m_numEntries;
+	const char *m_pNames;
+	UINT m_namesSize;
+};
+
+// A read-only view of one resource file: from the mounted pack if it holds the file, or else mapped from the loose
+// file, so that the game still runs from resources/ while there is no pack.
+class CResource
+{
+public:
+	CResource();
+
+	bool Open(const string &path);			// Returns false, without reporting an error, if there is no such file
+	void Close();
+
+	const BYTE *GetData() const;
+	UINT GetSize() const;
+
+	static bool Exists(const string &path);
+
+private:
+	CResource(const CResource &);
+	CResource &operator=(const CResource &);
+
+	CMappedFile m_file;
+	vector<BYTE> m_unpacked;				// Holds the data of a compressed file
+	const BYTE *m_pData;
+	UINT m_size;
+};
@@ -1,5 +1,6 @@
 #include "Common.h"
 #include "shaders.h"
+#include "ResourcePack.h"
 
 
 
@@ -13,25 +14,28 @@ CShader::~CShader()
 // Loads a shader, stored as a text file with filename sFile.  The shader is of type iType (vertex, fragment, geometry, etc.)
 bool CShader::LoadShader(string sFile, int iType)
 {
-	vector<string> sLines;
-
-	if(!GetLinesFromFile(sFile, false, &sLines)) {
+	// The lines point into the mapped files, which stay open until the shader has been compiled
+	vector<CResource*> vFiles;
+	vector<const char*> sLines;
+	vector<int> iLengths;
+
+	bool bRead = GetLinesFromFile(sFile, false, &vFiles, &sLines, &iLengths) && !sLines.empty();
+	if(!bRead) {
+		for (int i = 0; i < (int)vFiles.size(); i++)
+			delete vFiles[i];
 		char message[1024];
 		sprintf_s(message, "Cannot load shader\n%s\n", sFile.c_str());
 		MessageBox(NULL, message, "Error", MB_ICONERROR);
 		return false;
 	}
 
-	const char** sProgram = new const char*[(int)sLines.size()];
-	for (int i = 0; i < (int)sLines.size(); i++) 
-		sProgram[i] = sLines[i].c_str();
-	
 	m_uiShader = glCreateShader(iType);
 
-	glShaderSource(m_uiShader, (int)sLines.size(), sProgram, NULL);
+	glShaderSource(m_uiShader, (int)sLines.size(), &sLines[0], &iLengths[0]);
 	glCompileShader(m_uiShader);
 
-	delete[] sProgram;
+	for (int i = 0; i < (int)vFiles.size(); i++)
+		delete vFiles[i];
 
 	int iCompilationStatus;
 	glGetShaderiv(m_uiShader, GL_COMPILE_STATUS, &iCompilationStatus);
@@ -53,6 +57,8 @@ bool CShader::LoadShader(string sFile, int iType)
 			sprintf_s(sShaderType, "tesselation control shader");
 		else if (iType == GL_TESS_EVALUATION_SHADER)
 			sprintf_s(sShaderType, "tesselation evaluation shader");
+		else if (iType == GL_COMPUTE_SHADER)
+			sprintf_s(sShaderType, "compute shader");
 		else
 			sprintf_s(sShaderType, "unknown shader type");
 
@@ -68,12 +74,16 @@ bool CShader::LoadShader(string sFile, int iType)
 }
 
 
-// Loads a file into a vector of strings (vResult)
-bool CShader::GetLinesFromFile(string sFile, bool bIncludePart, vector<string>* vResult)
+// Finds the lines of a file, and of the files it includes, as pointers into the files (vFiles) where they are
+// mapped, and their lengths.  The caller deletes the files once it has finished with the lines.
+bool CShader::GetLinesFromFile(string sFile, bool bIncludePart, vector<CResource*>* vFiles, vector<const char*>* vLines, vector<int>* vLengths)
 {
-	FILE* fp;
-	fopen_s(&fp, sFile.c_str(), "rt");
-	if(!fp)return false;
+	CResource* pFile = new CResource;
+	if(!pFile->Open(sFile)) {
+		delete pFile;
+		return false;
+	}
+	vFiles->push_back(pFile);
 
 	string sDirectory;
 	int slashIndex = -1;
@@ -91,23 +101,35 @@ bool CShader::GetLinesFromFile(string sFile, bool bIncludePart, vector<string>*
 
 	// Get all lines from a file
 
-	char sLine[255];
+	const char* pText = (const char*) pFile->GetData();
+	const char* pEnd = pText + pFile->GetSize();
 
 	bool bInIncludePart = false;
 
-	while(fgets(sLine, 255, fp))
+	while(pText < pEnd)
 	{
-		stringstream ss(sLine);
-		string sFirst;
-		ss >> sFirst;
+		const char* sLine = pText;
+		const char* pLineEnd = (const char*) memchr(pText, '\n', pEnd - pText);
+		pLineEnd = pLineEnd ? pLineEnd + 1 : pEnd;
+		pText = pLineEnd;
+
+		// Only a line starting with # can be one of the directives handled here
+		const char* pFirst = sLine;
+		while(pFirst < pLineEnd && (*pFirst == ' ' || *pFirst == '\t'))
+			pFirst++;
+		string sFirst, sFileName;
+		if(pFirst < pLineEnd && *pFirst == '#')
+		{
+			stringstream ss(string(pFirst, pLineEnd));
+			ss >> sFirst >> sFileName;
+		}
+
 		if(sFirst == "#include")
 		{
-			string sFileName;
-			ss >> sFileName;
 			if((int)sFileName.size() > 0 && sFileName[0] == '\"' && sFileName[(int)sFileName.size()-1] == '\"')
 			{
 				sFileName = sFileName.substr(1, (int)sFileName.size()-2);
-				GetLinesFromFile(sDirectory+sFileName, true, vResult);
+				GetLinesFromFile(sDirectory+sFileName, true, vFiles, vLines, vLengths);
 			}
 		}
 		else if(sFirst == "#include_part")
@@ -115,9 +137,11 @@ bool CShader::GetLinesFromFile(string sFile, bool bIncludePart, vector<string>*
 		else if(sFirst == "#definition_part")
 			bInIncludePart = false;
 		else if(!bIncludePart || (bIncludePart && bInIncludePart))
-			vResult->push_back(sLine);
+		{
+			vLines->push_back(sLine);
+			vLengths->push_back(int(pLineEnd - sLine));
+		}
 	}
-	fclose(fp);
 
 	return true;
 }
@@ -214,94 +238,94 @@ UINT CShaderProgram::GetProgramID()
 
 // Setting floats
 
-void CShaderProgram::SetUniform(string sName, float* fValues, int iCount)
+void CShaderProgram::SetUniform(const char *sName, float* fValues, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1fv(iLoc, iCount, fValues);
 }
 
-void CShaderProgram::SetUniform(string sName, const float fValue)
+void CShaderProgram::SetUniform(const char *sName, const float fValue)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1fv(iLoc, 1, &fValue);
 }
 
 // Setting vectors
 
-void CShaderProgram::SetUniform(string sName, glm::vec2* vVectors, int iCount)
+void CShaderProgram::SetUniform(const char *sName, glm::vec2* vVectors, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform2fv(iLoc, iCount, (GLfloat*)vVectors);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::vec2 vVector)
+void CShaderProgram::SetUniform(const char *sName, const glm::vec2 vVector)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform2fv(iLoc, 1, (GLfloat*)&vVector);
 }
 
-void CShaderProgram::SetUniform(string sName, glm::vec3* vVectors, int iCount)
+void CShaderProgram::SetUniform(const char *sName, glm::vec3* vVectors, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform3fv(iLoc, iCount, (GLfloat*)vVectors);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::vec3 vVector)
+void CShaderProgram::SetUniform(const char *sName, const glm::vec3 vVector)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform3fv(iLoc, 1, (GLfloat*)&vVector);
 }
 
-void CShaderProgram::SetUniform(string sName, glm::vec4* vVectors, int iCount)
+void CShaderProgram::SetUniform(const char *sName, glm::vec4* vVectors, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform4fv(iLoc, iCount, (GLfloat*)vVectors);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::vec4 vVector)
+void CShaderProgram::SetUniform(const char *sName, const glm::vec4 vVector)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform4fv(iLoc, 1, (GLfloat*)&vVector);
 }
 
 // Setting 3x3 matrices
 
-void CShaderProgram::SetUniform(string sName, glm::mat3* mMatrices, int iCount)
+void CShaderProgram::SetUniform(const char *sName, glm::mat3* mMatrices, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix3fv(iLoc, iCount, FALSE, (GLfloat*)mMatrices);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::mat3 mMatrix)
+void CShaderProgram::SetUniform(const char *sName, const glm::mat3 mMatrix)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix3fv(iLoc, 1, FALSE, (GLfloat*)&mMatrix);
 }
 
 // Setting 4x4 matrices
 
-void CShaderProgram::SetUniform(string sName, glm::mat4* mMatrices, int iCount)
+void CShaderProgram::SetUniform(const char *sName, glm::mat4* mMatrices, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix4fv(iLoc, iCount, FALSE, (GLfloat*)mMatrices);
 }
 
-void CShaderProgram::SetUniform(string sName, const glm::mat4 mMatrix)
+void CShaderProgram::SetUniform(const char *sName, const glm::mat4 mMatrix)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniformMatrix4fv(iLoc, 1, FALSE, (GLfloat*)&mMatrix);
 }
 
 // Setting integers
 
-void CShaderProgram::SetUniform(string sName, int* iValues, int iCount)
+void CShaderProgram::SetUniform(const char *sName, int* iValues, int iCount)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1iv(iLoc, iCount, iValues);
 }
 
-void CShaderProgram::SetUniform(string sName, const int iValue)
+void CShaderProgram::SetUniform(const char *sName, const int iValue)
 {
-	int iLoc = glGetUniformLocation(m_uiProgram, sName.c_str());
+	int iLoc = glGetUniformLocation(m_uiProgram, sName);
 	glUniform1i(iLoc, iValue);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Common.h"
 
+class CResource;
 
 // A class that provides a wrapper around an OpenGL shader
 class CShader
@@ -13,7 +14,7 @@ public:
 	bool LoadShader(string sFile, int iType);
 	void DeleteShader();
 
-	bool GetLinesFromFile(string sFile, bool bIncludePart, vector<string>* vResult);
+	bool GetLinesFromFile(string sFile, bool bIncludePart, vector<CResource*>* vFiles, vector<const char*>* vLines, vector<int>* vLengths);
 
 	bool IsLoaded();
 	UINT GetShaderID();
@@ -43,28 +44,28 @@ public:
 	UINT GetProgramID();
 
 	// Setting vectors
-	void SetUniform(string sName, glm::vec2* vVectors, int iCount = 1);
-	void SetUniform(string sName, const glm::vec2 vVector);
-	void SetUniform(string sName, glm::vec3* vVectors, int iCount = 1);
-	void SetUniform(string sName, const glm::vec3 vVector);
-	void SetUniform(string sName, glm::vec4* vVectors, int iCount = 1);
-	void SetUniform(string sName, const glm::vec4 vVector);
+	void SetUniform(const char *sName, glm::vec2* vVectors, int iCount = 1);
+	void SetUniform(const char *sName, const glm::vec2 vVector);
+	void SetUniform(const char *sName, glm::vec3* vVectors, int iCount = 1);
+	void SetUniform(const char *sName, const glm::vec3 vVector);
+	void SetUniform(const char *sName, glm::vec4* vVectors, int iCount = 1);
+	void SetUniform(const char *sName, const glm::vec4 vVector);
 
 	// Setting floats
-	void SetUniform(string sName, float* fValues, int iCount = 1);
-	void SetUniform(string sName, const float fValue);
+	void SetUniform(const char *sName, float* fValues, int iCount = 1);
+	void SetUniform(const char *sName, const float fValue);
 
 	// Setting 3x3 matrices
-	void SetUniform(string sName, glm::mat3* mMatrices, int iCount = 1);
-	void SetUniform(string sName, const glm::mat3 mMatrix);
+	void SetUniform(const char *sName, glm::mat3* mMatrices, int iCount = 1);
+	void SetUniform(const char *sName, const glm::mat3 mMatrix);
 
 	// Setting 4x4 matrices
-	void SetUniform(string sName, glm::mat4* mMatrices, int iCount = 1);
-	void SetUniform(string sName, const glm::mat4 mMatrix);
+	void SetUniform(const char *sName, glm::mat4* mMatrices, int iCount = 1);
+	void SetUniform(const char *sName, const glm::mat4 mMatrix);
 
 	// Setting integers
-	void SetUniform(string sName, int* iValues, int iCount = 1);
-	void SetUniform(string sName, const int iValue);
+	void SetUniform(const char *sName, int* iValues, int iCount = 1);
+	void SetUniform(const char *sName, const int iValue);
 
 
 private:
@@ -3,29 +3,45 @@
 #include "skybox.h"
 
 
+// The six faces, in the order CCubemap::Create takes them
+static const char *FACE_FILES[6] = {
+	"resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_rt.jpg", "resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_lf.jpg",
+	"resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_up.jpg", "resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_dn.jpg",
+	"resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_bk.jpg", "resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_ft.jpg"
+};
+
 CSkybox::CSkybox()
-{}
+{
+	m_pPrimitives = NULL;
+	m_primitive = -1;
+}
 
 CSkybox::~CSkybox()
 {}
 
 
-// Create a skybox of a given size with six textures
-void CSkybox::Create(float size)
+void CSkybox::Prefetch()
 {
+	for (int i = 0; i < 6; i++)
+		CTexture::Prefetch(FACE_FILES[i]);
+}
 
-	m_cubemapTexture.Create("resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_rt.jpg", "resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_lf.jpg",
-		"resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_up.jpg", "resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_dn.jpg",
-		"resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_bk.jpg", "resources\\skyboxes\\mp_orbital\\flipped\\orbital-element_ft.jpg");
+// Create a skybox of a given size with six textures
+void CSkybox::Create(CPrimitiveArena *primitives, float size)
+{
 
-	
-	
-	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
+	m_cubemapTexture.Create(FACE_FILES[0], FACE_FILES[1], FACE_FILES[2], FACE_FILES[3], FACE_FILES[4], FACE_FILES[5]);
 
-	m_vbo.Create();
-	m_vbo.Bind();
+	vector<VertexPTN> vertices;
+	vector<unsigned int> indices;
+	GetTriangles(size, vertices, indices);
+	m_pPrimitives = primitives;
+	m_primitive = primitives->Add(vertices, indices);
+}
 
+// The six faces, each a strip of four corners made into two triangles
+void CSkybox::GetTriangles(float size, vector<VertexPTN> &vertices, vector<unsigned int> &indices)
+{
 
 	glm::vec3 vSkyBoxVertices[24] = 
 	{
@@ -57,40 +73,30 @@ void CSkybox::Create(float size)
 		glm::vec3(0.0f, 1.0f, 0.0f)
 	};
 
-	glm::vec4 vColour = glm::vec4(1, 1, 1, 1);
-	for (int i = 0; i < 24; i++) {
-		m_vbo.AddData(&vSkyBoxVertices[i], sizeof(glm::vec3));
-		m_vbo.AddData(&vSkyBoxTexCoords[i%4], sizeof(glm::vec2));
-		m_vbo.AddData(&vSkyBoxNormals[i/4], sizeof(glm::vec3));
+	vertices.clear();
+	indices.clear();
+	for (int i = 0; i < 24; i++)
+		vertices.push_back(VertexPTN(vSkyBoxVertices[i], vSkyBoxTexCoords[i%4], vSkyBoxNormals[i/4]));
+	for (unsigned int face = 0; face < 6; face++) {
+		unsigned int strip[6] = { 0, 1, 2, 2, 1, 3 };
+		for (int j = 0; j < 6; j++)
+			indices.push_back(face * 4 + strip[j]);
 	}
-
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
-
-	// Set the vertex attribute locations
-	GLsizei istride = 2*sizeof(glm::vec3)+sizeof(glm::vec2);
-
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, istride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, istride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, istride, (void*)(sizeof(glm::vec3)+sizeof(glm::vec2)));
-	
 }
 
-// Render the skybox
+// Render the skybox.  A depth range of just the far plane puts it there, where with GL_LEQUAL it is drawn only where
+// the depth buffer is still clear: anywhere, if it is drawn first, but only behind everything else if it is drawn
+// last.  Doing this here rather than in the shader leaves the main shader's positions as the depth pre-pass's.
 void CSkybox::Render()
 {
 	glDepthMask(0);
-	glBindVertexArray(m_vao);
+	glDepthFunc(GL_LEQUAL);
+	glDepthRange(1.0, 1.0);
+	m_pPrimitives->Bind();
 	m_cubemapTexture.Bind(1);
-	for (int i = 0; i < 6; i++) {
-		//m_textures[i].Bind();
-		glDrawArrays(GL_TRIANGLE_STRIP, i*4, 4);
-	}
+	m_pPrimitives->Draw(m_primitive);
+	glDepthRange(0.0, 1.0);
+	glDepthFunc(GL_LESS);
 	glDepthMask(1);
 }
 
@@ -100,6 +106,4 @@ void CSkybox::Release()
 	//for (int i = 0; i < 6; i++)
 		//m_textures[i].Release();
 	m_cubemapTexture.Release();
-	glDeleteVertexArrays(1, &m_vao);
-	m_vbo.Release();
 }
\ No newline at end of file
@@ -1,22 +1,24 @@
 #pragma once
 
 #include "Texture.h"
-#include "VertexBufferObject.h"
 #include "Cubemap.h"
+#include "PrimitiveArena.h"
 
-// This is a class for creating and rendering a skybox
+// This is a class for creating and rendering a skybox, drawn from the shared primitive arena
 class CSkybox
 {
 public:
 	CSkybox();
 	~CSkybox();
-	void Create(float size);
+	static void Prefetch();		// Decodes the six faces, on any thread, ready for Create
+	void Create(CPrimitiveArena *primitives, float size);	// Adds the box to primitives, which must then be created
 	void Render();
 	void Release();
+	static void GetTriangles(float size, vector<VertexPTN> &vertices, vector<unsigned int> &indices);
 
 private:
-	UINT m_vao;
-	CVertexBufferObject m_vbo;
+	CPrimitiveArena *m_pPrimitives;
+	int m_primitive;
 	CCubemap m_cubemapTexture;
 	
 };
\ No newline at end of file
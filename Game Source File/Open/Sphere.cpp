@@ -1,41 +1,26 @@
 #include "Common.h"
 
 #define _USE_MATH_DEFINES
-#define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 #include "Sphere.h"
 #include <math.h>
 
 CSphere::CSphere()
-{}
+{
+	m_pPrimitives = NULL;
+	m_firstPrimitive = -1;
+	m_numLods = 0;
+}
 
 CSphere::~CSphere()
 {}
 
-// Create a unit sphere 
-void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int stacksIn)
+// Emit the vertices and indices of one tessellation, through vertex(position, texCoord, normal) and index(i).
+// Indices are offset by firstVertex, the number of vertices already emitted.  Returns the number of triangles.
+template <typename VertexFunction, typename IndexFunction>
+static int Tessellate(int slicesIn, int stacksIn, unsigned int firstVertex, VertexFunction vertex, IndexFunction index)
 {
-	// check if filename passed in -- if so, load texture
-
-	m_texture.Load(a_sDirectory+a_sFilename);
-
-	m_directory = a_sDirectory;
-	m_filename = a_sFilename;
-
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
-	m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
-	
-	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
-
-	m_vbo.Create();
-	m_vbo.Bind();
-	
-
 	// Compute vertex attributes and store in VBO
-	int vertexCount = 0;
 	for (int stacks = 0; stacks < stacksIn; stacks++) {
 		float phi = (stacks / (float) (stacksIn - 1)) * (float) M_PI;
 		for (int slices = 0; slices <= slicesIn; slices++) {
@@ -45,69 +30,133 @@ void CSphere::Create(string a_sDirectory, string a_sFilename, int slicesIn, int
 			glm::vec2 t = glm::vec2(slices / (float) slicesIn, stacks / (float) stacksIn);
 			glm::vec3 n = v;
 
-			m_vbo.AddVertexData(&v, sizeof(glm::vec3));
-			m_vbo.AddVertexData(&t, sizeof(glm::vec2));
-			m_vbo.AddVertexData(&n, sizeof(glm::vec3));
-
-			vertexCount++;
-
+			vertex(v, t, n);
 		}
 	}
 
 	// Compute indices and store in VBO
-	m_numTriangles = 0;
+	int numTriangles = 0;
 	for (int stacks = 0; stacks < stacksIn; stacks++) {
 		for (int slices = 0; slices < slicesIn; slices++) {
 			unsigned int nextSlice = slices + 1;
 			unsigned int nextStack = (stacks + 1) % stacksIn;
 
-			unsigned int index0 = stacks * (slicesIn+1) + slices;
-			unsigned int index1 = nextStack * (slicesIn+1) + slices;
-			unsigned int index2 = stacks * (slicesIn+1) + nextSlice;
-			unsigned int index3 = nextStack * (slicesIn+1) + nextSlice;
+			unsigned int index0 = firstVertex + stacks * (slicesIn+1) + slices;
+			unsigned int index1 = firstVertex + nextStack * (slicesIn+1) + slices;
+			unsigned int index2 = firstVertex + stacks * (slicesIn+1) + nextSlice;
+			unsigned int index3 = firstVertex + nextStack * (slicesIn+1) + nextSlice;
 
-			m_vbo.AddIndexData(&index0, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index1, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index2, sizeof(unsigned int));
-			m_numTriangles++;
+			index(index0);
+			index(index1);
+			index(index2);
+			numTriangles++;
 
-			m_vbo.AddIndexData(&index2, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index1, sizeof(unsigned int));
-			m_vbo.AddIndexData(&index3, sizeof(unsigned int));
-			m_numTriangles++;
+			index(index2);
+			index(index1);
+			index(index3);
+			numTriangles++;
 
 		}
 	}
 
-	m_vbo.UploadDataToGPU(GL_STATIC_DRAW);
+	return numTriangles;
+}
 
-	GLsizei stride = 2*sizeof(glm::vec3)+sizeof(glm::vec2);
+// Work out how many levels there will be and how big they are all together
+static int CountLods(int slicesIn, int stacksIn, UINT &totalVertices, UINT &totalIndices)
+{
+	int numLods = 0;
+	totalVertices = 0;
+	totalIndices = 0;
+	while (numLods < MAX_LOD_LEVELS) {
+		int slicesLod = slicesIn >> numLods;
+		int stacksLod = stacksIn >> numLods;
+		if (numLods > 0 && (slicesLod < 6 || stacksLod < 4))
+			break;
+		totalVertices += stacksLod * (slicesLod + 1);
+		totalIndices += stacksLod * slicesLod * 6;
+		numLods++;
+	}
+	return numLods;
+}
 
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-	// Texture coordinates
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)sizeof(glm::vec3));
-	// Normal vectors
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(glm::vec3)+sizeof(glm::vec2)));
-	
+// Create a unit sphere 
+void CSphere::Create(CPrimitiveArena *primitives, string a_sDirectory, string a_sFilename, int slicesIn, int stacksIn)
+{
+	// check if filename passed in -- if so, load texture
+	if (!a_sFilename.empty()) {
+		m_texture.Load(a_sDirectory+a_sFilename);
+
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+		m_texture.SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+	}
+
+	m_directory = a_sDirectory;
+	m_filename = a_sFilename;
+
+	// Every level of detail, sharing one set of vertices in the arena, and each a primitive of its own
+	vector<VertexPTN> vertices;
+	vector<unsigned int> indices;
+	unsigned int lodFirstIndex[MAX_LOD_LEVELS], lodNumIndices[MAX_LOD_LEVELS];
+	m_numLods = GetTriangles(slicesIn, stacksIn, vertices, indices, lodFirstIndex, lodNumIndices);
+	for (int lod = 0; lod < m_numLods; lod++)
+		printf("Sphere LOD %d: %d x %d, %d triangles\n", lod, slicesIn >> lod, stacksIn >> lod, lodNumIndices[lod] / 3);
+
+	m_pPrimitives = primitives;
+	m_firstPrimitive = primitives->Add(vertices, indices, lodFirstIndex, lodNumIndices, m_numLods);
+}
+
+// Render the sphere as a set of triangles, using the given level of detail
+void CSphere::Render(int lod)
+{
+	Bind();
+	Draw(lod);
 }
 
-// Render the sphere as a set of triangles
-void CSphere::Render()
+void CSphere::Bind()
 {
-	glBindVertexArray(m_vao);
-	m_texture.Bind();
-	glDrawElements(GL_TRIANGLES, m_numTriangles*3, GL_UNSIGNED_INT, 0);
+	m_pPrimitives->Bind();
+	if (m_texture.IsCreated())
+		m_texture.Bind();
+}
+
+void CSphere::Draw(int lod)
+{
+	if (lod >= m_numLods)
+		lod = m_numLods - 1;
+
+	m_pPrimitives->Draw(m_firstPrimitive + lod);
+}
 
+// Each level in turn, appending its vertices and indices to the same lists
+int CSphere::GetTriangles(int slicesIn, int stacksIn, vector<VertexPTN> &vertices, vector<unsigned int> &indices,
+	unsigned int lodFirstIndex[MAX_LOD_LEVELS], unsigned int lodNumIndices[MAX_LOD_LEVELS])
+{
+	UINT totalVertices, totalIndices;
+	int numLods = CountLods(slicesIn, stacksIn, totalVertices, totalIndices);
+	vertices.clear();
+	indices.clear();
+	vertices.reserve(totalVertices);
+	indices.reserve(totalIndices);
+
+	for (int lod = 0; lod < numLods; lod++) {
+		lodFirstIndex[lod] = (unsigned int) indices.size();
+		lodNumIndices[lod] = 3 * Tessellate(slicesIn >> lod, stacksIn >> lod, (unsigned int) vertices.size(),
+			[&](const glm::vec3 &p, const glm::vec2 &t, const glm::vec3 &n) { vertices.push_back(VertexPTN(p, t, n)); },
+			[&](unsigned int i) { indices.push_back(i); });
+	}
+	return numLods;
+}
+
+int CSphere::GetNumLods() const
+{
+	return m_numLods;
 }
 
-// Release memory on the GPU 
+// Release memory on the GPU; the geometry belongs to the arena
 void CSphere::Release()
 {
 	m_texture.Release();
-	glDeleteVertexArrays(1, &m_vao);
-	m_vbo.Release();
 }
\ No newline at end of file
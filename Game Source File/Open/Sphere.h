@@ -1,22 +1,38 @@
 #pragma once
 
 #include "Texture.h"
-#include "VertexBufferObjectIndexed.h"
+#include "LevelOfDetail.h"
+#include "PrimitiveArena.h"
 
-// Class for generating a unit sphere
+// Class for generating a unit sphere, with coarser tessellations for use as levels of detail, drawn from the shared
+// primitive arena
 class CSphere
 {
 public:
 	CSphere();
 	~CSphere();
-	void Create(string directory, string front, int slicesIn, int stacksIn);
-	void Render();
+	// Adds the sphere to primitives, which must then be created.  An empty front leaves it untextured.
+	void Create(CPrimitiveArena *primitives, string directory, string front, int slicesIn, int stacksIn);
+	void Render(int lod = 0);	// Level 0 uses slicesIn x stacksIn; each further level halves both
+	void Bind();				// Render split in two, so that several spheres in a row need only bind once
+	void Draw(int lod = 0);
+	int GetNumLods() const;
+	int GetFirstPrimitive() const { return m_firstPrimitive; }	// Level 0 in the arena given to Create; the rest follow
 	void Release();
+	float GetBoundingRadius() const { return 1.0f; }	// Radius of a sphere about the origin enclosing the geometry
+
+	// Every level of detail as one indexed triangle list.  Fills in the range of indices each level uses and returns
+	// the number of levels.
+	static int GetTriangles(int slicesIn, int stacksIn, vector<VertexPTN> &vertices, vector<unsigned int> &indices,
+		unsigned int lodFirstIndex[MAX_LOD_LEVELS], unsigned int lodNumIndices[MAX_LOD_LEVELS]);
 private:
-	UINT m_vao;
-	CVertexBufferObjectIndexed m_vbo;
+
+	CPrimitiveArena *m_pPrimitives;
 	CTexture m_texture;
 	string m_directory;
 	string m_filename;
-	int m_numTriangles;
+
+	// The levels share their vertices, and each is a primitive of its own
+	int m_firstPrimitive;
+	int m_numLods;
 };
\ No newline at end of file
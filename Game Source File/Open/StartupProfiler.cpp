@@ -0,0 +1,101 @@
+#include "StartupProfiler.h"
+#include <algorithm>
+
+CStartupProfiler::CStartupProfiler()
+{
+	QueryPerformanceFrequency(&m_frequency);
+	QueryPerformanceCounter(&m_start);
+}
+
+CStartupProfiler::~CStartupProfiler()
+{}
+
+void CStartupProfiler::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	QueryPerformanceCounter(&m_start);
+	m_events.clear();
+}
+
+double CStartupProfiler::Now() const
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double) (now.QuadPart - m_start.QuadPart) * 1000.0 / m_frequency.QuadPart;
+}
+
+void CStartupProfiler::Record(const string &name, double start, double end)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Event event = { name, GetThread(), start, end, false };
+	m_events.push_back(event);
+}
+
+void CStartupProfiler::Mark(const string &name)
+{
+	double now = Now();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Event event = { name, GetThread(), now, now, true };
+	m_events.push_back(event);
+}
+
+// Called with the lock held
+int CStartupProfiler::GetThread()
+{
+	std::thread::id id = std::this_thread::get_id();
+	for (unsigned int i = 0; i < m_threads.size(); i++) {
+		if (m_threads[i] == id)
+			return i;
+	}
+	m_threads.push_back(id);
+	return (int) m_threads.size() - 1;
+}
+
+bool CStartupProfiler::Write(const string &filename) const
+{
+	FILE *file;
+	if (fopen_s(&file, filename.c_str(), "w") != 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (unsigned int i = 0; i < m_events.size(); i++) {
+		const Event &event = m_events[i];
+
+		// Names are file names and stage names; only backslashes and quotes need escaping
+		string name;
+		for (unsigned int c = 0; c < event.name.size(); c++) {
+			if (event.name[c] == '\\' || event.name[c] == '"')
+				name += '\\';
+			name += event.name[c];
+		}
+
+		if (event.mark)
+			fprintf(file, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%d,\"ts\":%.1f}", name.c_str(),
+				event.thread, event.start * 1000.0);
+		else
+			fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f}", name.c_str(),
+				event.thread, event.start * 1000.0, (event.end - event.start) * 1000.0);
+		fprintf(file, i + 1 < m_events.size() ? ",\n" : "\n");
+	}
+	fprintf(file, "]}\n");
+	fclose(file);
+	return true;
+}
+
+// The stages in the order they started, with how long each took and on which thread
+void CStartupProfiler::PrintSummary() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	vector<Event> events = m_events;
+	std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) { return a.start < b.start; });
+
+	printf("Startup:\n");
+	for (unsigned int i = 0; i < events.size(); i++) {
+		if (events[i].mark)
+			printf("  %8.1f ms               %s\n", events[i].start, events[i].name.c_str());
+		else
+			printf("  %8.1f ms %8.1f ms  [%d] %s\n", events[i].start, events[i].end - events[i].start, events[i].thread,
+				events[i].name.c_str());
+	}
+}
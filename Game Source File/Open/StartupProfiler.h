@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Common.h"
+#include <mutex>
+#include <thread>
+
+// Times the stages of starting the game, from any thread, into a trace that chrome://tracing (or Perfetto) can
+// show: one row per thread, one bar per stage.  Times are in milliseconds from Start.
+class CStartupProfiler
+{
+public:
+	CStartupProfiler();
+	~CStartupProfiler();
+
+	void Start();
+	double Now() const;
+
+	void Record(const string &name, double start, double end);	// A stage that ran on the calling thread
+	void Mark(const string &name);								// A moment, such as the first frame
+
+	bool Write(const string &filename) const;	// As Chrome trace event JSON
+	void PrintSummary() const;
+
+private:
+	struct Event {
+		string name;
+		int thread;
+		double start;
+		double end;			// The same as start for a mark
+		bool mark;
+	};
+
+	int GetThread();		// A small number for the calling thread, 0 for the first to record
+
+	LARGE_INTEGER m_start;
+	LARGE_INTEGER m_frequency;
+	mutable std::mutex m_mutex;
+	vector<Event> m_events;
+	vector<std::thread::id> m_threads;
+};
@@ -0,0 +1,154 @@
+#include "StreamBuffer.h"
+
+CStreamBuffer::CStreamBuffer()
+{
+	m_buffer = 0;
+	m_persistent = false;
+	m_pMapped = NULL;
+	m_allocationMapped = false;
+	m_frameSize = 0;
+	m_numFrames = 0;
+	m_currentFrame = 0;
+	m_used = 0;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		m_fences[i] = NULL;
+}
+
+CStreamBuffer::~CStreamBuffer()
+{
+	Release();
+}
+
+// Create the buffer object.  GL_COPY_WRITE_BUFFER is used for binding so that the application's own
+// GL_ARRAY_BUFFER binding is left alone.
+bool CStreamBuffer::Create(UINT frameSize, int framesInFlight)
+{
+	Release();
+
+	m_frameSize = frameSize;
+	m_numFrames = min(max(framesInFlight, 1), MAX_FRAMES_IN_FLIGHT);
+	m_currentFrame = 0;
+	m_used = 0;
+	GLsizeiptr totalSize = (GLsizeiptr) m_frameSize * m_numFrames;
+
+	glGenBuffers(1, &m_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+
+	// If the persistent mapping fails, fall back to mapping each allocation.  Storage made by glBufferStorage is
+	// immutable, so that needs a new buffer object.
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, NULL, flags);
+		m_pMapped = (BYTE*) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+		m_persistent = m_pMapped != NULL;
+		if (!m_persistent) {
+			printf("Stream buffer: cannot map persistently, so mapping each allocation instead\n");
+			glDeleteBuffers(1, &m_buffer);
+			glGenBuffers(1, &m_buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		}
+	}
+	if (!m_persistent)
+		glBufferData(GL_COPY_WRITE_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+
+	GLint size = 0;
+	glGetBufferParameteriv(GL_COPY_WRITE_BUFFER, GL_BUFFER_SIZE, &size);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	if (m_buffer == 0 || size != totalSize) {
+		Release();
+		return false;
+	}
+	return true;
+}
+
+void CStreamBuffer::Release()
+{
+	if (m_buffer == 0)
+		return;
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		if (m_fences[i] != NULL)
+			glDeleteSync(m_fences[i]);
+		m_fences[i] = NULL;
+	}
+
+	if (m_pMapped != NULL || m_allocationMapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	m_pMapped = NULL;
+	m_allocationMapped = false;
+
+	glDeleteBuffers(1, &m_buffer);
+	m_buffer = 0;
+	m_persistent = false;
+	m_frameSize = 0;
+	m_used = 0;
+}
+
+// Move on to the next region.  If the GPU has not yet finished the frame that last wrote to it, wait.
+void CStreamBuffer::BeginFrame()
+{
+	m_currentFrame = (m_currentFrame + 1) % m_numFrames;
+	m_used = 0;
+
+	GLsync &fence = m_fences[m_currentFrame];
+	if (fence != NULL) {
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(fence, 0, 1000000);
+		glDeleteSync(fence);
+		fence = NULL;
+	}
+}
+
+void CStreamBuffer::EndFrame()
+{
+	Commit();
+	m_fences[m_currentFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void *CStreamBuffer::Allocate(UINT size, UINT alignment, UINT &offset)
+{
+	Commit();
+
+	UINT start = m_used;
+	if (alignment > 1)
+		start = (start + alignment - 1) / alignment * alignment;
+	if (start + size > m_frameSize)
+		return NULL;
+	m_used = start + size;
+
+	offset = m_currentFrame * m_frameSize + start;
+	if (m_persistent)
+		return m_pMapped + offset;
+
+	// The fence on this region guarantees the GPU is done with it, so no synchronisation is needed
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	void *pData = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	m_allocationMapped = pData != NULL;
+	return pData;
+}
+
+void CStreamBuffer::Commit()
+{
+	if (!m_allocationMapped)
+		return;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	m_allocationMapped = false;
+}
+
+void CStreamBuffer::Bind(GLenum target)
+{
+	glBindBuffer(target, m_buffer);
+}
+
+GLuint CStreamBuffer::GetBuffer() const
+{
+	return m_buffer;
+}
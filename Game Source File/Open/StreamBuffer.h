@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Common.h"
+
+// A buffer object for data that is rewritten every frame, such as per-instance data and text.  It is split into
+// one region per frame in flight and used as a ring: each frame sub-allocates from its own region, and a fence
+// placed at the end of the frame tells us when the GPU has finished reading it, so the CPU never writes over data
+// still in use and the driver never has to synchronise implicitly.
+//
+// With GL 4.4 / ARB_buffer_storage the whole buffer is mapped once with GL_MAP_PERSISTENT_BIT and stays mapped.
+// Otherwise each allocation is mapped unsynchronised, which the fences make safe, and unmapped by Commit.
+class CStreamBuffer
+{
+public:
+	CStreamBuffer();
+	~CStreamBuffer();
+
+	bool Create(UINT frameSize, int framesInFlight = 3);	// frameSize is the number of bytes available per frame
+	void Release();
+
+	void BeginFrame();		// Moves to the next region, waiting for the GPU if it is still reading it
+	void EndFrame();		// Fences the current region; call after the last draw using this frame's data
+
+	// Returns space for size bytes, aligned to alignment, and its offset into the buffer object, or NULL if the
+	// frame's region is full.  Commit must be called once the data is written and before drawing from it.
+	void *Allocate(UINT size, UINT alignment, UINT &offset);
+	void Commit();			// A no-op when persistently mapped; otherwise unmaps the last allocation
+
+	void Bind(GLenum target);
+	GLuint GetBuffer() const;
+
+private:
+	static const int MAX_FRAMES_IN_FLIGHT = 4;
+
+	GLuint m_buffer;
+	bool m_persistent;		// True if the whole buffer is persistently mapped
+	BYTE *m_pMapped;		// Start of the persistent mapping
+	bool m_allocationMapped;	// Without persistent mapping, whether the last allocation is still mapped
+	UINT m_frameSize;
+	int m_numFrames;
+	int m_currentFrame;
+	UINT m_used;			// Bytes allocated so far in the current region
+	GLsync m_fences[MAX_FRAMES_IN_FLIGHT];
+};
@@ -1,12 +1,22 @@
 #include "Common.h"
 
 #include "texture.h"
+#include "ResourcePack.h"
 
 #include "include\freeimage\FreeImage.h"
 #pragma comment(lib, "lib/FreeImage.lib")
 
+#include <map>
+#include <mutex>
+
+// Images decoded by Prefetch and not yet loaded, by normalised path
+static std::mutex s_prefetchMutex;
+static map<string, FIBITMAP*> s_prefetched;
+
 CTexture::CTexture()
 {
+	m_textureID = 0;
+	m_samplerObjectID = 0;
 	m_mipMapsGenerated = false;
 }
 CTexture::~CTexture()
@@ -38,19 +48,7 @@ void CTexture::CreateFromData(BYTE* data, int width, int height, int bpp, GLenum
 // Loads a 2D texture given the filename (sPath).  bGenerateMipMaps will generate a mipmapped texture if true
 bool CTexture::Load(string path, bool generateMipMaps)
 {
-	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
-	FIBITMAP* dib(0);
-
-	fif = FreeImage_GetFileType(path.c_str(), 0); // Check the file signature and deduce its format
-
-	if(fif == FIF_UNKNOWN) // If still unknown, try to guess the file format from the file extension
-		fif = FreeImage_GetFIFFromFilename(path.c_str());
-	
-	if(fif == FIF_UNKNOWN) // If still unknown, return failure
-		return false;
-
-	if(FreeImage_FIFSupportsReading(fif)) // Check if the plugin has reading capabilities and load the file
-		dib = FreeImage_Load(fif, path.c_str());
+	FIBITMAP* dib = Decode(path);
 
 	if(!dib) {
 		char message[1024];
@@ -80,6 +78,64 @@ bool CTexture::Load(string path, bool generateMipMaps)
 	return true; // Success
 }
 
+// Decodes an image file, or takes it from those prefetched.  Returns NULL, without reporting an error, if the file
+// cannot be read or decoded.
+FIBITMAP* CTexture::Decode(const string &path)
+{
+	string key = CResourcePack::NormalisePath(path);
+	{
+		std::lock_guard<std::mutex> lock(s_prefetchMutex);
+		map<string, FIBITMAP*>::iterator it = s_prefetched.find(key);
+		if (it != s_prefetched.end()) {
+			FIBITMAP* dib = it->second;
+			s_prefetched.erase(it);
+			return dib;
+		}
+	}
+
+	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
+	FIBITMAP* dib(0);
+
+	// Decode the file where it is mapped, from the resource pack or the loose file
+	CResource file;
+	FIMEMORY* memory = NULL;
+	if (file.Open(path)) {
+		memory = FreeImage_OpenMemory((BYTE*) file.GetData(), file.GetSize());
+		fif = FreeImage_GetFileTypeFromMemory(memory, 0); // Check the file signature and deduce its format
+	}
+
+	if(fif == FIF_UNKNOWN) // If still unknown, try to guess the file format from the file extension
+		fif = FreeImage_GetFIFFromFilename(path.c_str());
+
+	if(memory != NULL && fif != FIF_UNKNOWN && FreeImage_FIFSupportsReading(fif)) // Check if the plugin has reading capabilities and load the file
+		dib = FreeImage_LoadFromMemory(fif, memory);
+	if (memory != NULL)
+		FreeImage_CloseMemory(memory);
+
+	return dib;
+}
+
+void CTexture::Prefetch(const string &path)
+{
+	FIBITMAP* dib = Decode(path);
+	if (dib == NULL)
+		return;		// Load will report it
+
+	std::lock_guard<std::mutex> lock(s_prefetchMutex);
+	FIBITMAP* &prefetched = s_prefetched[CResourcePack::NormalisePath(path)];
+	if (prefetched != NULL)
+		FreeImage_Unload(prefetched);
+	prefetched = dib;
+}
+
+void CTexture::ReleasePrefetched()
+{
+	std::lock_guard<std::mutex> lock(s_prefetchMutex);
+	for (map<string, FIBITMAP*>::iterator it = s_prefetched.begin(); it != s_prefetched.end(); ++it)
+		FreeImage_Unload(it->second);
+	s_prefetched.clear();
+}
+
 void CTexture::SetSamplerObjectParameter(GLenum parameter, GLenum value)
 {
 	glSamplerParameteri(m_samplerObjectID, parameter, value);
@@ -104,6 +160,8 @@ void CTexture::Release()
 {
 	glDeleteSamplers(1, &m_samplerObjectID);
 	glDeleteTextures(1, &m_textureID);
+	m_samplerObjectID = 0;
+	m_textureID = 0;
 }
 
 int CTexture::GetWidth()
@@ -119,4 +177,9 @@ int CTexture::GetHeight()
 int CTexture::GetBPP()
 {
 	return m_bpp;
+}
+
+bool CTexture::IsCreated() const
+{
+	return m_textureID != 0;
 }
\ No newline at end of file
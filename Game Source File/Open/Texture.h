@@ -1,5 +1,7 @@
 #pragma once
 
+struct FIBITMAP;
+
 // Class that provides a texture for texture mapping in OpenGL
 class CTexture
 {
@@ -14,9 +16,16 @@ public:
 	int GetWidth();
 	int GetHeight();
 	int GetBPP();
+	bool IsCreated() const;		// False until CreateFromData or Load, and again after Release
 
 	void Release();
 
+	// Decoding an image is the slow part of loading a texture and needs no GL, so it can be done ahead of time on any
+	// thread.  A later Load of the same path (or CCubemap::Create) then only uploads the decoded image.
+	static void Prefetch(const string &path);
+	static void ReleasePrefetched();					// Frees any prefetched images that were never loaded
+	static FIBITMAP* Decode(const string &path);		// Prefetched or decoded now; free it with FreeImage_Unload
+
 	CTexture();
 	~CTexture();
 private:
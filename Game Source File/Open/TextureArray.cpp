@@ -0,0 +1,128 @@
+#include "TextureArray.h"
+#include "Texture.h"
+
+#include "include\freeimage\FreeImage.h"
+
+CTextureArray::CTextureArray()
+{
+	m_textureID = 0;
+	m_samplerObjectID = 0;
+	m_width = m_height = 0;
+	m_numLayers = 0;
+}
+
+CTextureArray::~CTextureArray()
+{
+	Release();
+}
+
+bool CTextureArray::Create(const vector<string> &paths, int width, int height, bool generateMipMaps)
+{
+	if (paths.empty())
+		return false;
+
+	// Decode every image first, which may already have been done by CTexture::Prefetch
+	vector<FIBITMAP*> images(paths.size(), (FIBITMAP*) NULL);
+	bool alpha = false;
+	int largestWidth = 0, largestHeight = 0;
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		images[i] = CTexture::Decode(paths[i]);
+		if (images[i] == NULL) {
+			char message[1024];
+			sprintf_s(message, "Cannot load image\n%s\n", paths[i].c_str());
+			MessageBox(NULL, message, "Error", MB_ICONERROR);
+			for (unsigned int j = 0; j < i; j++)
+				FreeImage_Unload(images[j]);
+			return false;
+		}
+		alpha = alpha || FreeImage_IsTransparent(images[i]) || FreeImage_GetBPP(images[i]) == 32;
+		largestWidth = max(largestWidth, (int) FreeImage_GetWidth(images[i]));
+		largestHeight = max(largestHeight, (int) FreeImage_GetHeight(images[i]));
+	}
+	if (width <= 0 || height <= 0) {
+		width = largestWidth;
+		height = largestHeight;
+	}
+
+	int bpp = alpha ? 32 : 24;
+	GLenum format = alpha ? GL_BGRA : GL_BGR;
+
+	glGenTextures(1, &m_textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureID);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, alpha ? GL_RGBA8 : GL_RGB8, width, height, (GLsizei) paths.size(), 0, format,
+		GL_UNSIGNED_BYTE, NULL);
+
+	// Bring each image to the array's format and size, and copy it into its layer.  FreeImage pads rows to four
+	// bytes, which is what OpenGL expects by default.
+	for (unsigned int i = 0; i < images.size(); i++) {
+		FIBITMAP *image = images[i];
+		if ((int) FreeImage_GetBPP(image) != bpp) {
+			FIBITMAP *converted = alpha ? FreeImage_ConvertTo32Bits(image) : FreeImage_ConvertTo24Bits(image);
+			FreeImage_Unload(image);
+			image = converted;
+		}
+		if (image != NULL && ((int) FreeImage_GetWidth(image) != width || (int) FreeImage_GetHeight(image) != height)) {
+			FIBITMAP *resampled = FreeImage_Rescale(image, width, height, FILTER_BILINEAR);
+			printf("Texture array: resampled '%s' from %ux%u to %dx%d\n", paths[i].c_str(), FreeImage_GetWidth(image),
+				FreeImage_GetHeight(image), width, height);
+			FreeImage_Unload(image);
+			image = resampled;
+		}
+
+		if (image != NULL) {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, format, GL_UNSIGNED_BYTE,
+				FreeImage_GetBits(image));
+			FreeImage_Unload(image);
+		}
+	}
+	if (generateMipMaps)
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	glGenSamplers(1, &m_samplerObjectID);
+	SetSamplerObjectParameter(GL_TEXTURE_MIN_FILTER, generateMipMaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	SetSamplerObjectParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	SetSamplerObjectParameter(GL_TEXTURE_WRAP_S, GL_REPEAT);
+	SetSamplerObjectParameter(GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	m_width = width;
+	m_height = height;
+	m_numLayers = (int) paths.size();
+	printf("Texture array: %d layers of %dx%d\n", m_numLayers, m_width, m_height);
+	return true;
+}
+
+void CTextureArray::Bind(int textureUnit)
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureID);
+	glBindSampler(textureUnit, m_samplerObjectID);
+}
+
+void CTextureArray::Release()
+{
+	glDeleteSamplers(1, &m_samplerObjectID);
+	glDeleteTextures(1, &m_textureID);
+	m_samplerObjectID = 0;
+	m_textureID = 0;
+	m_numLayers = 0;
+}
+
+void CTextureArray::SetSamplerObjectParameter(GLenum parameter, GLenum value)
+{
+	glSamplerParameteri(m_samplerObjectID, parameter, value);
+}
+
+int CTextureArray::GetNumLayers() const
+{
+	return m_numLayers;
+}
+
+int CTextureArray::GetWidth() const
+{
+	return m_width;
+}
+
+int CTextureArray::GetHeight() const
+{
+	return m_height;
+}
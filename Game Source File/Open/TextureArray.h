@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Common.h"
+
+// Several images in one GL_TEXTURE_2D_ARRAY, a layer each, so that objects with different materials can be drawn
+// with a single texture bound and pick their layer in the shader.  The layers of an array must share a size and
+// format, so Create converts every image to the same format (with alpha if any image has it) and resamples any
+// that are not the common size.
+class CTextureArray
+{
+public:
+	CTextureArray();
+	~CTextureArray();
+
+	// One layer per image, in the order given.  A width and height of 0 use the largest of the images'.
+	bool Create(const vector<string> &paths, int width = 0, int height = 0, bool generateMipMaps = true);
+	void Bind(int textureUnit = 0);
+	void Release();
+
+	void SetSamplerObjectParameter(GLenum parameter, GLenum value);
+
+	int GetNumLayers() const;
+	int GetWidth() const;
+	int GetHeight() const;
+
+private:
+	UINT m_textureID;
+	UINT m_samplerObjectID;
+	int m_width, m_height;
+	int m_numLayers;
+};
@@ -0,0 +1,129 @@
+#version 400 core
+
+// Structure for matrices
+uniform struct Matrices
+{
+	mat4 projMatrix;
+	mat4 modelViewMatrix; 
+	mat3 normalMatrix;
+} matrices;
+
+// Structure holding light information:  its position as well as ambient, diffuse, and specular colours
+struct LightInfo
+{
+	vec4 position;
+	vec3 La;
+	vec3 Ld;
+	vec3 Ls;
+};
+
+// Structure holding material information:  its ambient, diffuse, and specular colours, and shininess
+struct MaterialInfo
+{
+	vec3 Ma;
+	vec3 Md;
+	vec3 Ms;
+	float shininess;
+};
+
+// Lights and materials passed in as uniform variables from client programme
+uniform LightInfo light1; 
+uniform MaterialInfo material1; 
+
+// Layout of vertex attributes in VBO
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec2 inCoord;
+layout (location = 2) in vec3 inNormal;
+
+// Per-instance attributes: where the instance is and its scale, and its rotation as a quaternion (x, y, z, w)
+layout (location = 3) in vec4 inInstancePositionScale;
+layout (location = 4) in vec4 inInstanceRotation;
+layout (location = 5) in float inMaterialLayer;		// The layer of the texture array to sample, as in mainShader.vert
+
+// Instances that spin and bob have the axis they spin about, in their own frame, and the phase of their animation;
+// for the rest the axis is zero.  They bob along their own up.
+layout (location = 6) in vec4 inInstanceSpin;
+
+uniform float t;			// Time, in seconds, that drives the animation
+uniform float spinSpeed;	// Radians per second
+uniform float bobHeight;	// How far above and below its place an instance bobs
+uniform float bobSpeed;		// Radians per second
+
+// Vertex colour output to fragment shader -- using Gouraud (interpolated) shading
+out vec3 vColour;	// Colour computed using reflectance model
+out vec3 meshColour;
+out vec2 vTexCoord;	// Texture coordinate
+
+out vec3 worldPosition;	// used for skybox
+flat out float vMaterialLayer;
+
+// This function implements the Phong shading model
+// The code is based on the OpenGL 4.0 Shading Language Cookbook, Chapter 2, pp. 62 - 63, with a few tweaks. 
+// Please see Chapter 2 of the book for a detailed discussion.
+vec3 PhongModel(vec4 eyePosition, vec3 eyeNorm)
+{
+	vec3 s = normalize(vec3(light1.position - eyePosition));
+	vec3 v = normalize(-eyePosition.xyz);
+	vec3 r = reflect(-s, eyeNorm);
+	vec3 n = eyeNorm;
+	vec3 ambient = light1.La * material1.Ma;
+	float sDotN = max(dot(s, n), 0.0f);
+	vec3 diffuse = light1.Ld * material1.Md * sDotN;
+	vec3 specular = vec3(0.0f);
+	float eps = 0.000001f; // add eps to shininess below -- pow not defined if second argument is 0 (as described in GLSL documentation)
+	if (sDotN > 0.0f) 
+		specular = light1.Ls * material1.Ms * pow(max(dot(r, v), 0.0f), material1.shininess + eps);
+	
+	return ambient + diffuse + specular;
+
+}
+
+// Rotate a vector by a unit quaternion
+vec3 Rotate(vec4 q, vec3 v)
+{
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// The quaternion that rotates by b and then by a
+vec4 Multiply(vec4 a, vec4 b)
+{
+	return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz), a.w * b.w - dot(a.xyz, b.xyz));
+}
+
+// This is the entry point into the vertex shader.  Same as mainShader.vert, except that the model transform comes
+// from the instance attributes, so matrices.modelViewMatrix and matrices.normalMatrix hold just the view transform.
+void main()
+{	
+	// Spin and bob the instance, if it is animated, from where the instance data puts it
+	vec4 rotation = inInstanceRotation;
+	vec3 origin = inInstancePositionScale.xyz;
+	if (dot(inInstanceSpin.xyz, inInstanceSpin.xyz) > 0.0f) {
+		float angle = spinSpeed * t + inInstanceSpin.w;
+		rotation = Multiply(rotation, vec4(normalize(inInstanceSpin.xyz) * sin(0.5f * angle), cos(0.5f * angle)));
+		origin += bobHeight * sin(bobSpeed * t + inInstanceSpin.w) * Rotate(inInstanceRotation, vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	// Place the vertex in the world
+	vec3 position = origin + inInstancePositionScale.w * Rotate(rotation, inPosition);
+	vec3 normal = Rotate(rotation, inNormal);
+
+// Save the world position for rendering the skybox
+	worldPosition = position;
+
+	// Transform the vertex spatial position using 
+	gl_Position = matrices.projMatrix * matrices.modelViewMatrix * vec4(position, 1.0f);
+	
+	// Get the vertex normal and vertex position in eye coordinates
+	vec3 vEyeNorm = normalize(matrices.normalMatrix * normal);
+	vec4 vEyePosition = matrices.modelViewMatrix * vec4(position, 1.0f);
+		
+	// Apply the Phong model to compute the vertex colour
+	vColour = PhongModel(vEyePosition, vEyeNorm);
+	
+	// Pass through the texture coordinate and layer
+	vTexCoord = inCoord;
+	vMaterialLayer = inMaterialLayer;
+
+
+} 
+	
\ No newline at end of file
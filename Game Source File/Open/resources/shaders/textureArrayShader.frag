@@ -0,0 +1,19 @@
+#version 400 core
+
+in vec3 vColour;			// Interpolated colour using colour calculated in the vertex shader
+in vec2 vTexCoord;			// Interpolated texture coordinate using texture coordinate from the vertex shader
+flat in float vMaterialLayer;	// The layer of the texture array holding this object's material
+
+out vec4 vOutputColour;		// The output colour
+
+uniform sampler2DArray samplerArray;	// Every material's texture, one per layer
+uniform bool bUseTexture;    // A flag indicating if texture-mapping should be applied
+
+// As mainShader.frag, for objects whose texture is a layer of a texture array
+void main()
+{
+	if (bUseTexture)
+		vOutputColour = texture(samplerArray, vec3(vTexCoord, vMaterialLayer))*vec4(vColour, 1.0f);	// Combine object colour and texture 
+	else
+		vOutputColour = vec4(vColour, 1.0f);	// Just use the colour instead
+}